@@ -51,6 +51,44 @@ typedef bool( QU_CALL_CONV* quStopAllOutputs_Ptr )();
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopAllOutputs() QU_RETURN_IF_DISABLED( false );
 typedef bool( QU_CALL_CONV* quRemoveOutput_Ptr )( quOutputID outputID );
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quRemoveOutput( quOutputID outputID ) QU_RETURN_IF_DISABLED( false );
+/**
+ * Keeps the most recent events in memory instead of streaming them anywhere. Every thread records into a circular buffer of
+ * bytesPerThread bytes that overwrites its oldest events once it's full, nothing is written until the recorder is dumped.
+ */
+typedef quOutputID( QU_CALL_CONV* quSetupFlightRecorderOutput_Ptr )( quUInt64 bytesPerThread, bool startImmediately );
+QU_INLINE_IF_DISABLED quOutputID QU_CALL_CONV quSetupFlightRecorderOutput( quUInt64 bytesPerThread, bool startImmediately ) QU_RETURN_IF_DISABLED( QU_INVALID_OUTPUT_ID );
+//Writes a snapshot of what the flight recorder holds to outputFile as a Google trace, the recording threads carry on meanwhile.
+typedef bool( QU_CALL_CONV* quDumpFlightRecorder_Ptr )( quOutputID outputID, const char* outputFile );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quDumpFlightRecorder( quOutputID outputID, const char* outputFile ) QU_RETURN_IF_DISABLED( false );
+/**
+ * Dumps the flight recorder whenever a marker named markerName is added or the process receives signalNumber, pass nullptr or 0
+ * for the trigger that isn't wanted. Every dump gets a file of its own, named after outputFile with the number of the dump put in
+ * front of its extension. Dumps are taken on a thread of the loader, which is why signals that end the process, such as those of
+ * a crash, don't leave enough time for them. Implemented by the loader, triggers go away along with their output.
+ */
+typedef bool( QU_CALL_CONV* quSetFlightRecorderTrigger_Ptr )( quOutputID outputID, const char* markerName, int signalNumber, const char* outputFile );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetFlightRecorderTrigger( quOutputID outputID, const char* markerName, int signalNumber, const char* outputFile ) QU_RETURN_IF_DISABLED( false );
+/**
+ * Writes events straight into outputFile through a shared memory mapping, so that everything recorded up to a crash survives it
+ * even though it was never flushed. Every thread gets buffers of bytesPerBuffer bytes in the file, see quMappedTraceHeader for its
+ * layout. The file isn't a trace by itself, QuTraceRecover turns it into a Google trace whether or not the process exited cleanly.
+ */
+typedef quOutputID( QU_CALL_CONV* quSetupMappedTraceOutput_Ptr )( const char* outputFile, quUInt64 bytesPerBuffer, bool startImmediately );
+QU_INLINE_IF_DISABLED quOutputID QU_CALL_CONV quSetupMappedTraceOutput( const char* outputFile, quUInt64 bytesPerBuffer, bool startImmediately ) QU_RETURN_IF_DISABLED( QU_INVALID_OUTPUT_ID );
+/**
+ * Writes a compact binary trace: timestamps and ids are delta and varint encoded and names are written once per chunk. Chunks of
+ * about chunkBytes bytes decode on their own and an index at the end of the file lists the time range and channels of each, so
+ * readers only need the chunks they're interested in. See quBinaryTraceHeader for the layout, QuTraceConvert turns it into a
+ * Google trace.
+ */
+typedef quOutputID( QU_CALL_CONV* quSetupBinaryTraceOutput_Ptr )( const char* outputFile, quUInt32 chunkBytes, bool startImmediately );
+QU_INLINE_IF_DISABLED quOutputID QU_CALL_CONV quSetupBinaryTraceOutput( const char* outputFile, quUInt32 chunkBytes, bool startImmediately ) QU_RETURN_IF_DISABLED( QU_INVALID_OUTPUT_ID );
+/**
+ * Streams the trace in the protobuf format of Perfetto, which its UI and trace processor load far quicker than a Google trace of
+ * the same events. Channels become thread tracks and counters counter tracks, the names of recurring activities are interned.
+ */
+typedef quOutputID( QU_CALL_CONV* quSetupPerfettoTraceOutput_Ptr )( const char* outputFile, bool startImmediately );
+QU_INLINE_IF_DISABLED quOutputID QU_CALL_CONV quSetupPerfettoTraceOutput( const char* outputFile, bool startImmediately ) QU_RETURN_IF_DISABLED( QU_INVALID_OUTPUT_ID );
 
 //Counters
 typedef quCounterID( QU_CALL_CONV* quAddCounter_Ptr )( const char* counterName, quUInt32 color );
@@ -59,6 +97,71 @@ typedef bool( QU_CALL_CONV* quSetCounterValue_Ptr )( quCounterID counterID, floa
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterValue( quCounterID counterID, float newCounterValue ) QU_RETURN_IF_DISABLED( false );
 typedef bool( QU_CALL_CONV* quRemoveCounter_Ptr )( quCounterID counterID );
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quRemoveCounter( quCounterID counterID ) QU_RETURN_IF_DISABLED( false );
+//Sets the values of several counters with a single call, counterIDs[ i ] is set to newCounterValues[ i ].
+typedef bool( QU_CALL_CONV* quSetCounterValues_Ptr )( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count ) QU_RETURN_IF_DISABLED( false );
+
+//Counter coalescing
+/**
+ * Counters that are set more often than anyone can look at them can be coalesced by the loader. Their values are then combined
+ * into a single value per flush interval as determined by their quCounterCoalescing, and that value is only passed on if it
+ * differs from the one passed on before. Combined values are passed on once the flush interval elapsed, whether or not the
+ * counter is still being set, by quFlushCounters and before outputs are stopped. The flush interval defaults to 10 milliseconds.
+ */
+typedef bool( QU_CALL_CONV* quSetCounterCoalescing_Ptr )( quCounterID counterID, quCounterCoalescing coalescing );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterCoalescing( quCounterID counterID, quCounterCoalescing coalescing ) QU_RETURN_IF_DISABLED( false );
+typedef void( QU_CALL_CONV* quSetCounterFlushInterval_Ptr )( quUInt64 intervalNanos );
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quSetCounterFlushInterval( quUInt64 intervalNanos ) QU_RETURN_IF_DISABLED( void() );
+typedef void( QU_CALL_CONV* quFlushCounters_Ptr )();
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quFlushCounters() QU_RETURN_IF_DISABLED( void() );
+
+//Typed counters
+/**
+ * Floats lose precision past 2^24, so totals such as byte or request counts are better kept in int64 or double counters.
+ * Accumulators are int64 counters that any number of threads add to without contending: every thread adds to one of a set of
+ * shards and the loader passes on their sum once per flush interval, see quSetCounterFlushInterval.
+ * Runtimes that predate typed counters are passed the values converted to float.
+ */
+typedef quCounterID( QU_CALL_CONV* quAddTypedCounter_Ptr )( const char* counterName, quUInt32 color, quCounterType type );
+QU_INLINE_IF_DISABLED quCounterID QU_CALL_CONV quAddTypedCounter( const char* counterName, quUInt32 color, quCounterType type ) QU_RETURN_IF_DISABLED( QU_INVALID_COUNTER_ID );
+typedef bool( QU_CALL_CONV* quSetCounterValueInt64_Ptr )( quCounterID counterID, quInt64 newCounterValue );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterValueInt64( quCounterID counterID, quInt64 newCounterValue ) QU_RETURN_IF_DISABLED( false );
+typedef bool( QU_CALL_CONV* quSetCounterValueDouble_Ptr )( quCounterID counterID, double newCounterValue );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterValueDouble( quCounterID counterID, double newCounterValue ) QU_RETURN_IF_DISABLED( false );
+//Only valid for QU_COUNTER_TYPE_ACCUMULATOR counters.
+typedef bool( QU_CALL_CONV* quAddToCounter_Ptr )( quCounterID counterID, quInt64 delta );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quAddToCounter( quCounterID counterID, quInt64 delta ) QU_RETURN_IF_DISABLED( false );
+
+//Polled counters
+/**
+ * Polled counters aren't set by the application, instead a single thread owned by the loader calls their callbacks every
+ * periodMicros while recording and sets the counters to what they return, all counters polled at the same time in a single batch.
+ * This keeps metrics that take effort to compute, such as queue depths or pool occupancy, off the threads being instrumented.
+ * Callbacks are called until quRemoveCounter returns, which waits for a running callback unless it's called from the callbacks.
+ * Callbacks may add and remove counters, their own included.
+ */
+typedef quCounterID( QU_CALL_CONV* quAddPolledCounter_Ptr )( const char* counterName, quUInt32 color, quPolledCounterCallback_Ptr callback, void* userData, quUInt32 periodMicros );
+QU_INLINE_IF_DISABLED quCounterID QU_CALL_CONV quAddPolledCounter( const char* counterName, quUInt32 color, quPolledCounterCallback_Ptr callback, void* userData, quUInt32 periodMicros ) QU_RETURN_IF_DISABLED( QU_INVALID_COUNTER_ID );
+
+//Counter families
+/**
+ * A counter family is a set of counters of the same type that are told apart by the values of their labels, such as one counter
+ * per connection or per tenant. The counter of a combination of label values, a series, is added the first time it's used and is
+ * named after the family and its labels, "familyName{labelName=labelValue,...}". labelValues always holds one value per label.
+ * Series are found by hashing their label values without taking any locks, so call sites don't have to format names or hold on
+ * to counter ids. Once a family holds maxSeries series, adding another one removes the series that went unused the longest.
+ * Values set at the moment their series is removed may be lost.
+ */
+typedef quCounterFamilyID( QU_CALL_CONV* quAddCounterFamily_Ptr )( const char* familyName, quUInt32 color, quCounterType type, const char* const* labelNames, quUInt32 labelCount, quUInt32 maxSeries );
+QU_INLINE_IF_DISABLED quCounterFamilyID QU_CALL_CONV quAddCounterFamily( const char* familyName, quUInt32 color, quCounterType type, const char* const* labelNames, quUInt32 labelCount, quUInt32 maxSeries ) QU_RETURN_IF_DISABLED( QU_INVALID_COUNTER_FAMILY_ID );
+typedef bool( QU_CALL_CONV* quRemoveCounterFamily_Ptr )( quCounterFamilyID familyID );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quRemoveCounterFamily( quCounterFamilyID familyID ) QU_RETURN_IF_DISABLED( false );
+//Converts the value to the type of the family, which can't be QU_COUNTER_TYPE_ACCUMULATOR.
+typedef bool( QU_CALL_CONV* quSetCounterSeriesValue_Ptr )( quCounterFamilyID familyID, const char* const* labelValues, double newCounterValue );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterSeriesValue( quCounterFamilyID familyID, const char* const* labelValues, double newCounterValue ) QU_RETURN_IF_DISABLED( false );
+//Only valid for families of QU_COUNTER_TYPE_ACCUMULATOR counters.
+typedef bool( QU_CALL_CONV* quAddToCounterSeries_Ptr )( quCounterFamilyID familyID, const char* const* labelValues, quInt64 delta );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quAddToCounterSeries( quCounterFamilyID familyID, const char* const* labelValues, quInt64 delta ) QU_RETURN_IF_DISABLED( false );
 
 //Activity channels
 typedef quActivityChannelID( QU_CALL_CONV* quAddActivityChannel_Ptr )( const char* channelName, quUInt32 color );
@@ -69,12 +172,22 @@ typedef quActivityChannelID( QU_CALL_CONV* quGetChannelIDForCurrentThread_Ptr )(
 QU_INLINE_IF_DISABLED quActivityChannelID QU_CALL_CONV quGetChannelIDForCurrentThread() QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_CHANNEL_ID );
 typedef quRecurringActivityID( QU_CALL_CONV* quAddRecurringActivity_Ptr )( const char* activityName, quUInt32 color );
 QU_INLINE_IF_DISABLED quRecurringActivityID QU_CALL_CONV quAddRecurringActivity( const char* activityName, quUInt32 color ) QU_RETURN_IF_DISABLED( QU_INVALID_RECURRING_ACTIVITY_ID );
+//Registers every descriptor with a name and writes the id of its activity to it, returns false if any of them failed.
+typedef bool( QU_CALL_CONV* quAddRecurringActivities_Ptr )( quActivityDescriptor* descriptors, quUInt32 count );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quAddRecurringActivities( quActivityDescriptor* descriptors, quUInt32 count ) QU_RETURN_IF_DISABLED( false );
 typedef quActivityID( QU_CALL_CONV* quStartRecurringActivity_Ptr )( quActivityChannelID channelID, quRecurringActivityID activityID );
 QU_INLINE_IF_DISABLED quActivityID QU_CALL_CONV quStartRecurringActivity( quActivityChannelID channelID, quRecurringActivityID activityID ) QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_ID );
 typedef quActivityID( QU_CALL_CONV* quStartActivity_Ptr )( quActivityChannelID channelID, const char* activityName, quUInt32 color );
 QU_INLINE_IF_DISABLED quActivityID QU_CALL_CONV quStartActivity( quActivityChannelID channelID, const char* activityName, quUInt32 color ) QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_ID );
 typedef bool( QU_CALL_CONV* quStopActivity_Ptr )( quActivityID activityID );
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopActivity( quActivityID activityID ) QU_RETURN_IF_DISABLED( false );
+/**
+ * Stops the activity started most recently on the channel that's still running, which saves the runtime from looking up the
+ * activity by id when activities are strictly nested. Runtimes that don't support this directly only allow it on the channel of
+ * the calling thread, the loader then keeps track of the activities on that channel itself.
+ */
+typedef bool( QU_CALL_CONV* quStopCurrentActivity_Ptr )( quActivityChannelID channelID );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopCurrentActivity( quActivityChannelID channelID ) QU_RETURN_IF_DISABLED( false );
 typedef bool( QU_CALL_CONV* quRemoveActivityChannel_Ptr )( quActivityChannelID channelID );
 QU_INLINE_IF_DISABLED bool QU_CALL_CONV quRemoveActivityChannel( quActivityChannelID channelID ) QU_RETURN_IF_DISABLED( false );
 
@@ -88,4 +201,264 @@ QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopFlow( quFlowID flowID, quActivityC
 typedef void( QU_CALL_CONV* quAddMarker_Ptr )( const char* markerName );
 QU_INLINE_IF_DISABLED void QU_CALL_CONV quAddMarker( const char* markerName ) QU_RETURN_IF_DISABLED( void() );
 
+//Categories
+/**
+ * Activities and markers can be assigned a category, they're only recorded while their category is enabled. Categories are
+ * implemented by the loader and can be switched at any time, initially every category is enabled.
+ */
+typedef void( QU_CALL_CONV* quSetCategoryEnabled_Ptr )( quCategory category, bool enabled );
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quSetCategoryEnabled( quCategory category, bool enabled ) QU_RETURN_IF_DISABLED( void() );
+typedef void( QU_CALL_CONV* quSetCategoryMask_Ptr )( quUInt64 categoryMask );
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quSetCategoryMask( quUInt64 categoryMask ) QU_RETURN_IF_DISABLED( void() );
+typedef quUInt64( QU_CALL_CONV* quGetCategoryMask_Ptr )();
+QU_INLINE_IF_DISABLED quUInt64 QU_CALL_CONV quGetCategoryMask() QU_RETURN_IF_DISABLED( 0 );
+
+//Activity filters
+/**
+ * Recurring activities can be sampled, in which case each thread only records every sampleInterval-th start of the activity,
+ * and given a minimum duration in nanoseconds below which they're dropped. Filtered activities never reach an output, the
+ * activities nested in them are recorded as part of the activity they were started in instead. The number of filtered activities
+ * is recorded in the counters "Sampled out activities" and "Activities below minimum duration".
+ * Filters are implemented by the loader. Minimum durations only apply to activities the loader stages, those on the channel of
+ * the calling thread when the runtime takes batches of events and QU_API_INLINE_EVENTS isn't defined. A sampleInterval of 0 or 1
+ * and a minDurationNanos of 0 disable filtering.
+ */
+typedef quRecurringActivityID( QU_CALL_CONV* quAddFilteredRecurringActivity_Ptr )( const char* activityName, quUInt32 color, quUInt32 sampleInterval, quUInt64 minDurationNanos );
+QU_INLINE_IF_DISABLED quRecurringActivityID QU_CALL_CONV quAddFilteredRecurringActivity( const char* activityName, quUInt32 color, quUInt32 sampleInterval, quUInt64 minDurationNanos ) QU_RETURN_IF_DISABLED( QU_INVALID_RECURRING_ACTIVITY_ID );
+typedef bool( QU_CALL_CONV* quSetRecurringActivityFilter_Ptr )( quRecurringActivityID activityID, quUInt32 sampleInterval, quUInt64 minDurationNanos );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetRecurringActivityFilter( quRecurringActivityID activityID, quUInt32 sampleInterval, quUInt64 minDurationNanos ) QU_RETURN_IF_DISABLED( false );
+
+//Formatted activities
+/**
+ * Starts a recurring activity whose name is a template in which every {} is replaced by the next argument, "Updating player #{}"
+ * for instance. {{ and }} stand for literal braces. The activity is registered once like any other recurring activity, the
+ * arguments are copied into its record as they are and only formatted when the trace is exported or viewed. Runtimes that can't
+ * take arguments are handed the formatted name through quStartActivity instead. The activity is stopped with quStopActivity.
+ */
+typedef quActivityID( QU_CALL_CONV* quStartFormattedActivity_Ptr )( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount );
+QU_INLINE_IF_DISABLED quActivityID QU_CALL_CONV quStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount ) QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_ID );
+
+//Activity annotations
+/**
+ * Attaches numbers to a single instance of an activity, such as the number of bytes it processed or the id of the request it
+ * served, without giving up its recurring id. Each key is added once by name and referred to by id afterwards. Key ids are handed
+ * out by the loader and remain valid for the lifetime of the process, adding a name twice returns the same id. Outputs show the
+ * annotations alongside the activity, the Google trace output as the args of its event.
+ * Annotations of activities on the calling thread's channel are staged like the activities themselves, which keeps them to a
+ * few nanoseconds each. Activities started through inline event rings can't be annotated. Runtimes that don't support
+ * annotations ignore them, quStopActivityWithArgs still stops the activity.
+ */
+typedef quAnnotationKeyID( QU_CALL_CONV* quAddAnnotationKey_Ptr )( const char* keyName );
+QU_INLINE_IF_DISABLED quAnnotationKeyID QU_CALL_CONV quAddAnnotationKey( const char* keyName ) QU_RETURN_IF_DISABLED( QU_INVALID_ANNOTATION_KEY_ID );
+typedef bool( QU_CALL_CONV* quAnnotateActivity_Ptr )( quActivityID activityID, const quAnnotation* annotations, quUInt32 count );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quAnnotateActivity( quActivityID activityID, const quAnnotation* annotations, quUInt32 count ) QU_RETURN_IF_DISABLED( false );
+typedef bool( QU_CALL_CONV* quStopActivityWithArgs_Ptr )( quActivityID activityID, const quAnnotation* annotations, quUInt32 count );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopActivityWithArgs( quActivityID activityID, const quAnnotation* annotations, quUInt32 count ) QU_RETURN_IF_DISABLED( false );
+//Tells the runtime the name of a key, for every key added before the runtime was loaded as well.
+typedef void( QU_CALL_CONV* quSetAnnotationKey_Ptr )( quAnnotationKeyID keyID, const char* keyName );
+
+//Activity interning
+/**
+ * Dynamic activity names are processed by the runtime on every quStartActivity. Most code that has to use them only ever passes
+ * a small set of names though, which interning turns into recurring activities: every distinct name and color is registered once
+ * with quAddRecurringActivity and its id is looked up in a lock-free table afterwards. qu::ScopedActivity interns the names it's
+ * given while interning is enabled. At most maxNames names are interned, later names keep going through quStartActivity.
+ * Implemented by the loader, a maxNames of 0 disables interning, which it is initially. Enabling it again starts a new table.
+ */
+typedef bool( QU_CALL_CONV* quSetActivityInterning_Ptr )( quUInt32 maxNames );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetActivityInterning( quUInt32 maxNames ) QU_RETURN_IF_DISABLED( false );
+//Returns QU_INVALID_RECURRING_ACTIVITY_ID if the name isn't interned, in which case the activity is started with quStartActivity.
+typedef quRecurringActivityID( QU_CALL_CONV* quInternActivity_Ptr )( const char* activityName, quUInt32 color );
+QU_INLINE_IF_DISABLED quRecurringActivityID QU_CALL_CONV quInternActivity( const char* activityName, quUInt32 color ) QU_RETURN_IF_DISABLED( QU_INVALID_RECURRING_ACTIVITY_ID );
+typedef void( QU_CALL_CONV* quGetActivityInterningStats_Ptr )( quActivityInterningStats* stats );
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quGetActivityInterningStats( quActivityInterningStats* stats ) QU_RETURN_IF_DISABLED( void() );
+
+//Governor
+/**
+ * Keeps the estimated overhead of recurring activities below a share of the CPU time used by the process, 0.01 for 1%. The
+ * governor counts how often each activity is started and times a sample of those starts. Whenever the overhead exceeds the
+ * budget it throttles the most frequently started activities, disabling them if needed, and restores them once there is room
+ * again. Its decisions are recorded as markers and the overhead as a counter. Implemented by the loader on a thread of its own,
+ * a budget of 0 stops it and restores every activity. Activities bypass inline event rings while the governor runs.
+ */
+typedef bool( QU_CALL_CONV* quSetOverheadBudget_Ptr )( float cpuFraction );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetOverheadBudget( float cpuFraction ) QU_RETURN_IF_DISABLED( false );
+
+//Events
+typedef bool( QU_CALL_CONV* quSubmitEvents_Ptr )( const quEvent* events, quUInt32 count );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSubmitEvents( const quEvent* events, quUInt32 count ) QU_RETURN_IF_DISABLED( false );
+typedef quActivityID( QU_CALL_CONV* quReserveActivityIDs_Ptr )( quUInt32 count );
+QU_INLINE_IF_DISABLED quActivityID QU_CALL_CONV quReserveActivityIDs( quUInt32 count ) QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_ID );
+typedef void( QU_CALL_CONV* quFlushEvents_Ptr )();
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quFlushEvents() QU_RETURN_IF_DISABLED( void() );
+
+//Timestamps
+/**
+ * Activities and counter values can be recorded after the fact with the timestamp at which they happened, so that work can be
+ * reported in bulk off the critical path or timings imported from hardware queues and logs. Timestamps are in the clock domain
+ * of quEvent::timestamp, which quGetTimestamp reads (qu::GetTimestamp reads it without calling into the loader).
+ * Activities on a channel still have to nest: an activity must stop before the activity it was started in does. The activities
+ * aren't filtered and runtimes that take neither batches of events nor timestamps record them at the time of the call instead.
+ */
+typedef quUInt64( QU_CALL_CONV* quGetTimestamp_Ptr )();
+QU_INLINE_IF_DISABLED quUInt64 QU_CALL_CONV quGetTimestamp() QU_RETURN_IF_DISABLED( 0 );
+typedef quActivityID( QU_CALL_CONV* quStartRecurringActivityAt_Ptr )( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp );
+QU_INLINE_IF_DISABLED quActivityID QU_CALL_CONV quStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp ) QU_RETURN_IF_DISABLED( QU_INVALID_ACTIVITY_ID );
+typedef bool( QU_CALL_CONV* quStopActivityAt_Ptr )( quActivityID activityID, quUInt64 timestamp );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quStopActivityAt( quActivityID activityID, quUInt64 timestamp ) QU_RETURN_IF_DISABLED( false );
+typedef bool( QU_CALL_CONV* quSetCounterValueAt_Ptr )( quCounterID counterID, float newCounterValue, quUInt64 timestamp );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetCounterValueAt( quCounterID counterID, float newCounterValue, quUInt64 timestamp ) QU_RETURN_IF_DISABLED( false );
+
+//Clocks
+/**
+ * Selects the clock every timestamp is taken from, by the loader, the header utilities and the runtime alike. Timestamps are
+ * always in nanoseconds. QU_CLOCK_SOURCE_TSC reads the time stamp counter, which only takes a few cycles, and converts it with a
+ * calibration against QU_CLOCK_SOURCE_MONOTONIC. The calibration takes 10 milliseconds and is corrected for drift every second
+ * by a thread of the loader, the runtime is handed every calibration so that it can record them in its traces.
+ * Fails if the clock isn't available on this machine, or if the runtime doesn't support clock sources other than the default.
+ * Also fails while an output is recording, a trace can only hold timestamps from a single clock. Selecting the clock that's in
+ * use already always succeeds.
+ */
+typedef bool( QU_CALL_CONV* quSetClockSource_Ptr )( quClockSource clockSource );
+QU_INLINE_IF_DISABLED bool QU_CALL_CONV quSetClockSource( quClockSource clockSource ) QU_RETURN_IF_DISABLED( false );
+//Tells the runtime which clock the timestamps come from, calibration is nullptr unless clockSource is QU_CLOCK_SOURCE_TSC.
+typedef void( QU_CALL_CONV* quSetClockCalibration_Ptr )( quClockSource clockSource, const quClockCalibration* calibration );
+
+//Event rings
+/**
+ * Runtimes that support it hand each thread that owns a channel a ring to which the activities of that channel can be written
+ * directly from the instrumented code (see QU_API_INLINE_EVENTS in quApi.hpp). The runtime drains every ring on its own thread
+ * and also drains a thread's ring before it handles any other call made from that thread, so that the records stay ordered with
+ * regular calls. Stopping the current activity of a ring's channel from another thread drains that ring first, which is how
+ * activities that were started through a ring are stopped on other threads or when the ring stays full. Rings are therefore only
+ * used with runtimes that provide quStopCurrentActivity. A thread's ring stays valid until the runtime is released.
+ */
+typedef quEventRing*( QU_CALL_CONV* quGetEventRingForCurrentThread_Ptr )();
+QU_INLINE_IF_DISABLED quEventRing* QU_CALL_CONV quGetEventRingForCurrentThread() QU_RETURN_IF_DISABLED( nullptr );
+typedef void( QU_CALL_CONV* quFlushEventRing_Ptr )();
+QU_INLINE_IF_DISABLED void QU_CALL_CONV quFlushEventRing() QU_RETURN_IF_DISABLED( void() );
+
+//Shared state
+/**
+ * The loader owns a quSharedState that the instrumentation reads before doing anything else (see quApi.hpp). Runtimes that
+ * support it are handed that state after loading and keep it up to date from then on, until they are passed nullptr.
+ */
+typedef void( QU_CALL_CONV* quSetSharedState_Ptr )( quSharedState* sharedState );
+
+//Activity addresses
+/**
+ * Runtimes that support it accept descriptors that are identified by address instead of by name, see quActivityDescriptor.
+ * They only store the address and resolve its name through the resolver the loader hands them when the name is actually needed,
+ * for instance when writing a trace. The resolver caches its results and stays valid until the runtime is passed nullptr.
+ */
+typedef void( QU_CALL_CONV* quSetAddressResolver_Ptr )( quAddressResolver_Ptr resolver );
+
+//Dispatch table
+/**
+ * The runtime hands its entire api to the loader through a single exported symbol instead of one symbol per function.
+ * New entries are only ever appended, so the size field tells both sides which part of the table the other one knows about.
+ * Entries the runtime doesn't fill in are left as nullptr and the loader substitutes no-op implementations for them.
+ * The functions called for every instrumented scope come first so that they share the table's first cache line.
+ */
+#define QU_DISPATCH_TABLE_SYMBOL "quGetDispatchTable"
+#define QU_DISPATCH_TABLE_VERSION 17
+typedef struct quDispatchTable
+{
+	quUInt32 version; //!< QU_DISPATCH_TABLE_VERSION of the side that filled in the table.
+	quUInt32 size;    //!< Size in bytes of the table, entries past this size are not present.
+
+	//Hot path
+	quStartRecurringActivity_Ptr StartRecurringActivity;
+	quStopActivity_Ptr StopActivity;
+	quGetChannelIDForCurrentThread_Ptr GetChannelIDForCurrentThread;
+	quSetCounterValue_Ptr SetCounterValue;
+	quStartActivity_Ptr StartActivity;
+	quStartFlow_Ptr StartFlow;
+	quStopFlow_Ptr StopFlow;
+
+	//QuApi core
+	quInitialize_Ptr Initialize;
+	quRelease_Ptr Release;
+
+	//Outputs
+	quSetupGoogleTraceOutput_Ptr SetupGoogleTraceOutput;
+	quSetupTCPOutput_Ptr SetupTCPOutput;
+	quStartOutput_Ptr StartOutput;
+	quStopOutput_Ptr StopOutput;
+	quStartAllOutputs_Ptr StartAllOutputs;
+	quStopAllOutputs_Ptr StopAllOutputs;
+	quRemoveOutput_Ptr RemoveOutput;
+
+	//Counters
+	quAddCounter_Ptr AddCounter;
+	quRemoveCounter_Ptr RemoveCounter;
+
+	//Activity channels
+	quAddActivityChannel_Ptr AddActivityChannel;
+	quAddActivityChannelForCurrentThread_Ptr AddActivityChannelForCurrentThread;
+	quAddRecurringActivity_Ptr AddRecurringActivity;
+	quRemoveActivityChannel_Ptr RemoveActivityChannel;
+
+	//Markers
+	quAddMarker_Ptr AddMarker;
+
+	//Events
+	quSubmitEvents_Ptr SubmitEvents;
+
+	//Event rings
+	quGetEventRingForCurrentThread_Ptr GetEventRingForCurrentThread;
+	quFlushEventRing_Ptr FlushEventRing;
+
+	//Shared state
+	quSetSharedState_Ptr SetSharedState;
+
+	//Activity descriptors
+	quAddRecurringActivities_Ptr AddRecurringActivities;
+
+	//Activity addresses
+	quSetAddressResolver_Ptr SetAddressResolver;
+
+	//Counter batches
+	quSetCounterValues_Ptr SetCounterValues;
+
+	//Typed counters, runtimes that provide SetCounterValueInt64 take QU_EVENT_SET_TYPED_COUNTER_VALUE events in SubmitEvents as well.
+	quAddTypedCounter_Ptr AddTypedCounter;
+	quSetCounterValueInt64_Ptr SetCounterValueInt64;
+	quSetCounterValueDouble_Ptr SetCounterValueDouble;
+
+	//Timestamps
+	quStartRecurringActivityAt_Ptr StartRecurringActivityAt;
+	quStopActivityAt_Ptr StopActivityAt;
+	quSetCounterValueAt_Ptr SetCounterValueAt;
+
+	//Clocks
+	quSetClockCalibration_Ptr SetClockCalibration;
+
+	//Formatted activities, the loader registers the descriptor before it's passed on. Runtimes that provide StartFormattedActivity
+	//take QU_EVENT_FORMAT_ARGUMENT events in SubmitEvents as well.
+	quStartFormattedActivity_Ptr StartFormattedActivity;
+
+	//Activity annotations, runtimes that provide AnnotateActivity take QU_EVENT_ANNOTATE_ACTIVITY events in SubmitEvents as well.
+	quSetAnnotationKey_Ptr SetAnnotationKey;
+	quAnnotateActivity_Ptr AnnotateActivity;
+	quStopActivityWithArgs_Ptr StopActivityWithArgs;
+
+	//Nested stops, runtimes that provide StopCurrentActivity take stop events without an activity id in SubmitEvents as well.
+	quStopCurrentActivity_Ptr StopCurrentActivity;
+
+	//Flight recorder
+	quSetupFlightRecorderOutput_Ptr SetupFlightRecorderOutput;
+	quDumpFlightRecorder_Ptr DumpFlightRecorder;
+
+	//Mapped trace files
+	quSetupMappedTraceOutput_Ptr SetupMappedTraceOutput;
+
+	//Binary trace files
+	quSetupBinaryTraceOutput_Ptr SetupBinaryTraceOutput;
+
+	//Perfetto trace files
+	quSetupPerfettoTraceOutput_Ptr SetupPerfettoTraceOutput;
+} quDispatchTable;
+typedef const quDispatchTable*( QU_CALL_CONV* quGetDispatchTable_Ptr )( quUInt32 headerVersion );
+
 #endif
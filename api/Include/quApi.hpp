@@ -16,14 +16,271 @@
 
 #ifndef _QU_API_HPP_
 #define _QU_API_HPP_
-#include <string.h> //For strncpy
-#include <string>   //For std::u8string
-#include <utility>  //For std::move
+#include <string.h>         //For strncpy
+#include <string>           //For std::u8string
+#include <utility>          //For std::move
+#include <atomic>           //For std::atomic_ref
+#include <vector>           //For std::vector
+#include <functional>       //For std::function
+#include <memory>           //For std::unique_ptr
+#include <initializer_list> //For std::initializer_list
+#include <chrono>           //For std::chrono::steady_clock
+#include <type_traits>      //For std::is_integral_v
+#include <algorithm>        //For std::find
 #include "quApi.h"
+#if defined( _MSC_VER )
+#	include <intrin.h> //For _ReturnAddress and __rdtsc
+#elif defined( __x86_64__ )
+#	include <x86intrin.h> //For __rdtsc
+#endif
+#if defined( __linux__ )
+#	include <time.h> //For clock_gettime
+#endif
 
 namespace qu
 {
 
+//State the loader shares with the runtime and the utilities below. Instrumentation checks it before doing anything else, so that
+//applications without the runtime or without a running output only pay for a single well predicted branch.
+#if defined( QU_API_ENABLED )
+extern constinit quSharedState sharedState;
+#else
+inline constinit quSharedState sharedState = {
+	.recording = 0,
+	.filtering = 0,
+	.categoryMask = ~0ull,
+	.clockSource = QU_CLOCK_SOURCE_MONOTONIC,
+	.clockSequence = 0,
+	.clockCalibration = { 0, 0, 0.0 },
+	.interning = 0,
+	.threadStateGeneration = 0,
+};
+#endif
+
+inline bool IsRecording()
+{
+	return std::atomic_ref< quUInt32 >( sharedState.recording ).load( std::memory_order_relaxed ) != 0;
+}
+//Categories past QU_MAX_CATEGORIES have no bit in the mask, they're never enabled.
+inline bool IsCategoryEnabled( quCategory category )
+{
+	if( category >= QU_MAX_CATEGORIES )
+		return false;
+
+	return ( std::atomic_ref< quUInt64 >( sharedState.categoryMask ).load( std::memory_order_relaxed ) >> category ) & 1;
+}
+inline bool IsInterning()
+{
+	return std::atomic_ref< quUInt32 >( sharedState.interning ).load( std::memory_order_relaxed ) != 0;
+}
+
+//State of the current thread that the loader shares with the utilities below so they can skip calling into the api.
+#if defined( QU_API_ENABLED )
+extern constinit thread_local quThreadState threadState;
+#else
+inline constinit thread_local quThreadState threadState = {
+	.eventRing = nullptr,
+	.channelID = QU_INVALID_ACTIVITY_CHANNEL_ID,
+	.generation = 0,
+};
+#endif
+
+//Returns the state of the current thread. Removing a channel only bumps the shared generation, as no thread may write another
+//thread's state. A thread that notices has quGetChannelIDForCurrentThread bring its state up to date.
+inline const quThreadState& GetCurrentThreadState()
+{
+	if( threadState.generation != std::atomic_ref< quUInt32 >( sharedState.threadStateGeneration ).load( std::memory_order_acquire ) )
+		::quGetChannelIDForCurrentThread();
+
+	return threadState;
+}
+//Same as quGetChannelIDForCurrentThread, but reads the channel from the thread's state instead of asking the api for it.
+inline quActivityChannelID GetChannelIDForCurrentThread()
+{
+	return GetCurrentThreadState().channelID;
+}
+//Channel of the current thread while category is enabled, otherwise an invalid channel so that activities on it are skipped.
+inline quActivityChannelID GetChannelIDForCategory( quCategory category )
+{
+	return IsCategoryEnabled( category ) ? GetChannelIDForCurrentThread() : QU_INVALID_ACTIVITY_CHANNEL_ID;
+}
+//Stands in for the channel of the current thread where looking it up can wait until something records, see qu::ScopedActivity.
+inline constexpr quActivityChannelID CURRENT_THREAD_CHANNEL = QU_INVALID_ACTIVITY_CHANNEL_ID - 1;
+
+/**
+ * QU_DECLARE_ACTIVITY_DESCRIPTOR describes its activity with a constant initialized quActivityDescriptor. Where the compiler can place
+ * those in a dedicated section of the binary, the loader registers all of them with a single call when the api is initialized.
+ * Descriptors it didn't register are registered the first time they're used while recording. Either way instrumented scopes
+ * only read the descriptor's id, there's no static initialization guard involved. QU_DECLARE_ACTIVITY still declares a
+ * quRecurringActivityID that's added during static initialization, for code that stores or passes those ids.
+ */
+#if !defined( QU_API_ACTIVITY_SECTIONS ) && defined( __clang__ ) && ( defined( __ELF__ ) || defined( __APPLE__ ) )
+#	define QU_API_ACTIVITY_SECTIONS
+#endif
+#if !defined( QU_API_ENABLED ) || !defined( QU_API_ACTIVITY_SECTIONS )
+#	define QU_ACTIVITY_SECTION
+#elif defined( __APPLE__ )
+#	define QU_ACTIVITY_SECTION __attribute__( ( section( "__DATA,qu_activities" ), used ) )
+#else
+#	define QU_ACTIVITY_SECTION __attribute__( ( section( "qu_activities" ), used ) )
+#endif
+
+constexpr quUInt64 HashActivityName( const char* activityName )
+{
+	quUInt64 hash = 14695981039346656037ull;
+	for( ; *activityName != '\0'; ++activityName )
+	{
+		hash ^= (quUInt8)*activityName;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline quRecurringActivityID GetRecurringActivityID( quActivityDescriptor& descriptor )
+{
+	quRecurringActivityID recurringActivityID = std::atomic_ref< quRecurringActivityID >( descriptor.id ).load( std::memory_order_relaxed );
+	if( recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID ) [[unlikely]]
+	{
+		quAddRecurringActivities( &descriptor, 1 );
+		recurringActivityID = std::atomic_ref< quRecurringActivityID >( descriptor.id ).load( std::memory_order_relaxed );
+	}
+	return recurringActivityID;
+}
+
+#if defined( _MSC_VER )
+#	define QU_NOINLINE __declspec( noinline )
+#	define QU_RETURN_ADDRESS() _ReturnAddress()
+#else
+#	define QU_NOINLINE __attribute__( ( noinline ) )
+#	define QU_RETURN_ADDRESS() __builtin_return_address( 0 )
+#endif
+
+/**
+ * Activities declared with QU_DECLARE_ACTIVITY_AT_ADDRESS are identified by where they're used instead of by name, so that
+ * functions with very long signatures dont need to store, copy or hash them. The address is captured the first time the
+ * activity is used while recording, which is why CaptureActivityAddress has to be called directly from the instrumented code.
+ * Functions that were inlined are attributed to the function they were inlined into.
+ */
+inline bool HasActivityAddress( quActivityDescriptor& descriptor )
+{
+	return std::atomic_ref< const void* >( descriptor.address ).load( std::memory_order_relaxed ) != nullptr;
+}
+QU_NOINLINE inline void CaptureActivityAddress( quActivityDescriptor& descriptor )
+{
+	std::atomic_ref< const void* >( descriptor.address ).store( QU_RETURN_ADDRESS(), std::memory_order_relaxed );
+}
+
+//Reads the time stamp counter, 0 on platforms that don't have one.
+inline quUInt64 ReadClockTicks()
+{
+#if defined( _M_X64 ) || defined( __x86_64__ )
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+//Converts time stamp counter ticks to nanoseconds with the calibration in sharedState, which the loader may be updating.
+inline quUInt64 TicksToTimestamp( quUInt64 ticks )
+{
+	std::atomic_ref< quUInt32 > sequence( sharedState.clockSequence );
+	for( ;; )
+	{
+		quUInt32 sequenceBefore = sequence.load( std::memory_order_acquire );
+		quUInt64 baseTicks = std::atomic_ref< quUInt64 >( sharedState.clockCalibration.baseTicks ).load( std::memory_order_relaxed );
+		quUInt64 baseNanos = std::atomic_ref< quUInt64 >( sharedState.clockCalibration.baseNanos ).load( std::memory_order_relaxed );
+		double nanosPerTick = std::atomic_ref< double >( sharedState.clockCalibration.nanosPerTick ).load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( ( sequenceBefore & 1 ) != 0 || sequence.load( std::memory_order_relaxed ) != sequenceBefore )
+			continue;
+
+		//Ticks read just before a calibration was published lie before its base.
+		return baseNanos + quUInt64( quInt64( double( quInt64( ticks - baseTicks ) ) * nanosPerTick ) );
+	}
+}
+//Reads the clock timestamps are taken from, see quGetTimestamp and quSetClockSource.
+inline quUInt64 GetTimestamp()
+{
+	switch( std::atomic_ref< quUInt32 >( sharedState.clockSource ).load( std::memory_order_relaxed ) )
+	{
+	case QU_CLOCK_SOURCE_TSC:
+		return TicksToTimestamp( ReadClockTicks() );
+#if defined( __linux__ )
+	case QU_CLOCK_SOURCE_MONOTONIC_RAW:
+	{
+		timespec time;
+		clock_gettime( CLOCK_MONOTONIC_RAW, &time );
+		return quUInt64( time.tv_sec ) * 1000000000ull + quUInt64( time.tv_nsec );
+	}
+#endif
+	default:
+		return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+}
+
+#if defined( QU_API_INLINE_EVENTS )
+/**
+ * With inline events enabled, activities on the current thread's channel are written into the ring the runtime shares with
+ * that thread instead of being passed through a function call. Only when the ring is full do we fall back to calling the api.
+ */
+inline constexpr quActivityID RING_ACTIVITY_ID = QU_INVALID_ACTIVITY_ID - 1; //!< Activity id of activities that were started through the ring.
+
+inline bool WriteRingRecord( quEventRing* ring, quUInt32 type, quRecurringActivityID recurringActivityID )
+{
+	//We're the only one writing the write index, so reading it doesn't need any synchronization.
+	quUInt64 writeIndex = ring->writeIndex;
+	if( writeIndex - ring->cachedReadIndex > ring->capacityMask )
+	{
+		ring->cachedReadIndex = std::atomic_ref< quUInt64 >( ring->readIndex ).load( std::memory_order_acquire );
+		if( writeIndex - ring->cachedReadIndex > ring->capacityMask )
+			return false;
+	}
+
+	quEventRingRecord& record = ring->records[ writeIndex & ring->capacityMask ];
+	record.timestamp = GetTimestamp();
+	record.recurringActivityID = recurringActivityID;
+	record.type = type;
+	std::atomic_ref< quUInt64 >( ring->writeIndex ).store( writeIndex + 1, std::memory_order_release );
+	return true;
+}
+//Filtered activities have to pass through the loader, the ring would hand them to the runtime unfiltered.
+inline bool IsFiltering()
+{
+	return std::atomic_ref< quUInt32 >( sharedState.filtering ).load( std::memory_order_relaxed ) != 0;
+}
+//Returns the ring the activity was started through, nullptr if it has to be started by calling the api.
+inline quEventRing* StartRingActivity( quActivityChannelID activityChannelID, quRecurringActivityID recurringActivityID )
+{
+	quEventRing* ring = GetCurrentThreadState().eventRing;
+	if( ring == nullptr || ring->channelID != activityChannelID || IsFiltering() )
+		return nullptr;
+
+	return WriteRingRecord( ring, QU_EVENT_RING_RECORD_START, recurringActivityID ) ? ring : nullptr;
+}
+inline void StopRingActivity( quEventRing* startRing, quActivityChannelID activityChannelID )
+{
+	//If the channel was removed in the meantime there's nothing left to stop.
+	if( startRing->channelID != activityChannelID )
+		return;
+
+	//Only the thread that owns a ring may write to it. Activities stopped on another thread, such as a ScopedActivity that was
+	//moved there, are stopped through the api, which drains the channel's ring first.
+	if( GetCurrentThreadState().eventRing != startRing )
+	{
+		quStopCurrentActivity( activityChannelID );
+		return;
+	}
+
+	//The start is already in the ring, so the stop has to come after it. Have the runtime make room, and if it can't, stop
+	//through the api, which drains the ring before handling the call.
+	if( WriteRingRecord( startRing, QU_EVENT_RING_RECORD_STOP, QU_INVALID_RECURRING_ACTIVITY_ID ) )
+		return;
+
+	quFlushEventRing();
+	if( !WriteRingRecord( startRing, QU_EVENT_RING_RECORD_STOP, QU_INVALID_RECURRING_ACTIVITY_ID ) )
+		quStopCurrentActivity( activityChannelID );
+}
+#endif
+
 class ScopedCounter
 {
 public:
@@ -32,12 +289,8 @@ public:
 	{
 	}
 	ScopedCounter( const char8_t* counterName, quUInt32 color, bool addImmediately = true ) :
-	    counterID( QU_INVALID_COUNTER_ID ),
-	    name( counterName ),
-	    color( color )
+	    ScopedCounter( counterName, color, QU_COUNTER_TYPE_FLOAT, addImmediately )
 	{
-		if( addImmediately )
-			Add();
 	}
 	ScopedCounter( ScopedCounter&& movable ) noexcept :
 	    ScopedCounter( u8"", 0, false )
@@ -51,6 +304,8 @@ public:
 		std::swap( counterID, movable.counterID );
 		std::swap( name, movable.name );
 		color = movable.color;
+		type = movable.type;
+		coalescing = movable.coalescing;
 		return *this;
 	}
 	~ScopedCounter()
@@ -63,7 +318,12 @@ public:
 		if( counterID != QU_INVALID_COUNTER_ID )
 			return false;
 
-		counterID = quAddCounter( (const char*)name.c_str(), color );
+		if( type == QU_COUNTER_TYPE_FLOAT )
+			counterID = quAddCounter( (const char*)name.c_str(), color );
+		else
+			counterID = quAddTypedCounter( (const char*)name.c_str(), color, type );
+		if( counterID != QU_INVALID_COUNTER_ID && coalescing != QU_COUNTER_COALESCING_NONE )
+			quSetCounterCoalescing( counterID, coalescing );
 		return counterID != QU_INVALID_COUNTER_ID;
 	}
 	void Remove()
@@ -77,7 +337,32 @@ public:
 
 	void SetValue( float newCounterValue ) const
 	{
-		quSetCounterValue( counterID, newCounterValue );
+		if( IsRecording() )
+			quSetCounterValue( counterID, newCounterValue );
+	}
+	//Kept across Remove and Add.
+	void SetCoalescing( quCounterCoalescing newCoalescing )
+	{
+		coalescing = newCoalescing;
+		if( counterID != QU_INVALID_COUNTER_ID )
+			quSetCounterCoalescing( counterID, coalescing );
+	}
+
+	quCounterID GetID() const
+	{
+		return counterID;
+	}
+
+protected:
+	ScopedCounter( const char8_t* counterName, quUInt32 color, quCounterType type, bool addImmediately ) :
+	    counterID( QU_INVALID_COUNTER_ID ),
+	    name( counterName ),
+	    color( color ),
+	    type( type ),
+	    coalescing( QU_COUNTER_COALESCING_NONE )
+	{
+		if( addImmediately )
+			Add();
 	}
 
 private:
@@ -87,6 +372,253 @@ private:
 	quCounterID counterID;
 	std::u8string name;
 	quUInt32 color;
+	quCounterType type;
+	quCounterCoalescing coalescing;
+};
+//Counters that keep 64 bit integers, which floats can't represent past 2^24.
+class ScopedInt64Counter : public ScopedCounter
+{
+public:
+	ScopedInt64Counter( const char8_t* counterName, quUInt32 color = 0, bool addImmediately = true ) :
+	    ScopedCounter( counterName, color, QU_COUNTER_TYPE_INT64, addImmediately )
+	{
+	}
+
+	void SetValue( quInt64 newCounterValue ) const
+	{
+		if( IsRecording() )
+			quSetCounterValueInt64( GetID(), newCounterValue );
+	}
+};
+class ScopedDoubleCounter : public ScopedCounter
+{
+public:
+	ScopedDoubleCounter( const char8_t* counterName, quUInt32 color = 0, bool addImmediately = true ) :
+	    ScopedCounter( counterName, color, QU_COUNTER_TYPE_DOUBLE, addImmediately )
+	{
+	}
+
+	void SetValue( double newCounterValue ) const
+	{
+		if( IsRecording() )
+			quSetCounterValueDouble( GetID(), newCounterValue );
+	}
+};
+//Totals any thread can add to without contending with the others, such as the number of bytes or requests handled.
+class ScopedAccumulator : public ScopedCounter
+{
+public:
+	ScopedAccumulator( const char8_t* counterName, quUInt32 color = 0, bool addImmediately = true ) :
+	    ScopedCounter( counterName, color, QU_COUNTER_TYPE_ACCUMULATOR, addImmediately )
+	{
+	}
+
+	//Additions are kept while not recording, so that the total is still correct once recording starts.
+	void AddToValue( quInt64 delta ) const
+	{
+		quAddToCounter( GetID(), delta );
+	}
+
+	//The value of an accumulator is the sum of what was added to it.
+	void SetValue( float ) const = delete;
+};
+//Collects counter values so that they're set in a single call, which is submitted when the batch goes out of scope.
+class CounterBatch
+{
+public:
+	CounterBatch() = default;
+	~CounterBatch()
+	{
+		Submit();
+	}
+
+	void SetValue( const ScopedCounter& counter, float newCounterValue )
+	{
+		SetValue( counter.GetID(), newCounterValue );
+	}
+	void SetValue( quCounterID counterID, float newCounterValue )
+	{
+		counterIDs.push_back( counterID );
+		counterValues.push_back( newCounterValue );
+	}
+
+	void Submit()
+	{
+		if( !counterIDs.empty() && IsRecording() )
+			quSetCounterValues( counterIDs.data(), counterValues.data(), quUInt32( counterIDs.size() ) );
+
+		counterIDs.clear();
+		counterValues.clear();
+	}
+
+private:
+	CounterBatch( const CounterBatch& ) = delete;
+	CounterBatch& operator=( const CounterBatch& ) = delete;
+
+	std::vector< quCounterID > counterIDs;
+	std::vector< float > counterValues;
+};
+//Counter whose value is computed by poll every periodMicros on a thread owned by the loader, see quAddPolledCounter.
+class ScopedPolledCounter
+{
+public:
+	using Poll = std::function< float() >;
+
+	ScopedPolledCounter( const char8_t* counterName, quUInt32 periodMicros, Poll poll, bool addImmediately = true ) :
+	    ScopedPolledCounter( counterName, 0, periodMicros, std::move( poll ), addImmediately )
+	{
+	}
+	ScopedPolledCounter( const char8_t* counterName, quUInt32 color, quUInt32 periodMicros, Poll poll, bool addImmediately = true ) :
+	    counterID( QU_INVALID_COUNTER_ID ),
+	    name( counterName ),
+	    color( color ),
+	    periodMicros( periodMicros ),
+	    poll( std::make_unique< Poll >( std::move( poll ) ) )
+	{
+		if( addImmediately )
+			Add();
+	}
+	ScopedPolledCounter( ScopedPolledCounter&& movable ) noexcept :
+	    ScopedPolledCounter( u8"", 0, 0, Poll(), false )
+	{
+		*this = std::move( movable );
+	}
+	ScopedPolledCounter& operator=( ScopedPolledCounter&& movable ) noexcept
+	{
+		Remove();
+
+		//The loader holds on to the address of poll, which stays the same while it's moved around.
+		std::swap( counterID, movable.counterID );
+		std::swap( name, movable.name );
+		std::swap( poll, movable.poll );
+		color = movable.color;
+		periodMicros = movable.periodMicros;
+		return *this;
+	}
+	~ScopedPolledCounter()
+	{
+		Remove();
+	}
+
+	bool Add()
+	{
+		if( counterID != QU_INVALID_COUNTER_ID || !*poll )
+			return false;
+
+		counterID = quAddPolledCounter( (const char*)name.c_str(), color, &CallPoll, poll.get(), periodMicros );
+		return counterID != QU_INVALID_COUNTER_ID;
+	}
+	void Remove()
+	{
+		if( counterID == QU_INVALID_COUNTER_ID )
+			return;
+
+		quRemoveCounter( counterID );
+		counterID = QU_INVALID_COUNTER_ID;
+	}
+
+	quCounterID GetID() const
+	{
+		return counterID;
+	}
+
+private:
+	ScopedPolledCounter( const ScopedPolledCounter& ) = delete;
+	ScopedPolledCounter& operator=( const ScopedPolledCounter& ) = delete;
+
+	static float QU_CALL_CONV CallPoll( void* userData )
+	{
+		return ( *static_cast< Poll* >( userData ) )();
+	}
+
+	quCounterID counterID;
+	std::u8string name;
+	quUInt32 color;
+	quUInt32 periodMicros;
+	std::unique_ptr< Poll > poll;
+};
+//Counters told apart by the values of their labels, see quAddCounterFamily.
+class ScopedCounterFamily
+{
+public:
+	ScopedCounterFamily( const char8_t* familyName, std::initializer_list< const char8_t* > labelNames, quUInt32 maxSeries, bool addImmediately = true ) :
+	    ScopedCounterFamily( familyName, labelNames, maxSeries, QU_COUNTER_TYPE_FLOAT, 0, addImmediately )
+	{
+	}
+	ScopedCounterFamily( const char8_t* familyName, std::initializer_list< const char8_t* > labelNames, quUInt32 maxSeries, quCounterType type, quUInt32 color, bool addImmediately = true ) :
+	    familyID( QU_INVALID_COUNTER_FAMILY_ID ),
+	    name( familyName ),
+	    labelNames( labelNames.begin(), labelNames.end() ),
+	    maxSeries( maxSeries ),
+	    type( type ),
+	    color( color )
+	{
+		if( addImmediately )
+			Add();
+	}
+	ScopedCounterFamily( ScopedCounterFamily&& movable ) noexcept :
+	    ScopedCounterFamily( u8"", {}, 0, QU_COUNTER_TYPE_FLOAT, 0, false )
+	{
+		*this = std::move( movable );
+	}
+	ScopedCounterFamily& operator=( ScopedCounterFamily&& movable ) noexcept
+	{
+		Remove();
+
+		std::swap( familyID, movable.familyID );
+		std::swap( name, movable.name );
+		std::swap( labelNames, movable.labelNames );
+		maxSeries = movable.maxSeries;
+		type = movable.type;
+		color = movable.color;
+		return *this;
+	}
+	~ScopedCounterFamily()
+	{
+		Remove();
+	}
+
+	bool Add()
+	{
+		if( familyID != QU_INVALID_COUNTER_FAMILY_ID )
+			return false;
+
+		std::vector< const char* > labelNamePointers;
+		for( const std::u8string& labelName : labelNames )
+			labelNamePointers.push_back( (const char*)labelName.c_str() );
+		familyID = quAddCounterFamily( (const char*)name.c_str(), color, type, labelNamePointers.data(), quUInt32( labelNamePointers.size() ), maxSeries );
+		return familyID != QU_INVALID_COUNTER_FAMILY_ID;
+	}
+	void Remove()
+	{
+		if( familyID == QU_INVALID_COUNTER_FAMILY_ID )
+			return;
+
+		quRemoveCounterFamily( familyID );
+		familyID = QU_INVALID_COUNTER_FAMILY_ID;
+	}
+
+	//labelValues holds one value per label, in the order the labels were passed in.
+	void SetValue( std::initializer_list< const char8_t* > labelValues, double newCounterValue ) const
+	{
+		if( IsRecording() )
+			quSetCounterSeriesValue( familyID, (const char* const*)labelValues.begin(), newCounterValue );
+	}
+	void AddToValue( std::initializer_list< const char8_t* > labelValues, quInt64 delta ) const
+	{
+		quAddToCounterSeries( familyID, (const char* const*)labelValues.begin(), delta );
+	}
+
+private:
+	ScopedCounterFamily( const ScopedCounterFamily& ) = delete;
+	ScopedCounterFamily& operator=( const ScopedCounterFamily& ) = delete;
+
+	quCounterFamilyID familyID;
+	std::u8string name;
+	std::vector< std::u8string > labelNames;
+	quUInt32 maxSeries;
+	quCounterType type;
+	quUInt32 color;
 };
 class ScopedActivityChannel
 {
@@ -159,31 +691,111 @@ private:
 	bool forCurrentThread;
 	quUInt32 color;
 };
+//Argument of a formatted activity, converts from integers, floating point numbers and strings.
+struct ActivityArg : quActivityArg
+{
+	template< typename T >
+	    requires std::is_integral_v< T >
+	ActivityArg( T value ) :
+	    quActivityArg()
+	{
+		if constexpr( std::is_signed_v< T > )
+		{
+			intValue = value;
+			type = QU_ACTIVITY_ARG_INT64;
+		}
+		else
+		{
+			uintValue = value;
+			type = QU_ACTIVITY_ARG_UINT64;
+		}
+	}
+	ActivityArg( double value ) :
+	    quActivityArg()
+	{
+		doubleValue = value;
+		type = QU_ACTIVITY_ARG_DOUBLE;
+	}
+	//The string only has to stay valid until the activity was started.
+	ActivityArg( const char* value ) :
+	    quActivityArg()
+	{
+		stringValue = value;
+		type = QU_ACTIVITY_ARG_STRING;
+	}
+	ActivityArg( const std::string& value ) :
+	    ActivityArg( value.c_str() )
+	{
+	}
+};
+static_assert( sizeof( ActivityArg ) == sizeof( quActivityArg ), "Arguments are passed on as an array of quActivityArg." );
+
+//Annotation of an activity, see quAnnotateActivity. Converts from integers and floating point numbers.
+struct Annotation : quAnnotation
+{
+	template< typename T >
+	    requires std::is_integral_v< T >
+	Annotation( quAnnotationKeyID annotationKeyID, T value ) :
+	    quAnnotation()
+	{
+		keyID = annotationKeyID;
+		if constexpr( std::is_signed_v< T > )
+		{
+			intValue = value;
+			type = QU_ACTIVITY_ARG_INT64;
+		}
+		else
+		{
+			uintValue = value;
+			type = QU_ACTIVITY_ARG_UINT64;
+		}
+	}
+	Annotation( quAnnotationKeyID annotationKeyID, double value ) :
+	    quAnnotation()
+	{
+		keyID = annotationKeyID;
+		doubleValue = value;
+		type = QU_ACTIVITY_ARG_DOUBLE;
+	}
+};
+static_assert( sizeof( Annotation ) == sizeof( quAnnotation ), "Annotations are passed on as an array of quAnnotation." );
+
+//With QU_API_NESTED_SCOPE_STOPS the innermost scope on the current thread's channel is stopped with quStopCurrentActivity, so
+//activities started on that channel by other means have to stop before the scopes around them end. Other scopes stop by id.
+//Scopes on the current thread's channel only look it up once they start while something records.
 class ScopedActivity
 {
 public:
-	ScopedActivity( const char* activityName, quActivityChannelID activityChannelID = quGetChannelIDForCurrentThread() ) :
+	ScopedActivity( const char* activityName, quActivityChannelID activityChannelID = CURRENT_THREAD_CHANNEL ) :
 	    ScopedActivity( activityName, 0, activityChannelID )
 	{
 	}
-	ScopedActivity( const char* activityName, quUInt32 color, quActivityChannelID activityChannelID = quGetChannelIDForCurrentThread() ) :
-	    activityChannelID( activityChannelID )
+	ScopedActivity( const char* activityName, quUInt32 color, quActivityChannelID activityChannelID = CURRENT_THREAD_CHANNEL ) :
+	    activityChannelID( activityChannelID ),
+	    activityID( StartOneShot( activityName, color ) )
 	{
-		if( activityChannelID != QU_INVALID_ACTIVITY_CHANNEL_ID )
-			activityID = quStartActivity( activityChannelID, activityName, color );
-		else
-			activityID = QU_INVALID_ACTIVITY_ID;
 	}
-	ScopedActivity( quRecurringActivityID recurringActivityID, quActivityChannelID activityChannelID = quGetChannelIDForCurrentThread() ) :
-	    activityChannelID( activityChannelID )
+	ScopedActivity( quRecurringActivityID recurringActivityID, quActivityChannelID activityChannelID = CURRENT_THREAD_CHANNEL ) :
+	    activityChannelID( activityChannelID ),
+	    activityID( StartRecurring( recurringActivityID ) )
+	{
+	}
+	ScopedActivity( quActivityDescriptor& activityDescriptor, quActivityChannelID activityChannelID = CURRENT_THREAD_CHANNEL ) :
+	    activityChannelID( activityChannelID ),
+	    activityID( StartDescribed( activityDescriptor ) )
+	{
+	}
+	//The descriptor's name is a template in which every {} is replaced by the next argument, see quStartFormattedActivity.
+	ScopedActivity( quActivityDescriptor& activityDescriptor, std::initializer_list< ActivityArg > args, quActivityChannelID activityChannelID = CURRENT_THREAD_CHANNEL ) :
+	    activityChannelID( activityChannelID ),
+	    activityID( StartFormatted( activityDescriptor, args ) )
 	{
-		if( activityChannelID != QU_INVALID_ACTIVITY_CHANNEL_ID )
-			activityID = quStartRecurringActivity( activityChannelID, recurringActivityID );
-		else
-			activityID = QU_INVALID_ACTIVITY_ID;
 	}
 	ScopedActivity( ScopedActivity&& movable ) noexcept :
 	    activityChannelID( movable.activityChannelID ),
+#if defined( QU_API_INLINE_EVENTS )
+	    startRing( movable.startRing ),
+#endif
 	    activityID( movable.activityID )
 	{
 		movable.activityID = QU_INVALID_ACTIVITY_ID;
@@ -193,6 +805,9 @@ public:
 		EndScope();
 
 		activityChannelID = movable.activityChannelID;
+#if defined( QU_API_INLINE_EVENTS )
+		startRing = movable.startRing;
+#endif
 		std::swap( activityID, movable.activityID );
 		return *this;
 	}
@@ -207,38 +822,216 @@ public:
 	}
 	void Rescope( const char* newActivityName, quUInt32 color )
 	{
-		if( activityID != QU_INVALID_ACTIVITY_ID )
-			quStopActivity( activityID );
-		activityID = quStartActivity( activityChannelID, newActivityName, color );
+		Stop();
+		activityID = StartOneShot( newActivityName, color );
 	}
 	void Rescope( quRecurringActivityID recurringActivityID )
 	{
-		if( activityID != QU_INVALID_ACTIVITY_ID )
-			quStopActivity( activityID );
-		activityID = quStartRecurringActivity( activityChannelID, recurringActivityID );
+		Stop();
+		activityID = StartRecurring( recurringActivityID );
+	}
+	void Rescope( quActivityDescriptor& activityDescriptor )
+	{
+		Stop();
+		activityID = StartDescribed( activityDescriptor );
+	}
+	void Rescope( quActivityDescriptor& activityDescriptor, std::initializer_list< ActivityArg > args )
+	{
+		Stop();
+		activityID = StartFormatted( activityDescriptor, args );
 	}
 	void EndScope()
 	{
 		if( activityID != QU_INVALID_ACTIVITY_ID )
 		{
-			quStopActivity( activityID );
+			Stop();
 			activityID = QU_INVALID_ACTIVITY_ID;
 		}
 	}
+	//Stops the activity with annotations attached.
+	void EndScope( std::initializer_list< Annotation > annotations )
+	{
+		if( activityID == QU_INVALID_ACTIVITY_ID )
+			return;
+
+		if( CanAnnotate() )
+		{
+			LeaveScope();
+			quStopActivityWithArgs( activityID, annotations.begin(), quUInt32( annotations.size() ) );
+		}
+		else
+			Stop();
+		activityID = QU_INVALID_ACTIVITY_ID;
+	}
+	bool Annotate( std::initializer_list< Annotation > annotations ) const
+	{
+		if( !CanAnnotate() )
+			return false;
+
+		return quAnnotateActivity( activityID, annotations.begin(), quUInt32( annotations.size() ) );
+	}
 
 private:
 	ScopedActivity( const ScopedActivity& ) = delete;
 	ScopedActivity& operator=( const ScopedActivity& ) = delete;
 
+	bool CanStart()
+	{
+		if( !IsRecording() )
+			return false;
+
+		if( activityChannelID == CURRENT_THREAD_CHANNEL )
+			activityChannelID = GetChannelIDForCurrentThread();
+		return activityChannelID != QU_INVALID_ACTIVITY_CHANNEL_ID;
+	}
+	//Activities started through the ring have no id the runtime knows.
+	bool CanAnnotate() const
+	{
+#if defined( QU_API_INLINE_EVENTS )
+		if( activityID == RING_ACTIVITY_ID )
+			return false;
+#endif
+		return activityID != QU_INVALID_ACTIVITY_ID;
+	}
+	quActivityID StartOneShot( const char* activityName, quUInt32 color )
+	{
+		if( !CanStart() )
+			return QU_INVALID_ACTIVITY_ID;
+
+		if( IsInterning() )
+		{
+			quRecurringActivityID recurringActivityID = quInternActivity( activityName, color );
+			if( recurringActivityID != QU_INVALID_RECURRING_ACTIVITY_ID )
+				return StartRecurringOnChannel( recurringActivityID );
+		}
+		return EnterScope( quStartActivity( activityChannelID, activityName, color ) );
+	}
+	quActivityID StartDescribed( quActivityDescriptor& activityDescriptor )
+	{
+		if( !CanStart() || !IsCategoryEnabled( (quCategory)activityDescriptor.category ) )
+			return QU_INVALID_ACTIVITY_ID;
+
+		//Only registers the activity if the loader couldn't do so up front.
+		quRecurringActivityID recurringActivityID = GetRecurringActivityID( activityDescriptor );
+		if( recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID )
+			return QU_INVALID_ACTIVITY_ID;
+
+		return StartRecurringOnChannel( recurringActivityID );
+	}
+	quActivityID StartFormatted( quActivityDescriptor& activityDescriptor, std::initializer_list< ActivityArg > args )
+	{
+		if( !CanStart() || !IsCategoryEnabled( (quCategory)activityDescriptor.category ) )
+			return QU_INVALID_ACTIVITY_ID;
+
+		return EnterScope( quStartFormattedActivity( activityChannelID, &activityDescriptor, args.begin(), quUInt32( args.size() ) ) );
+	}
+	quActivityID StartRecurring( quRecurringActivityID recurringActivityID )
+	{
+		if( !CanStart() )
+			return QU_INVALID_ACTIVITY_ID;
+
+		return StartRecurringOnChannel( recurringActivityID );
+	}
+	quActivityID StartRecurringOnChannel( quRecurringActivityID recurringActivityID )
+	{
+#if defined( QU_API_INLINE_EVENTS )
+		startRing = StartRingActivity( activityChannelID, recurringActivityID );
+		if( startRing != nullptr )
+			return RING_ACTIVITY_ID;
+#endif
+		return EnterScope( quStartRecurringActivity( activityChannelID, recurringActivityID ) );
+	}
+	void Stop() const
+	{
+#if defined( QU_API_INLINE_EVENTS )
+		if( activityID == RING_ACTIVITY_ID )
+		{
+			StopRingActivity( startRing, activityChannelID );
+			return;
+		}
+#endif
+		if( activityID == QU_INVALID_ACTIVITY_ID )
+			return;
+
+		//The innermost scope on the thread's own channel is the channel's current activity, so the runtime doesn't need to look up its id.
+		if( LeaveScope() )
+			quStopCurrentActivity( activityChannelID );
+		else
+			quStopActivity( activityID );
+	}
+#if defined( QU_API_NESTED_SCOPE_STOPS )
+	static constexpr quUInt32 MAX_NESTED_SCOPES = 64;
+
+	//Running scopes on the thread's channel, innermost last. Scopes nested deeper than MAX_NESTED_SCOPES aren't tracked. Starts out
+	//zeroed like any thread_local.
+	struct NestedScopes
+	{
+		quActivityID activityIDs[ MAX_NESTED_SCOPES ];
+		quUInt32 depth;
+	};
+#endif
+	//Remembers the running scopes on the thread's channel so that LeaveScope knows whether they're stopped in order.
+	quActivityID EnterScope( quActivityID startedID ) const
+	{
+#if defined( QU_API_NESTED_SCOPE_STOPS )
+		if( startedID != QU_INVALID_ACTIVITY_ID && activityChannelID == GetChannelIDForCurrentThread() && nestedScopes.depth < MAX_NESTED_SCOPES )
+			nestedScopes.activityIDs[ nestedScopes.depth++ ] = startedID;
+#endif
+		return startedID;
+	}
+	//Whether the activity is the innermost running scope on the thread's channel. Scopes that aren't, such as the previous scope of
+	//a move assignment or scopes destroyed out of order, are stopped by id, debug builds mark them as well.
+	bool LeaveScope() const
+	{
+#if defined( QU_API_NESTED_SCOPE_STOPS )
+		quUInt32 depth = nestedScopes.depth;
+		if( depth != 0 && nestedScopes.activityIDs[ depth - 1 ] == activityID )
+		{
+			nestedScopes.depth = depth - 1;
+			return activityChannelID == GetChannelIDForCurrentThread();
+		}
+
+		quActivityID* scopesEnd = nestedScopes.activityIDs + depth;
+		quActivityID* scope = std::find( nestedScopes.activityIDs, scopesEnd, activityID );
+		if( scope != scopesEnd )
+		{
+			std::copy( scope + 1, scopesEnd, scope );
+			--nestedScopes.depth;
+#	if defined( _DEBUG ) || defined( DEBUG )
+			quAddMarker( "ScopedActivity stopped out of order" );
+#	endif
+		}
+#endif
+		return false;
+	}
+
+#if defined( QU_API_NESTED_SCOPE_STOPS )
+	static inline thread_local NestedScopes nestedScopes;
+#endif
+
 	quActivityChannelID activityChannelID;
+#if defined( QU_API_INLINE_EVENTS )
+	//Ring the activity was started through if it's RING_ACTIVITY_ID. Declared before activityID, which is started by the constructors.
+	quEventRing* startRing = nullptr;
+#endif
 	quActivityID activityID;
 };
 
+//Descriptors are constant initialized, so their category can be checked while compiling.
+#define QU_ASSERT_CATEGORY( category ) static_assert( ( category ) < QU_MAX_CATEGORIES, "Categories have to be smaller than QU_MAX_CATEGORIES" )
+
 // clang-format off
 #if defined( QU_API_ENABLED )
 	//Static init
 #	define QU_DECLARE_ACTIVITY( varName, activityName ) static quRecurringActivityID varName = ::quAddRecurringActivity( activityName, 0 )
 #	define QU_DECLARE_ACTIVITY_COLOR( varName, activityName, color ) static quRecurringActivityID varName = ::quAddRecurringActivity( activityName, color )
+#	define QU_DECLARE_ACTIVITY_DESCRIPTOR( varName, activityName ) QU_DECLARE_ACTIVITY_DESCRIPTOR_COLOR( varName, activityName, 0 )
+#	define QU_DECLARE_ACTIVITY_DESCRIPTOR_COLOR( varName, activityName, color ) QU_DECLARE_ACTIVITY_CAT( varName, activityName, color, QU_CATEGORY_DEFAULT )
+#	define QU_DECLARE_ACTIVITY_CAT( varName, activityName, color, category ) QU_ASSERT_CATEGORY( category ); alignas( quActivityDescriptor ) static constinit quActivityDescriptor varName QU_ACTIVITY_SECTION = { \
+		qu::HashActivityName( activityName ), activityName, __FILE__, nullptr, __LINE__, color, QU_INVALID_RECURRING_ACTIVITY_ID, category }
+#	define QU_DECLARE_ACTIVITY_AT_ADDRESS( varName ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, QU_CATEGORY_DEFAULT )
+#	define QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, category ) QU_ASSERT_CATEGORY( category ); alignas( quActivityDescriptor ) static constinit quActivityDescriptor varName QU_ACTIVITY_SECTION = { \
+		0, nullptr, __FILE__, nullptr, __LINE__, 0, QU_INVALID_RECURRING_ACTIVITY_ID, category }
 
 	//Constructors
 #	define QU_SCOPED_COUNTER( varName, counterName ) qu::ScopedCounter varName = qu::ScopedCounter( counterName )
@@ -249,10 +1042,18 @@ private:
 
 #	define QU_SCOPED_ACTIVITY_ONESHOT( varName, activityName ) qu::ScopedActivity varName( activityName )
 #	define QU_SCOPED_ACTIVITY_ONESHOT_COLOR( varName, activityName, color ) qu::ScopedActivity varName( activityName, color )
-#	define QU_SCOPED_ACTIVITY_RECURRING( varName, activityName ) QU_DECLARE_ACTIVITY( QU_CONCAT( quaid, __LINE__ ), activityName ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
-#	define QU_SCOPED_ACTIVITY_RECURRING_COLOR( varName, activityName, color ) QU_DECLARE_ACTIVITY_COLOR( QU_CONCAT( quaid, __LINE__ ), activityName, color ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
+#	define QU_SCOPED_ACTIVITY_ONESHOT_CAT( varName, activityName, category ) qu::ScopedActivity varName( activityName, qu::IsCategoryEnabled( category ) ? qu::CURRENT_THREAD_CHANNEL : QU_INVALID_ACTIVITY_CHANNEL_ID )
+#	define QU_SCOPED_ACTIVITY_RECURRING( varName, activityName ) QU_DECLARE_ACTIVITY_DESCRIPTOR( QU_CONCAT( quaid, __LINE__ ), activityName ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
+#	define QU_SCOPED_ACTIVITY_RECURRING_COLOR( varName, activityName, color ) QU_DECLARE_ACTIVITY_DESCRIPTOR_COLOR( QU_CONCAT( quaid, __LINE__ ), activityName, color ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
+#	define QU_SCOPED_ACTIVITY_RECURRING_CAT( varName, activityName, category ) QU_DECLARE_ACTIVITY_CAT( QU_CONCAT( quaid, __LINE__ ), activityName, 0, category ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
+#	define QU_SCOPED_ACTIVITY_FORMATTED( varName, activityFormat, ... ) QU_DECLARE_ACTIVITY_DESCRIPTOR( QU_CONCAT( quaid, __LINE__ ), activityFormat ); qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ), { __VA_ARGS__ } )
+#	define QU_SCOPED_ACTIVITY_AT_ADDRESS( varName ) QU_SCOPED_ACTIVITY_AT_ADDRESS_CAT( varName, QU_CATEGORY_DEFAULT )
+#	define QU_SCOPED_ACTIVITY_AT_ADDRESS_CAT( varName, category ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( QU_CONCAT( quaid, __LINE__ ), category ); \
+		if( qu::IsRecording() && !qu::HasActivityAddress( QU_CONCAT( quaid, __LINE__ ) ) ) [[unlikely]] qu::CaptureActivityAddress( QU_CONCAT( quaid, __LINE__ ) ); \
+		qu::ScopedActivity varName( QU_CONCAT( quaid, __LINE__ ) )
 
-#	define QU_MARKER( markerName ) ::quAddMarker( markerName )
+#	define QU_MARKER( markerName ) ( qu::IsRecording() ? ::quAddMarker( markerName ) : void() )
+#	define QU_MARKER_IN_CATEGORY( markerName, category ) ( qu::IsRecording() && qu::IsCategoryEnabled( category ) ? ::quAddMarker( markerName ) : void() )
 
 	//Mutators
 #	define QU_SET_COUNTER_VALUE( varName, newCounterValue ) varName.SetValue( newCounterValue )
@@ -265,6 +1066,11 @@ private:
 	//Static init
 #	define QU_DECLARE_ACTIVITY( varName, activityName ) static quRecurringActivityID varName = QU_INVALID_RECURRING_ACTIVITY_ID
 #	define QU_DECLARE_ACTIVITY_COLOR( varName, activityName, color ) static quRecurringActivityID varName = QU_INVALID_RECURRING_ACTIVITY_ID
+#	define QU_DECLARE_ACTIVITY_DESCRIPTOR( varName, activityName ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, QU_CATEGORY_DEFAULT )
+#	define QU_DECLARE_ACTIVITY_DESCRIPTOR_COLOR( varName, activityName, color ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, QU_CATEGORY_DEFAULT )
+#	define QU_DECLARE_ACTIVITY_CAT( varName, activityName, color, category ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, category )
+#	define QU_DECLARE_ACTIVITY_AT_ADDRESS( varName ) QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, QU_CATEGORY_DEFAULT )
+#	define QU_DECLARE_ACTIVITY_AT_ADDRESS_CAT( varName, category ) QU_ASSERT_CATEGORY( category ); static constinit quActivityDescriptor varName = { 0, nullptr, nullptr, nullptr, 0, 0, QU_INVALID_RECURRING_ACTIVITY_ID, category }
 
 	//Constructors
 #	define QU_SCOPED_COUNTER( varName, counterName ) do {} while( false )
@@ -275,10 +1081,16 @@ private:
 
 #	define QU_SCOPED_ACTIVITY_ONESHOT( varName, activityName ) do {} while( false )
 #	define QU_SCOPED_ACTIVITY_ONESHOT_COLOR( varName, activityName, color ) do {} while( false )
+#	define QU_SCOPED_ACTIVITY_ONESHOT_CAT( varName, activityName, category ) do {} while( false )
 #	define QU_SCOPED_ACTIVITY_RECURRING( varName, activityID ) do {} while( false )
 #	define QU_SCOPED_ACTIVITY_RECURRING_COLOR( varName, activityName, color ) do {} while( false )
+#	define QU_SCOPED_ACTIVITY_RECURRING_CAT( varName, activityName, category ) do {} while( false )
+#	define QU_SCOPED_ACTIVITY_FORMATTED( varName, activityFormat, ... ) do {} while( false )
+#	define QU_SCOPED_ACTIVITY_AT_ADDRESS( varName ) do {} while( false )
+#	define QU_SCOPED_ACTIVITY_AT_ADDRESS_CAT( varName, category ) do {} while( false )
 
 #	define QU_MARKER( markerName ) do {} while( false )
+#	define QU_MARKER_IN_CATEGORY( markerName, category ) do {} while( false )
 
 	//Mutators
 #	define QU_SET_COUNTER_VALUE( varName, newCounterValue ) do {} while( false )
@@ -297,12 +1109,54 @@ private:
 #define QU_ONESHOT_ACTIVITY_COLOR( activityName, color ) QU_SCOPED_ACTIVITY_ONESHOT( QU_CONCAT( qusaid, __LINE__ ), activityName, color )
 #define QU_RECURRING_ACTIVITY( activityName ) QU_SCOPED_ACTIVITY_RECURRING( QU_CONCAT( qusaid, __LINE__ ), activityName )
 #define QU_RECURRING_ACTIVITY_COLOR( activityName, color ) QU_SCOPED_ACTIVITY_RECURRING_COLOR( QU_CONCAT( qusaid, __LINE__ ), activityName, color )
-#define QU_RECURRING_RESCOPE( varName, activityName ) QU_DECLARE_ACTIVITY( QU_CONCAT( quaid, __LINE__ ), activityName ); QU_RESCOPE_RECURRING( varName, QU_CONCAT( quaid, __LINE__ ) )
+#define QU_FORMATTED_ACTIVITY( activityFormat, ... ) QU_SCOPED_ACTIVITY_FORMATTED( QU_CONCAT( qusaid, __LINE__ ), activityFormat, __VA_ARGS__ )
+#define QU_RECURRING_RESCOPE( varName, activityName ) QU_DECLARE_ACTIVITY_DESCRIPTOR( QU_CONCAT( quaid, __LINE__ ), activityName ); QU_RESCOPE_RECURRING( varName, QU_CONCAT( quaid, __LINE__ ) )
+
+//Levels, instrumentation with a level below QU_API_MIN_LEVEL is removed at compile time.
+#define QU_LEVEL_TRACE 0
+#define QU_LEVEL_DEBUG 1
+#define QU_LEVEL_INFO 2
+#define QU_LEVEL_ESSENTIAL 3
+#if !defined( QU_API_MIN_LEVEL )
+#	define QU_API_MIN_LEVEL QU_LEVEL_TRACE
+#endif
+#if QU_API_MIN_LEVEL <= QU_LEVEL_TRACE
+#	define QU_IF_LEVEL_0( ... ) __VA_ARGS__
+#else
+#	define QU_IF_LEVEL_0( ... )
+#endif
+#if QU_API_MIN_LEVEL <= QU_LEVEL_DEBUG
+#	define QU_IF_LEVEL_1( ... ) __VA_ARGS__
+#else
+#	define QU_IF_LEVEL_1( ... )
+#endif
+#if QU_API_MIN_LEVEL <= QU_LEVEL_INFO
+#	define QU_IF_LEVEL_2( ... ) __VA_ARGS__
+#else
+#	define QU_IF_LEVEL_2( ... )
+#endif
+#if QU_API_MIN_LEVEL <= QU_LEVEL_ESSENTIAL
+#	define QU_IF_LEVEL_3( ... ) __VA_ARGS__
+#else
+#	define QU_IF_LEVEL_3( ... )
+#endif
+//Level has to be one of the QU_LEVEL_* values or a literal from 0 to 3.
+#define QU_IF_LEVEL( level, ... ) QU_CONCAT( QU_IF_LEVEL_, level )( __VA_ARGS__ )
+
+#define QU_ONESHOT_ACTIVITY_CAT( activityName, category, level ) QU_IF_LEVEL( level, QU_SCOPED_ACTIVITY_ONESHOT_CAT( QU_CONCAT( qusaid, __LINE__ ), activityName, category ) )
+#define QU_RECURRING_ACTIVITY_CAT( activityName, category, level ) QU_IF_LEVEL( level, QU_SCOPED_ACTIVITY_RECURRING_CAT( QU_CONCAT( qusaid, __LINE__ ), activityName, category ) )
+#define QU_MARKER_CAT( markerName, category, level ) QU_IF_LEVEL( level, QU_MARKER_IN_CATEGORY( markerName, category ) )
 
-#if defined( _WIN64 )
+//With QU_API_ACTIVITY_ADDRESSES defined, instrumented functions are identified by address and named by the runtime when needed.
+#if defined( QU_API_ACTIVITY_ADDRESSES )
+#	define QU_INSTRUMENT_FUNCTION() QU_SCOPED_ACTIVITY_AT_ADDRESS( QU_CONCAT( qusaid, __LINE__ ) )
+#	define QU_INSTRUMENT_FUNCTION_CAT( category, level ) QU_IF_LEVEL( level, QU_SCOPED_ACTIVITY_AT_ADDRESS_CAT( QU_CONCAT( qusaid, __LINE__ ), category ) )
+#elif defined( _WIN64 )
 #	define QU_INSTRUMENT_FUNCTION() QU_RECURRING_ACTIVITY( __FUNCTION__ )
+#	define QU_INSTRUMENT_FUNCTION_CAT( category, level ) QU_RECURRING_ACTIVITY_CAT( __FUNCTION__, category, level )
 #else
 #	define QU_INSTRUMENT_FUNCTION() QU_RECURRING_ACTIVITY( __PRETTY_FUNCTION__ )
+#	define QU_INSTRUMENT_FUNCTION_CAT( category, level ) QU_RECURRING_ACTIVITY_CAT( __PRETTY_FUNCTION__, category, level )
 #endif
 // clang-format on
 
@@ -79,6 +79,27 @@ typedef quUInt16 quOutputID;
 //Counters
 typedef quUInt16 quCounterID;
 #define QU_INVALID_COUNTER_ID ( ( quCounterID ) - 1 )
+typedef quUInt8 quCounterCoalescing;
+#define QU_COUNTER_COALESCING_NONE 0    //Every value is passed on.
+#define QU_COUNTER_COALESCING_LAST 1    //Only the last value set during a flush interval is passed on.
+#define QU_COUNTER_COALESCING_MIN 2     //Only the smallest value set during a flush interval is passed on.
+#define QU_COUNTER_COALESCING_MAX 3     //Only the largest value set during a flush interval is passed on.
+#define QU_COUNTER_COALESCING_AVERAGE 4 //Only the average of the values set during a flush interval is passed on.
+typedef quUInt8 quCounterType;
+#define QU_COUNTER_TYPE_FLOAT 0       //Set with quSetCounterValue, what quAddCounter adds.
+#define QU_COUNTER_TYPE_INT64 1       //Set with quSetCounterValueInt64.
+#define QU_COUNTER_TYPE_DOUBLE 2      //Set with quSetCounterValueDouble.
+#define QU_COUNTER_TYPE_ACCUMULATOR 3 //Added to with quAddToCounter from any thread, the runtime sees an int64 counter set to the sum.
+typedef float( QU_CALL_CONV* quPolledCounterCallback_Ptr )( void* userData ); //Computes the current value of a polled counter.
+typedef quUInt16 quCounterFamilyID;
+#define QU_INVALID_COUNTER_FAMILY_ID ( ( quCounterFamilyID ) - 1 )
+#define QU_MAX_COUNTER_FAMILIES 1024
+#define QU_MAX_COUNTER_SERIES 16384 //Maximum number of series a single family can hold at once.
+
+//Categories
+typedef quUInt8 quCategory;   //Index of the bit in quSharedState::categoryMask that enables the category.
+#define QU_MAX_CATEGORIES 64
+#define QU_CATEGORY_DEFAULT 0 //Category of everything that wasn't given one explicitly.
 
 //Activity channels
 typedef quUInt16 quActivityChannelID;
@@ -90,7 +111,280 @@ typedef quUInt64 quActivityID;
 typedef quUInt64 quFlowID;
 #define QU_INVALID_FLOW_ID ( ( quFlowID ) - 1 )
 
+//Formatted activities
+typedef quUInt8 quActivityArgType;
+#define QU_ACTIVITY_ARG_INT64 0
+#define QU_ACTIVITY_ARG_UINT64 1
+#define QU_ACTIVITY_ARG_DOUBLE 2
+#define QU_ACTIVITY_ARG_STRING 3 //Utf-8 encoded and zero terminated, only referenced for the duration of the call.
+#define QU_MAX_ACTIVITY_ARGS 8
+//Value of a {} placeholder in the name of a formatted activity.
+typedef struct quActivityArg
+{
+	union
+	{
+		quInt64 intValue;
+		quUInt64 uintValue;
+		double doubleValue;
+		const char* stringValue;
+	};
+	quActivityArgType type; //!< One of the QU_ACTIVITY_ARG_* values, determines which of the values above is used.
+	quUInt8 reserved[ 7 ];
+} quActivityArg;
+
+//Activity annotations
+typedef quUInt16 quAnnotationKeyID;
+#define QU_INVALID_ANNOTATION_KEY_ID ( ( quAnnotationKeyID ) - 1 )
+#define QU_MAX_ANNOTATION_KEYS 4096
+#define QU_MAX_ANNOTATIONS 16 //Maximum number of annotations passed in a single call.
+//Fixed width key/value pair attached to an activity.
+typedef struct quAnnotation
+{
+	union
+	{
+		quInt64 intValue;
+		quUInt64 uintValue;
+		double doubleValue;
+	};
+	quAnnotationKeyID keyID; //!< Key added with quAddAnnotationKey.
+	quActivityArgType type;  //!< QU_ACTIVITY_ARG_INT64, QU_ACTIVITY_ARG_UINT64 or QU_ACTIVITY_ARG_DOUBLE, determines which of the values above is used.
+	quUInt8 reserved[ 5 ];
+} quAnnotation;
+
+//Activity interning
+#define QU_MAX_INTERNED_ACTIVITIES 65536
+typedef struct quActivityInterningStats
+{
+	quUInt64 lookups;   //!< Names looked up since interning was enabled.
+	quUInt64 hits;      //!< Lookups that found their name registered already.
+	quUInt64 rejected;  //!< Lookups of new names that weren't registered because maxNames were interned already.
+	quUInt32 nameCount; //!< Number of names interned.
+	quUInt32 maxNames;  //!< Largest number of names that will be interned, 0 while interning is disabled.
+} quActivityInterningStats;
+
+/**
+ * Describes a recurring activity declared with QU_DECLARE_ACTIVITY_DESCRIPTOR. Everything but the id is known at compile time, the id is
+ * filled in once the activity was registered with the runtime and is QU_INVALID_RECURRING_ACTIVITY_ID until then.
+ * Activities declared with QU_DECLARE_ACTIVITY_AT_ADDRESS have no name, they're identified by an address in the code they
+ * instrument instead, which is only known once that code ran. Descriptors with neither are the padding some linkers insert.
+ */
+typedef struct quActivityDescriptor
+{
+	quUInt64 nameHash;        //!< 64 bit FNV-1a hash of name, lets the runtime find activities it already knows without comparing names. 0 without a name.
+	const char* name;         //!< Utf-8 encoded name of the activity, nullptr if the activity is identified by address.
+	const char* file;         //!< Source file the activity was declared in.
+	const void* address;      //!< Address in the instrumented function, written atomically before registration if name is nullptr.
+	quUInt32 line;            //!< Line in file the activity was declared on.
+	quUInt32 color;           //!< Color of the activity, 0 for the default color.
+	quRecurringActivityID id; //!< Written by the runtime during registration, read atomically.
+	quUInt32 category;        //!< quCategory of the activity, it's only started while that category is enabled.
+} quActivityDescriptor;
+typedef const char*( QU_CALL_CONV* quAddressResolver_Ptr )( const void* address ); //Resolves a code address to the utf-8 encoded name of its function, nullptr if unknown.
+
 //Markers
 #define QU_MAX_MARKER_NAME_LENGTH 63 //Maximum length of Marker names not including the nul character.
 
+//Events
+typedef quUInt8 quEventType;
+#define QU_EVENT_START_RECURRING_ACTIVITY 0
+#define QU_EVENT_STOP_ACTIVITY 1
+#define QU_EVENT_SET_COUNTER_VALUE 2
+#define QU_EVENT_ANNOTATE_ACTIVITY 3 //Only submitted to runtimes that provide quDispatchTable::AnnotateActivity.
+#define QU_EVENT_SET_TYPED_COUNTER_VALUE 4 //Only submitted to runtimes that provide quDispatchTable::SetCounterValueInt64.
+#define QU_EVENT_FORMAT_ARGUMENT 5 //Only submitted to runtimes that provide quDispatchTable::StartFormattedActivity, right after the start of its activity.
+#define QU_SUBMITTED_ACTIVITY_ID_BIT ( (quActivityID)1 << 63 ) //Set on every activity id handed out by the submitter instead of the runtime.
+typedef struct quEvent
+{
+	union
+	{
+		quUInt64 timestamp;       //!< Nanoseconds on the steady clock (CLOCK_MONOTONIC / QueryPerformanceCounter) at which the event happened.
+		quUInt64 annotationValue; //!< Annotation and format argument: bits of the value, they have no timestamp of their own. Strings are passed as pointers only valid during the call.
+	};
+	union
+	{
+		quActivityID activityID;   //!< Start: id chosen by the submitter (see quReserveActivityIDs). Stop, annotation and format argument: id of the activity, QU_INVALID_ACTIVITY_ID stops the current activity of channelID.
+		quUInt64 typedCounterBits; //!< Typed counter: bits of the quInt64 or double value.
+	};
+	quRecurringActivityID recurringActivityID; //!< Start: the activity that was started.
+	float counterValue;                        //!< Counter: the new value of the counter.
+	quActivityChannelID channelID;             //!< Start: the channel the activity was started on. Stop: the channel whose current activity is stopped.
+	union
+	{
+		quCounterID counterID;             //!< Counter: the counter that was changed.
+		quAnnotationKeyID annotationKeyID; //!< Annotation: key of the value.
+	};
+	quEventType type;                 //!< One of the QU_EVENT_* values, determines which of the fields above are used.
+	union
+	{
+		quActivityArgType annotationType; //!< Annotation and format argument: type of the value.
+		quCounterType counterType;        //!< Typed counter: QU_COUNTER_TYPE_INT64 or QU_COUNTER_TYPE_DOUBLE.
+	};
+	quUInt8 reserved[ 2 ];
+} quEvent;
+
+//Event rings
+#define QU_EVENT_RING_RECORD_START 0
+#define QU_EVENT_RING_RECORD_STOP 1
+typedef struct quEventRingRecord
+{
+	quUInt64 timestamp;                        //!< Nanoseconds on the same clock as quEvent::timestamp.
+	quRecurringActivityID recurringActivityID; //!< Start: the activity that was started. Stop records always stop the most recently started activity.
+	quUInt32 type;                             //!< One of the QU_EVENT_RING_RECORD_* values.
+} quEventRingRecord;
+/**
+ * Single producer single consumer ring through which an instrumented thread passes its activities to the runtime without
+ * calling into it. Both indices only ever increase, a record is readable once writeIndex has been stored past it with release
+ * semantics and its slot may be reused once readIndex has been stored past it. Each side writes its own cache line only.
+ */
+typedef struct quEventRing
+{
+	//Written by the instrumented thread
+	quUInt64 writeIndex;      //!< Number of records written to the ring.
+	quUInt64 cachedReadIndex; //!< Last value of readIndex the instrumented thread has seen, saves it from reading the runtime's cache line for every record.
+	quUInt8 producerPadding[ 48 ];
+
+	//Written by the runtime
+	quUInt64 readIndex; //!< Number of records the runtime has consumed from the ring.
+	quUInt8 consumerPadding[ 56 ];
+
+	//Written by the runtime while the ring isn't being used
+	quEventRingRecord* records;    //!< Storage of capacityMask + 1 records.
+	quUInt32 capacityMask;         //!< Capacity of the ring minus one, the capacity is a power of two.
+	quActivityChannelID channelID; //!< Channel the records belong to, or QU_INVALID_ACTIVITY_CHANNEL_ID once that channel was removed.
+} quEventRing;
+
+//Mapped trace files
+#define QU_MAPPED_TRACE_MAGIC 0x3145434152545551ull //"QUTRACE1" read as a little endian number.
+#define QU_MAPPED_TRACE_VERSION 1
+#define QU_MAPPED_TRACE_NAME_CHANNEL 0            //id is the quActivityChannelID.
+#define QU_MAPPED_TRACE_NAME_RECURRING_ACTIVITY 1 //id is the quRecurringActivityID.
+#define QU_MAPPED_TRACE_NAME_ACTIVITY 2           //id is the quActivityID of an activity started by name, its start event has no recurring activity.
+#define QU_MAPPED_TRACE_NAME_COUNTER 3            //id is the quCounterID.
+#define QU_MAPPED_TRACE_NAME_ANNOTATION_KEY 4     //id is the quAnnotationKeyID.
+#define QU_MAPPED_TRACE_NAME_MARKER 5             //id is the quActivityChannelID the marker was added on, timestamp is when.
+/**
+ * Files written by quSetupMappedTraceOutput start with this header, followed by bufferCount quMappedTraceBuffer, nameBytes of
+ * quMappedTraceName records and finally bufferCount buffers of bufferBytes each that hold quEvent. The runtime maps the file
+ * shared and writes into it directly, so the kernel keeps whatever was written even if the process dies. Every cursor is stored
+ * with release semantics once the data it covers is complete, which is all a recovery tool may rely on.
+ */
+typedef struct quMappedTraceHeader
+{
+	quUInt64 magic;          //!< QU_MAPPED_TRACE_MAGIC.
+	quUInt32 version;        //!< QU_MAPPED_TRACE_VERSION.
+	quUInt32 bufferCount;    //!< Number of buffers the file has room for.
+	quUInt64 bufferBytes;    //!< Size of each buffer, a multiple of sizeof( quEvent ).
+	quUInt64 nameBytes;      //!< Size of the name region.
+	quUInt64 nameCursor;     //!< Bytes of the name region that hold complete records. Only accessed atomically.
+	quUInt32 usedBuffers;    //!< Number of buffers handed out to threads. Only accessed atomically.
+	quUInt32 closed;         //!< Non-zero once the output was stopped, still zero in files of processes that died. Only accessed atomically.
+	quUInt64 startTimestamp; //!< Timestamp on the clock of quEvent::timestamp at which the output started.
+} quMappedTraceHeader;
+//Each thread writes into a buffer of its own, threads whose buffer is full move on to a new one.
+typedef struct quMappedTraceBuffer
+{
+	quUInt64 writeCursor; //!< Bytes of the buffer that hold complete events. Only accessed atomically.
+	quUInt32 threadID;    //!< Thread that wrote the buffer, numbered by the runtime.
+	quUInt32 sequence;    //!< Number of buffers the thread filled before this one, orders the buffers of a thread.
+} quMappedTraceBuffer;
+//Record of the name region, the name follows as utf-8 without terminator and the next record starts at the next multiple of 8 bytes.
+typedef struct quMappedTraceName
+{
+	quUInt64 timestamp; //!< Markers: timestamp at which the marker was added.
+	quUInt64 id;        //!< What is named, depends on kind.
+	quUInt32 kind;      //!< One of the QU_MAPPED_TRACE_NAME_* values.
+	quUInt32 length;    //!< Length of the name in bytes.
+} quMappedTraceName;
+
+//Binary trace files
+#define QU_BINARY_TRACE_MAGIC 0x3145434152544251ull        //"QBTRACE1" read as a little endian number.
+#define QU_BINARY_TRACE_CHUNK_MAGIC 0x4b484351u            //"QCHK" read as a little endian number, marks the start of every chunk.
+#define QU_BINARY_TRACE_FOOTER_MAGIC 0x3158444e49544251ull //"QBTINDX1" read as a little endian number.
+#define QU_BINARY_TRACE_VERSION 1
+/**
+ * Records of a chunk start with one of these tags, followed by their fields. Unsigned fields are LEB128 varints, time and activity
+ * fields are zigzag encoded varints of the difference with the previous timestamp or activity id of the chunk, starting from
+ * the chunk's firstTimestamp and 0. Strings are numbered in the order they appear in the chunk and names refer to them by number.
+ * A chunk defines every name and string it uses and starts with the activities still running from earlier chunks, each followed by
+ * the annotations it got so far, which makes every chunk decodable on its own. Readers that decode consecutive chunks ignore
+ * the starts of activities that are already running and the annotations that follow them.
+ */
+#define QU_BINARY_RECORD_STRING 0                  //Length, utf-8 bytes.
+#define QU_BINARY_RECORD_CHANNEL_NAME 1            //Channel, string.
+#define QU_BINARY_RECORD_RECURRING_ACTIVITY_NAME 2 //Recurring activity, string.
+#define QU_BINARY_RECORD_COUNTER_NAME 3            //Counter, string.
+#define QU_BINARY_RECORD_ANNOTATION_KEY_NAME 4     //Annotation key, string.
+#define QU_BINARY_RECORD_START_RECURRING 5         //Time, channel, activity, recurring activity.
+#define QU_BINARY_RECORD_START_NAMED 6             //Time, channel, activity, string.
+#define QU_BINARY_RECORD_STOP 7                    //Time, activity.
+#define QU_BINARY_RECORD_STOP_CURRENT 8            //Time, channel.
+#define QU_BINARY_RECORD_COUNTER_VALUE 9           //Time, counter, 8 byte little endian double.
+#define QU_BINARY_RECORD_ANNOTATION 10             //Activity, annotation key, quActivityArgType byte, 8 byte little endian value.
+#define QU_BINARY_RECORD_MARKER 11                 //Time, channel, string.
+//Files written by quSetupBinaryTraceOutput start with this header, followed by the chunks, the index and a quBinaryTraceFooter.
+typedef struct quBinaryTraceHeader
+{
+	quUInt64 magic;   //!< QU_BINARY_TRACE_MAGIC.
+	quUInt32 version; //!< QU_BINARY_TRACE_VERSION.
+	quUInt32 reserved;
+} quBinaryTraceHeader;
+typedef struct quBinaryTraceChunk
+{
+	quUInt32 magic;          //!< QU_BINARY_TRACE_CHUNK_MAGIC, lets files without an index be read chunk by chunk.
+	quUInt32 recordBytes;    //!< Size of the records that follow.
+	quUInt64 firstTimestamp; //!< Timestamp the time differences of the chunk start from, nothing in the chunk happened earlier apart from its running activities.
+	quUInt64 lastTimestamp;  //!< Latest timestamp in the chunk, events may be added slightly out of order.
+} quBinaryTraceChunk;
+//The index holds an entry per chunk, followed by the channels of all chunks as quActivityChannelID.
+typedef struct quBinaryTraceIndexEntry
+{
+	quUInt64 offset;         //!< Position of the chunk's quBinaryTraceChunk in the file.
+	quUInt64 firstTimestamp; //!< Same as in quBinaryTraceChunk.
+	quUInt64 lastTimestamp;  //!< Same as in quBinaryTraceChunk.
+	quUInt32 firstChannel;   //!< Index of the chunk's first channel in the channels following the entries.
+	quUInt32 channelCount;   //!< Number of channels the chunk has events for.
+} quBinaryTraceIndexEntry;
+//Last bytes of a complete file, files of processes that died have chunks only.
+typedef struct quBinaryTraceFooter
+{
+	quUInt64 indexOffset;  //!< Position of the first quBinaryTraceIndexEntry.
+	quUInt32 chunkCount;   //!< Number of index entries.
+	quUInt32 channelCount; //!< Number of channels following the index entries.
+	quUInt64 magic;        //!< QU_BINARY_TRACE_FOOTER_MAGIC.
+} quBinaryTraceFooter;
+
+//Clocks
+typedef quUInt8 quClockSource;
+#define QU_CLOCK_SOURCE_MONOTONIC 0     //CLOCK_MONOTONIC, QueryPerformanceCounter on Windows. The default.
+#define QU_CLOCK_SOURCE_MONOTONIC_RAW 1 //CLOCK_MONOTONIC_RAW, which isn't slewed by NTP. Linux only.
+#define QU_CLOCK_SOURCE_TSC 2           //The invariant time stamp counter converted to nanoseconds of QU_CLOCK_SOURCE_MONOTONIC. x86-64 only.
+//Converts time stamp counter ticks to nanoseconds: baseNanos + ( ticks - baseTicks ) * nanosPerTick.
+typedef struct quClockCalibration
+{
+	quUInt64 baseTicks; //!< Time stamp counter at the moment of the last calibration.
+	quUInt64 baseNanos; //!< Timestamp in nanoseconds at baseTicks.
+	double nanosPerTick;
+} quClockCalibration;
+
+//Shared state
+typedef struct quSharedState
+{
+	quUInt32 recording;                  //!< Non-zero while at least one output is running. Only accessed atomically.
+	quUInt32 filtering;                  //!< Non-zero while any recurring activity is filtered, see quSetRecurringActivityFilter. Only accessed atomically.
+	quUInt64 categoryMask;               //!< Bit n is set while the category with index n is enabled. Only accessed atomically.
+	quUInt32 clockSource;                //!< quClockSource timestamps are taken from. Only accessed atomically.
+	quUInt32 clockSequence;              //!< Odd while clockCalibration is being updated. Only accessed atomically.
+	quClockCalibration clockCalibration; //!< Used while clockSource is QU_CLOCK_SOURCE_TSC. Its fields are only accessed atomically.
+	quUInt32 interning;                  //!< Non-zero while dynamic activity names are interned, see quSetActivityInterning. Only accessed atomically.
+	quUInt32 threadStateGeneration;      //!< Incremented when a channel is removed or the runtime unloaded. Only accessed atomically.
+} quSharedState;
+
+//Thread state
+typedef struct quThreadState
+{
+	quEventRing* eventRing;        //!< Ring of the current thread's channel, nullptr if inline events aren't enabled or supported by the runtime.
+	quActivityChannelID channelID; //!< Channel that belongs to the current thread, QU_INVALID_ACTIVITY_CHANNEL_ID if there is none.
+	quUInt32 generation;           //!< quSharedState::threadStateGeneration the fields above were read at, they're stale once it differs.
+} quThreadState;
+
 #endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#if defined( _MSC_VER )
+#	include <intrin.h>
+#endif
+
+/**
+ * Minimal timing helpers shared by the benchmarks. Every measurement is repeated a couple of times and the fastest run is
+ * reported, which filters out most of the noise caused by other processes and frequency scaling.
+ */
+namespace Benchmark
+{
+
+static constexpr int REPETITIONS = 5;
+
+//Returns the time in nanoseconds a single iteration of the given function took. The function runs all iterations itself so
+//that the loop can be inlined into it.
+template< typename Function >
+double NanosPerIteration( uint64_t iterations, Function&& function )
+{
+	double bestNanos = 0.0;
+	for( int i = 0; i < REPETITIONS; ++i )
+	{
+		auto start = std::chrono::steady_clock::now();
+		function( iterations );
+		auto end = std::chrono::steady_clock::now();
+
+		double nanos = (double)std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count() / (double)iterations;
+		bestNanos = i == 0 ? nanos : std::min( bestNanos, nanos );
+	}
+	return bestNanos;
+}
+
+//Keeps the compiler from optimizing away the computation of value, without the cost of storing it anywhere.
+template< typename T >
+inline void DoNotOptimize( const T& value )
+{
+#if defined( _MSC_VER )
+	static_cast< void >( *static_cast< const volatile T* >( &value ) );
+	_ReadWriteBarrier();
+#else
+	asm volatile( "" : : "r,m"( value ) : "memory" );
+#endif
+}
+
+inline void Report( const char* name, double nanosPerIteration )
+{
+	std::cout << "  " << std::left << std::setw( 64 ) << name << std::right << std::fixed << std::setprecision( 2 ) << std::setw( 10 ) << nanosPerIteration << " ns" << std::endl;
+}
+//Reports iterations per second rather than their duration, for benchmarks that measure throughput.
+inline void ReportRate( const char* name, double nanosPerIteration )
+{
+	std::cout << "  " << std::left << std::setw( 64 ) << name << std::right << std::fixed << std::setprecision( 0 ) << std::setw( 12 ) << 1e9 / nanosPerIteration << " /s" << std::endl;
+}
+
+} //End namespace Benchmark
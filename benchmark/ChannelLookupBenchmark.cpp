@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ChannelLookupBenchmark.h"
+#include "Benchmark.h"
+#include <quApi.hpp>
+
+static constexpr uint64_t ITERATIONS = 10000000;
+
+//Kept out of line so that the compiler cant merge the instrumentation of consecutive iterations.
+#if defined( _MSC_VER )
+#	define NO_INLINE __declspec( noinline )
+#else
+#	define NO_INLINE __attribute__( ( noinline ) )
+#endif
+
+//Without a channel in the thread state quGetChannelIDForCurrentThread asks the runtime, which is what every lookup did before
+//the thread state existed. The state belongs to this thread, so it may be cleared here for as long as the measurement runs.
+class UncachedChannel
+{
+public:
+	UncachedChannel() :
+		channelID( qu::threadState.channelID )
+	{
+		qu::threadState.channelID = QU_INVALID_ACTIVITY_CHANNEL_ID;
+	}
+	~UncachedChannel()
+	{
+		qu::threadState.channelID = channelID;
+	}
+
+private:
+	quActivityChannelID channelID;
+};
+
+NO_INLINE static void InstrumentedWithApiLookup( quRecurringActivityID activityID )
+{
+	qu::ScopedActivity activity( activityID, quGetChannelIDForCurrentThread() );
+}
+NO_INLINE static void InstrumentedWithThreadState( quRecurringActivityID activityID )
+{
+	qu::ScopedActivity activity( activityID );
+}
+
+void RunChannelLookupBenchmark()
+{
+	std::cout << "Channel lookup per instrumented scope:" << std::endl;
+
+	qu::ScopedActivityChannel channel( u8"Benchmark thread", true );
+	quRecurringActivityID activityID = quAddRecurringActivity( "Benchmark activity", 0 );
+
+	double apiLookupNanos = Benchmark::NanosPerIteration( ITERATIONS, [ & ]( uint64_t iterations ) {
+		UncachedChannel uncached;
+		for( uint64_t i = 0; i < iterations; ++i )
+			Benchmark::DoNotOptimize( quGetChannelIDForCurrentThread() );
+	} );
+	double threadStateNanos = Benchmark::NanosPerIteration( ITERATIONS, [ & ]( uint64_t iterations ) {
+		for( uint64_t i = 0; i < iterations; ++i )
+			Benchmark::DoNotOptimize( qu::GetChannelIDForCurrentThread() );
+	} );
+	double apiScopeNanos = Benchmark::NanosPerIteration( ITERATIONS, [ & ]( uint64_t iterations ) {
+		UncachedChannel uncached;
+		for( uint64_t i = 0; i < iterations; ++i )
+			InstrumentedWithApiLookup( activityID );
+	} );
+	double threadStateScopeNanos = Benchmark::NanosPerIteration( ITERATIONS, [ & ]( uint64_t iterations ) {
+		for( uint64_t i = 0; i < iterations; ++i )
+			InstrumentedWithThreadState( activityID );
+	} );
+
+	Benchmark::Report( "quGetChannelIDForCurrentThread(), uncached", apiLookupNanos );
+	Benchmark::Report( "qu::GetChannelIDForCurrentThread()", threadStateNanos );
+	Benchmark::Report( "Scope, channel from the runtime (before)", apiScopeNanos );
+	Benchmark::Report( "Scope, channel from thread state (after)", threadStateScopeNanos );
+}
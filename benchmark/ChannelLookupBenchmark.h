@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/**
+ * Compares the cost of an instrumented scope that looks up the current thread's channel through the api with one that reads
+ * the channel from the thread state the loader maintains, which is what qu::ScopedActivity and the macros do by default.
+ */
+void RunChannelLookupBenchmark();
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceJsonBenchmark.h"
+#include "Benchmark.h"
+#include <TraceJsonWriter.h>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static constexpr uint64_t EVENTS = 2000000;
+static constexpr quUInt64 START_TIMESTAMP = 1000000;
+#if defined( _WIN32 )
+static constexpr const char* NULL_DEVICE = "NUL";
+#else
+static constexpr const char* NULL_DEVICE = "/dev/null";
+#endif
+
+//The Google trace writer as it was before it encoded events straight into its buffer, copied from the tree before that change.
+//Only AddActivity takes the recurring activity it now receives, which it ignores.
+class NaiveTraceJsonWriter : public qut::TraceWriter
+{
+public:
+	NaiveTraceJsonWriter( FILE* file, quUInt64 startTimestamp );
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override;
+	void AddActivity( quActivityChannelID channelID, quRecurringActivityID recurringActivityID, std::string_view name, quUInt64 startTimestamp, quUInt64 duration, const qut::TraceArg* args, quUInt32 argCount, bool unfinished ) override;
+	void AddCounterValue( std::string_view counterName, quUInt64 timestamp, double value ) override;
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override;
+	bool Finish() override;
+
+private:
+	static constexpr size_t BUFFER_FLUSH_SIZE = 1 << 20;
+
+	void BeginEvent( std::string_view name, char phase );
+	void EndEvent();
+	void WriteString( std::string_view text );
+	void WriteInteger( quInt64 value );
+	void WriteDouble( double value );
+	//Google traces take microseconds, which are written with the nanoseconds as three decimals.
+	void WriteMicros( quInt64 nanos );
+	void Flush();
+
+	FILE* file;
+	quUInt64 startTimestamp;
+	std::string buffer;
+	bool firstEvent = true;
+	bool failed = false;
+};
+
+NaiveTraceJsonWriter::NaiveTraceJsonWriter( FILE* file, quUInt64 startTimestamp ) :
+    file( file ),
+    startTimestamp( startTimestamp )
+{
+	buffer.reserve( BUFFER_FLUSH_SIZE + 4096 );
+	buffer += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+}
+
+void NaiveTraceJsonWriter::NameChannel( quActivityChannelID channelID, std::string_view name )
+{
+	BeginEvent( "thread_name", 'M' );
+	buffer += ",\"tid\":";
+	WriteInteger( channelID );
+	buffer += ",\"args\":{\"name\":";
+	WriteString( name );
+	buffer += '}';
+	EndEvent();
+}
+void NaiveTraceJsonWriter::AddActivity( quActivityChannelID channelID, quRecurringActivityID, std::string_view name, quUInt64 startTimestamp, quUInt64 duration, const qut::TraceArg* args, quUInt32 argCount, bool unfinished )
+{
+	BeginEvent( name, 'X' );
+	buffer += ",\"tid\":";
+	WriteInteger( channelID );
+	buffer += ",\"ts\":";
+	WriteMicros( quInt64( startTimestamp - this->startTimestamp ) );
+	buffer += ",\"dur\":";
+	WriteMicros( quInt64( duration ) );
+	if( argCount != 0 || unfinished )
+	{
+		buffer += ",\"args\":{";
+		for( quUInt32 i = 0; i < argCount; ++i )
+		{
+			if( i != 0 )
+				buffer += ',';
+			WriteString( args[ i ].key );
+			buffer += ':';
+			switch( args[ i ].type )
+			{
+			case QU_ACTIVITY_ARG_INT64:
+				WriteInteger( args[ i ].int64Value );
+				break;
+			case QU_ACTIVITY_ARG_UINT64:
+			{
+				char digits[ 24 ];
+				buffer.append( digits, std::to_chars( digits, digits + sizeof( digits ), args[ i ].uint64Value ).ptr );
+				break;
+			}
+			default:
+				WriteDouble( args[ i ].doubleValue );
+				break;
+			}
+		}
+		if( unfinished )
+			buffer += argCount != 0 ? ",\"unfinished\":true" : "\"unfinished\":true";
+		buffer += '}';
+	}
+	EndEvent();
+}
+void NaiveTraceJsonWriter::AddCounterValue( std::string_view counterName, quUInt64 timestamp, double value )
+{
+	BeginEvent( counterName, 'C' );
+	buffer += ",\"ts\":";
+	WriteMicros( quInt64( timestamp - startTimestamp ) );
+	buffer += ",\"args\":{\"value\":";
+	WriteDouble( value );
+	buffer += '}';
+	EndEvent();
+}
+void NaiveTraceJsonWriter::AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp )
+{
+	BeginEvent( name, 'i' );
+	buffer += ",\"s\":\"t\",\"tid\":";
+	WriteInteger( channelID );
+	buffer += ",\"ts\":";
+	WriteMicros( quInt64( timestamp - startTimestamp ) );
+	EndEvent();
+}
+bool NaiveTraceJsonWriter::Finish()
+{
+	buffer += "]}\n";
+	Flush();
+	failed |= fflush( file ) != 0;
+	return !failed;
+}
+
+void NaiveTraceJsonWriter::BeginEvent( std::string_view name, char phase )
+{
+	buffer += firstEvent ? "\n{\"name\":" : ",\n{\"name\":";
+	firstEvent = false;
+	WriteString( name );
+	buffer += ",\"ph\":\"";
+	buffer += phase;
+	buffer += "\",\"pid\":1";
+}
+void NaiveTraceJsonWriter::EndEvent()
+{
+	buffer += '}';
+	if( buffer.size() >= BUFFER_FLUSH_SIZE )
+		Flush();
+}
+void NaiveTraceJsonWriter::WriteString( std::string_view text )
+{
+	static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+	buffer += '"';
+	for( char c : text )
+	{
+		if( c == '"' || c == '\\' )
+		{
+			buffer += '\\';
+			buffer += c;
+		}
+		else if( (unsigned char)c < 0x20 )
+		{
+			buffer += "\\u00";
+			buffer += HEX_DIGITS[ ( c >> 4 ) & 0xF ];
+			buffer += HEX_DIGITS[ c & 0xF ];
+		}
+		else
+			buffer += c;
+	}
+	buffer += '"';
+}
+void NaiveTraceJsonWriter::WriteInteger( quInt64 value )
+{
+	char digits[ 24 ];
+	buffer.append( digits, std::to_chars( digits, digits + sizeof( digits ), value ).ptr );
+}
+void NaiveTraceJsonWriter::WriteDouble( double value )
+{
+	//JSON has no representation for infinities and NaN.
+	if( value != value || value - value != 0.0 )
+	{
+		buffer += "null";
+		return;
+	}
+
+	char digits[ 32 ];
+	buffer.append( digits, std::to_chars( digits, digits + sizeof( digits ), value ).ptr );
+}
+void NaiveTraceJsonWriter::WriteMicros( quInt64 nanos )
+{
+	if( nanos < 0 )
+	{
+		buffer += '-';
+		nanos = -nanos;
+	}
+	WriteInteger( nanos / 1000 );
+	quInt64 fraction = nanos % 1000;
+	buffer += '.';
+	buffer += char( '0' + fraction / 100 );
+	buffer += char( '0' + fraction / 10 % 10 );
+	buffer += char( '0' + fraction % 10 );
+}
+void NaiveTraceJsonWriter::Flush()
+{
+	if( !failed && !buffer.empty() )
+		failed = fwrite( buffer.data(), 1, buffer.size(), file ) != buffer.size();
+	buffer.clear();
+}
+
+//Mimics a frame loop: nested recurring activities with an occasional annotation, a counter and a named activity now and then.
+//The first marker precedes the start of the trace, as events recorded just before an output was set up do.
+static void WriteEvents( qut::TraceWriter& writer, uint64_t eventCount )
+{
+	static constexpr std::string_view NAMES[] = { "Frame", "Update", "Physics", "Broadphase collision detection", "Animation", "Render", "Cull", "Submit draw calls" };
+	static constexpr quUInt32 NAME_COUNT = sizeof( NAMES ) / sizeof( NAMES[0] );
+
+	qut::TraceArg args[ 3 ];
+	args[0].key = "bytes";
+	args[0].type = QU_ACTIVITY_ARG_INT64;
+	args[1].key = "load factor";
+	args[1].type = QU_ACTIVITY_ARG_DOUBLE;
+	args[2].key = "frame hash";
+	args[2].type = QU_ACTIVITY_ARG_UINT64;
+
+	writer.NameChannel( 1, "Main thread" );
+	writer.AddMarker( 1, "Output set up", START_TIMESTAMP - 2500 );
+	quUInt64 timestamp = START_TIMESTAMP;
+	for( uint64_t i = 0; i < eventCount; ++i )
+	{
+		timestamp += 1 + i % 4000;
+		if( i % 16 == 15 )
+			writer.AddCounterValue( "Memory usage", timestamp, double( i % 1000 ) * 0.25 );
+		else if( i % 64 == 7 )
+			writer.AddActivity( 1, QU_INVALID_RECURRING_ACTIVITY_ID, "Load \"level.bin\"", timestamp, 250000 + i % 3000, nullptr, 0, false );
+		else
+		{
+			args[0].int64Value = quInt64( i * 64 );
+			args[1].doubleValue = double( i % 100 ) / 128.0;
+			args[2].uint64Value = i * 0x9E3779B97F4A7C15ull;
+			quUInt32 argCount = i % 8 == 0 ? 3 : 0;
+			quRecurringActivityID recurringActivityID = quRecurringActivityID( i % NAME_COUNT );
+			writer.AddActivity( 1, recurringActivityID, NAMES[ recurringActivityID ], timestamp, 1000 + i % 50000, args, argCount, false );
+		}
+	}
+	writer.Finish();
+}
+
+//Returns whether both writers produce the same trace, which makes the comparison between them a fair one.
+static bool WritersAgree( uint64_t eventCount )
+{
+	std::string traces[ 2 ];
+	for( std::string& trace : traces )
+	{
+		FILE* file = tmpfile();
+		if( file == nullptr )
+			return false;
+		if( &trace == &traces[0] )
+		{
+			NaiveTraceJsonWriter writer( file, START_TIMESTAMP );
+			WriteEvents( writer, eventCount );
+		}
+		else
+		{
+			qut::TraceJsonWriter writer( file, START_TIMESTAMP );
+			WriteEvents( writer, eventCount );
+		}
+
+		rewind( file );
+		char block[ 4096 ];
+		size_t bytes;
+		while( ( bytes = fread( block, 1, sizeof( block ), file ) ) != 0 )
+			trace.append( block, bytes );
+		fclose( file );
+	}
+	return !traces[0].empty() && traces[0] == traces[1];
+}
+
+void RunTraceJsonBenchmark()
+{
+	std::cout << "Google trace writing, events per second:" << std::endl;
+
+	if( !WritersAgree( EVENTS / 8 ) )
+	{
+		std::cout << "  The writers produce different traces, not measuring them." << std::endl;
+		return;
+	}
+
+	FILE* file = fopen( NULL_DEVICE, "wb" );
+	if( file == nullptr )
+	{
+		std::cout << "  Failed to open " << NULL_DEVICE << "." << std::endl;
+		return;
+	}
+
+	double naiveNanos = Benchmark::NanosPerIteration( EVENTS, [ & ]( uint64_t iterations ) {
+		NaiveTraceJsonWriter writer( file, START_TIMESTAMP );
+		WriteEvents( writer, iterations );
+	} );
+	double writerNanos = Benchmark::NanosPerIteration( EVENTS, [ & ]( uint64_t iterations ) {
+		qut::TraceJsonWriter writer( file, START_TIMESTAMP );
+		WriteEvents( writer, iterations );
+	} );
+	fclose( file );
+
+	Benchmark::ReportRate( "Naive writer, appending to a string (before)", naiveNanos );
+	Benchmark::ReportRate( "qut::TraceJsonWriter (after)", writerNanos );
+}
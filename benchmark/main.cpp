@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ChannelLookupBenchmark.h"
+#if defined( QU_API_BENCHMARK_TRACE_TOOLS )
+#	include "TraceJsonBenchmark.h"
+#endif
+#include <quApi.hpp>
+#include <iostream>
+
+/**
+ * Measures the overhead instrumentation adds to the application. The results depend a lot on whether the QuApi runtime could be
+ * loaded and on which outputs are running, so both are reported along with the numbers. Without a runtime the numbers show the
+ * cost instrumentation has in applications that are shipped with it enabled. Passing a file name records to a trace output in
+ * that file while measuring, without it nothing is recorded. Builds that include the trace tools measure their trace writers too.
+ */
+int main( int argc, const char* argv[] )
+{
+	bool initialized = quInitialize( QU_VERSION, nullptr ) != 0;
+	std::cout << "QuApi runtime " << ( initialized ? "loaded" : "not available, measuring the cost of inactive instrumentation" ) << "." << std::endl;
+	if( initialized && argc > 1 )
+		quSetupGoogleTraceOutput( argv[1], true );
+	std::cout << "Recording " << ( qu::IsRecording() ? "active" : "inactive" ) << "." << std::endl;
+
+	RunChannelLookupBenchmark();
+#if defined( QU_API_BENCHMARK_TRACE_TOOLS )
+	RunTraceJsonBenchmark();
+#endif
+
+	quRelease();
+	return 0;
+}
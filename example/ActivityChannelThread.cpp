@@ -24,17 +24,23 @@ static std::mt19937 gen( rd() );
 static std::uniform_real_distribution< float > dis( 0.0f, 1.0f );
 
 //When at all possible you should predefine recurring activities. These activities take up less
-//processing power as well as less network bandwidth and trace storage. You dont have to declare them
-//globally. You could use QU_DECLARE_ACTIVITY or QU_DECLARE_SCOPED_ACTIVITY to have a static
-//activity id declared in a function. The easiest way to instrument a function is use a
-//QU_INSTRUMENT_FUNCTION at the start of the function. This will automatically use the function's signature
-//as the activity's name and add the activity to the channel for the thread that the function is called from.
-static std::array< quRecurringActivityID, 5 > RECURRING_ACTIVITY_IDS = {
-	quAddRecurringActivity( "Stack 0", 0 ),
-	quAddRecurringActivity( "Stack 1", 0 ),
-	quAddRecurringActivity( "Stack 2", 0 ),
-	quAddRecurringActivity( "Stack 3", 0 ),
-	quAddRecurringActivity( "Stack 4", 0 )
+//processing power as well as less network bandwidth and trace storage. QU_DECLARE_ACTIVITY_DESCRIPTOR declares
+//the activity at compile time, the loader registers all of them at once when the api is initialized.
+//You dont have to declare them globally, you could also declare them inside of a function.
+//The easiest way to instrument a function is use a QU_INSTRUMENT_FUNCTION at the start of the function.
+//This will automatically use the function's signature as the activity's name and add the activity to
+//the channel for the thread that the function is called from.
+QU_DECLARE_ACTIVITY_DESCRIPTOR( STACK_0_ACTIVITY, "Stack 0" );
+QU_DECLARE_ACTIVITY_DESCRIPTOR( STACK_1_ACTIVITY, "Stack 1" );
+QU_DECLARE_ACTIVITY_DESCRIPTOR( STACK_2_ACTIVITY, "Stack 2" );
+QU_DECLARE_ACTIVITY_DESCRIPTOR( STACK_3_ACTIVITY, "Stack 3" );
+QU_DECLARE_ACTIVITY_DESCRIPTOR( STACK_4_ACTIVITY, "Stack 4" );
+static std::array< quActivityDescriptor*, 5 > RECURRING_ACTIVITIES = {
+	&STACK_0_ACTIVITY,
+	&STACK_1_ACTIVITY,
+	&STACK_2_ACTIVITY,
+	&STACK_3_ACTIVITY,
+	&STACK_4_ACTIVITY
 };
 
 ActivityChannelThread::ActivityChannelThread( const std::u8string& threadName, uint32_t loopWaitMS ) :
@@ -69,10 +75,10 @@ void ActivityChannelThread::ThreadRun()
 			}
 		}
 
-		if( activeActivities.size() < RECURRING_ACTIVITY_IDS.size() )
+		if( activeActivities.size() < RECURRING_ACTIVITIES.size() )
 		{
 			if( dis( gen ) < 0.9f )
-				activeActivities.push_back( quStartRecurringActivity( activityChannel.GetID(), RECURRING_ACTIVITY_IDS[ activeActivities.size() ] ) );
+				activeActivities.push_back( quStartRecurringActivity( activityChannel.GetID(), qu::GetRecurringActivityID( *RECURRING_ACTIVITIES[ activeActivities.size() ] ) ) );
 		}
 		if( loopWaitMS != 0 )
 		{
@@ -90,10 +90,10 @@ quFlowID flowID = QU_INVALID_FLOW_ID;
 void IOThread_ReadFile()
 {
 	QU_INSTRUMENT_FUNCTION();
-	flowID = quStartFlow( quGetChannelIDForCurrentThread() );
+	flowID = quStartFlow( qu::GetChannelIDForCurrentThread() );
 }
 void TaskThread_ExecuteTask()
 {
 	QU_INSTRUMENT_FUNCTION();
-	quStopFlow( flowID, quGetChannelIDForCurrentThread() );
+	quStopFlow( flowID, qu::GetChannelIDForCurrentThread() );
 }
@@ -107,6 +107,13 @@ void UpdatePlayer( int playerIndex )
 	//After that we can use those IDs freely, bypassing all the repeated processing.
 	qu::ScopedActivity activity2( ACTIVITY_IDS[ playerIndex ] );
 	//... do update work.
+
+
+	//When you can't know the names up front, declare a single activity whose name is a template instead. The arguments
+	//are recorded as they are and only formatted into the name when the profile is viewed, without allocating anything here.
+	QU_DECLARE_ACTIVITY_DESCRIPTOR( UPDATING_PLAYER, "Updating player #{}" );
+	qu::ScopedActivity activity3( UPDATING_PLAYER, { playerIndex } );
+	//... do update work.
 }
 
 
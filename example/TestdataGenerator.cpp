@@ -28,9 +28,9 @@ static std::uniform_real_distribution< float > markerDistribution( 300.0f, 4000.
 TestdataGenerator::TimePoint TestdataGenerator::applicationStartTime = TestdataGenerator::Clock::now();
 
 TestdataGenerator::TestdataGenerator() :
-    sineWave( u8"Sine Wave", false ),
-    saw( u8"Sawtooth", false ),
-    saw100( u8"Saw 100", false )
+    sineWave( u8"Sine Wave", COUNTER_PERIOD_MICROS, [] { return sinf( GetSecondsSinceStart() * 2.0f * 3.1415f ); }, false ),
+    saw( u8"Sawtooth", COUNTER_PERIOD_MICROS, [] { return fmodf( GetSecondsSinceStart(), 1.0f ); }, false ),
+    saw100( u8"Saw 100", COUNTER_PERIOD_MICROS, [] { return fmodf( GetSecondsSinceStart() * 100.0f, 100.0f ); }, false )
 {
 }
 TestdataGenerator::~TestdataGenerator() = default;
@@ -44,19 +44,8 @@ void TestdataGenerator::Run()
 		while( generating.load() )
 		{
 			TimePoint timeNow = Clock::now();
-			auto nanosSinceStart = std::chrono::duration_cast< std::chrono::nanoseconds >( timeNow - applicationStartTime ).count();
-			//We can use nanosecond precision time snapshots, but we need to be careful not to overflow any data type. So for that reason
-			//we use integer division to find seconds and then use floating point math only on the fractional part.
-			float secondsSinceStart = 0.0f;
-			secondsSinceStart += nanosSinceStart / 1000000000;
-			secondsSinceStart += ( nanosSinceStart % 1000000000 ) * 0.000000001f;
 
-			//Test counters
-			sineWave.SetValue( sinf( secondsSinceStart * 2.0f * 3.1415f ) );
-			saw.SetValue( fmodf( secondsSinceStart, 1.0f ) );
-			saw100.SetValue( fmodf( secondsSinceStart * 100.0f, 100.0f ) );
-
-			//Test markers
+			//Test markers, the test counters are polled by the loader.
 			if( timeNow > timeOfNextMark )
 			{
 				quAddMarker( "Test Marker" );
@@ -96,6 +85,16 @@ void TestdataGenerator::Stop()
 	highFrequencyActivityThread.reset();
 }
 
+float TestdataGenerator::GetSecondsSinceStart()
+{
+	auto nanosSinceStart = std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - applicationStartTime ).count();
+	//We can use nanosecond precision time snapshots, but we need to be careful not to overflow any data type. So for that reason
+	//we use integer division to find seconds and then use floating point math only on the fractional part.
+	float secondsSinceStart = 0.0f;
+	secondsSinceStart += nanosSinceStart / 1000000000;
+	secondsSinceStart += ( nanosSinceStart % 1000000000 ) * 0.000000001f;
+	return secondsSinceStart;
+}
 TestdataGenerator::TimePoint TestdataGenerator::GetNextMarkerTime()
 {
 	return Clock::now() + std::chrono::milliseconds( (int64_t)markerDistribution( gen ) );
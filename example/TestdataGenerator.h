@@ -37,17 +37,19 @@ private:
 	using Clock = std::chrono::steady_clock;
 	using TimePoint = Clock::time_point;
 
+	static constexpr quUInt32 COUNTER_PERIOD_MICROS = 10000;
 	static TimePoint applicationStartTime;
 
 	void Start();
 	void Stop();
 
+	static float GetSecondsSinceStart();
 	TimePoint GetNextMarkerTime();
 
 	//Counter test data
-	qu::ScopedCounter sineWave;
-	qu::ScopedCounter saw;
-	qu::ScopedCounter saw100;
+	qu::ScopedPolledCounter sineWave;
+	qu::ScopedPolledCounter saw;
+	qu::ScopedPolledCounter saw100;
 
 	//Activity test data
 	std::unique_ptr< ActivityChannelThread > lowFrequencyActivityThread;
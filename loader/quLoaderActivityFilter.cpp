@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderActivityFilter.h"
+#include "quLoaderSharedState.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qul
+{
+
+static constexpr quRecurringActivityID MAX_FILTERED_ACTIVITIES = 1 << 16; //!< Recurring activity ids are handed out in order, so this limits the size of the filter table.
+static constexpr quUInt64 REPORT_CHECK_INTERVAL = 64;                     //!< Number of filtered activities after which we check whether the counters are due.
+static constexpr quUInt64 REPORT_INTERVAL_NANOS = 100000000;              //!< Minimum time between updates of the counters.
+static constexpr quUInt32 COUNTS_PER_PAGE = 1024;                         //!< Start counts are allocated in pages, most threads only start a few activities.
+static constexpr quUInt32 STARTS_PER_TIMING = 256;                        //!< Only one in this many counted starts is timed.
+
+struct Filter
+{
+	std::atomic< quUInt32 > sampleInterval;   //!< Only every sampleInterval-th start is recorded, 0 and 1 record every start.
+	std::atomic< quUInt64 > minDurationNanos; //!< Activities that are shorter are dropped, 0 keeps all of them.
+	std::atomic< quUInt32 > throttleInterval; //!< Sample interval the Governor imposes on top of sampleInterval.
+};
+struct FilterTable
+{
+	quRecurringActivityID capacity;
+	std::unique_ptr< Filter[] > filters;
+};
+
+//Only written by the thread it belongs to, read by the Governor.
+struct ThreadStartCounts
+{
+	std::atomic< quUInt64* > pages[ MAX_FILTERED_ACTIVITIES / COUNTS_PER_PAGE ]; //!< Number of starts indexed by recurring activity id, accessed atomically.
+	quUInt64 timedStarts;                                                     //!< Accessed atomically.
+	quUInt64 timedNanos;                                                      //!< Total time the timed starts took, accessed atomically.
+	quUInt32 startsUntilTiming;
+
+	~ThreadStartCounts()
+	{
+		for( std::atomic< quUInt64* >& page : pages )
+			delete[] page.load();
+	}
+};
+
+static quDispatchTable runtime;                                       //!< The runtime's own entries, used to add and set the counters.
+static quStartRecurringActivity_Ptr startRecurringActivity = nullptr; //!< The entry we're filtering for.
+static quStartFormattedActivity_Ptr startFormattedActivity = nullptr; //!< Formatted activities are recurring activities as well.
+static std::mutex filtersMutex;                                       //!< Guards changing filters and the counters.
+static std::atomic< FilterTable* > filterTable = nullptr;             //!< Table indexed by recurring activity id, replaced by a larger copy when needed.
+static std::vector< std::unique_ptr< FilterTable > > allTables;       //!< Every table ever published, other threads may still be reading any of them.
+static quCounterID sampledOutCounterID = QU_INVALID_COUNTER_ID;
+static quCounterID belowMinDurationCounterID = QU_INVALID_COUNTER_ID;
+static std::atomic< quUInt64 > sampledOutCount = 0;
+static std::atomic< quUInt64 > belowMinDurationCount = 0;
+static quUInt64 reportedSampledOutCount = 0;
+static quUInt64 reportedBelowMinDurationCount = 0;
+static std::atomic< quUInt64 > nextReportNanos = 0;
+
+static std::atomic< bool > countingStarts = false;
+static std::mutex startCountsMutex;                         //!< Guards threadStartCounts and the counts of exited threads.
+static std::vector< ThreadStartCounts* > threadStartCounts; //!< Start counts of every running thread that started a recurring activity.
+static std::vector< quUInt64 > exitedStartCounts;           //!< Sum of the start counts of threads that exited.
+static quUInt64 exitedTimedStarts = 0;
+static quUInt64 exitedTimedNanos = 0;
+
+static thread_local std::vector< quUInt32 > sampleCounters; //!< Number of times the current thread started each activity, indexed by recurring activity id.
+
+//Adds the start counts of a thread to those of exited threads when it exits.
+struct ThreadStartCountsCleanup
+{
+	ThreadStartCounts* counts = nullptr;
+
+	~ThreadStartCountsCleanup()
+	{
+		if( counts == nullptr )
+			return;
+
+		std::lock_guard lock( startCountsMutex );
+		threadStartCounts.erase( std::find( threadStartCounts.begin(), threadStartCounts.end(), counts ) );
+		for( quUInt32 pageIndex = 0; pageIndex < std::size( counts->pages ); ++pageIndex )
+		{
+			const quUInt64* page = counts->pages[ pageIndex ].load();
+			if( page == nullptr )
+				continue;
+
+			exitedStartCounts.resize( std::max< size_t >( exitedStartCounts.size(), ( pageIndex + 1 ) * COUNTS_PER_PAGE ), 0 );
+			for( quUInt32 i = 0; i < COUNTS_PER_PAGE; ++i )
+				exitedStartCounts[ pageIndex * COUNTS_PER_PAGE + i ] += page[ i ];
+		}
+		exitedTimedStarts += counts->timedStarts;
+		exitedTimedNanos += counts->timedNanos;
+		delete counts;
+	}
+};
+static thread_local ThreadStartCountsCleanup threadStartCountsCleanup;
+
+static ThreadStartCounts& GetThreadStartCounts()
+{
+	if( threadStartCountsCleanup.counts != nullptr )
+		return *threadStartCountsCleanup.counts;
+
+	ThreadStartCounts* counts = new ThreadStartCounts();
+	counts->startsUntilTiming = STARTS_PER_TIMING;
+	{
+		std::lock_guard lock( startCountsMutex );
+		threadStartCounts.push_back( counts );
+	}
+	threadStartCountsCleanup.counts = counts;
+	return *counts;
+}
+
+static void CountStart( ThreadStartCounts& counts, quRecurringActivityID activityID )
+{
+	if( activityID >= MAX_FILTERED_ACTIVITIES )
+		return;
+
+	std::atomic< quUInt64* >& page = counts.pages[ activityID / COUNTS_PER_PAGE ];
+	quUInt64* startCounts = page.load( std::memory_order_relaxed );
+	if( startCounts == nullptr ) [[unlikely]]
+	{
+		startCounts = new quUInt64[ COUNTS_PER_PAGE ]();
+		page.store( startCounts, std::memory_order_release );
+	}
+	std::atomic_ref< quUInt64 > startCount( startCounts[ activityID % COUNTS_PER_PAGE ] );
+	startCount.store( startCount.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+static const Filter* FindFilter( quRecurringActivityID activityID )
+{
+	const FilterTable* table = filterTable.load( std::memory_order_acquire );
+	if( table == nullptr || activityID >= table->capacity )
+		return nullptr;
+
+	return &table->filters[ activityID ];
+}
+
+static quUInt64 GetNanos()
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void OnFiltered( std::atomic< quUInt64 >& count )
+{
+	if( ( count.fetch_add( 1, std::memory_order_relaxed ) + 1 ) % REPORT_CHECK_INTERVAL != 0 )
+		return;
+
+	if( GetNanos() >= nextReportNanos.load( std::memory_order_relaxed ) )
+		ActivityFilter::ReportFilteredCounts();
+}
+
+//Hot path
+//Counts the start and decides whether it's sampled out. counts is set while starts are counted.
+static bool IsSampledOut( quRecurringActivityID activityID, ThreadStartCounts*& counts )
+{
+	if( countingStarts.load( std::memory_order_relaxed ) )
+	{
+		counts = &GetThreadStartCounts();
+		CountStart( *counts, activityID );
+	}
+
+	const Filter* filter = FindFilter( activityID );
+	quUInt32 sampleInterval = 0;
+	if( filter != nullptr )
+		sampleInterval = std::max( filter->sampleInterval.load( std::memory_order_relaxed ), filter->throttleInterval.load( std::memory_order_relaxed ) );
+	if( sampleInterval <= 1 )
+		return false;
+
+	if( activityID >= sampleCounters.size() )
+		sampleCounters.resize( activityID + 1, 0 );
+
+	//Sampled out activities are never started, so there is nothing to stop either.
+	if( sampleInterval == ActivityFilter::DISABLED_INTERVAL || sampleCounters[ activityID ]++ % sampleInterval != 0 )
+	{
+		OnFiltered( sampledOutCount );
+		return true;
+	}
+	return false;
+}
+template< typename Start >
+static quActivityID TimedStart( ThreadStartCounts* counts, Start&& start )
+{
+	if( counts == nullptr || --counts->startsUntilTiming != 0 )
+		return start();
+
+	//Stopping goes through the same path as starting, so this is what half of every recorded activity costs.
+	auto begin = std::chrono::steady_clock::now();
+	quActivityID startedActivityID = start();
+	quUInt64 nanos = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - begin ).count();
+	counts->startsUntilTiming = STARTS_PER_TIMING;
+	std::atomic_ref< quUInt64 >( counts->timedNanos ).store( counts->timedNanos + nanos, std::memory_order_relaxed );
+	std::atomic_ref< quUInt64 >( counts->timedStarts ).store( counts->timedStarts + 1, std::memory_order_relaxed );
+	return startedActivityID;
+}
+static quActivityID QU_CALL_CONV SampledStartRecurringActivity( quActivityChannelID channelID, quRecurringActivityID activityID )
+{
+	ThreadStartCounts* counts = nullptr;
+	if( IsSampledOut( activityID, counts ) )
+		return QU_INVALID_ACTIVITY_ID;
+
+	return TimedStart( counts, [ & ] { return startRecurringActivity( channelID, activityID ); } );
+}
+//The descriptor was registered before the call, so its id can be filtered like any other.
+static quActivityID QU_CALL_CONV SampledStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount )
+{
+	ThreadStartCounts* counts = nullptr;
+	if( IsSampledOut( std::atomic_ref< quRecurringActivityID >( descriptor->id ).load( std::memory_order_relaxed ), counts ) )
+		return QU_INVALID_ACTIVITY_ID;
+
+	return TimedStart( counts, [ & ] { return startFormattedActivity( channelID, descriptor, args, argCount ); } );
+}
+
+//Must be called with filtersMutex locked.
+static Filter* GetOrAddFilter( quRecurringActivityID activityID )
+{
+	FilterTable* table = filterTable.load( std::memory_order_relaxed );
+	if( table != nullptr && activityID < table->capacity )
+		return &table->filters[ activityID ];
+
+	//Published tables are never changed in size, so the filters are copied into a larger one.
+	auto newTable = std::make_unique< FilterTable >();
+	newTable->capacity = std::min( std::max< quRecurringActivityID >( activityID + 1, table != nullptr ? table->capacity * 2 : 64 ), MAX_FILTERED_ACTIVITIES );
+	newTable->filters = std::make_unique< Filter[] >( newTable->capacity );
+	for( quRecurringActivityID i = 0; i < newTable->capacity; ++i )
+	{
+		bool copy = table != nullptr && i < table->capacity;
+		newTable->filters[ i ].sampleInterval = copy ? table->filters[ i ].sampleInterval.load() : 0;
+		newTable->filters[ i ].minDurationNanos = copy ? table->filters[ i ].minDurationNanos.load() : 0;
+		newTable->filters[ i ].throttleInterval = copy ? table->filters[ i ].throttleInterval.load() : 0;
+	}
+	filterTable.store( newTable.get(), std::memory_order_release );
+	allTables.push_back( std::move( newTable ) );
+	return &allTables.back()->filters[ activityID ];
+}
+
+//Must be called with filtersMutex locked.
+static void UpdateFiltering()
+{
+	//Starts are counted by the loader, so they have to pass through it as well.
+	bool filtering = countingStarts;
+	if( const FilterTable* table = filterTable.load( std::memory_order_relaxed ) )
+	{
+		for( quRecurringActivityID i = 0; i < table->capacity && !filtering; ++i )
+			filtering = table->filters[ i ].sampleInterval > 1 || table->filters[ i ].minDurationNanos != 0 || table->filters[ i ].throttleInterval > 1;
+	}
+	SharedState::SetFiltering( filtering );
+}
+
+void ActivityFilter::Install( quDispatchTable& dispatch, const quDispatchTable& runtimeTable )
+{
+	std::lock_guard lock( filtersMutex );
+	runtime = runtimeTable;
+	startRecurringActivity = dispatch.StartRecurringActivity;
+	dispatch.StartRecurringActivity = &SampledStartRecurringActivity;
+	startFormattedActivity = dispatch.StartFormattedActivity;
+	dispatch.StartFormattedActivity = &SampledStartFormattedActivity;
+}
+void ActivityFilter::Detach()
+{
+	//Recurring activity ids are only valid for the runtime that handed them out, as are the counters.
+	std::lock_guard lock( filtersMutex );
+	if( FilterTable* table = filterTable.load( std::memory_order_relaxed ) )
+	{
+		for( quRecurringActivityID i = 0; i < table->capacity; ++i )
+		{
+			table->filters[ i ].sampleInterval = 0;
+			table->filters[ i ].minDurationNanos = 0;
+			table->filters[ i ].throttleInterval = 0;
+		}
+	}
+	countingStarts = false;
+	SharedState::SetFiltering( false );
+	runtime = {};
+	startRecurringActivity = nullptr;
+	startFormattedActivity = nullptr;
+	sampledOutCounterID = QU_INVALID_COUNTER_ID;
+	belowMinDurationCounterID = QU_INVALID_COUNTER_ID;
+	sampledOutCount = 0;
+	belowMinDurationCount = 0;
+	reportedSampledOutCount = 0;
+	reportedBelowMinDurationCount = 0;
+}
+
+bool ActivityFilter::SetFilter( quRecurringActivityID activityID, quUInt32 sampleInterval, quUInt64 minDurationNanos )
+{
+	if( activityID >= MAX_FILTERED_ACTIVITIES )
+		return false;
+
+	std::lock_guard lock( filtersMutex );
+	if( startRecurringActivity == nullptr )
+		return false;
+
+	Filter* filter = GetOrAddFilter( activityID );
+	filter->sampleInterval.store( sampleInterval, std::memory_order_relaxed );
+	filter->minDurationNanos.store( minDurationNanos, std::memory_order_relaxed );
+	UpdateFiltering();
+
+	if( sampleInterval > 1 && sampledOutCounterID == QU_INVALID_COUNTER_ID )
+		sampledOutCounterID = runtime.AddCounter( "Sampled out activities", 0 );
+	if( minDurationNanos != 0 && belowMinDurationCounterID == QU_INVALID_COUNTER_ID )
+		belowMinDurationCounterID = runtime.AddCounter( "Activities below minimum duration", 0 );
+	return true;
+}
+quUInt64 ActivityFilter::GetMinDuration( quRecurringActivityID activityID )
+{
+	const Filter* filter = FindFilter( activityID );
+	return filter != nullptr ? filter->minDurationNanos.load( std::memory_order_relaxed ) : 0;
+}
+
+void ActivityFilter::OnBelowMinDuration()
+{
+	OnFiltered( belowMinDurationCount );
+}
+void ActivityFilter::ReportFilteredCounts()
+{
+	//Whoever is reporting already will report counts that are at most a few activities behind.
+	std::unique_lock lock( filtersMutex, std::try_to_lock );
+	if( !lock.owns_lock() )
+		return;
+
+	nextReportNanos.store( GetNanos() + REPORT_INTERVAL_NANOS, std::memory_order_relaxed );
+	quUInt64 sampledOut = sampledOutCount.load( std::memory_order_relaxed );
+	quUInt64 belowMinDuration = belowMinDurationCount.load( std::memory_order_relaxed );
+	if( sampledOut != reportedSampledOutCount && sampledOutCounterID != QU_INVALID_COUNTER_ID )
+	{
+		runtime.SetCounterValue( sampledOutCounterID, (float)sampledOut );
+		reportedSampledOutCount = sampledOut;
+	}
+	if( belowMinDuration != reportedBelowMinDurationCount && belowMinDurationCounterID != QU_INVALID_COUNTER_ID )
+	{
+		runtime.SetCounterValue( belowMinDurationCounterID, (float)belowMinDuration );
+		reportedBelowMinDurationCount = belowMinDuration;
+	}
+}
+
+void ActivityFilter::SetThrottle( quRecurringActivityID activityID, quUInt32 throttleInterval )
+{
+	if( activityID >= MAX_FILTERED_ACTIVITIES )
+		return;
+
+	std::lock_guard lock( filtersMutex );
+	if( startRecurringActivity == nullptr )
+		return;
+
+	GetOrAddFilter( activityID )->throttleInterval.store( throttleInterval, std::memory_order_relaxed );
+	UpdateFiltering();
+	if( throttleInterval > 1 && sampledOutCounterID == QU_INVALID_COUNTER_ID )
+		sampledOutCounterID = runtime.AddCounter( "Sampled out activities", 0 );
+}
+quUInt32 ActivityFilter::GetThrottle( quRecurringActivityID activityID )
+{
+	const Filter* filter = FindFilter( activityID );
+	return filter != nullptr ? filter->throttleInterval.load( std::memory_order_relaxed ) : 0;
+}
+
+void ActivityFilter::SetCountingStarts( bool counting )
+{
+	std::lock_guard lock( filtersMutex );
+	countingStarts = counting;
+	UpdateFiltering();
+}
+void ActivityFilter::CollectStartCounts( std::vector< quUInt64 >& startCounts )
+{
+	std::lock_guard lock( startCountsMutex );
+	startCounts.resize( std::max( startCounts.size(), exitedStartCounts.size() ), 0 );
+	for( size_t i = 0; i < exitedStartCounts.size(); ++i )
+		startCounts[ i ] += exitedStartCounts[ i ];
+
+	for( const ThreadStartCounts* counts : threadStartCounts )
+	{
+		for( quUInt32 pageIndex = 0; pageIndex < std::size( counts->pages ); ++pageIndex )
+		{
+			quUInt64* page = counts->pages[ pageIndex ].load( std::memory_order_acquire );
+			if( page == nullptr )
+				continue;
+
+			startCounts.resize( std::max< size_t >( startCounts.size(), ( pageIndex + 1 ) * COUNTS_PER_PAGE ), 0 );
+			for( quUInt32 i = 0; i < COUNTS_PER_PAGE; ++i )
+				startCounts[ pageIndex * COUNTS_PER_PAGE + i ] += std::atomic_ref< quUInt64 >( page[ i ] ).load( std::memory_order_relaxed );
+		}
+	}
+}
+double ActivityFilter::GetAverageStartNanos()
+{
+	std::lock_guard lock( startCountsMutex );
+	quUInt64 timedStarts = exitedTimedStarts;
+	quUInt64 timedNanos = exitedTimedNanos;
+	for( ThreadStartCounts* counts : threadStartCounts )
+	{
+		timedStarts += std::atomic_ref< quUInt64 >( counts->timedStarts ).load( std::memory_order_relaxed );
+		timedNanos += std::atomic_ref< quUInt64 >( counts->timedNanos ).load( std::memory_order_relaxed );
+	}
+	return timedStarts != 0 ? double( timedNanos ) / double( timedStarts ) : 0.0;
+}
+
+} //End namespace qul
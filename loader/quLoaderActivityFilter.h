@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+#include <vector>
+
+namespace qul
+{
+
+/**
+ * Filters recurring activities before they reach the runtime. Sampled activities are only started every sampleInterval-th time
+ * on each thread, the others are never started at all. Activities with a minimum duration are held back by EventStaging until
+ * they stop, and are dropped along with their stop if they turned out shorter. Either way the runtime only sees the activities
+ * nested in a filtered one, so those end up in the activity the filtered one was started in.
+ * The number of filtered activities is recorded in two counters that are added the first time a filter is set.
+ * While the Governor runs, starts are also counted per thread and every STARTS_PER_TIMING-th start of a thread is timed, which
+ * gives the Governor both how often each activity is started and what that costs.
+ */
+class ActivityFilter
+{
+public:
+	//Routes starting recurring and formatted activities through sampling. The counters are set through the runtime's own table, so that they
+	//can be set while EventStaging is flushing.
+	static void Install( quDispatchTable& dispatch, const quDispatchTable& runtimeTable );
+	static void Detach();
+
+	static bool SetFilter( quRecurringActivityID activityID, quUInt32 sampleInterval, quUInt64 minDurationNanos );
+	//Returns 0 for activities without a minimum duration.
+	static quUInt64 GetMinDuration( quRecurringActivityID activityID );
+
+	static void OnBelowMinDuration();
+	//Sets the counters to the number of activities filtered so far, if that changed since they were last set.
+	static void ReportFilteredCounts();
+
+	//Throttled activities are sampled at the throttle interval if that's larger than their own. DISABLED_INTERVAL drops all starts.
+	static constexpr quUInt32 DISABLED_INTERVAL = ~0u;
+	static void SetThrottle( quRecurringActivityID activityID, quUInt32 throttleInterval );
+	static quUInt32 GetThrottle( quRecurringActivityID activityID );
+
+	static void SetCountingStarts( bool countingStarts );
+	//Adds the number of times each activity was started so far to startCounts, which is indexed by recurring activity id.
+	static void CollectStartCounts( std::vector< quUInt64 >& startCounts );
+	//Average time starting a recurring activity took over the timed starts, 0 if none were timed yet.
+	static double GetAverageStartNanos();
+};
+
+} //End namespace qul
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderActivityFormat.h"
+#include <charconv>
+
+namespace qul
+{
+
+static void AppendArg( std::string& name, const quActivityArg& arg )
+{
+	char buffer[ 32 ];
+	std::to_chars_result result = { buffer, std::errc() };
+	switch( arg.type )
+	{
+	case QU_ACTIVITY_ARG_INT64:
+		result = std::to_chars( buffer, buffer + sizeof( buffer ), arg.intValue );
+		break;
+	case QU_ACTIVITY_ARG_UINT64:
+		result = std::to_chars( buffer, buffer + sizeof( buffer ), arg.uintValue );
+		break;
+	case QU_ACTIVITY_ARG_DOUBLE:
+		result = std::to_chars( buffer, buffer + sizeof( buffer ), arg.doubleValue );
+		break;
+	case QU_ACTIVITY_ARG_STRING:
+		if( arg.stringValue != nullptr )
+			name += arg.stringValue;
+		return;
+	default:
+		return;
+	}
+	name.append( buffer, result.ptr );
+}
+
+void ActivityFormat::Format( std::string& name, const char* format, const quActivityArg* args, quUInt32 argCount )
+{
+	name.clear();
+	if( format == nullptr )
+		return;
+
+	quUInt32 nextArg = 0;
+	for( const char* c = format; *c != '\0'; ++c )
+	{
+		if( ( c[ 0 ] == '{' && c[ 1 ] == '{' ) || ( c[ 0 ] == '}' && c[ 1 ] == '}' ) )
+		{
+			name += *c++;
+			continue;
+		}
+		if( c[ 0 ] == '{' && c[ 1 ] == '}' && nextArg < argCount )
+		{
+			AppendArg( name, args[ nextArg++ ] );
+			++c;
+			continue;
+		}
+		name += *c;
+	}
+}
+
+} //End namespace qul
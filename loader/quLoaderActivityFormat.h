@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+#include <string>
+
+namespace qul
+{
+
+/**
+ * Formats the names of formatted activities for runtimes that can't take their arguments, see quStartFormattedActivity.
+ * Every {} in the template is replaced by the next argument, {{ and }} by a single brace. Placeholders without an argument are
+ * kept as they are and arguments without a placeholder are left out.
+ */
+class ActivityFormat
+{
+public:
+	static void Format( std::string& name, const char* format, const quActivityArg* args, quUInt32 argCount );
+};
+
+} //End namespace qul
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderActivityInterning.h"
+#include "quLoaderSharedState.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qul
+{
+
+static constexpr quUInt32 SHARD_COUNT = 16;
+
+struct InternedName
+{
+	std::atomic< quUInt64 > hash;            //!< Hash of the name and color, 0 for free slots.
+	std::atomic< const char* > name;         //!< Copy of the name, nullptr until the thread that claimed the slot wrote it.
+	quUInt32 color;                          //!< Written before name.
+	std::atomic< quRecurringActivityID > id; //!< QU_INVALID_RECURRING_ACTIVITY_ID until the name was registered.
+	std::atomic< bool > failed;              //!< Whether registering the name failed, the next lookup of it tries again.
+};
+
+struct InternTable
+{
+	quUInt32 maxNames;
+	quUInt32 slotMask;                                    //!< Number of slots minus one, the number of slots is a power of two.
+	std::atomic< quUInt32 > nameCount;                    //!< Number of slots claimed.
+	std::unique_ptr< InternedName[] > slots;              //!< slotMask + 1 slots.
+	std::unique_ptr< std::unique_ptr< char[] >[] > names; //!< Storage of the name of every slot.
+};
+
+//Statistics are counted per shard of threads, so that threads looking up names don't share cache lines.
+struct alignas( 64 ) StatsShard
+{
+	std::atomic< quUInt64 > lookups;
+	std::atomic< quUInt64 > hits;
+	std::atomic< quUInt64 > rejected;
+};
+
+static std::mutex tablesMutex;                   //!< Guards switching tables.
+static std::atomic< InternTable* > currentTable; //!< Table names are interned in, nullptr while interning is disabled.
+//Tables are never freed, other threads may still be looking up names in a table while it's replaced.
+static std::vector< std::unique_ptr< InternTable > > allTables;
+static StatsShard statsShards[ SHARD_COUNT ];
+
+static std::atomic< quUInt32 > nextShard = 0;
+static thread_local quUInt32 threadShard = nextShard.fetch_add( 1, std::memory_order_relaxed ) % SHARD_COUNT;
+
+static quUInt64 HashName( const char* activityName, quUInt32 color )
+{
+	quUInt64 hash = qu::HashActivityName( activityName ) ^ ( quUInt64( color ) * 0x9E3779B97F4A7C15ull );
+	//0 marks free slots.
+	return hash != 0 ? hash : 1;
+}
+
+//Must be called with tablesMutex locked.
+static void StartTable( quUInt32 maxNames )
+{
+	InternTable* table = nullptr;
+	if( maxNames != 0 )
+	{
+		std::unique_ptr< InternTable > newTable = std::make_unique< InternTable >();
+		newTable->maxNames = maxNames;
+		newTable->slotMask = std::bit_ceil( maxNames * 2 ) - 1;
+		newTable->nameCount.store( 0, std::memory_order_relaxed );
+		newTable->slots = std::make_unique< InternedName[] >( newTable->slotMask + 1 );
+		newTable->names = std::make_unique< std::unique_ptr< char[] >[] >( newTable->slotMask + 1 );
+		for( quUInt32 slot = 0; slot <= newTable->slotMask; ++slot )
+		{
+			newTable->slots[ slot ].id.store( QU_INVALID_RECURRING_ACTIVITY_ID, std::memory_order_relaxed );
+			newTable->slots[ slot ].failed.store( false, std::memory_order_relaxed );
+		}
+
+		table = newTable.get();
+		allTables.push_back( std::move( newTable ) );
+	}
+	currentTable.store( table, std::memory_order_release );
+	SharedState::SetInterning( table != nullptr );
+}
+
+//Reserves room for a name, so that racing threads can't exceed maxNames between them.
+static bool ReserveName( InternTable& table, StatsShard& stats )
+{
+	if( table.nameCount.fetch_add( 1, std::memory_order_relaxed ) < table.maxNames )
+		return true;
+
+	table.nameCount.fetch_sub( 1, std::memory_order_relaxed );
+	stats.rejected.fetch_add( 1, std::memory_order_relaxed );
+	return false;
+}
+
+//Registers the name of a slot this thread claimed or took the retry of. Names the runtime refused don't count against
+//maxNames, the slot keeps them so the next lookup can try again.
+static quRecurringActivityID RegisterName( InternTable& table, InternedName& internedName )
+{
+	quRecurringActivityID id = quAddRecurringActivity( internedName.name.load( std::memory_order_relaxed ), internedName.color );
+	if( id == QU_INVALID_RECURRING_ACTIVITY_ID )
+	{
+		table.nameCount.fetch_sub( 1, std::memory_order_relaxed );
+		internedName.failed.store( true, std::memory_order_release );
+		return id;
+	}
+
+	internedName.id.store( id, std::memory_order_release );
+	return id;
+}
+
+//Registers the name in a slot this thread just claimed.
+static quRecurringActivityID AddName( InternTable& table, quUInt32 slot, const char* activityName, quUInt32 color )
+{
+	size_t length = strlen( activityName );
+	std::unique_ptr< char[] >& name = table.names[ slot ];
+	name = std::make_unique< char[] >( length + 1 );
+	memcpy( name.get(), activityName, length + 1 );
+
+	InternedName& internedName = table.slots[ slot ];
+	internedName.color = color;
+	internedName.name.store( name.get(), std::memory_order_release );
+	return RegisterName( table, internedName );
+}
+
+void ActivityInterning::Detach()
+{
+	std::lock_guard lock( tablesMutex );
+	InternTable* table = currentTable.load( std::memory_order_relaxed );
+	if( table != nullptr )
+		StartTable( table->maxNames );
+}
+
+bool ActivityInterning::SetMaxNames( quUInt32 maxNames )
+{
+	if( maxNames > QU_MAX_INTERNED_ACTIVITIES )
+		return false;
+
+	std::lock_guard lock( tablesMutex );
+	for( StatsShard& shard : statsShards )
+	{
+		shard.lookups.store( 0, std::memory_order_relaxed );
+		shard.hits.store( 0, std::memory_order_relaxed );
+		shard.rejected.store( 0, std::memory_order_relaxed );
+	}
+	StartTable( maxNames );
+	return true;
+}
+
+//Hot path
+quRecurringActivityID ActivityInterning::Intern( const char* activityName, quUInt32 color )
+{
+	InternTable* table = currentTable.load( std::memory_order_acquire );
+	if( table == nullptr || activityName == nullptr )
+		return QU_INVALID_RECURRING_ACTIVITY_ID;
+
+	StatsShard& stats = statsShards[ threadShard ];
+	stats.lookups.fetch_add( 1, std::memory_order_relaxed );
+
+	quUInt64 hash = HashName( activityName, color );
+	for( quUInt32 probe = 0, slot = quUInt32( hash ) & table->slotMask; probe <= table->slotMask; ++probe, slot = ( slot + 1 ) & table->slotMask )
+	{
+		InternedName& internedName = table->slots[ slot ];
+		quUInt64 slotHash = internedName.hash.load( std::memory_order_acquire );
+		if( slotHash == 0 )
+		{
+			if( !ReserveName( *table, stats ) )
+				return QU_INVALID_RECURRING_ACTIVITY_ID;
+			if( internedName.hash.compare_exchange_strong( slotHash, hash, std::memory_order_acq_rel ) )
+				return AddName( *table, slot, activityName, color );
+
+			//Another thread claimed the slot first, it may have been for the same name.
+			table->nameCount.fetch_sub( 1, std::memory_order_relaxed );
+		}
+		if( slotHash != hash )
+			continue;
+
+		//The name is still being copied or registered by the thread that claimed the slot.
+		const char* name = internedName.name.load( std::memory_order_acquire );
+		if( name == nullptr )
+			return QU_INVALID_RECURRING_ACTIVITY_ID;
+		if( internedName.color != color || strcmp( name, activityName ) != 0 )
+			continue;
+
+		quRecurringActivityID id = internedName.id.load( std::memory_order_acquire );
+		if( id != QU_INVALID_RECURRING_ACTIVITY_ID )
+		{
+			stats.hits.fetch_add( 1, std::memory_order_relaxed );
+			return id;
+		}
+
+		//Only one of the threads looking up a name whose registration failed tries again, the others skip the activity.
+		if( !internedName.failed.load( std::memory_order_relaxed ) || !internedName.failed.exchange( false, std::memory_order_acquire ) )
+			return QU_INVALID_RECURRING_ACTIVITY_ID;
+		if( !ReserveName( *table, stats ) )
+		{
+			internedName.failed.store( true, std::memory_order_release );
+			return QU_INVALID_RECURRING_ACTIVITY_ID;
+		}
+		return RegisterName( *table, internedName );
+	}
+	return QU_INVALID_RECURRING_ACTIVITY_ID;
+}
+
+void ActivityInterning::GetStats( quActivityInterningStats& stats )
+{
+	stats = {};
+	for( const StatsShard& shard : statsShards )
+	{
+		stats.lookups += shard.lookups.load( std::memory_order_relaxed );
+		stats.hits += shard.hits.load( std::memory_order_relaxed );
+		stats.rejected += shard.rejected.load( std::memory_order_relaxed );
+	}
+
+	std::lock_guard lock( tablesMutex );
+	if( InternTable* table = currentTable.load( std::memory_order_relaxed ) )
+	{
+		stats.nameCount = std::min( table->nameCount.load( std::memory_order_relaxed ), table->maxNames );
+		stats.maxNames = table->maxNames;
+	}
+}
+
+} //End namespace qul
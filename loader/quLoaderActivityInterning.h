@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Interns dynamic activity names as recurring activities, see quSetActivityInterning. Names are kept in an open addressing table
+ * that's twice as large as the number of names it may hold, keyed by a hash of the name and its color. Looking up a name never
+ * locks: the first thread to look up a new name claims a free slot by swapping in its hash, copies the name and registers it
+ * with the runtime. Until the id is written other threads that find the slot fall back to starting the activity by name. Names the
+ * runtime refuses to register keep their slot without counting against the maximum, and the next lookup registers them again.
+ * Tables only grow, names are never removed from them, and they're never freed since other threads may be reading them.
+ */
+class ActivityInterning
+{
+public:
+	//Recurring activity ids are only valid for the runtime that handed them out, this starts over with an empty table.
+	static void Detach();
+
+	static bool SetMaxNames( quUInt32 maxNames );
+	static quRecurringActivityID Intern( const char* activityName, quUInt32 color );
+	static void GetStats( quActivityInterningStats& stats );
+};
+
+} //End namespace qul
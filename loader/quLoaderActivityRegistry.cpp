@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderActivityRegistry.h"
+#include "quLoaderSymbolizer.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+//Bounds of the activity section, the linker provides these for the binary the loader is linked into. They're weak so that
+//binaries without any descriptors in the section still link, in which case both are nullptr.
+#if defined( __APPLE__ )
+extern quActivityDescriptor activitySectionBegin[] __asm( "section$start$__DATA$qu_activities" );
+extern quActivityDescriptor activitySectionEnd[] __asm( "section$end$__DATA$qu_activities" );
+#	define QU_ACTIVITY_SECTION_BEGIN activitySectionBegin
+#	define QU_ACTIVITY_SECTION_END activitySectionEnd
+#elif defined( __ELF__ )
+extern "C" quActivityDescriptor __start_qu_activities[] __attribute__( ( weak ) );
+extern "C" quActivityDescriptor __stop_qu_activities[] __attribute__( ( weak ) );
+#	define QU_ACTIVITY_SECTION_BEGIN __start_qu_activities
+#	define QU_ACTIVITY_SECTION_END __stop_qu_activities
+#else
+#	define QU_ACTIVITY_SECTION_BEGIN nullptr
+#	define QU_ACTIVITY_SECTION_END nullptr
+#endif
+
+namespace qul
+{
+
+static std::mutex lateDescriptorsMutex;                                     //!< Guards lateDescriptors, failedDescriptors and addedNames.
+static std::unordered_set< quActivityDescriptor* > lateDescriptors;         //!< Descriptors outside of the section that received an id.
+static std::unordered_set< quActivityDescriptor* > failedDescriptors;       //!< Descriptors the current runtime didn't register, they aren't retried.
+static std::unordered_map< quRecurringActivityID, std::string > addedNames; //!< Names of the activities added without a descriptor.
+static quSetAddressResolver_Ptr setAddressResolver = nullptr;               //!< Set when the runtime resolves the addresses of descriptors itself.
+
+static const char* QU_CALL_CONV ResolveAddress( const void* address )
+{
+	return Symbolizer::Resolve( address );
+}
+
+static bool IsInSection( const quActivityDescriptor* descriptor )
+{
+	const quActivityDescriptor* sectionBegin = QU_ACTIVITY_SECTION_BEGIN;
+	const quActivityDescriptor* sectionEnd = QU_ACTIVITY_SECTION_END;
+	return sectionBegin != nullptr && descriptor >= sectionBegin && descriptor < sectionEnd;
+}
+
+static bool IsDeclared( quActivityDescriptor& descriptor )
+{
+	//Descriptors identified by address are skipped until their address is known, they're registered once they're used.
+	return descriptor.name != nullptr || std::atomic_ref< const void* >( descriptor.address ).load( std::memory_order_relaxed ) != nullptr;
+}
+static bool RegisterRun( quActivityDescriptor* descriptors, quUInt32 count, const quDispatchTable& dispatch )
+{
+	//Runtimes that can't resolve addresses themselves get the names the loader resolved instead.
+	bool anyAddresses = std::any_of( descriptors, descriptors + count, []( const quActivityDescriptor& descriptor ) { return descriptor.name == nullptr; } );
+	if( anyAddresses && setAddressResolver == nullptr )
+		return ActivityRegistry::RegisterOneByOne( descriptors, count, dispatch );
+
+	return dispatch.AddRecurringActivities( descriptors, count );
+}
+
+void ActivityRegistry::Attach( quSetAddressResolver_Ptr runtimeSetAddressResolver )
+{
+	{
+		std::lock_guard lock( lateDescriptorsMutex );
+		failedDescriptors.clear();
+	}
+
+	setAddressResolver = runtimeSetAddressResolver;
+	if( setAddressResolver != nullptr )
+		setAddressResolver( &ResolveAddress );
+}
+void ActivityRegistry::Detach()
+{
+	if( setAddressResolver != nullptr )
+		setAddressResolver( nullptr );
+	setAddressResolver = nullptr;
+	Symbolizer::Clear();
+
+	for( quActivityDescriptor* descriptor = QU_ACTIVITY_SECTION_BEGIN; descriptor < QU_ACTIVITY_SECTION_END; ++descriptor )
+		std::atomic_ref< quRecurringActivityID >( descriptor->id ).store( QU_INVALID_RECURRING_ACTIVITY_ID, std::memory_order_relaxed );
+
+	std::lock_guard lock( lateDescriptorsMutex );
+	for( quActivityDescriptor* descriptor : lateDescriptors )
+		std::atomic_ref< quRecurringActivityID >( descriptor->id ).store( QU_INVALID_RECURRING_ACTIVITY_ID, std::memory_order_relaxed );
+	lateDescriptors.clear();
+	failedDescriptors.clear();
+	addedNames.clear();
+}
+
+void ActivityRegistry::RegisterSection( const quDispatchTable& dispatch )
+{
+	quActivityDescriptor* descriptor = QU_ACTIVITY_SECTION_BEGIN;
+	quActivityDescriptor* sectionEnd = QU_ACTIVITY_SECTION_END;
+	if( descriptor == nullptr )
+		return;
+
+	//Linkers may pad between the descriptors of different objects. The padding is zeroed, so we hand the runtime every run of
+	//actual descriptors separately.
+	while( descriptor < sectionEnd )
+	{
+		if( !IsDeclared( *descriptor ) )
+		{
+			++descriptor;
+			continue;
+		}
+
+		quActivityDescriptor* runEnd = descriptor;
+		while( runEnd < sectionEnd && IsDeclared( *runEnd ) )
+			++runEnd;
+
+		RegisterRun( descriptor, quUInt32( runEnd - descriptor ), dispatch );
+		descriptor = runEnd;
+	}
+}
+bool ActivityRegistry::Register( quActivityDescriptor* descriptors, quUInt32 count, const quDispatchTable& dispatch )
+{
+	//Descriptors are registered again each time they're used while they dont have an id, so a runtime that rejected them
+	//would otherwise be asked over and over. They're retried once a runtime is loaded again.
+	{
+		std::lock_guard lock( lateDescriptorsMutex );
+		if( count != 0 && std::all_of( descriptors, descriptors + count, []( quActivityDescriptor& descriptor ) { return failedDescriptors.contains( &descriptor ); } ) )
+			return false;
+	}
+
+	bool registeredAll = RegisterRun( descriptors, count, dispatch );
+
+	std::lock_guard lock( lateDescriptorsMutex );
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		quActivityDescriptor* descriptor = &descriptors[ i ];
+		if( std::atomic_ref< quRecurringActivityID >( descriptor->id ).load( std::memory_order_relaxed ) == QU_INVALID_RECURRING_ACTIVITY_ID )
+		{
+			if( IsDeclared( *descriptor ) )
+				failedDescriptors.insert( descriptor );
+		}
+		else if( !IsInSection( descriptor ) )
+			lateDescriptors.insert( descriptor );
+	}
+	return registeredAll;
+}
+bool ActivityRegistry::RegisterOneByOne( quActivityDescriptor* descriptors, quUInt32 count, const quDispatchTable& dispatch )
+{
+	bool registeredAll = true;
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		quActivityDescriptor& descriptor = descriptors[ i ];
+		if( !IsDeclared( descriptor ) )
+			continue;
+
+		//Activities identified by address are named after their function, or after where they were declared if it can't be resolved.
+		std::string resolvedName;
+		const char* name = descriptor.name;
+		if( name == nullptr )
+		{
+			name = Symbolizer::Resolve( descriptor.address );
+			if( name == nullptr )
+			{
+				resolvedName = std::string( descriptor.file ) + ":" + std::to_string( descriptor.line );
+				name = resolvedName.c_str();
+			}
+		}
+
+		quRecurringActivityID recurringActivityID = dispatch.AddRecurringActivity( name, descriptor.color );
+		std::atomic_ref< quRecurringActivityID >( descriptor.id ).store( recurringActivityID, std::memory_order_relaxed );
+		registeredAll &= recurringActivityID != QU_INVALID_RECURRING_ACTIVITY_ID;
+	}
+	return registeredAll;
+}
+
+void ActivityRegistry::OnActivityAdded( quRecurringActivityID activityID, const char* activityName )
+{
+	if( activityID == QU_INVALID_RECURRING_ACTIVITY_ID || activityName == nullptr )
+		return;
+
+	std::lock_guard lock( lateDescriptorsMutex );
+	addedNames[ activityID ] = activityName;
+}
+std::string ActivityRegistry::GetName( quRecurringActivityID activityID )
+{
+	auto nameOf = []( const quActivityDescriptor& descriptor ) -> std::string {
+		if( descriptor.name != nullptr )
+			return descriptor.name;
+		if( const char* name = Symbolizer::Resolve( descriptor.address ) )
+			return name;
+		return std::string( descriptor.file ) + ":" + std::to_string( descriptor.line );
+	};
+
+	for( quActivityDescriptor* descriptor = QU_ACTIVITY_SECTION_BEGIN; descriptor < QU_ACTIVITY_SECTION_END; ++descriptor )
+	{
+		if( IsDeclared( *descriptor ) && std::atomic_ref< quRecurringActivityID >( descriptor->id ).load( std::memory_order_relaxed ) == activityID )
+			return nameOf( *descriptor );
+	}
+
+	std::lock_guard lock( lateDescriptorsMutex );
+	for( quActivityDescriptor* descriptor : lateDescriptors )
+	{
+		if( std::atomic_ref< quRecurringActivityID >( descriptor->id ).load( std::memory_order_relaxed ) == activityID )
+			return nameOf( *descriptor );
+	}
+	auto it = addedNames.find( activityID );
+	return it != addedNames.end() ? it->second : std::string();
+}
+
+} //End namespace qul
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+#include <string>
+
+namespace qul
+{
+
+/**
+ * Registers the activity descriptors declared with QU_DECLARE_ACTIVITY_DESCRIPTOR. Descriptors the compiler placed in the activity section
+ * of the binary are registered in bulk when the api is initialized, any others when they're first used. The ids they receive are
+ * only valid for the runtime that handed them out, so all of them are reset when the runtime is unloaded.
+ * Runtimes that can resolve the addresses of descriptors without a name are handed the Symbolizer, for all others the loader
+ * resolves those names itself before registering them.
+ */
+class ActivityRegistry
+{
+public:
+	//Pass nullptr for runtimes that dont resolve addresses themselves.
+	static void Attach( quSetAddressResolver_Ptr runtimeSetAddressResolver );
+	static void Detach();
+
+	static void RegisterSection( const quDispatchTable& dispatch );
+	static bool Register( quActivityDescriptor* descriptors, quUInt32 count, const quDispatchTable& dispatch );
+	//Fallback for runtimes that don't take descriptors, registers them one by one through AddRecurringActivity.
+	static bool RegisterOneByOne( quActivityDescriptor* descriptors, quUInt32 count, const quDispatchTable& dispatch );
+
+	//Remembers the names of activities that weren't declared with a descriptor.
+	static void OnActivityAdded( quRecurringActivityID activityID, const char* activityName );
+	//Slow, meant for diagnostics only. Returns an empty string for unknown activities.
+	static std::string GetName( quRecurringActivityID activityID );
+};
+
+} //End namespace qul
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderActivityStacks.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace qul
+{
+
+static constexpr size_t MAX_STACK_DEPTH = 1024; //!< Deeper stacks push out their oldest activities, which are the likeliest to have stopped unnoticed.
+
+struct StackedActivity
+{
+	quActivityChannelID channelID;
+	quActivityID activityID;
+};
+//Activities the current thread started that are still running, the channels share the stack but each only sees its own.
+struct ActivityStack
+{
+	~ActivityStack();
+
+	//Owning thread
+	quUInt32 generation = 0; //!< Value of stackGeneration the activities belong to.
+	bool registered = false; //!< Whether the stack is in stacks.
+	std::vector< StackedActivity > activities;
+
+	//Shared with the threads that stop activities
+	std::mutex mutex;
+	std::atomic< quUInt32 > stoppedElsewhereCount = 0; //!< Lets the owning thread check for stoppedElsewhere without locking.
+	std::vector< quActivityID > stoppedElsewhere;      //!< Activities other threads stopped, which may or may not be on this stack.
+};
+
+static quDispatchTable next;                        //!< The entries we pass every call on to.
+static std::atomic< quUInt32 > stackGeneration = 1; //!< Increased on every detach, which invalidates the stacks of all threads.
+static std::mutex stacksMutex;                      //!< Guards stacks.
+static std::vector< ActivityStack* > stacks;        //!< Stack of every thread that started or stopped an activity and is still running.
+static thread_local ActivityStack threadStack;
+
+ActivityStack::~ActivityStack()
+{
+	if( !registered )
+		return;
+
+	std::lock_guard lock( stacksMutex );
+	stacks.erase( std::find( stacks.begin(), stacks.end(), this ) );
+}
+
+//Takes activities other threads stopped off the stack, so that stopping the current activity never stops them again.
+static void RemoveStoppedElsewhere( ActivityStack& stack )
+{
+	std::lock_guard lock( stack.mutex );
+	for( quActivityID activityID : stack.stoppedElsewhere )
+	{
+		auto it = std::find_if( stack.activities.rbegin(), stack.activities.rend(), [ activityID ]( const StackedActivity& activity ) { return activity.activityID == activityID; } );
+		if( it != stack.activities.rend() )
+			stack.activities.erase( std::next( it ).base() );
+	}
+	stack.stoppedElsewhere.clear();
+	stack.stoppedElsewhereCount.store( 0, std::memory_order_relaxed );
+}
+
+static std::vector< StackedActivity >& GetStack()
+{
+	ActivityStack& stack = threadStack;
+	if( !stack.registered ) [[unlikely]]
+	{
+		std::lock_guard lock( stacksMutex );
+		stacks.push_back( &stack );
+		stack.registered = true;
+	}
+
+	quUInt32 generation = stackGeneration.load( std::memory_order_relaxed );
+	if( stack.generation != generation )
+	{
+		stack.generation = generation;
+		stack.activities.clear();
+		std::lock_guard lock( stack.mutex );
+		stack.stoppedElsewhere.clear();
+		stack.stoppedElsewhereCount.store( 0, std::memory_order_relaxed );
+	}
+	else if( stack.stoppedElsewhereCount.load( std::memory_order_relaxed ) != 0 ) [[unlikely]]
+	{
+		RemoveStoppedElsewhere( stack );
+	}
+	return stack.activities;
+}
+
+static quActivityID Push( quActivityChannelID channelID, quActivityID activityID )
+{
+	if( activityID == QU_INVALID_ACTIVITY_ID || channelID == QU_INVALID_ACTIVITY_CHANNEL_ID )
+		return activityID;
+
+	std::vector< StackedActivity >& stack = GetStack();
+	if( stack.size() == MAX_STACK_DEPTH ) [[unlikely]]
+		stack.erase( stack.begin() );
+	stack.push_back( { channelID, activityID } );
+	return activityID;
+}
+//Activities stopped by id usually are the current one, but any of them may be stopped. Activities that aren't on the stack of
+//the calling thread were started by another one, which we can't tell from their id, so every other thread is told about them.
+static void Remove( quActivityID activityID )
+{
+	if( activityID == QU_INVALID_ACTIVITY_ID )
+		return;
+
+	std::vector< StackedActivity >& stack = GetStack();
+	auto it = std::find_if( stack.rbegin(), stack.rend(), [ activityID ]( const StackedActivity& activity ) { return activity.activityID == activityID; } );
+	if( it != stack.rend() )
+	{
+		stack.erase( std::next( it ).base() );
+		return;
+	}
+
+	std::lock_guard stacksLock( stacksMutex );
+	for( ActivityStack* other : stacks )
+	{
+		if( other == &threadStack )
+			continue;
+
+		std::lock_guard lock( other->mutex );
+		if( other->stoppedElsewhere.size() == MAX_STACK_DEPTH )
+			other->stoppedElsewhere.erase( other->stoppedElsewhere.begin() );
+		other->stoppedElsewhere.push_back( activityID );
+		other->stoppedElsewhereCount.store( quUInt32( other->stoppedElsewhere.size() ), std::memory_order_relaxed );
+	}
+}
+
+//Hot path
+static quActivityID QU_CALL_CONV StackedStartRecurringActivity( quActivityChannelID channelID, quRecurringActivityID activityID )
+{
+	return Push( channelID, next.StartRecurringActivity( channelID, activityID ) );
+}
+static bool QU_CALL_CONV StackedStopActivity( quActivityID activityID )
+{
+	Remove( activityID );
+	return next.StopActivity( activityID );
+}
+static quActivityID QU_CALL_CONV StackedStartActivity( quActivityChannelID channelID, const char* activityName, quUInt32 color )
+{
+	return Push( channelID, next.StartActivity( channelID, activityName, color ) );
+}
+static bool QU_CALL_CONV StackedStopCurrentActivity( quActivityChannelID channelID )
+{
+	std::vector< StackedActivity >& stack = GetStack();
+	auto it = std::find_if( stack.rbegin(), stack.rend(), [ channelID ]( const StackedActivity& activity ) { return activity.channelID == channelID; } );
+	if( it == stack.rend() )
+		return false;
+
+	quActivityID activityID = it->activityID;
+	stack.erase( std::next( it ).base() );
+	return next.StopActivity( activityID );
+}
+
+//Timestamps
+static quActivityID QU_CALL_CONV StackedStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp )
+{
+	return Push( channelID, next.StartRecurringActivityAt( channelID, activityID, timestamp ) );
+}
+static bool QU_CALL_CONV StackedStopActivityAt( quActivityID activityID, quUInt64 timestamp )
+{
+	Remove( activityID );
+	return next.StopActivityAt( activityID, timestamp );
+}
+
+//Formatted activities
+static quActivityID QU_CALL_CONV StackedStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount )
+{
+	return Push( channelID, next.StartFormattedActivity( channelID, descriptor, args, argCount ) );
+}
+
+//Activity annotations
+static bool QU_CALL_CONV StackedStopActivityWithArgs( quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	Remove( activityID );
+	return next.StopActivityWithArgs( activityID, annotations, count );
+}
+
+void ActivityStacks::Install( quDispatchTable& dispatch )
+{
+	next = dispatch;
+
+	//Hot path
+	dispatch.StartRecurringActivity = &StackedStartRecurringActivity;
+	dispatch.StopActivity = &StackedStopActivity;
+	dispatch.StartActivity = &StackedStartActivity;
+
+	//Timestamps
+	dispatch.StartRecurringActivityAt = &StackedStartRecurringActivityAt;
+	dispatch.StopActivityAt = &StackedStopActivityAt;
+
+	//Formatted activities
+	dispatch.StartFormattedActivity = &StackedStartFormattedActivity;
+
+	//Activity annotations
+	dispatch.StopActivityWithArgs = &StackedStopActivityWithArgs;
+
+	//Nested stops
+	dispatch.StopCurrentActivity = &StackedStopCurrentActivity;
+}
+void ActivityStacks::Detach()
+{
+	//Activity ids are only valid for the runtime that handed them out.
+	stackGeneration.fetch_add( 1, std::memory_order_relaxed );
+}
+
+} //End namespace qul
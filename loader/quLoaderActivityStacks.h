@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Implements quStopCurrentActivity for runtimes that can't stop the current activity of a channel themselves. Every thread keeps
+ * the activities it started along with their channels, in the order they were started, and stopping the current activity of a
+ * channel stops the last of them that was started on that channel by id. Only activities the calling thread started are seen,
+ * activities another thread stops are taken off the stack of the thread that started them the next time that thread uses it.
+ */
+class ActivityStacks
+{
+public:
+	//Routes starting and stopping activities through the stacks, they're passed on to the entries they replace.
+	static void Install( quDispatchTable& dispatch );
+	static void Detach();
+};
+
+} //End namespace qul
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderAnnotationKeys.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qul
+{
+
+struct Keys
+{
+	std::mutex mutex;                                         //!< Guards everything below.
+	std::vector< std::string > names;                         //!< Name of every key, indexed by key id.
+	std::unordered_map< std::string, quAnnotationKeyID > ids; //!< Id of every key, by name.
+	quSetAnnotationKey_Ptr setAnnotationKey = nullptr;        //!< Set when the runtime supports annotations.
+};
+
+static std::atomic< quUInt32 > keyCount = 0; //!< Number of keys, lets annotations be checked without locking.
+
+//Keys are typically added during static initialization, possibly before this file's own statics would have been constructed.
+static Keys& GetKeys()
+{
+	static Keys keys;
+	return keys;
+}
+
+void AnnotationKeys::Attach( quSetAnnotationKey_Ptr runtimeSetAnnotationKey )
+{
+	Keys& keys = GetKeys();
+	std::lock_guard lock( keys.mutex );
+	keys.setAnnotationKey = runtimeSetAnnotationKey;
+	if( keys.setAnnotationKey == nullptr )
+		return;
+
+	for( size_t keyID = 0; keyID < keys.names.size(); ++keyID )
+		keys.setAnnotationKey( quAnnotationKeyID( keyID ), keys.names[ keyID ].c_str() );
+}
+void AnnotationKeys::Detach()
+{
+	Keys& keys = GetKeys();
+	std::lock_guard lock( keys.mutex );
+	keys.setAnnotationKey = nullptr;
+}
+
+quAnnotationKeyID AnnotationKeys::Add( const char* keyName )
+{
+	if( keyName == nullptr )
+		return QU_INVALID_ANNOTATION_KEY_ID;
+
+	Keys& keys = GetKeys();
+	std::lock_guard lock( keys.mutex );
+	auto it = keys.ids.find( keyName );
+	if( it != keys.ids.end() )
+		return it->second;
+
+	if( keys.names.size() >= QU_MAX_ANNOTATION_KEYS )
+		return QU_INVALID_ANNOTATION_KEY_ID;
+
+	quAnnotationKeyID keyID = quAnnotationKeyID( keys.names.size() );
+	keys.names.push_back( keyName );
+	keys.ids.emplace( keyName, keyID );
+	keyCount.store( quUInt32( keys.names.size() ), std::memory_order_release );
+	if( keys.setAnnotationKey != nullptr )
+		keys.setAnnotationKey( keyID, keyName );
+	return keyID;
+}
+bool AnnotationKeys::AreValid( const quAnnotation* annotations, quUInt32 count )
+{
+	if( ( annotations == nullptr && count != 0 ) || count > QU_MAX_ANNOTATIONS )
+		return false;
+
+	quUInt32 validKeyCount = keyCount.load( std::memory_order_acquire );
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		if( annotations[ i ].keyID >= validKeyCount || annotations[ i ].type > QU_ACTIVITY_ARG_DOUBLE )
+			return false;
+	}
+	return true;
+}
+
+} //End namespace qul
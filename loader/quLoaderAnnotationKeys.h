@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Hands out the ids of annotation keys, see quAddAnnotationKey. Ids are assigned by the loader so that they stay valid when the
+ * runtime is loaded after the keys were added or replaced by another one. Every runtime is told the names of all keys.
+ */
+class AnnotationKeys
+{
+public:
+	//Pass nullptr for runtimes that don't support annotations.
+	static void Attach( quSetAnnotationKey_Ptr runtimeSetAnnotationKey );
+	static void Detach();
+
+	static quAnnotationKeyID Add( const char* keyName );
+	//Checks the count, keys and types of annotations passed to the api.
+	static bool AreValid( const quAnnotation* annotations, quUInt32 count );
+};
+
+} //End namespace qul
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderClock.h"
+#include <quApi.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if defined( _MSC_VER )
+#	include <intrin.h>
+#elif defined( __x86_64__ )
+#	include <cpuid.h>
+#endif
+
+namespace qul
+{
+
+static constexpr auto CALIBRATION_DURATION = std::chrono::milliseconds( 10 );
+static constexpr auto RECALIBRATION_INTERVAL = std::chrono::seconds( 1 );
+static constexpr double MAX_RATE_CORRECTION = 0.001; //!< Largest share by which a recalibration may speed up or slow down the clock.
+
+//A reading of the time stamp counter and the monotonic clock taken at the same time.
+struct ClockReading
+{
+	quUInt64 ticks;
+	quUInt64 nanos;
+};
+
+static std::mutex controlMutex; //!< Serializes switching clocks and starting and stopping the recalibration thread.
+static std::mutex clockMutex;   //!< Guards everything below.
+static std::condition_variable stopRequested;
+static quSetClockCalibration_Ptr setClockCalibration = nullptr;       //!< Set when the runtime supports other clocks than the default.
+static bool stopping = false;
+static ClockReading firstReading;                                     //!< Reading the first calibration was based on, rates are measured since then.
+
+//Joins the recalibration thread if it's still running when the application exits.
+struct RecalibrationThread
+{
+	std::thread thread;
+
+	~RecalibrationThread()
+	{
+		if( !thread.joinable() )
+			return;
+
+		{
+			std::lock_guard lock( clockMutex );
+			stopping = true;
+		}
+		stopRequested.notify_all();
+		thread.join();
+	}
+};
+static RecalibrationThread recalibrationThread;
+
+static bool HasInvariantTsc()
+{
+#if defined( _MSC_VER ) && defined( _M_X64 )
+	int registers[ 4 ];
+	__cpuid( registers, 0x80000000 );
+	if( quUInt32( registers[ 0 ] ) < 0x80000007 )
+		return false;
+
+	__cpuid( registers, 0x80000007 );
+	return ( registers[ 3 ] & ( 1 << 8 ) ) != 0;
+#elif defined( __x86_64__ )
+	unsigned int eax, ebx, ecx, edx;
+	if( __get_cpuid_max( 0x80000000, nullptr ) < 0x80000007 || !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) )
+		return false;
+
+	return ( edx & ( 1 << 8 ) ) != 0;
+#else
+	return false;
+#endif
+}
+
+static quUInt64 GetMonotonicNanos()
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+//Takes the reading with the least time passing between reading both clocks out of a few, and pairs the midpoint with it.
+static ClockReading Read()
+{
+	ClockReading best = {};
+	quUInt64 bestSpread = ~0ull;
+	for( int attempt = 0; attempt < 5; ++attempt )
+	{
+		quUInt64 ticksBefore = qu::ReadClockTicks();
+		quUInt64 nanos = GetMonotonicNanos();
+		quUInt64 ticksAfter = qu::ReadClockTicks();
+		if( ticksAfter - ticksBefore < bestSpread )
+		{
+			bestSpread = ticksAfter - ticksBefore;
+			best = { ticksBefore + bestSpread / 2, nanos };
+		}
+	}
+	return best;
+}
+
+//Must be called with clockMutex locked.
+static void PublishCalibration( const quClockCalibration& calibration )
+{
+	std::atomic_ref< quUInt32 > sequence( qu::sharedState.clockSequence );
+	quUInt32 sequenceBefore = sequence.load( std::memory_order_relaxed );
+	sequence.store( sequenceBefore + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	std::atomic_ref< quUInt64 >( qu::sharedState.clockCalibration.baseTicks ).store( calibration.baseTicks, std::memory_order_relaxed );
+	std::atomic_ref< quUInt64 >( qu::sharedState.clockCalibration.baseNanos ).store( calibration.baseNanos, std::memory_order_relaxed );
+	std::atomic_ref< double >( qu::sharedState.clockCalibration.nanosPerTick ).store( calibration.nanosPerTick, std::memory_order_relaxed );
+	sequence.store( sequenceBefore + 2, std::memory_order_release );
+
+	if( setClockCalibration != nullptr )
+		setClockCalibration( QU_CLOCK_SOURCE_TSC, &calibration );
+}
+
+static quClockCalibration Calibrate()
+{
+	firstReading = Read();
+	std::this_thread::sleep_for( CALIBRATION_DURATION );
+	ClockReading reading = Read();
+	return { reading.ticks, reading.nanos, double( reading.nanos - firstReading.nanos ) / double( reading.ticks - firstReading.ticks ) };
+}
+
+//Must be called with clockMutex locked.
+static void Recalibrate()
+{
+	ClockReading reading = Read();
+	quUInt64 timestamp = qu::TicksToTimestamp( reading.ticks );
+
+	//Continue from the timestamp the current calibration gives, at the rate measured over the longest period we have, corrected
+	//so that the error with the monotonic clock is gone by the next recalibration.
+	constexpr double intervalNanos = double( std::chrono::duration_cast< std::chrono::nanoseconds >( RECALIBRATION_INTERVAL ).count() );
+	double nanosPerTick = double( reading.nanos - firstReading.nanos ) / double( reading.ticks - firstReading.ticks );
+	double correction = std::clamp( ( double( reading.nanos ) - double( timestamp ) ) / intervalNanos, -MAX_RATE_CORRECTION, MAX_RATE_CORRECTION );
+	PublishCalibration( { reading.ticks, timestamp, nanosPerTick * ( 1.0 + correction ) } );
+}
+
+static void Run()
+{
+	std::unique_lock lock( clockMutex );
+	while( !stopRequested.wait_for( lock, RECALIBRATION_INTERVAL, [] { return stopping; } ) )
+		Recalibrate();
+}
+
+static void Stop()
+{
+	{
+		std::lock_guard lock( clockMutex );
+		stopping = true;
+	}
+	stopRequested.notify_all();
+	if( recalibrationThread.thread.joinable() )
+		recalibrationThread.thread.join();
+}
+
+static void SetClockSource( quClockSource clockSource )
+{
+	std::atomic_ref< quUInt32 >( qu::sharedState.clockSource ).store( clockSource, std::memory_order_relaxed );
+}
+
+void Clock::Attach( quSetClockCalibration_Ptr runtimeSetClockCalibration )
+{
+	std::lock_guard lock( clockMutex );
+	setClockCalibration = runtimeSetClockCalibration;
+}
+void Clock::Detach()
+{
+	std::lock_guard controlLock( controlMutex );
+	Stop();
+
+	std::lock_guard lock( clockMutex );
+	SetClockSource( QU_CLOCK_SOURCE_MONOTONIC );
+	setClockCalibration = nullptr;
+}
+
+bool Clock::SetSource( quClockSource clockSource )
+{
+	switch( clockSource )
+	{
+	case QU_CLOCK_SOURCE_MONOTONIC:
+		break;
+	case QU_CLOCK_SOURCE_MONOTONIC_RAW:
+#if !defined( __linux__ )
+		return false;
+#endif
+		break;
+	case QU_CLOCK_SOURCE_TSC:
+		if( !HasInvariantTsc() )
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	std::lock_guard controlLock( controlMutex );
+	{
+		std::lock_guard lock( clockMutex );
+		if( clockSource == std::atomic_ref< quUInt32 >( qu::sharedState.clockSource ).load( std::memory_order_relaxed ) )
+			return true;
+		//Whatever the runtime timestamps itself has to come from the same clock.
+		if( clockSource != QU_CLOCK_SOURCE_MONOTONIC && setClockCalibration == nullptr )
+			return false;
+	}
+	//A trace whose timestamps come from two different clocks can't be put in order.
+	if( qu::IsRecording() )
+		return false;
+	Stop();
+
+	if( clockSource != QU_CLOCK_SOURCE_TSC )
+	{
+		std::lock_guard lock( clockMutex );
+		SetClockSource( clockSource );
+		if( setClockCalibration != nullptr )
+			setClockCalibration( clockSource, nullptr );
+		return true;
+	}
+
+	quClockCalibration calibration = Calibrate();
+	std::lock_guard lock( clockMutex );
+	PublishCalibration( calibration );
+	SetClockSource( clockSource );
+	stopping = false;
+	recalibrationThread.thread = std::thread( &Run );
+	return true;
+}
+
+} //End namespace qul
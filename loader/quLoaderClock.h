@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Maintains the clock source and the time stamp counter calibration in qu::sharedState, which qu::GetTimestamp reads.
+ * The time stamp counter is calibrated against the monotonic clock once when it's selected. A background thread then compares
+ * both clocks every second and publishes a new calibration that starts where the previous one left off, with a rate that
+ * catches up with the monotonic clock over the next second. That way timestamps never go backwards and don't drift apart from
+ * the monotonic clock. Every calibration is handed to the runtime.
+ */
+class Clock
+{
+public:
+	//Pass nullptr for runtimes that only take timestamps from the default clock.
+	static void Attach( quSetClockCalibration_Ptr runtimeSetClockCalibration );
+	//Switches back to the default clock.
+	static void Detach();
+
+	static bool SetSource( quClockSource clockSource );
+};
+
+} //End namespace qul
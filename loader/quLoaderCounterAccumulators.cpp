@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderCounterAccumulators.h"
+#include "quLoaderCounterCoalescing.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qul
+{
+
+static constexpr quUInt32 MAX_SHARD_COUNT = 16;
+static constexpr quUInt32 ADDS_PER_FLUSH_CHECK = 64;
+static constexpr size_t MAX_COUNTERS = size_t( QU_INVALID_COUNTER_ID ) + 1;
+
+struct alignas( 64 ) AccumulatorShard
+{
+	std::atomic< quInt64 > value;
+};
+
+struct Accumulator
+{
+	std::unique_ptr< AccumulatorShard[] > shards;
+	quCounterID counterID;
+	bool passedOn;         //!< Whether passedOnValue is valid.
+	quInt64 passedOnValue; //!< Sum passed on by the last sample.
+};
+
+//More shards than threads that can run at once only cost memory, every accumulator has a cache line per shard.
+static quUInt32 GetShardCount()
+{
+	static const quUInt32 shardCount = std::bit_ceil( std::clamp( std::thread::hardware_concurrency(), 1u, MAX_SHARD_COUNT ) );
+	return shardCount;
+}
+
+static quSetCounterValueInt64_Ptr setCounterValueInt64 = nullptr; //!< Entry the sums are passed on through.
+static std::atomic< Accumulator* > accumulators[ MAX_COUNTERS ];  //!< Accumulator of every counter, indexed by counter id.
+static std::mutex accumulatorsMutex;                              //!< Guards everything below.
+static std::vector< Accumulator* > activeAccumulators;            //!< Every accumulator that belongs to a counter.
+//Accumulators are neither freed nor reused, threads that are adding to a counter while it's removed may still be touching its
+//accumulator. Handing it to a new counter would add their deltas to that counter instead.
+static std::vector< std::unique_ptr< Accumulator > > allAccumulators;
+
+static std::atomic< quUInt32 > nextShard = 0;
+static thread_local quUInt32 threadShard = nextShard.fetch_add( 1, std::memory_order_relaxed ) & ( GetShardCount() - 1 );
+static thread_local quUInt32 addsUntilFlushCheck = ADDS_PER_FLUSH_CHECK;
+
+static quInt64 Sum( const Accumulator& accumulator )
+{
+	quInt64 sum = 0;
+	for( quUInt32 i = 0; i < GetShardCount(); ++i )
+		sum += accumulator.shards[ i ].value.load( std::memory_order_relaxed );
+	return sum;
+}
+
+void CounterAccumulators::Install( const quDispatchTable& dispatch )
+{
+	std::lock_guard lock( accumulatorsMutex );
+	setCounterValueInt64 = dispatch.SetCounterValueInt64;
+}
+void CounterAccumulators::Detach()
+{
+	//Counter ids are only valid for the runtime that handed them out.
+	std::lock_guard lock( accumulatorsMutex );
+	for( Accumulator* accumulator : activeAccumulators )
+		accumulators[ accumulator->counterID ].store( nullptr, std::memory_order_relaxed );
+	activeAccumulators.clear();
+	setCounterValueInt64 = nullptr;
+}
+
+void CounterAccumulators::AddAccumulator( quCounterID counterID )
+{
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return;
+
+	std::lock_guard lock( accumulatorsMutex );
+	if( accumulators[ counterID ].load( std::memory_order_relaxed ) != nullptr )
+		return;
+
+	allAccumulators.push_back( std::make_unique< Accumulator >() );
+	Accumulator* accumulator = allAccumulators.back().get();
+	accumulator->shards = std::make_unique< AccumulatorShard[] >( GetShardCount() );
+	for( quUInt32 i = 0; i < GetShardCount(); ++i )
+		accumulator->shards[ i ].value.store( 0, std::memory_order_relaxed );
+	accumulator->counterID = counterID;
+	accumulator->passedOn = false;
+	accumulator->passedOnValue = 0;
+	activeAccumulators.push_back( accumulator );
+	accumulators[ counterID ].store( accumulator, std::memory_order_release );
+}
+void CounterAccumulators::RemoveAccumulator( quCounterID counterID )
+{
+	if( counterID == QU_INVALID_COUNTER_ID || accumulators[ counterID ].load( std::memory_order_relaxed ) == nullptr )
+		return;
+
+	Sample();
+	std::lock_guard lock( accumulatorsMutex );
+	Accumulator* accumulator = accumulators[ counterID ].exchange( nullptr, std::memory_order_relaxed );
+	if( accumulator == nullptr )
+		return;
+
+	activeAccumulators.erase( std::find( activeAccumulators.begin(), activeAccumulators.end(), accumulator ) );
+}
+
+//Hot path
+bool CounterAccumulators::AddTo( quCounterID counterID, quInt64 delta )
+{
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return false;
+
+	Accumulator* accumulator = accumulators[ counterID ].load( std::memory_order_acquire );
+	if( accumulator == nullptr )
+		return false;
+
+	accumulator->shards[ threadShard ].value.fetch_add( delta, std::memory_order_relaxed );
+	if( --addsUntilFlushCheck == 0 )
+	{
+		addsUntilFlushCheck = ADDS_PER_FLUSH_CHECK;
+		CounterCoalescing::FlushIfDue();
+	}
+	return true;
+}
+void CounterAccumulators::Sample()
+{
+	static thread_local std::vector< quCounterID > counterIDs;
+	static thread_local std::vector< quInt64 > sums;
+	counterIDs.clear();
+	sums.clear();
+	quSetCounterValueInt64_Ptr passOn;
+	{
+		std::lock_guard lock( accumulatorsMutex );
+		passOn = setCounterValueInt64;
+		for( Accumulator* accumulator : activeAccumulators )
+		{
+			quInt64 sum = Sum( *accumulator );
+			if( accumulator->passedOn && accumulator->passedOnValue == sum )
+				continue;
+
+			accumulator->passedOn = true;
+			accumulator->passedOnValue = sum;
+			counterIDs.push_back( accumulator->counterID );
+			sums.push_back( sum );
+		}
+	}
+	if( passOn == nullptr )
+		return;
+
+	for( size_t i = 0; i < counterIDs.size(); ++i )
+		passOn( counterIDs[ i ], sums[ i ] );
+}
+
+} //End namespace qul
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Keeps the totals of accumulator counters, see quAddToCounter. Every accumulator is split into shards that sit on their own
+ * cache lines, one per hardware thread up to a limit, and every thread adds to its own shard, so threads adding to the same
+ * accumulator rarely contend. The shards are
+ * summed whenever counters are flushed, and the sum is passed on as an int64 value if it changed. Counters are flushed by
+ * CounterCoalescing's flushing thread once per flush interval, and every few additions a thread checks whether it elapsed too.
+ */
+class CounterAccumulators
+{
+public:
+	//The sums are passed on through the table's SetCounterValueInt64.
+	static void Install( const quDispatchTable& dispatch );
+	static void Detach();
+
+	static void AddAccumulator( quCounterID counterID );
+	//Passes on the final sum before the counter goes away.
+	static void RemoveAccumulator( quCounterID counterID );
+
+	//Fails for counters that aren't accumulators.
+	static bool AddTo( quCounterID counterID, quInt64 delta );
+	static void Sample();
+};
+
+} //End namespace qul
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderCounterCoalescing.h"
+#include "quLoaderCounterAccumulators.h"
+#include "quLoaderEventStaging.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qul
+{
+
+static constexpr quUInt64 DEFAULT_FLUSH_INTERVAL_NANOS = 10000000;
+static constexpr quUInt64 MIN_TIMED_FLUSH_INTERVAL_NANOS = 1000000;
+static constexpr size_t MAX_COUNTERS = size_t( QU_INVALID_COUNTER_ID ) + 1;
+
+struct CoalescedCounter
+{
+	quCounterID counterID;
+	bool passedOn;       //!< Whether passedOnValue is valid.
+	float passedOnValue; //!< Value passed on by the last flush.
+};
+
+static quSetCounterValue_Ptr setCounterValue = nullptr;                //!< The entry we're coalescing for.
+static quSetCounterValues_Ptr setCounterValues = nullptr;              //!< The entry we're coalescing for, used to pass on combined values.
+static std::atomic< quCounterCoalescing > coalescings[ MAX_COUNTERS ]; //!< Coalescing of every counter, indexed by counter id.
+//Values combined since the last flush, indexed by counter id. The number of values sits in the upper 32 bits, none means
+//nothing is pending, and the bits of their combination, their sum for averages, in the lower 32 bits.
+static std::atomic< quUInt64 > pendingValues[ MAX_COUNTERS ];
+static std::atomic< quUInt32 > coalescedCount = 0;                     //!< Number of counters with a coalescing other than QU_COUNTER_COALESCING_NONE.
+static std::mutex countersMutex;                                       //!< Guards counters, held while flushing.
+static std::vector< CoalescedCounter > counters;                       //!< Every coalesced counter.
+static std::atomic< quUInt64 > flushIntervalNanos = DEFAULT_FLUSH_INTERVAL_NANOS;
+static std::atomic< quUInt64 > nextFlushNanos = 0;
+
+static std::mutex controlMutex;                  //!< Serializes starting and stopping the flushing thread.
+static std::mutex flushingMutex;                 //!< Guards stopping.
+static std::condition_variable flushingChanged;  //!< Wakes the flushing thread when the flush interval changed or it should stop.
+static bool stopping = false;
+
+//Set while passing on combined values, which mustn't be coalesced again when the entry we pass them to ends up calling us.
+static thread_local bool passingOn = false;
+
+//Joins the flushing thread if it's still running when the application exits.
+struct FlushingThread
+{
+	std::thread thread;
+
+	~FlushingThread()
+	{
+		if( !thread.joinable() )
+			return;
+
+		{
+			std::lock_guard lock( flushingMutex );
+			stopping = true;
+		}
+		flushingChanged.notify_all();
+		thread.join();
+	}
+};
+static FlushingThread flushingThread;
+
+static quUInt64 GetNanos()
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static bool IsCoalesced( quCounterID counterID )
+{
+	return !passingOn && counterID != QU_INVALID_COUNTER_ID && coalescings[ counterID ].load( std::memory_order_relaxed ) != QU_COUNTER_COALESCING_NONE;
+}
+
+static quUInt64 Pack( quUInt32 count, float value )
+{
+	return ( quUInt64( count ) << 32 ) | std::bit_cast< quUInt32 >( value );
+}
+static quUInt32 GetCount( quUInt64 pending )
+{
+	return quUInt32( pending >> 32 );
+}
+static float GetValue( quUInt64 pending )
+{
+	return std::bit_cast< float >( quUInt32( pending ) );
+}
+
+//Threads setting the same counter only contend on its slot, never on a lock.
+static void Combine( quCounterID counterID, float newCounterValue )
+{
+	quCounterCoalescing coalescing = coalescings[ counterID ].load( std::memory_order_relaxed );
+	std::atomic< quUInt64 >& slot = pendingValues[ counterID ];
+	quUInt64 pending = slot.load( std::memory_order_relaxed );
+	quUInt64 combined;
+	do
+	{
+		quUInt32 count = GetCount( pending );
+		if( count == 0 )
+		{
+			combined = Pack( 1, newCounterValue );
+			continue;
+		}
+
+		float value = GetValue( pending );
+		switch( coalescing )
+		{
+		case QU_COUNTER_COALESCING_MIN:
+			value = std::min( value, newCounterValue );
+			break;
+		case QU_COUNTER_COALESCING_MAX:
+			value = std::max( value, newCounterValue );
+			break;
+		case QU_COUNTER_COALESCING_AVERAGE:
+			value += newCounterValue;
+			break;
+		default:
+			value = newCounterValue;
+			break;
+		}
+		combined = Pack( count == UINT32_MAX ? count : count + 1, value );
+	} while( !slot.compare_exchange_weak( pending, combined, std::memory_order_relaxed ) );
+}
+
+//Takes whatever was combined for the counter, returns false if nothing was.
+static bool TakePending( quCounterID counterID, quCounterCoalescing coalescing, float& value )
+{
+	quUInt64 pending = pendingValues[ counterID ].exchange( 0, std::memory_order_relaxed );
+	quUInt32 count = GetCount( pending );
+	if( count == 0 )
+		return false;
+
+	value = coalescing == QU_COUNTER_COALESCING_AVERAGE ? GetValue( pending ) / float( count ) : GetValue( pending );
+	return true;
+}
+
+static void PassOn( const quCounterID* counterIDs, const float* values, quUInt32 count )
+{
+	if( count == 0 || setCounterValues == nullptr )
+		return;
+
+	passingOn = true;
+	setCounterValues( counterIDs, values, count );
+	passingOn = false;
+}
+
+//Flushes once the flush interval elapsed even when nothing is set or added, so the last values of counters that went idle
+//aren't withheld.
+static void RunFlushing()
+{
+	std::unique_lock lock( flushingMutex );
+	while( !stopping )
+	{
+		quUInt64 intervalNanos = std::max( flushIntervalNanos.load( std::memory_order_relaxed ), MIN_TIMED_FLUSH_INTERVAL_NANOS );
+		quUInt64 flushNanos = std::max( nextFlushNanos.load( std::memory_order_relaxed ), GetNanos() + MIN_TIMED_FLUSH_INTERVAL_NANOS );
+		flushNanos = std::min( flushNanos, GetNanos() + intervalNanos );
+		flushingChanged.wait_until( lock, std::chrono::steady_clock::time_point( std::chrono::nanoseconds( flushNanos ) ) );
+		if( stopping )
+			break;
+
+		lock.unlock();
+		CounterCoalescing::FlushIfDue();
+		//Nothing else runs on this thread that would flush the values later on.
+		EventStaging::FlushCurrentThread();
+		lock.lock();
+	}
+}
+
+static void StopFlushing()
+{
+	{
+		std::lock_guard lock( flushingMutex );
+		stopping = true;
+	}
+	flushingChanged.notify_all();
+	if( flushingThread.thread.joinable() )
+		flushingThread.thread.join();
+}
+
+//Hot path
+static bool QU_CALL_CONV CoalescingSetCounterValue( quCounterID counterID, float newCounterValue )
+{
+	if( !IsCoalesced( counterID ) )
+		return setCounterValue( counterID, newCounterValue );
+
+	Combine( counterID, newCounterValue );
+	CounterCoalescing::FlushIfDue();
+	return true;
+}
+static bool QU_CALL_CONV CoalescingSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count )
+{
+	if( passingOn || coalescedCount.load( std::memory_order_relaxed ) == 0 )
+		return setCounterValues( counterIDs, newCounterValues, count );
+
+	//Counters that aren't coalesced are still passed on in a single batch.
+	static thread_local std::vector< quCounterID > passedOnIDs;
+	static thread_local std::vector< float > passedOnValues;
+	passedOnIDs.clear();
+	passedOnValues.clear();
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		if( IsCoalesced( counterIDs[ i ] ) )
+		{
+			Combine( counterIDs[ i ], newCounterValues[ i ] );
+			continue;
+		}
+		passedOnIDs.push_back( counterIDs[ i ] );
+		passedOnValues.push_back( newCounterValues[ i ] );
+	}
+
+	bool setAll = passedOnIDs.empty() || setCounterValues( passedOnIDs.data(), passedOnValues.data(), quUInt32( passedOnIDs.size() ) );
+	CounterCoalescing::FlushIfDue();
+	return setAll;
+}
+
+void CounterCoalescing::Install( quDispatchTable& dispatch )
+{
+	setCounterValue = dispatch.SetCounterValue;
+	setCounterValues = dispatch.SetCounterValues;
+	dispatch.SetCounterValue = &CoalescingSetCounterValue;
+	dispatch.SetCounterValues = &CoalescingSetCounterValues;
+}
+void CounterCoalescing::Detach()
+{
+	std::lock_guard controlLock( controlMutex );
+	StopFlushing();
+
+	//Counter ids are only valid for the runtime that handed them out.
+	std::lock_guard lock( countersMutex );
+	for( const CoalescedCounter& counter : counters )
+	{
+		coalescings[ counter.counterID ].store( QU_COUNTER_COALESCING_NONE, std::memory_order_relaxed );
+		pendingValues[ counter.counterID ].store( 0, std::memory_order_relaxed );
+	}
+	counters.clear();
+	coalescedCount = 0;
+	setCounterValue = nullptr;
+	setCounterValues = nullptr;
+}
+
+bool CounterCoalescing::SetCoalescing( quCounterID counterID, quCounterCoalescing coalescing )
+{
+	if( counterID == QU_INVALID_COUNTER_ID || coalescing > QU_COUNTER_COALESCING_AVERAGE )
+		return false;
+
+	//Whatever was combined so far is passed on first, values combined one way can't be combined another way.
+	float value;
+	bool pending;
+	{
+		std::lock_guard lock( countersMutex );
+		quCounterCoalescing previous = coalescings[ counterID ].exchange( coalescing, std::memory_order_relaxed );
+		pending = TakePending( counterID, previous, value );
+		auto it = std::find_if( counters.begin(), counters.end(), [ counterID ]( const CoalescedCounter& counter ) { return counter.counterID == counterID; } );
+		if( coalescing == QU_COUNTER_COALESCING_NONE && it != counters.end() )
+		{
+			counters.erase( it );
+			--coalescedCount;
+		}
+		else if( coalescing != QU_COUNTER_COALESCING_NONE && it == counters.end() )
+		{
+			counters.push_back( { counterID, false, 0.0f } );
+			++coalescedCount;
+		}
+	}
+	if( pending )
+		PassOn( &counterID, &value, 1 );
+	if( coalescing != QU_COUNTER_COALESCING_NONE )
+		StartFlushing();
+	return true;
+}
+void CounterCoalescing::SetFlushInterval( quUInt64 intervalNanos )
+{
+	flushIntervalNanos.store( intervalNanos, std::memory_order_relaxed );
+	nextFlushNanos.store( 0, std::memory_order_relaxed );
+	flushingChanged.notify_all();
+}
+void CounterCoalescing::StartFlushing()
+{
+	std::lock_guard controlLock( controlMutex );
+	if( flushingThread.thread.joinable() || setCounterValues == nullptr )
+		return;
+
+	{
+		std::lock_guard lock( flushingMutex );
+		stopping = false;
+	}
+	flushingThread.thread = std::thread( &RunFlushing );
+}
+void CounterCoalescing::Flush()
+{
+	static thread_local std::vector< quCounterID > counterIDs;
+	static thread_local std::vector< float > values;
+	counterIDs.clear();
+	values.clear();
+	{
+		std::lock_guard lock( countersMutex );
+		nextFlushNanos.store( GetNanos() + flushIntervalNanos.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+		for( CoalescedCounter& counter : counters )
+		{
+			float value;
+			if( !TakePending( counter.counterID, coalescings[ counter.counterID ].load( std::memory_order_relaxed ), value ) )
+				continue;
+			if( counter.passedOn && counter.passedOnValue == value )
+				continue;
+
+			counter.passedOn = true;
+			counter.passedOnValue = value;
+			counterIDs.push_back( counter.counterID );
+			values.push_back( value );
+		}
+	}
+	PassOn( counterIDs.data(), values.data(), quUInt32( counterIDs.size() ) );
+	CounterAccumulators::Sample();
+}
+void CounterCoalescing::FlushIfDue()
+{
+	if( GetNanos() >= nextFlushNanos.load( std::memory_order_relaxed ) )
+		Flush();
+}
+void CounterCoalescing::OnCounterRemoved( quCounterID counterID )
+{
+	if( counterID != QU_INVALID_COUNTER_ID )
+		SetCoalescing( counterID, QU_COUNTER_COALESCING_NONE );
+}
+
+} //End namespace qul
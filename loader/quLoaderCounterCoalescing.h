@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Combines the values of coalesced counters into a single value per flush interval, see quSetCounterCoalescing. Values of
+ * counters that aren't coalesced are passed on right away, so they only pay for checking whether they are. Every coalesced
+ * counter combines its values in an atomic slot of its own, and a thread flushes once per flush interval while there are
+ * coalesced counters or accumulators, so the last value of a counter that stopped being set still gets passed on.
+ */
+class CounterCoalescing
+{
+public:
+	//Routes setting counter values through coalescing, the combined values are passed on to the entries it replaces.
+	static void Install( quDispatchTable& dispatch );
+	static void Detach();
+
+	static bool SetCoalescing( quCounterID counterID, quCounterCoalescing coalescing );
+	static void SetFlushInterval( quUInt64 intervalNanos );
+	//Starts the flushing thread if it isn't running yet, it keeps running until we're detached.
+	static void StartFlushing();
+	//Passes on the combined value of every counter that was set since the last flush, if it changed, and samples the
+	//CounterAccumulators.
+	static void Flush();
+	static void FlushIfDue();
+	static void OnCounterRemoved( quCounterID counterID );
+};
+
+} //End namespace qul
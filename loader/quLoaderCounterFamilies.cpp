@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderCounterFamilies.h"
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace qul
+{
+
+struct CounterSeries
+{
+	std::atomic< quUInt32 > generation;   //!< Odd while the slot is being written, lookups retry if it changed while they read it.
+	std::atomic< quUInt64 > hash;         //!< Hash of the label values, 0 for slots that were never used.
+	std::atomic< quUInt64 > checkHash;    //!< Second hash of the label values, together with hash it identifies the series.
+	std::atomic< quCounterID > counterID; //!< QU_INVALID_COUNTER_ID while the series has no counter, for instance after it was evicted.
+	std::atomic< bool > referenced;       //!< Set by lookups, cleared when eviction passes by.
+};
+
+struct CounterFamily
+{
+	std::string name;
+	std::vector< std::string > labelNames;
+	quUInt32 color;
+	quCounterType type;
+	quUInt32 maxSeries;
+	std::mutex mutex;      //!< Guards adding and evicting series, and everything below.
+	quUInt32 seriesCount;  //!< Number of series that currently have a counter.
+	quUInt32 evictionHand; //!< Slot the next eviction starts sweeping at.
+	quUInt32 slotMask;     //!< Number of slots minus one, the number of slots is a power of two.
+	std::unique_ptr< CounterSeries[] > slots;
+};
+
+static std::mutex familiesMutex;                                          //!< Guards adding and removing families.
+static std::atomic< CounterFamily* > families[ QU_MAX_COUNTER_FAMILIES ]; //!< Every family, indexed by family id.
+//Families are never freed, other threads may still be looking up series in a family while it's removed.
+static std::vector< std::unique_ptr< CounterFamily > > allFamilies;
+
+//The epoch a thread was at when it started using a series, 0 while it isn't using any.
+struct ReaderEpoch
+{
+	std::atomic< quUInt64 > epoch;
+	std::atomic< bool > inUse; //!< Cleared when the thread exits, the next new thread takes it over.
+};
+//A counter that was taken out of its family, it's removed once every thread that may still be using it moved on.
+struct RetiredCounter
+{
+	quCounterID counterID;
+	quUInt64 epoch; //!< Epoch the counter was retired in, threads that started using a series later can't have found it.
+};
+
+static std::atomic< quUInt64 > currentEpoch = 1;
+static std::mutex readersMutex;                                 //!< Guards readers and retiredCounters.
+static std::vector< std::unique_ptr< ReaderEpoch > > readers;   //!< Never shrinks, so threads can keep their entry without locking.
+static std::vector< RetiredCounter > retiredCounters;
+
+struct ReaderEpochRelease
+{
+	ReaderEpoch* reader = nullptr;
+
+	~ReaderEpochRelease()
+	{
+		if( reader != nullptr )
+			reader->inUse.store( false, std::memory_order_release );
+	}
+};
+static thread_local ReaderEpochRelease threadReader;
+
+static ReaderEpoch& GetReaderEpoch()
+{
+	if( threadReader.reader != nullptr )
+		return *threadReader.reader;
+
+	std::lock_guard lock( readersMutex );
+	for( std::unique_ptr< ReaderEpoch >& reader : readers )
+	{
+		if( !reader->inUse.load( std::memory_order_acquire ) )
+		{
+			reader->inUse.store( true, std::memory_order_relaxed );
+			threadReader.reader = reader.get();
+			return *reader;
+		}
+	}
+	readers.push_back( std::make_unique< ReaderEpoch >() );
+	readers.back()->inUse.store( true, std::memory_order_relaxed );
+	threadReader.reader = readers.back().get();
+	return *threadReader.reader;
+}
+
+/**
+ * Held while a thread looks up a series and uses its counter. The runtime may hand the id of a removed counter to the next
+ * counter it adds, so counters taken out of a family are only removed once no thread can still be holding on to their id.
+ */
+class SeriesReadScope
+{
+public:
+	SeriesReadScope() :
+	    reader( GetReaderEpoch() )
+	{
+		reader.epoch.store( currentEpoch.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+	}
+	~SeriesReadScope()
+	{
+		reader.epoch.store( 0, std::memory_order_release );
+	}
+
+	SeriesReadScope( const SeriesReadScope& ) = delete;
+	SeriesReadScope& operator=( const SeriesReadScope& ) = delete;
+
+private:
+	ReaderEpoch& reader;
+};
+
+//Removes the retired counters no thread can be using anymore.
+static void RemoveRetiredCounters()
+{
+	std::vector< quCounterID > removable;
+	{
+		std::lock_guard lock( readersMutex );
+		if( retiredCounters.empty() )
+			return;
+
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		quUInt64 oldestEpoch = UINT64_MAX;
+		for( std::unique_ptr< ReaderEpoch >& reader : readers )
+		{
+			quUInt64 epoch = reader->epoch.load( std::memory_order_acquire );
+			if( epoch != 0 && epoch < oldestEpoch )
+				oldestEpoch = epoch;
+		}
+		std::erase_if( retiredCounters, [ & ]( const RetiredCounter& retired ) {
+			if( retired.epoch >= oldestEpoch )
+				return false;
+			removable.push_back( retired.counterID );
+			return true;
+		} );
+	}
+	for( quCounterID counterID : removable )
+		quRemoveCounter( counterID );
+}
+//The series must have been taken out of its slot already.
+static void RetireCounter( quCounterID counterID )
+{
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	quUInt64 epoch = currentEpoch.fetch_add( 1, std::memory_order_seq_cst );
+	std::lock_guard lock( readersMutex );
+	retiredCounters.push_back( { counterID, epoch } );
+}
+
+//Must be called with the family's mutex locked, lookups that overlap with it retry.
+static void WriteSeries( CounterSeries& series, quUInt64 hash, quUInt64 checkHash, quCounterID counterID )
+{
+	quUInt32 generation = series.generation.load( std::memory_order_relaxed );
+	series.generation.store( generation + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	series.hash.store( hash, std::memory_order_relaxed );
+	series.checkHash.store( checkHash, std::memory_order_relaxed );
+	series.counterID.store( counterID, std::memory_order_relaxed );
+	series.generation.store( generation + 2, std::memory_order_release );
+}
+
+//Hashes the label values with two different functions, values are separated by a byte that never occurs in utf-8.
+static std::pair< quUInt64, quUInt64 > HashLabelValues( const CounterFamily& family, const char* const* labelValues )
+{
+	quUInt64 hash = 14695981039346656037ull;
+	quUInt64 checkHash = 0x9E3779B97F4A7C15ull;
+	auto add = [ & ]( quUInt8 byte ) {
+		hash = ( hash ^ byte ) * 1099511628211ull;
+		checkHash = ( checkHash ^ byte ) * 0xFF51AFD7ED558CCDull;
+		checkHash ^= checkHash >> 29;
+	};
+
+	for( size_t label = 0; label < family.labelNames.size(); ++label )
+	{
+		for( const char* c = labelValues[ label ] != nullptr ? labelValues[ label ] : ""; *c != '\0'; ++c )
+			add( quUInt8( *c ) );
+		add( 0xFF );
+	}
+	//0 marks slots that were never used.
+	return { hash != 0 ? hash : 1, checkHash };
+}
+
+static CounterFamily* GetFamily( quCounterFamilyID familyID )
+{
+	if( familyID >= QU_MAX_COUNTER_FAMILIES )
+		return nullptr;
+
+	return families[ familyID ].load( std::memory_order_acquire );
+}
+
+//Must be called with the family's mutex locked.
+static void EvictSeries( CounterFamily& family )
+{
+	for( ;; )
+	{
+		CounterSeries& series = family.slots[ family.evictionHand ];
+		family.evictionHand = ( family.evictionHand + 1 ) & family.slotMask;
+
+		quCounterID counterID = series.counterID.load( std::memory_order_relaxed );
+		if( counterID == QU_INVALID_COUNTER_ID || series.referenced.exchange( false, std::memory_order_relaxed ) )
+			continue;
+
+		WriteSeries( series, series.hash.load( std::memory_order_relaxed ), series.checkHash.load( std::memory_order_relaxed ), QU_INVALID_COUNTER_ID );
+		RetireCounter( counterID );
+		--family.seriesCount;
+		return;
+	}
+}
+
+static quCounterID AddSeries( CounterFamily& family, const char* const* labelValues, quUInt64 hash, quUInt64 checkHash )
+{
+	std::lock_guard lock( family.mutex );
+
+	//Another thread may have added the series in the meantime. If not, the first slot without a counter along the way is taken.
+	CounterSeries* match = nullptr;
+	CounterSeries* freeSlot = nullptr;
+	for( quUInt32 probe = 0, slot = quUInt32( hash ) & family.slotMask; probe <= family.slotMask; ++probe, slot = ( slot + 1 ) & family.slotMask )
+	{
+		CounterSeries& series = family.slots[ slot ];
+		quUInt64 seriesHash = series.hash.load( std::memory_order_relaxed );
+		if( seriesHash == hash && series.checkHash.load( std::memory_order_relaxed ) == checkHash )
+		{
+			match = &series;
+			break;
+		}
+		if( freeSlot == nullptr && series.counterID.load( std::memory_order_relaxed ) == QU_INVALID_COUNTER_ID )
+			freeSlot = &series;
+		if( seriesHash == 0 )
+			break;
+	}
+	if( match != nullptr && match->counterID.load( std::memory_order_relaxed ) != QU_INVALID_COUNTER_ID )
+		return match->counterID.load( std::memory_order_relaxed );
+
+	CounterSeries* series = match != nullptr ? match : freeSlot;
+	if( series == nullptr )
+		return QU_INVALID_COUNTER_ID;
+
+	if( family.seriesCount >= family.maxSeries )
+		EvictSeries( family );
+	RemoveRetiredCounters();
+
+	std::string counterName = family.name + "{";
+	for( size_t label = 0; label < family.labelNames.size(); ++label )
+	{
+		if( label != 0 )
+			counterName += ",";
+		counterName += family.labelNames[ label ] + "=" + ( labelValues[ label ] != nullptr ? labelValues[ label ] : "" );
+	}
+	counterName += "}";
+
+	quCounterID counterID = quAddTypedCounter( counterName.c_str(), family.color, family.type );
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return QU_INVALID_COUNTER_ID;
+
+	series->referenced.store( true, std::memory_order_relaxed );
+	WriteSeries( *series, hash, checkHash, counterID );
+	++family.seriesCount;
+	return counterID;
+}
+
+//Hot path, must be called within a SeriesReadScope.
+static quCounterID GetSeries( CounterFamily& family, const char* const* labelValues )
+{
+	auto [hash, checkHash] = HashLabelValues( family, labelValues );
+	for( quUInt32 probe = 0, slot = quUInt32( hash ) & family.slotMask; probe <= family.slotMask; ++probe, slot = ( slot + 1 ) & family.slotMask )
+	{
+		CounterSeries& series = family.slots[ slot ];
+		quUInt32 generation = series.generation.load( std::memory_order_acquire );
+		quUInt64 seriesHash = series.hash.load( std::memory_order_relaxed );
+		quUInt64 seriesCheckHash = series.checkHash.load( std::memory_order_relaxed );
+		quCounterID counterID = series.counterID.load( std::memory_order_relaxed );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		//The slot is being written, the family's mutex waits for that to finish.
+		if( ( generation & 1 ) != 0 || series.generation.load( std::memory_order_relaxed ) != generation )
+			break;
+		if( seriesHash == 0 )
+			break;
+		if( seriesHash != hash || seriesCheckHash != checkHash )
+			continue;
+		if( counterID == QU_INVALID_COUNTER_ID )
+			break;
+
+		//Only written when it changes, so that series used by many threads don't bounce their cache line around.
+		if( !series.referenced.load( std::memory_order_relaxed ) )
+			series.referenced.store( true, std::memory_order_relaxed );
+		return counterID;
+	}
+	return AddSeries( family, labelValues, hash, checkHash );
+}
+
+void CounterFamilies::Detach()
+{
+	std::lock_guard lock( familiesMutex );
+	for( std::atomic< CounterFamily* >& family : families )
+		family.store( nullptr, std::memory_order_relaxed );
+
+	std::lock_guard readersLock( readersMutex );
+	retiredCounters.clear();
+}
+
+quCounterFamilyID CounterFamilies::AddFamily( const char* familyName, quUInt32 color, quCounterType type, const char* const* labelNames, quUInt32 labelCount, quUInt32 maxSeries )
+{
+	if( familyName == nullptr || ( labelNames == nullptr && labelCount != 0 ) || type > QU_COUNTER_TYPE_ACCUMULATOR || maxSeries == 0 || maxSeries > QU_MAX_COUNTER_SERIES )
+		return QU_INVALID_COUNTER_FAMILY_ID;
+
+	std::unique_ptr< CounterFamily > family = std::make_unique< CounterFamily >();
+	family->name = familyName;
+	for( quUInt32 label = 0; label < labelCount; ++label )
+		family->labelNames.push_back( labelNames[ label ] != nullptr ? labelNames[ label ] : "" );
+	family->color = color;
+	family->type = type;
+	family->maxSeries = maxSeries;
+	family->seriesCount = 0;
+	family->evictionHand = 0;
+	family->slotMask = std::bit_ceil( maxSeries * 2 ) - 1;
+	family->slots = std::make_unique< CounterSeries[] >( family->slotMask + 1 );
+	for( quUInt32 slot = 0; slot <= family->slotMask; ++slot )
+		family->slots[ slot ].counterID.store( QU_INVALID_COUNTER_ID, std::memory_order_relaxed );
+
+	std::lock_guard lock( familiesMutex );
+	for( quCounterFamilyID familyID = 0; familyID < QU_MAX_COUNTER_FAMILIES; ++familyID )
+	{
+		if( families[ familyID ].load( std::memory_order_relaxed ) != nullptr )
+			continue;
+
+		families[ familyID ].store( family.get(), std::memory_order_release );
+		allFamilies.push_back( std::move( family ) );
+		return familyID;
+	}
+	return QU_INVALID_COUNTER_FAMILY_ID;
+}
+bool CounterFamilies::RemoveFamily( quCounterFamilyID familyID )
+{
+	{
+		std::lock_guard lock( familiesMutex );
+		CounterFamily* family = GetFamily( familyID );
+		if( family == nullptr )
+			return false;
+
+		families[ familyID ].store( nullptr, std::memory_order_relaxed );
+		std::lock_guard familyLock( family->mutex );
+		for( quUInt32 slot = 0; slot <= family->slotMask; ++slot )
+		{
+			CounterSeries& series = family->slots[ slot ];
+			quCounterID counterID = series.counterID.load( std::memory_order_relaxed );
+			if( counterID == QU_INVALID_COUNTER_ID )
+				continue;
+
+			WriteSeries( series, series.hash.load( std::memory_order_relaxed ), series.checkHash.load( std::memory_order_relaxed ), QU_INVALID_COUNTER_ID );
+			RetireCounter( counterID );
+		}
+		family->seriesCount = 0;
+	}
+	RemoveRetiredCounters();
+	return true;
+}
+
+bool CounterFamilies::SetValue( quCounterFamilyID familyID, const char* const* labelValues, double newCounterValue )
+{
+	CounterFamily* family = GetFamily( familyID );
+	if( family == nullptr || family->type == QU_COUNTER_TYPE_ACCUMULATOR || ( labelValues == nullptr && !family->labelNames.empty() ) )
+		return false;
+
+	SeriesReadScope readScope;
+	quCounterID counterID = GetSeries( *family, labelValues );
+	switch( family->type )
+	{
+	case QU_COUNTER_TYPE_INT64:
+		return quSetCounterValueInt64( counterID, quInt64( newCounterValue ) );
+	case QU_COUNTER_TYPE_DOUBLE:
+		return quSetCounterValueDouble( counterID, newCounterValue );
+	default:
+		return quSetCounterValue( counterID, float( newCounterValue ) );
+	}
+}
+bool CounterFamilies::AddTo( quCounterFamilyID familyID, const char* const* labelValues, quInt64 delta )
+{
+	CounterFamily* family = GetFamily( familyID );
+	if( family == nullptr || family->type != QU_COUNTER_TYPE_ACCUMULATOR || ( labelValues == nullptr && !family->labelNames.empty() ) )
+		return false;
+
+	SeriesReadScope readScope;
+	return quAddToCounter( GetSeries( *family, labelValues ), delta );
+}
+
+} //End namespace qul
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Keeps the series of every counter family, see quAddCounterFamily. Each family has an open addressing table that's twice as
+ * large as the number of series it may hold, whose slots are identified by two independent hashes of the label values. Looking
+ * up a series only reads atomics, the family's mutex is only taken to add a series or to evict one. Evicted series keep their
+ * slot, without a counter, so that lookups never stop early. Slots are reclaimed by series added later on.
+ * Eviction approximates least recently used with the clock algorithm: lookups mark the series they find, and eviction sweeps
+ * over the table, unmarking series until it finds one that wasn't used since it last passed by.
+ * Slots carry a generation that's odd while they're written, lookups that overlap with a write fall back to the locked path.
+ * The counters of evicted series are only removed once every thread that was using the family at the time has moved on, since
+ * the runtime may hand their ids to the next counter it adds.
+ */
+class CounterFamilies
+{
+public:
+	//Counter ids are only valid for the runtime that handed them out, this forgets every family.
+	static void Detach();
+
+	static quCounterFamilyID AddFamily( const char* familyName, quUInt32 color, quCounterType type, const char* const* labelNames, quUInt32 labelCount, quUInt32 maxSeries );
+	static bool RemoveFamily( quCounterFamilyID familyID );
+
+	static bool SetValue( quCounterFamilyID familyID, const char* const* labelValues, double newCounterValue );
+	static bool AddTo( quCounterFamilyID familyID, const char* const* labelValues, quInt64 delta );
+};
+
+} //End namespace qul
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderCounterPolling.h"
+#include "quLoaderEventStaging.h"
+#include <quApi.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qul
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct PolledCounter
+{
+	quCounterID counterID;
+	quPolledCounterCallback_Ptr callback;
+	void* userData;
+	Clock::duration period;
+	Clock::time_point nextPoll;
+};
+
+static std::mutex controlMutex;                      //!< Serializes starting and stopping the polling thread.
+static std::mutex pollingMutex;                      //!< Guards everything below, held while polling except for the callbacks.
+static std::condition_variable pollingChanged;       //!< Wakes the polling thread when counters were added or it should stop.
+static std::condition_variable callbackReturned;     //!< Wakes the threads removing a counter whose callback is running.
+static quSetCounterValues_Ptr setCounterValues = nullptr;
+static std::vector< PolledCounter > polledCounters;
+static quCounterID polledCounterID = QU_INVALID_COUNTER_ID; //!< Counter whose callback is running.
+static std::thread::id pollingThreadID;                      //!< Lets the callbacks remove counters without waiting on themselves.
+static bool stopping = false;
+
+//Joins the polling thread if it's still running when the application exits.
+struct PollingThread
+{
+	std::thread thread;
+
+	~PollingThread()
+	{
+		if( !thread.joinable() )
+			return;
+
+		{
+			std::lock_guard lock( pollingMutex );
+			stopping = true;
+		}
+		pollingChanged.notify_all();
+		thread.join();
+	}
+};
+static PollingThread pollingThread;
+
+static PolledCounter* FindPolledCounter( quCounterID counterID )
+{
+	auto it = std::find_if( polledCounters.begin(), polledCounters.end(), [ counterID ]( const PolledCounter& counter ) { return counter.counterID == counterID; } );
+	return it != polledCounters.end() ? &*it : nullptr;
+}
+
+//Must be called with pollingMutex locked, which is unlocked while a callback runs so that callbacks may add and remove polled
+//counters. Counters that are removed by then aren't called anymore. Returns when the next counter is due, if there are any.
+static Clock::time_point Poll( std::unique_lock< std::mutex >& lock )
+{
+	static std::vector< quCounterID > dueCounterIDs;
+	static std::vector< quCounterID > counterIDs;
+	static std::vector< float > values;
+	dueCounterIDs.clear();
+	counterIDs.clear();
+	values.clear();
+
+	bool recording = qu::IsRecording();
+	Clock::time_point now = Clock::now();
+	for( PolledCounter& counter : polledCounters )
+	{
+		if( counter.nextPoll <= now )
+		{
+			if( recording )
+				dueCounterIDs.push_back( counter.counterID );
+			//Polls that were missed, because a callback took too long or we weren't scheduled, aren't caught up on.
+			counter.nextPoll = std::max( counter.nextPoll + counter.period, now );
+		}
+	}
+
+	for( quCounterID counterID : dueCounterIDs )
+	{
+		PolledCounter* counter = FindPolledCounter( counterID );
+		if( counter == nullptr )
+			continue;
+
+		quPolledCounterCallback_Ptr callback = counter->callback;
+		void* userData = counter->userData;
+		polledCounterID = counterID;
+		lock.unlock();
+		float value = callback( userData );
+		lock.lock();
+		polledCounterID = QU_INVALID_COUNTER_ID;
+		callbackReturned.notify_all();
+
+		counterIDs.push_back( counterID );
+		values.push_back( value );
+	}
+
+	//Callbacks may have removed counters that were polled before them.
+	for( size_t i = counterIDs.size(); i-- > 0; )
+	{
+		if( FindPolledCounter( counterIDs[ i ] ) == nullptr )
+		{
+			counterIDs.erase( counterIDs.begin() + i );
+			values.erase( values.begin() + i );
+		}
+	}
+	if( !counterIDs.empty() && setCounterValues != nullptr )
+	{
+		setCounterValues( counterIDs.data(), values.data(), quUInt32( counterIDs.size() ) );
+		//Nothing else runs on this thread that would flush the values later on.
+		EventStaging::FlushCurrentThread();
+	}
+
+	//Counters added by the callbacks are due right away.
+	Clock::time_point nextPoll = Clock::time_point::max();
+	for( const PolledCounter& counter : polledCounters )
+		nextPoll = std::min( nextPoll, counter.nextPoll );
+	return nextPoll;
+}
+
+static void Run()
+{
+	std::unique_lock lock( pollingMutex );
+	pollingThreadID = std::this_thread::get_id();
+	while( !stopping )
+	{
+		Clock::time_point nextPoll = Poll( lock );
+		//Stopping while a callback ran didn't wake anyone.
+		if( stopping )
+			break;
+		if( polledCounters.empty() )
+			pollingChanged.wait( lock );
+		else
+			pollingChanged.wait_until( lock, nextPoll );
+	}
+	//Thread ids are reused once the thread exits.
+	pollingThreadID = std::thread::id();
+}
+
+static void Stop()
+{
+	{
+		std::lock_guard lock( pollingMutex );
+		stopping = true;
+	}
+	pollingChanged.notify_all();
+	if( pollingThread.thread.joinable() )
+		pollingThread.thread.join();
+}
+
+void CounterPolling::Install( const quDispatchTable& dispatch )
+{
+	std::lock_guard lock( pollingMutex );
+	setCounterValues = dispatch.SetCounterValues;
+}
+void CounterPolling::Detach()
+{
+	std::lock_guard controlLock( controlMutex );
+	Stop();
+
+	//Counter ids are only valid for the runtime that handed them out.
+	std::lock_guard lock( pollingMutex );
+	polledCounters.clear();
+	setCounterValues = nullptr;
+}
+
+bool CounterPolling::AddPolledCounter( quCounterID counterID, quPolledCounterCallback_Ptr callback, void* userData, quUInt32 periodMicros )
+{
+	if( counterID == QU_INVALID_COUNTER_ID || callback == nullptr || periodMicros == 0 )
+		return false;
+
+	std::lock_guard controlLock( controlMutex );
+	{
+		std::lock_guard lock( pollingMutex );
+		if( setCounterValues == nullptr )
+			return false;
+
+		polledCounters.push_back( { counterID, callback, userData, std::chrono::microseconds( periodMicros ), Clock::now() } );
+		if( pollingThread.thread.joinable() )
+		{
+			pollingChanged.notify_all();
+			return true;
+		}
+		stopping = false;
+	}
+
+	pollingThread.thread = std::thread( &Run );
+	return true;
+}
+void CounterPolling::RemovePolledCounter( quCounterID counterID )
+{
+	std::unique_lock lock( pollingMutex );
+	auto it = std::find_if( polledCounters.begin(), polledCounters.end(), [ counterID ]( const PolledCounter& counter ) { return counter.counterID == counterID; } );
+	if( it != polledCounters.end() )
+		polledCounters.erase( it );
+
+	//Whatever the callback polls may go away once we return. Callbacks removing their own counter can't wait for themselves.
+	if( std::this_thread::get_id() != pollingThreadID )
+		callbackReturned.wait( lock, [ counterID ] { return polledCounterID != counterID; } );
+}
+
+} //End namespace qul
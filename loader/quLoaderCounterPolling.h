@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Polls the counters added with quAddPolledCounter. A background thread, started along with the first polled counter, sleeps
+ * until the next counter is due, calls the callbacks of every counter that's due and passes their values on in a single batch.
+ * Callbacks are called with the polling mutex unlocked, so they may add and remove polled counters, their own included. Removing
+ * a counter waits for its callback if it's running, after which the callback won't be called anymore.
+ */
+class CounterPolling
+{
+public:
+	//The values are passed on through the table's SetCounterValues.
+	static void Install( const quDispatchTable& dispatch );
+	static void Detach();
+
+	static bool AddPolledCounter( quCounterID counterID, quPolledCounterCallback_Ptr callback, void* userData, quUInt32 periodMicros );
+	static void RemovePolledCounter( quCounterID counterID );
+};
+
+} //End namespace qul
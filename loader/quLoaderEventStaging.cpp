@@ -0,0 +1,950 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderEventStaging.h"
+#include "quLoaderActivityFilter.h"
+#include <quApi.hpp>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+namespace qul
+{
+
+static constexpr quUInt32 STAGED_EVENT_CAPACITY = 256; //!< Power of two, events are stored at their position modulo the capacity.
+static constexpr quUInt32 STAGED_EVENT_MASK = STAGED_EVENT_CAPACITY - 1;
+//Events of activities that turned out too short are marked instead of taken out, other threads may be flushing the events before them.
+static constexpr quEventType DROPPED_EVENT = 0xFF;
+
+/**
+ * Activity ids handed out for staged activities have QU_SUBMITTED_ACTIVITY_ID_BIT set, followed by the slot of the thread that
+ * staged them and a counter. This tells us whether a stop can be staged as well or whether another thread may still be holding on
+ * to the start. Slot 0 is used for the ids applications reserve themselves.
+ */
+static constexpr int THREAD_SLOT_SHIFT = 40;
+static constexpr quActivityID ACTIVITY_COUNTER_MASK = ( (quActivityID)1 << THREAD_SLOT_SHIFT ) - 1;
+static constexpr quActivityID THREAD_SLOT_MASK = ~QU_SUBMITTED_ACTIVITY_ID_BIT & ~ACTIVITY_COUNTER_MASK;
+
+//A staged activity with a minimum duration whose stop hasn't been staged yet.
+struct PendingActivity
+{
+	quActivityID activityID;
+	quUInt64 minDurationNanos;
+	quUInt32 position; //!< Position of the activity's start in ThreadEvents::events.
+};
+
+/**
+ * Only the owning thread stages events, it publishes them by storing the position past them and doesn't lock anything to do so.
+ * Flushing takes the mutex, whichever thread does it. The owning thread only takes it to touch the pending activities, which
+ * other threads settle as well when they flush or stop one of them.
+ */
+struct ThreadEvents
+{
+	//Owning thread
+	quActivityID threadSlot;                       //!< Submitted bit and slot of this thread, shared by every activity id this thread hands out.
+	quActivityID nextActivityID;                   //!< Counter part of the next activity id this thread hands out.
+	quUInt32 tail;                                 //!< Position the next event is staged at.
+	quUInt32 runningCount;                         //!< Number of activities started on the channel that haven't stopped yet.
+	quActivityID running[ STAGED_EVENT_CAPACITY ]; //!< The running activities in the order they started.
+	std::atomic< quUInt32 > published;             //!< Events before this position are staged completely.
+	std::atomic< quActivityChannelID > channelID;  //!< The channel that belongs to this thread, only activities on this channel are staged.
+
+	//Guarded by mutex
+	std::mutex mutex;
+	std::atomic< quUInt32 > head;                    //!< Events before this position were submitted.
+	std::atomic< quUInt32 > pendingCount;            //!< Number of pending activities, ordered by the position of their start.
+	std::atomic< quUInt32 > stoppedElsewhereCount;   //!< Lets the owning thread check for stoppedElsewhere without locking.
+	std::vector< quActivityID > stoppedElsewhere;    //!< Activities of this thread that other threads stopped, they may still be running.
+	PendingActivity pending[ STAGED_EVENT_CAPACITY ];
+	quEvent events[ STAGED_EVENT_CAPACITY ];
+	//Copies of the string arguments of formatted activities, by the position of their event. Only the owning thread writes
+	//them, once that position was submitted.
+	std::string argumentStrings[ STAGED_EVENT_CAPACITY ];
+};
+
+//Submitted activities the runtime knows by the id it handed out while their events were replayed.
+struct ReplayedActivity
+{
+	quActivityID activityID;
+	quActivityChannelID channelID;
+	quUInt64 sequence; //!< Order in which the activities were replayed, the last one of a channel is its current one.
+};
+
+static quDispatchTable runtime;              //!< The entries of the runtime we forward to.
+static std::atomic< bool > installed;        //!< Whether the dispatch table currently routes through staging.
+static bool stagesTypedCounters = false;     //!< Whether the runtime takes QU_EVENT_SET_TYPED_COUNTER_VALUE events.
+static bool stagesFormatArguments = false;   //!< Whether the runtime takes QU_EVENT_FORMAT_ARGUMENT events.
+static std::mutex threadsMutex;              //!< Guards threads.
+static std::vector< ThreadEvents* > threads; //!< Every thread that has staged events at some point and is still running.
+static std::atomic< quActivityID > nextThreadSlot = 1;
+static std::atomic< quActivityID > nextReservedActivityID = 0;
+static std::mutex replayMutex;                                                   //!< Guards replayedActivities.
+static std::unordered_map< quActivityID, ReplayedActivity > replayedActivities; //!< Activities that were replayed and didn't stop yet, by submitted id.
+static quUInt64 nextReplaySequence = 0;                                          //!< Guarded by replayMutex.
+
+static thread_local ThreadEvents* threadEvents = nullptr;
+
+static quEvent& EventAt( ThreadEvents& events, quUInt32 position )
+{
+	return events.events[ position & STAGED_EVENT_MASK ];
+}
+
+//Must be called with the mutex locked. Submits the events before settledEnd, which mustn't include the start of a pending activity.
+static void SubmitSettled( ThreadEvents& events, quUInt32 settledEnd )
+{
+	quUInt32 head = events.head.load( std::memory_order_relaxed );
+	if( settledEnd == head )
+		return;
+
+	quEvent batch[ STAGED_EVENT_CAPACITY ];
+	quUInt32 count = 0;
+	for( quUInt32 position = head; position != settledEnd; ++position )
+	{
+		const quEvent& event = EventAt( events, position );
+		if( event.type != DROPPED_EVENT )
+			batch[ count++ ] = event;
+	}
+	if( count != 0 )
+		runtime.SubmitEvents( batch, count );
+	events.head.store( settledEnd, std::memory_order_release );
+}
+static quUInt32 GetSettledEnd( ThreadEvents& events )
+{
+	return events.pendingCount.load( std::memory_order_relaxed ) != 0 ? events.pending[ 0 ].position : events.published.load( std::memory_order_acquire );
+}
+static void RemovePending( ThreadEvents& events, quUInt32 index )
+{
+	quUInt32 pendingCount = events.pendingCount.load( std::memory_order_relaxed ) - 1;
+	memmove( &events.pending[ index ], &events.pending[ index + 1 ], ( pendingCount - index ) * sizeof( PendingActivity ) );
+	events.pendingCount.store( pendingCount, std::memory_order_relaxed );
+}
+
+//Must be called with the mutex locked. Submits the staged events up to the oldest pending activity. Pending activities that ran
+//for their minimum duration already are kept no matter when they stop, the others stay staged until their stop decides whether
+//they're submitted at all.
+static void Flush( ThreadEvents& events )
+{
+	if( quUInt32 pendingCount = events.pendingCount.load( std::memory_order_relaxed ); pendingCount != 0 )
+	{
+		quUInt64 now = qu::GetTimestamp();
+		quUInt32 keptCount = 0;
+		for( quUInt32 i = 0; i < pendingCount; ++i )
+		{
+			const PendingActivity& pending = events.pending[ i ];
+			if( now - EventAt( events, pending.position ).timestamp < pending.minDurationNanos )
+				events.pending[ keptCount++ ] = pending;
+		}
+		events.pendingCount.store( keptCount, std::memory_order_relaxed );
+	}
+	SubmitSettled( events, GetSettledEnd( events ) );
+}
+//Must be called with the mutex locked. Submits every staged event, activities that were still pending are kept regardless of their duration.
+static void FlushAll( ThreadEvents& events )
+{
+	events.pendingCount.store( 0, std::memory_order_relaxed );
+	SubmitSettled( events, events.published.load( std::memory_order_acquire ) );
+}
+
+//Flushes and releases the staged events of a thread when it exits.
+struct ThreadEventsCleanup
+{
+	ThreadEvents* events = nullptr;
+
+	~ThreadEventsCleanup()
+	{
+		if( events == nullptr )
+			return;
+
+		std::lock_guard threadsLock( threadsMutex );
+		threads.erase( std::find( threads.begin(), threads.end(), events ) );
+		{
+			//Activities this thread didn't stop are no longer stopped here, so there's no point in holding them back.
+			std::lock_guard lock( events->mutex );
+			FlushAll( *events );
+		}
+		delete events;
+		threadEvents = nullptr;
+	}
+};
+static thread_local ThreadEventsCleanup threadEventsCleanup;
+
+static ThreadEvents& GetThreadEvents()
+{
+	if( threadEvents != nullptr )
+		return *threadEvents;
+
+	ThreadEvents* events = new ThreadEvents();
+	events->threadSlot = QU_SUBMITTED_ACTIVITY_ID_BIT | ( ( nextThreadSlot.fetch_add( 1 ) << THREAD_SLOT_SHIFT ) & THREAD_SLOT_MASK );
+	events->nextActivityID = 0;
+	events->tail = 0;
+	events->runningCount = 0;
+	events->published.store( 0, std::memory_order_relaxed );
+	events->channelID.store( QU_INVALID_ACTIVITY_CHANNEL_ID, std::memory_order_relaxed );
+	events->head.store( 0, std::memory_order_relaxed );
+	events->pendingCount.store( 0, std::memory_order_relaxed );
+	events->stoppedElsewhereCount.store( 0, std::memory_order_relaxed );
+	{
+		std::lock_guard threadsLock( threadsMutex );
+		threads.push_back( events );
+	}
+	threadEventsCleanup.events = events;
+	threadEvents = events;
+	return *events;
+}
+
+static bool HasRoom( const ThreadEvents& events, quUInt32 head, quUInt32 count )
+{
+	return events.tail - head <= STAGED_EVENT_CAPACITY - count;
+}
+//Must be called with the mutex locked. Makes room for count events after the last staged one.
+static void MakeRoomLocked( ThreadEvents& events, quUInt32 count )
+{
+	Flush( events );
+	while( !HasRoom( events, events.head.load( std::memory_order_relaxed ), count ) && events.pendingCount.load( std::memory_order_relaxed ) != 0 )
+	{
+		//The oldest pending activity holds back the whole buffer by itself, it's kept so that the buffer can take more events.
+		RemovePending( events, 0 );
+		SubmitSettled( events, GetSettledEnd( events ) );
+	}
+}
+static void MakeRoom( ThreadEvents& events, quUInt32 count )
+{
+	std::lock_guard lock( events.mutex );
+	MakeRoomLocked( events, count );
+}
+//Only called by the owning thread, the event is only seen by others once it's published.
+static quEvent& StageEvent( ThreadEvents& events, quEventType type )
+{
+	if( !HasRoom( events, events.head.load( std::memory_order_acquire ), 1 ) ) [[unlikely]]
+		MakeRoom( events, 1 );
+
+	quEvent& event = EventAt( events, events.tail );
+	event.timestamp = qu::GetTimestamp();
+	event.type = type;
+	return event;
+}
+static void PublishEvent( ThreadEvents& events )
+{
+	events.published.store( ++events.tail, std::memory_order_release );
+}
+
+//Must be called with the mutex locked. Takes the activity out of the pending ones and drops its start if it's shorter than its
+//minimum duration, in which case its stop mustn't be staged.
+static bool DropIfTooShort( ThreadEvents& events, quActivityID activityID, quUInt64 stopTimestamp )
+{
+	for( quUInt32 i = events.pendingCount.load( std::memory_order_relaxed ); i-- > 0; )
+	{
+		if( events.pending[ i ].activityID != activityID )
+			continue;
+
+		quUInt32 startPosition = events.pending[ i ].position;
+		bool tooShort = stopTimestamp - EventAt( events, startPosition ).timestamp < events.pending[ i ].minDurationNanos;
+		RemovePending( events, i );
+		if( !tooShort )
+			return false;
+
+		//Whatever was staged in between stays, it now belongs to the activity this one was started in. Only the activity's own
+		//arguments and annotations go with it.
+		EventAt( events, startPosition ).type = DROPPED_EVENT;
+		quUInt32 published = events.published.load( std::memory_order_acquire );
+		for( quUInt32 position = startPosition + 1; position != published; ++position )
+		{
+			quEvent& event = EventAt( events, position );
+			if( ( event.type == QU_EVENT_ANNOTATE_ACTIVITY || event.type == QU_EVENT_FORMAT_ARGUMENT ) && event.activityID == activityID )
+				event.type = DROPPED_EVENT;
+		}
+		ActivityFilter::OnBelowMinDuration();
+		return true;
+	}
+	return false;
+}
+
+//Activities started on the thread's channel nest, so the last one still running is the channel's current activity. Activities
+//the runtime started on the channel before it was bound to the thread lie below them, stopping those is left to the runtime.
+static void PushRunning( ThreadEvents& events, quActivityID activityID )
+{
+	if( events.runningCount == STAGED_EVENT_CAPACITY )
+	{
+		//Forgetting the oldest is fine, the runtime stops it on its own once the newer ones have stopped.
+		--events.runningCount;
+		memmove( &events.running[ 0 ], &events.running[ 1 ], events.runningCount * sizeof( quActivityID ) );
+	}
+	events.running[ events.runningCount++ ] = activityID;
+}
+static void StopRunning( ThreadEvents& events, quActivityID activityID )
+{
+	for( quUInt32 i = events.runningCount; i-- > 0; )
+	{
+		if( events.running[ i ] != activityID )
+			continue;
+
+		--events.runningCount;
+		memmove( &events.running[ i ], &events.running[ i + 1 ], ( events.runningCount - i ) * sizeof( quActivityID ) );
+		return;
+	}
+}
+//Takes the activities other threads stopped off the running ones, only the owning thread knows which are running.
+static void ForgetStoppedElsewhere( ThreadEvents& events )
+{
+	if( events.stoppedElsewhereCount.load( std::memory_order_relaxed ) == 0 ) [[likely]]
+		return;
+
+	std::lock_guard lock( events.mutex );
+	for( quActivityID activityID : events.stoppedElsewhere )
+		StopRunning( events, activityID );
+	events.stoppedElsewhere.clear();
+	events.stoppedElsewhereCount.store( 0, std::memory_order_relaxed );
+}
+
+//Activities staged by another thread may still be pending there, stopping them here decides whether they're kept just the same.
+static bool DropIfTooShortOnOwner( quActivityID activityID, quUInt64 stopTimestamp )
+{
+	if( activityID == QU_INVALID_ACTIVITY_ID || ( activityID & QU_SUBMITTED_ACTIVITY_ID_BIT ) == 0 )
+		return false;
+
+	std::lock_guard threadsLock( threadsMutex );
+	for( ThreadEvents* events : threads )
+	{
+		if( ( activityID & ~ACTIVITY_COUNTER_MASK ) != events->threadSlot )
+			continue;
+
+		std::lock_guard lock( events->mutex );
+		if( events->stoppedElsewhere.size() == STAGED_EVENT_CAPACITY )
+			events->stoppedElsewhere.erase( events->stoppedElsewhere.begin() );
+		events->stoppedElsewhere.push_back( activityID );
+		events->stoppedElsewhereCount.store( quUInt32( events->stoppedElsewhere.size() ), std::memory_order_relaxed );
+		return events->pendingCount.load( std::memory_order_relaxed ) != 0 && DropIfTooShort( *events, activityID, stopTimestamp );
+	}
+	return false;
+}
+
+static bool IsStagedHere( const ThreadEvents& events, quActivityID activityID )
+{
+	return activityID != QU_INVALID_ACTIVITY_ID && ( activityID & ~ACTIVITY_COUNTER_MASK ) == events.threadSlot;
+}
+//Writes the start of an activity and the arguments of formatted ones behind the staged events, they're published together so
+//that a flush can't separate them.
+static void WriteStart( ThreadEvents& events, quActivityID stagedActivityID, quActivityChannelID channelID, quRecurringActivityID activityID, const quActivityArg* args, quUInt32 argCount )
+{
+	quEvent& event = EventAt( events, events.tail );
+	event.timestamp = qu::GetTimestamp();
+	event.type = QU_EVENT_START_RECURRING_ACTIVITY;
+	event.activityID = stagedActivityID;
+	event.recurringActivityID = activityID;
+	event.channelID = channelID;
+	for( quUInt32 i = 0; i < argCount; ++i )
+	{
+		quUInt32 position = events.tail + 1 + i;
+		quEvent& argument = EventAt( events, position );
+		argument.type = QU_EVENT_FORMAT_ARGUMENT;
+		argument.activityID = stagedActivityID;
+		argument.annotationType = args[ i ].type;
+		if( args[ i ].type == QU_ACTIVITY_ARG_STRING )
+		{
+			std::string& string = events.argumentStrings[ position & STAGED_EVENT_MASK ];
+			string = args[ i ].stringValue != nullptr ? args[ i ].stringValue : "";
+			argument.annotationValue = quUInt64( uintptr_t( string.c_str() ) );
+		}
+		else
+		{
+			argument.annotationValue = args[ i ].uintValue;
+		}
+	}
+}
+static quActivityID StageStart( ThreadEvents& events, quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 minDurationNanos, const quActivityArg* args = nullptr, quUInt32 argCount = 0 )
+{
+	quActivityID stagedActivityID = events.threadSlot | ( events.nextActivityID++ & ACTIVITY_COUNTER_MASK );
+	quUInt32 count = 1 + argCount;
+	if( minDurationNanos == 0 )
+	{
+		if( !HasRoom( events, events.head.load( std::memory_order_acquire ), count ) ) [[unlikely]]
+			MakeRoom( events, count );
+		WriteStart( events, stagedActivityID, channelID, activityID, args, argCount );
+		events.tail += count;
+		events.published.store( events.tail, std::memory_order_release );
+		return stagedActivityID;
+	}
+
+	//Flushes mustn't submit the start before it's known to be pending.
+	std::lock_guard lock( events.mutex );
+	if( !HasRoom( events, events.head.load( std::memory_order_relaxed ), count ) ) [[unlikely]]
+		MakeRoomLocked( events, count );
+	WriteStart( events, stagedActivityID, channelID, activityID, args, argCount );
+	quUInt32 pendingCount = events.pendingCount.load( std::memory_order_relaxed );
+	events.pending[ pendingCount ] = { stagedActivityID, minDurationNanos, events.tail };
+	events.pendingCount.store( pendingCount + 1, std::memory_order_relaxed );
+	events.tail += count;
+	events.published.store( events.tail, std::memory_order_release );
+	return stagedActivityID;
+}
+static void StageAnnotations( ThreadEvents& events, quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		quEvent& event = StageEvent( events, QU_EVENT_ANNOTATE_ACTIVITY );
+		event.annotationValue = annotations[ i ].uintValue;
+		event.activityID = activityID;
+		event.annotationKeyID = annotations[ i ].keyID;
+		event.annotationType = annotations[ i ].type;
+		PublishEvent( events );
+	}
+}
+//Stages the stop of an activity, unless it was pending and turned out too short.
+static void StageStop( ThreadEvents& events, quActivityID activityID, quActivityChannelID channelID, quUInt64 timestamp, const quAnnotation* annotations, quUInt32 annotationCount )
+{
+	if( activityID != QU_INVALID_ACTIVITY_ID && events.pendingCount.load( std::memory_order_relaxed ) != 0 )
+	{
+		std::lock_guard lock( events.mutex );
+		if( DropIfTooShort( events, activityID, timestamp ) )
+			return;
+	}
+
+	StageAnnotations( events, activityID, annotations, annotationCount );
+	quEvent& event = StageEvent( events, QU_EVENT_STOP_ACTIVITY );
+	event.timestamp = timestamp;
+	event.activityID = activityID;
+	event.channelID = channelID;
+	PublishEvent( events );
+}
+static void FlushThread( ThreadEvents& events )
+{
+	std::lock_guard lock( events.mutex );
+	Flush( events );
+}
+
+//Hot path
+static quActivityID QU_CALL_CONV StagedStartRecurringActivity( quActivityChannelID channelID, quRecurringActivityID activityID )
+{
+	ThreadEvents& events = GetThreadEvents();
+	if( channelID == QU_INVALID_ACTIVITY_CHANNEL_ID || channelID != events.channelID.load( std::memory_order_relaxed ) )
+	{
+		FlushThread( events );
+		return runtime.StartRecurringActivity( channelID, activityID );
+	}
+
+	quActivityID stagedActivityID = StageStart( events, channelID, activityID, ActivityFilter::GetMinDuration( activityID ) );
+	PushRunning( events, stagedActivityID );
+	return stagedActivityID;
+}
+static bool QU_CALL_CONV StagedStopActivity( quActivityID activityID )
+{
+	ThreadEvents& events = GetThreadEvents();
+	StopRunning( events, activityID );
+	if( IsStagedHere( events, activityID ) )
+	{
+		StageStop( events, activityID, QU_INVALID_ACTIVITY_CHANNEL_ID, qu::GetTimestamp(), nullptr, 0 );
+		return true;
+	}
+	FlushThread( events );
+
+	//The activity may have been staged by another thread, whatever that thread staged has to reach the runtime before this stop does.
+	if( DropIfTooShortOnOwner( activityID, qu::GetTimestamp() ) )
+		return true;
+	if( activityID != QU_INVALID_ACTIVITY_ID && ( activityID & QU_SUBMITTED_ACTIVITY_ID_BIT ) != 0 )
+		EventStaging::FlushAllThreads();
+	return runtime.StopActivity( activityID );
+}
+static bool QU_CALL_CONV StagedSetCounterValue( quCounterID counterID, float newCounterValue )
+{
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return false;
+
+	ThreadEvents& events = GetThreadEvents();
+	quEvent& event = StageEvent( events, QU_EVENT_SET_COUNTER_VALUE );
+	event.counterID = counterID;
+	event.counterValue = newCounterValue;
+	PublishEvent( events );
+	return true;
+}
+static bool QU_CALL_CONV StagedSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count )
+{
+	bool setAll = true;
+	ThreadEvents& events = GetThreadEvents();
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		if( counterIDs[ i ] == QU_INVALID_COUNTER_ID )
+		{
+			setAll = false;
+			continue;
+		}
+
+		quEvent& event = StageEvent( events, QU_EVENT_SET_COUNTER_VALUE );
+		event.counterID = counterIDs[ i ];
+		event.counterValue = newCounterValues[ i ];
+		PublishEvent( events );
+	}
+	return setAll;
+}
+static bool StageTypedCounterValue( quCounterID counterID, quCounterType counterType, quUInt64 bits )
+{
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return false;
+
+	ThreadEvents& events = GetThreadEvents();
+	quEvent& event = StageEvent( events, QU_EVENT_SET_TYPED_COUNTER_VALUE );
+	event.counterID = counterID;
+	event.counterType = counterType;
+	event.typedCounterBits = bits;
+	PublishEvent( events );
+	return true;
+}
+//Runtimes that don't know typed counters get the value converted, as their stubs would have done.
+static bool QU_CALL_CONV StagedSetCounterValueInt64( quCounterID counterID, quInt64 newCounterValue )
+{
+	if( !stagesTypedCounters )
+		return StagedSetCounterValue( counterID, float( newCounterValue ) );
+
+	return StageTypedCounterValue( counterID, QU_COUNTER_TYPE_INT64, quUInt64( newCounterValue ) );
+}
+static bool QU_CALL_CONV StagedSetCounterValueDouble( quCounterID counterID, double newCounterValue )
+{
+	if( !stagesTypedCounters )
+		return StagedSetCounterValue( counterID, float( newCounterValue ) );
+
+	quUInt64 bits;
+	memcpy( &bits, &newCounterValue, sizeof( bits ) );
+	return StageTypedCounterValue( counterID, QU_COUNTER_TYPE_DOUBLE, bits );
+}
+static quActivityID QU_CALL_CONV StagedStartActivity( quActivityChannelID channelID, const char* activityName, quUInt32 color )
+{
+	ThreadEvents& events = GetThreadEvents();
+	FlushThread( events );
+	quActivityID activityID = runtime.StartActivity( channelID, activityName, color );
+	if( activityID != QU_INVALID_ACTIVITY_ID && channelID != QU_INVALID_ACTIVITY_CHANNEL_ID && channelID == events.channelID.load( std::memory_order_relaxed ) )
+		PushRunning( events, activityID );
+	return activityID;
+}
+static quFlowID QU_CALL_CONV StagedStartFlow( quActivityChannelID sourceChannel )
+{
+	EventStaging::FlushCurrentThread();
+	return runtime.StartFlow( sourceChannel );
+}
+static bool QU_CALL_CONV StagedStopFlow( quFlowID flowID, quActivityChannelID targetChannel )
+{
+	EventStaging::FlushCurrentThread();
+	return runtime.StopFlow( flowID, targetChannel );
+}
+
+//Timestamps
+static quActivityID QU_CALL_CONV StagedStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp )
+{
+	if( channelID == QU_INVALID_ACTIVITY_CHANNEL_ID )
+		return QU_INVALID_ACTIVITY_ID;
+
+	//The timestamp tells the runtime where the activity belongs, so it can be staged no matter which channel it's on.
+	ThreadEvents& events = GetThreadEvents();
+	quEvent& event = StageEvent( events, QU_EVENT_START_RECURRING_ACTIVITY );
+	event.timestamp = timestamp;
+	event.activityID = events.threadSlot | ( events.nextActivityID++ & ACTIVITY_COUNTER_MASK );
+	event.recurringActivityID = activityID;
+	event.channelID = channelID;
+	quActivityID stagedActivityID = event.activityID;
+	PublishEvent( events );
+	if( channelID == events.channelID.load( std::memory_order_relaxed ) )
+		PushRunning( events, stagedActivityID );
+	return stagedActivityID;
+}
+static bool QU_CALL_CONV StagedStopActivityAt( quActivityID activityID, quUInt64 timestamp )
+{
+	if( activityID == QU_INVALID_ACTIVITY_ID )
+		return false;
+
+	ThreadEvents& events = GetThreadEvents();
+	StopRunning( events, activityID );
+	if( IsStagedHere( events, activityID ) )
+	{
+		StageStop( events, activityID, QU_INVALID_ACTIVITY_CHANNEL_ID, timestamp, nullptr, 0 );
+		return true;
+	}
+	FlushThread( events );
+
+	if( DropIfTooShortOnOwner( activityID, timestamp ) )
+		return true;
+	if( ( activityID & QU_SUBMITTED_ACTIVITY_ID_BIT ) != 0 )
+		EventStaging::FlushAllThreads();
+	quEvent event = {};
+	event.timestamp = timestamp;
+	event.activityID = activityID;
+	event.type = QU_EVENT_STOP_ACTIVITY;
+	return runtime.SubmitEvents( &event, 1 );
+}
+static bool QU_CALL_CONV StagedSetCounterValueAt( quCounterID counterID, float newCounterValue, quUInt64 timestamp )
+{
+	if( counterID == QU_INVALID_COUNTER_ID )
+		return false;
+
+	ThreadEvents& events = GetThreadEvents();
+	quEvent& event = StageEvent( events, QU_EVENT_SET_COUNTER_VALUE );
+	event.timestamp = timestamp;
+	event.counterID = counterID;
+	event.counterValue = newCounterValue;
+	PublishEvent( events );
+	return true;
+}
+static quActivityID QU_CALL_CONV StagedStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount )
+{
+	//Runtimes that can't take the arguments as events are handed the formatted name, which can't be staged.
+	ThreadEvents& events = GetThreadEvents();
+	if( !stagesFormatArguments || channelID == QU_INVALID_ACTIVITY_CHANNEL_ID || channelID != events.channelID.load( std::memory_order_relaxed ) )
+	{
+		FlushThread( events );
+		return runtime.StartFormattedActivity( channelID, descriptor, args, argCount );
+	}
+
+	quRecurringActivityID activityID = std::atomic_ref< quRecurringActivityID >( descriptor->id ).load( std::memory_order_relaxed );
+	quActivityID stagedActivityID = StageStart( events, channelID, activityID, ActivityFilter::GetMinDuration( activityID ), args, argCount );
+	PushRunning( events, stagedActivityID );
+	return stagedActivityID;
+}
+
+//Activity annotations
+static bool QU_CALL_CONV StagedAnnotateActivity( quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	ThreadEvents& events = GetThreadEvents();
+	if( IsStagedHere( events, activityID ) )
+	{
+		StageAnnotations( events, activityID, annotations, count );
+		return true;
+	}
+	FlushThread( events );
+
+	if( ( activityID & QU_SUBMITTED_ACTIVITY_ID_BIT ) != 0 )
+		EventStaging::FlushAllThreads();
+	return runtime.AnnotateActivity( activityID, annotations, count );
+}
+static bool QU_CALL_CONV StagedStopActivityWithArgs( quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	ThreadEvents& events = GetThreadEvents();
+	StopRunning( events, activityID );
+	if( IsStagedHere( events, activityID ) )
+	{
+		StageStop( events, activityID, QU_INVALID_ACTIVITY_CHANNEL_ID, qu::GetTimestamp(), annotations, count );
+		return true;
+	}
+	FlushThread( events );
+
+	if( DropIfTooShortOnOwner( activityID, qu::GetTimestamp() ) )
+		return true;
+	if( activityID != QU_INVALID_ACTIVITY_ID && ( activityID & QU_SUBMITTED_ACTIVITY_ID_BIT ) != 0 )
+		EventStaging::FlushAllThreads();
+	return runtime.StopActivityWithArgs( activityID, annotations, count );
+}
+
+//Nested stops
+static bool QU_CALL_CONV StagedStopCurrentActivity( quActivityChannelID channelID )
+{
+	ThreadEvents& events = GetThreadEvents();
+	if( channelID == QU_INVALID_ACTIVITY_CHANNEL_ID || channelID != events.channelID.load( std::memory_order_relaxed ) )
+	{
+		FlushThread( events );
+		return runtime.StopCurrentActivity( channelID );
+	}
+
+	//Activities we know of are stopped by id so that short ones can still be dropped, the runtime resolves the others.
+	ForgetStoppedElsewhere( events );
+	quActivityID activityID = events.runningCount != 0 ? events.running[ --events.runningCount ] : QU_INVALID_ACTIVITY_ID;
+	StageStop( events, activityID, channelID, qu::GetTimestamp(), nullptr, 0 );
+	return true;
+}
+
+//Outputs
+static bool QU_CALL_CONV StagedStopOutput( quOutputID outputID )
+{
+	EventStaging::FlushAllThreads();
+	return runtime.StopOutput( outputID );
+}
+static bool QU_CALL_CONV StagedStopAllOutputs()
+{
+	EventStaging::FlushAllThreads();
+	return runtime.StopAllOutputs();
+}
+static bool QU_CALL_CONV StagedRemoveOutput( quOutputID outputID )
+{
+	EventStaging::FlushAllThreads();
+	return runtime.RemoveOutput( outputID );
+}
+
+//Counters
+static bool QU_CALL_CONV StagedRemoveCounter( quCounterID counterID )
+{
+	EventStaging::FlushAllThreads();
+	return runtime.RemoveCounter( counterID );
+}
+
+//Activity channels
+static quActivityChannelID QU_CALL_CONV StagedAddActivityChannelForCurrentThread( const char* channelName, quUInt32 color )
+{
+	quActivityChannelID channelID = runtime.AddActivityChannelForCurrentThread( channelName, color );
+	if( channelID != QU_INVALID_ACTIVITY_CHANNEL_ID )
+	{
+		ThreadEvents& events = GetThreadEvents();
+		FlushThread( events );
+		events.runningCount = 0;
+		events.channelID.store( channelID, std::memory_order_relaxed );
+	}
+	return channelID;
+}
+static bool QU_CALL_CONV StagedRemoveActivityChannel( quActivityChannelID channelID )
+{
+	//Channels are usually removed by the thread they belong to, but we cant rely on that.
+	{
+		std::lock_guard threadsLock( threadsMutex );
+		for( ThreadEvents* events : threads )
+		{
+			//Activities still pending on the channel have to reach the runtime while it still knows the channel.
+			std::lock_guard lock( events->mutex );
+			if( events->channelID.load( std::memory_order_relaxed ) == channelID )
+			{
+				FlushAll( *events );
+				events->channelID.store( QU_INVALID_ACTIVITY_CHANNEL_ID, std::memory_order_relaxed );
+			}
+			else
+			{
+				Flush( *events );
+			}
+		}
+	}
+	return runtime.RemoveActivityChannel( channelID );
+}
+
+//Markers
+static void QU_CALL_CONV StagedAddMarker( const char* markerName )
+{
+	EventStaging::FlushCurrentThread();
+	runtime.AddMarker( markerName );
+}
+
+//Events
+static bool QU_CALL_CONV StagedSubmitEvents( const quEvent* events, quUInt32 count )
+{
+	EventStaging::FlushCurrentThread();
+	return runtime.SubmitEvents( events, count );
+}
+
+void EventStaging::Install( quDispatchTable& dispatch, const quDispatchTable& runtimeTable, bool stagesAnnotations, bool takesTypedCounters, bool takesFormatArguments )
+{
+	runtime = runtimeTable;
+	stagesTypedCounters = takesTypedCounters;
+	stagesFormatArguments = takesFormatArguments;
+
+	//Hot path
+	dispatch.StartRecurringActivity = &StagedStartRecurringActivity;
+	dispatch.StopActivity = &StagedStopActivity;
+	dispatch.SetCounterValue = &StagedSetCounterValue;
+	dispatch.StartActivity = &StagedStartActivity;
+	dispatch.StartFlow = &StagedStartFlow;
+	dispatch.StopFlow = &StagedStopFlow;
+
+	//Outputs
+	dispatch.StopOutput = &StagedStopOutput;
+	dispatch.StopAllOutputs = &StagedStopAllOutputs;
+	dispatch.RemoveOutput = &StagedRemoveOutput;
+
+	//Counters
+	dispatch.RemoveCounter = &StagedRemoveCounter;
+
+	//Activity channels
+	dispatch.AddActivityChannelForCurrentThread = &StagedAddActivityChannelForCurrentThread;
+	dispatch.RemoveActivityChannel = &StagedRemoveActivityChannel;
+
+	//Markers
+	dispatch.AddMarker = &StagedAddMarker;
+
+	//Events
+	dispatch.SubmitEvents = &StagedSubmitEvents;
+
+	//Counter batches
+	dispatch.SetCounterValues = &StagedSetCounterValues;
+
+	//Typed counters
+	dispatch.SetCounterValueInt64 = &StagedSetCounterValueInt64;
+	dispatch.SetCounterValueDouble = &StagedSetCounterValueDouble;
+
+	//Timestamps
+	dispatch.StartRecurringActivityAt = &StagedStartRecurringActivityAt;
+	dispatch.StopActivityAt = &StagedStopActivityAt;
+	dispatch.SetCounterValueAt = &StagedSetCounterValueAt;
+
+	//Formatted activities
+	dispatch.StartFormattedActivity = &StagedStartFormattedActivity;
+
+	//Activity annotations
+	if( stagesAnnotations )
+	{
+		dispatch.AnnotateActivity = &StagedAnnotateActivity;
+		dispatch.StopActivityWithArgs = &StagedStopActivityWithArgs;
+	}
+
+	//Nested stops, ActivityStacks takes this over again for runtimes that can't stop the current activity themselves.
+	dispatch.StopCurrentActivity = &StagedStopCurrentActivity;
+
+	installed = true;
+}
+void EventStaging::Uninstall()
+{
+	{
+		std::lock_guard lock( replayMutex );
+		replayedActivities.clear();
+	}
+	if( !installed.exchange( false ) )
+		return;
+
+	//Anything still staged belongs to a runtime that is going away, and channel ids may be reused by the next one. The running
+	//activities the threads remember don't matter anymore once they have no channel.
+	std::lock_guard threadsLock( threadsMutex );
+	for( ThreadEvents* events : threads )
+	{
+		std::lock_guard lock( events->mutex );
+		events->head.store( events->published.load( std::memory_order_acquire ), std::memory_order_relaxed );
+		events->pendingCount.store( 0, std::memory_order_relaxed );
+		events->stoppedElsewhere.clear();
+		events->stoppedElsewhereCount.store( 0, std::memory_order_relaxed );
+		events->channelID.store( QU_INVALID_ACTIVITY_CHANNEL_ID, std::memory_order_relaxed );
+	}
+}
+
+void EventStaging::UnbindCurrentThreadChannel()
+{
+	if( !installed || threadEvents == nullptr )
+		return;
+
+	FlushThread( *threadEvents );
+	threadEvents->runningCount = 0;
+	threadEvents->channelID.store( QU_INVALID_ACTIVITY_CHANNEL_ID, std::memory_order_relaxed );
+}
+void EventStaging::OnChannelRemoved( quActivityChannelID channelID )
+{
+	std::lock_guard lock( replayMutex );
+	std::erase_if( replayedActivities, [ channelID ]( const auto& replayed ) { return replayed.second.channelID == channelID; } );
+}
+void EventStaging::FlushCurrentThread()
+{
+	if( !installed || threadEvents == nullptr )
+		return;
+
+	FlushThread( *threadEvents );
+}
+void EventStaging::FlushAllThreads()
+{
+	if( !installed )
+		return;
+
+	std::lock_guard threadsLock( threadsMutex );
+	for( ThreadEvents* events : threads )
+	{
+		std::lock_guard lock( events->mutex );
+		Flush( *events );
+	}
+}
+
+quActivityID EventStaging::ReserveActivityIDs( quUInt32 count )
+{
+	if( count == 0 )
+		return QU_INVALID_ACTIVITY_ID;
+
+	return QU_SUBMITTED_ACTIVITY_ID_BIT | ( nextReservedActivityID.fetch_add( count ) & ACTIVITY_COUNTER_MASK );
+}
+bool EventStaging::ReplayEvents( const quEvent* events, quUInt32 count, const quDispatchTable& dispatch )
+{
+	//The runtime only knows the ids it handed out itself, so we have to remember which of those belongs to which submitted id.
+	bool submittedAll = true;
+	std::lock_guard lock( replayMutex );
+	for( quUInt32 i = 0; i < count; ++i )
+	{
+		const quEvent& event = events[ i ];
+		switch( event.type )
+		{
+		case QU_EVENT_START_RECURRING_ACTIVITY:
+		{
+			quActivityID activityID = dispatch.StartRecurringActivity( event.channelID, event.recurringActivityID );
+			if( activityID != QU_INVALID_ACTIVITY_ID )
+				replayedActivities[ event.activityID ] = { activityID, event.channelID, nextReplaySequence++ };
+			else
+				submittedAll = false;
+			break;
+		}
+		case QU_EVENT_STOP_ACTIVITY:
+		{
+			if( event.activityID == QU_INVALID_ACTIVITY_ID )
+			{
+				//The activity that's current to the runtime is the one to stop, which on older runtimes the activity stacks know.
+				bool stopped = dispatch.StopCurrentActivity( event.channelID );
+				submittedAll &= stopped;
+				if( stopped )
+				{
+					//Submitted activities of a channel nest, so the one that stopped is the last of them that was replayed.
+					auto current = replayedActivities.end();
+					for( auto it = replayedActivities.begin(); it != replayedActivities.end(); ++it )
+					{
+						if( it->second.channelID == event.channelID && ( current == replayedActivities.end() || it->second.sequence > current->second.sequence ) )
+							current = it;
+					}
+					if( current != replayedActivities.end() )
+						replayedActivities.erase( current );
+				}
+				break;
+			}
+
+			auto it = replayedActivities.find( event.activityID );
+			if( it != replayedActivities.end() )
+			{
+				submittedAll &= dispatch.StopActivity( it->second.activityID );
+				replayedActivities.erase( it );
+			}
+			else
+			{
+				submittedAll &= dispatch.StopActivity( event.activityID );
+			}
+			break;
+		}
+		case QU_EVENT_SET_COUNTER_VALUE:
+			submittedAll &= dispatch.SetCounterValue( event.counterID, event.counterValue );
+			break;
+		case QU_EVENT_SET_TYPED_COUNTER_VALUE:
+			if( event.counterType == QU_COUNTER_TYPE_DOUBLE )
+			{
+				double value;
+				memcpy( &value, &event.typedCounterBits, sizeof( value ) );
+				submittedAll &= dispatch.SetCounterValueDouble( event.counterID, value );
+			}
+			else
+			{
+				submittedAll &= dispatch.SetCounterValueInt64( event.counterID, quInt64( event.typedCounterBits ) );
+			}
+			break;
+		case QU_EVENT_ANNOTATE_ACTIVITY:
+		{
+			quAnnotation annotation = {};
+			annotation.uintValue = event.annotationValue;
+			annotation.keyID = event.annotationKeyID;
+			annotation.type = event.annotationType;
+			auto it = replayedActivities.find( event.activityID );
+			submittedAll &= dispatch.AnnotateActivity( it != replayedActivities.end() ? it->second.activityID : event.activityID, &annotation, 1 );
+			break;
+		}
+		default:
+			submittedAll = false;
+			break;
+		}
+	}
+	return submittedAll;
+}
+
+} //End namespace qul
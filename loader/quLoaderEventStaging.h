@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Collects start, stop and counter events per thread and hands them to the runtime in batches, so that instrumented code
+ * doesn't have to cross into the runtime for every single event. Only activities on the channel that belongs to the calling
+ * thread are staged. A thread stages its events without locking anything, only flushing them takes a lock. Every other call is
+ * forwarded to the runtime directly, after the thread's staged events have been flushed so that the runtime still receives
+ * everything in the order it happened.
+ * Starts of activities with a minimum duration (see ActivityFilter) are held back until the activity stops, so that activities
+ * that turn out too short can still be taken out again. Flushing doesn't release them before they ran for their minimum duration,
+ * along with everything staged after them, only their thread or channel going away does.
+ */
+class EventStaging
+{
+public:
+	//Routes the event functions of the dispatch table through staging, the runtime's own table must support batches. Annotations
+	//and formatted activities are only staged for runtimes that support them, typed counter values are converted to floats for
+	//runtimes that don't take them.
+	static void Install( quDispatchTable& dispatch, const quDispatchTable& runtimeTable, bool stagesAnnotations, bool takesTypedCounters, bool takesFormatArguments );
+	static void Uninstall();
+
+	//Stops staging the activities of the current thread's channel, they're passed to the runtime some other way.
+	static void UnbindCurrentThreadChannel();
+	//Forgets the replayed activities of a removed channel, their stops won't be submitted anymore.
+	static void OnChannelRemoved( quActivityChannelID channelID );
+
+	static void FlushCurrentThread();
+	static void FlushAllThreads();
+
+	static quActivityID ReserveActivityIDs( quUInt32 count );
+	//Fallback for runtimes that can't take batches. Submits the events one by one through the single event functions, which
+	//means the timestamps of the events are lost.
+	static bool ReplayEvents( const quEvent* events, quUInt32 count, const quDispatchTable& dispatch );
+};
+
+} //End namespace qul
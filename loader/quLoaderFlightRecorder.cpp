@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderFlightRecorder.h"
+#include "quLoaderActivityFilter.h"
+#include "quLoaderCounterCoalescing.h"
+#include "quLoaderEventStaging.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if !defined( _WIN64 )
+#	include <signal.h>
+#endif
+
+namespace qul
+{
+
+//Raised signals are kept in a bit mask, which leaves out the real-time signals that some platforms number beyond it.
+constexpr int MAX_SIGNAL_NUMBER = 63;
+//Signal handlers can't wake the dump thread, it looks for raised signals this often while any trigger waits for one.
+constexpr std::chrono::milliseconds SIGNAL_POLL_INTERVAL( 50 );
+
+//What a signal was handled by before we took it over, restored once no trigger waits for it anymore.
+#if defined( _WIN64 )
+using SignalAction = void ( * )( int );
+#else
+using SignalAction = struct sigaction;
+#endif
+
+struct Trigger
+{
+	quOutputID outputID;
+	std::string markerName; //!< Empty for triggers that only wait for a signal.
+	int signalNumber;       //!< 0 for triggers that only wait for a marker.
+	std::string outputFile;
+	quUInt32 dumpCount;     //!< Number of dumps taken so far, numbers the files.
+	bool markerAdded;       //!< Whether the marker was added since the last dump, markers added meanwhile share a dump.
+};
+
+struct PendingDump
+{
+	quOutputID outputID;
+	std::string outputFile;
+};
+
+static std::mutex controlMutex;                        //!< Serializes starting and stopping the dump thread.
+static std::mutex triggersMutex;                       //!< Guards everything below.
+static std::condition_variable dumpRequested;          //!< Wakes the dump thread when a marker fired or it should stop.
+static quAddMarker_Ptr addMarker = nullptr;            //!< The entry we pass markers on to.
+static quDumpFlightRecorder_Ptr dumpFlightRecorder = nullptr;
+static std::vector< Trigger > triggers;
+static quUInt64 handledSignals = 0;                    //!< Bit per signal we installed OnSignal for.
+static SignalAction previousActions[ MAX_SIGNAL_NUMBER + 1 ];
+static bool stopping = false;
+static std::atomic< bool > hasMarkerTriggers = false;  //!< Lets markers skip the lock while there's nothing to compare them with.
+static std::atomic< quUInt64 > raisedSignals = 0;      //!< Bit per signal that was received but not dumped for yet.
+
+//Joins the dump thread if it's still running when the application exits.
+struct DumpThread
+{
+	std::thread thread;
+
+	~DumpThread()
+	{
+		if( !thread.joinable() )
+			return;
+
+		{
+			std::lock_guard lock( triggersMutex );
+			stopping = true;
+		}
+		dumpRequested.notify_all();
+		thread.join();
+	}
+};
+static DumpThread dumpThread;
+
+static void OnSignal( int signalNumber )
+{
+	raisedSignals.fetch_or( quUInt64( 1 ) << signalNumber, std::memory_order_relaxed );
+#if defined( _WIN64 )
+	//The CRT resets the handler before calling it.
+	std::signal( signalNumber, &OnSignal );
+#endif
+}
+
+//sigaction keeps the flags, mask and SA_SIGINFO handler of the previous action, which std::signal would lose when restoring it.
+static bool InstallSignalHandler( int signalNumber )
+{
+#if defined( _WIN64 )
+	SignalAction previousAction = std::signal( signalNumber, &OnSignal );
+	if( previousAction == SIG_ERR )
+		return false;
+
+	previousActions[ signalNumber ] = previousAction;
+	return true;
+#else
+	struct sigaction action = {};
+	action.sa_handler = &OnSignal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset( &action.sa_mask );
+	return sigaction( signalNumber, &action, &previousActions[ signalNumber ] ) == 0;
+#endif
+}
+static void RestoreSignalHandler( int signalNumber )
+{
+#if defined( _WIN64 )
+	std::signal( signalNumber, previousActions[ signalNumber ] );
+#else
+	sigaction( signalNumber, &previousActions[ signalNumber ], nullptr );
+#endif
+}
+
+//trace.json becomes trace.3.json for the third dump, files without an extension get the number appended.
+static std::string GetDumpFile( const std::string& outputFile, quUInt32 dumpNumber )
+{
+	size_t extension = outputFile.find_last_of( '.' );
+	size_t directory = outputFile.find_last_of( "/\\" );
+	if( extension == std::string::npos || ( directory != std::string::npos && extension < directory ) )
+		extension = outputFile.size();
+	return outputFile.substr( 0, extension ) + '.' + std::to_string( dumpNumber ) + outputFile.substr( extension );
+}
+
+//Must be called with triggersMutex locked, gives signals that no trigger waits for anymore back to their previous handler.
+static void RestoreUnusedSignals()
+{
+	quUInt64 usedSignals = 0;
+	bool markers = false;
+	for( const Trigger& trigger : triggers )
+	{
+		if( trigger.signalNumber != 0 )
+			usedSignals |= quUInt64( 1 ) << trigger.signalNumber;
+		markers |= !trigger.markerName.empty();
+	}
+	hasMarkerTriggers = markers;
+
+	for( int signalNumber = 1; signalNumber <= MAX_SIGNAL_NUMBER; ++signalNumber )
+	{
+		quUInt64 bit = quUInt64( 1 ) << signalNumber;
+		if( ( handledSignals & bit ) == 0 || ( usedSignals & bit ) != 0 )
+			continue;
+
+		RestoreSignalHandler( signalNumber );
+		handledSignals &= ~bit;
+	}
+}
+
+static void Run()
+{
+	std::vector< PendingDump > pendingDumps;
+	std::unique_lock lock( triggersMutex );
+	while( !stopping )
+	{
+		quUInt64 signals = raisedSignals.exchange( 0, std::memory_order_relaxed );
+		for( Trigger& trigger : triggers )
+		{
+			bool signaled = trigger.signalNumber != 0 && ( ( signals >> trigger.signalNumber ) & 1 ) != 0;
+			if( !signaled && !trigger.markerAdded )
+				continue;
+
+			trigger.markerAdded = false;
+			pendingDumps.push_back( { trigger.outputID, GetDumpFile( trigger.outputFile, ++trigger.dumpCount ) } );
+		}
+
+		//Markers keep being compared with the triggers while the dumps are taken.
+		if( !pendingDumps.empty() )
+		{
+			lock.unlock();
+			for( const PendingDump& pendingDump : pendingDumps )
+				FlightRecorder::Dump( pendingDump.outputID, pendingDump.outputFile.c_str() );
+			pendingDumps.clear();
+			lock.lock();
+			continue;
+		}
+
+		if( handledSignals != 0 )
+			dumpRequested.wait_for( lock, SIGNAL_POLL_INTERVAL );
+		else
+			dumpRequested.wait( lock );
+	}
+}
+
+static void Stop()
+{
+	{
+		std::lock_guard lock( triggersMutex );
+		stopping = true;
+	}
+	dumpRequested.notify_all();
+	if( dumpThread.thread.joinable() )
+		dumpThread.thread.join();
+}
+
+//Markers
+static void QU_CALL_CONV TriggeringAddMarker( const char* markerName )
+{
+	addMarker( markerName );
+	if( !hasMarkerTriggers.load( std::memory_order_relaxed ) || markerName == nullptr )
+		return;
+
+	bool fired = false;
+	{
+		std::lock_guard lock( triggersMutex );
+		for( Trigger& trigger : triggers )
+		{
+			if( trigger.markerName == markerName )
+			{
+				trigger.markerAdded = true;
+				fired = true;
+			}
+		}
+	}
+	if( fired )
+		dumpRequested.notify_all();
+}
+
+void FlightRecorder::Install( quDispatchTable& dispatch )
+{
+	std::lock_guard lock( triggersMutex );
+	addMarker = dispatch.AddMarker;
+	dumpFlightRecorder = dispatch.DumpFlightRecorder;
+
+	//Markers
+	dispatch.AddMarker = &TriggeringAddMarker;
+}
+void FlightRecorder::Detach()
+{
+	std::lock_guard controlLock( controlMutex );
+	Stop();
+
+	//Output ids are only valid for the runtime that handed them out.
+	std::lock_guard lock( triggersMutex );
+	triggers.clear();
+	RestoreUnusedSignals();
+	raisedSignals = 0;
+	dumpFlightRecorder = nullptr;
+}
+
+bool FlightRecorder::Dump( quOutputID outputID, const char* outputFile )
+{
+	quDumpFlightRecorder_Ptr dump;
+	{
+		std::lock_guard lock( triggersMutex );
+		dump = dumpFlightRecorder;
+	}
+	if( dump == nullptr || outputID == QU_INVALID_OUTPUT_ID || outputFile == nullptr )
+		return false;
+
+	//Whatever the threads recorded so far has to reach the recorder first.
+	ActivityFilter::ReportFilteredCounts();
+	CounterCoalescing::Flush();
+	EventStaging::FlushAllThreads();
+	return dump( outputID, outputFile );
+}
+bool FlightRecorder::AddTrigger( quOutputID outputID, const char* markerName, int signalNumber, const char* outputFile )
+{
+	bool hasMarker = markerName != nullptr && *markerName != '\0';
+	if( outputID == QU_INVALID_OUTPUT_ID || outputFile == nullptr || signalNumber < 0 || signalNumber > MAX_SIGNAL_NUMBER || ( !hasMarker && signalNumber == 0 ) )
+		return false;
+
+	std::lock_guard controlLock( controlMutex );
+	{
+		std::lock_guard lock( triggersMutex );
+		if( dumpFlightRecorder == nullptr )
+			return false;
+
+		quUInt64 bit = signalNumber != 0 ? quUInt64( 1 ) << signalNumber : 0;
+		if( bit != 0 && ( handledSignals & bit ) == 0 )
+		{
+			if( !InstallSignalHandler( signalNumber ) )
+				return false;
+
+			handledSignals |= bit;
+		}
+
+		triggers.push_back( { outputID, hasMarker ? markerName : "", signalNumber, outputFile, 0, false } );
+		hasMarkerTriggers = hasMarkerTriggers || hasMarker;
+		if( dumpThread.thread.joinable() )
+		{
+			//Switches the thread over to polling for signals.
+			dumpRequested.notify_all();
+			return true;
+		}
+		stopping = false;
+	}
+
+	dumpThread.thread = std::thread( &Run );
+	return true;
+}
+void FlightRecorder::RemoveTriggers( quOutputID outputID )
+{
+	std::lock_guard lock( triggersMutex );
+	std::erase_if( triggers, [ outputID ]( const Trigger& trigger ) { return trigger.outputID == outputID; } );
+	RestoreUnusedSignals();
+}
+
+} //End namespace qul
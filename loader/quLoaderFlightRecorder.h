@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Dumps flight recorders when the triggers set with quSetFlightRecorderTrigger fire. Markers are compared with the trigger names
+ * as they're added and signals only set a bit, the dumps themselves are taken by a background thread that's started along with
+ * the first trigger. Staged events and counters are flushed before every dump so that it includes everything recorded up to then.
+ */
+class FlightRecorder
+{
+public:
+	//Markers are passed on through the table's AddMarker before they're compared with the triggers.
+	static void Install( quDispatchTable& dispatch );
+	static void Detach();
+
+	static bool Dump( quOutputID outputID, const char* outputFile );
+	static bool AddTrigger( quOutputID outputID, const char* markerName, int signalNumber, const char* outputFile );
+	static void RemoveTriggers( quOutputID outputID );
+};
+
+} //End namespace qul
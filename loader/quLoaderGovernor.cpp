@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderGovernor.h"
+#include "quLoaderActivityFilter.h"
+#include "quLoaderActivityRegistry.h"
+#include <quApi.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined( _WIN64 )
+#	include <Windows.h>
+#else
+#	include <time.h>
+#endif
+
+namespace qul
+{
+
+static constexpr auto TICK_INTERVAL = std::chrono::milliseconds( 250 );
+static constexpr quUInt32 MAX_THROTTLE_INTERVAL = 1024; //!< Activities that would have to be throttled further are disabled.
+static constexpr double RELAX_BELOW = 0.5;              //!< Share of the budget below which throttled activities are restored.
+static constexpr double RELAX_UP_TO = 0.75;             //!< Share of the budget restoring activities may take up, so that they aren't throttled again right away.
+
+//Overhead of a single activity during the last tick.
+struct ActivityCost
+{
+	quRecurringActivityID activityID;
+	quUInt64 starts;          //!< Number of times the activity was started, including the starts that were throttled.
+	quUInt32 throttleInterval;
+	double nanos;             //!< Time spent recording the starts that weren't throttled and their stops.
+};
+
+static std::mutex controlMutex;  //!< Serializes starting and stopping the governor thread.
+static std::mutex governorMutex; //!< Guards everything below.
+static std::condition_variable stopRequested;
+static quDispatchTable runtime;  //!< The runtime's own entries, used to add markers and counters.
+static float budget = 0.0f;
+static bool stopping = false;
+static std::vector< quUInt64 > previousStartCounts;
+static quUInt64 previousCpuNanos = 0;
+static quCounterID overheadCounterID = QU_INVALID_COUNTER_ID;
+static quCounterID throttledCounterID = QU_INVALID_COUNTER_ID;
+
+//Joins the governor thread if it's still running when the application exits.
+struct GovernorThread
+{
+	std::thread thread;
+
+	~GovernorThread()
+	{
+		if( !thread.joinable() )
+			return;
+
+		{
+			std::lock_guard lock( governorMutex );
+			stopping = true;
+		}
+		stopRequested.notify_all();
+		thread.join();
+	}
+};
+static GovernorThread governorThread;
+
+static quUInt64 GetProcessCpuNanos()
+{
+#if defined( _WIN64 )
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if( !GetProcessTimes( GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime ) )
+		return 0;
+
+	auto toNanos = []( FILETIME time ) { return ( ( quUInt64( time.dwHighDateTime ) << 32 ) | time.dwLowDateTime ) * 100; };
+	return toNanos( kernelTime ) + toNanos( userTime );
+#else
+	timespec time;
+	if( clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &time ) != 0 )
+		return 0;
+
+	return quUInt64( time.tv_sec ) * 1000000000ull + quUInt64( time.tv_nsec );
+#endif
+}
+
+static void AddDecisionMarker( const std::string& decision, quRecurringActivityID activityID )
+{
+	std::string name = ActivityRegistry::GetName( activityID );
+	if( name.empty() )
+		name = "activity " + std::to_string( activityID );
+
+	std::string markerName = decision + " " + name;
+	markerName.resize( std::min< size_t >( markerName.size(), QU_MAX_MARKER_NAME_LENGTH ) );
+	runtime.AddMarker( markerName.c_str() );
+}
+
+static double GetCost( quUInt64 starts, quUInt32 throttleInterval, double startNanos )
+{
+	if( throttleInterval == ActivityFilter::DISABLED_INTERVAL )
+		return 0.0;
+
+	//Every recorded activity is started and stopped, both of which cost about the same.
+	return double( starts ) / double( std::max( throttleInterval, 1u ) ) * 2.0 * startNanos;
+}
+
+//Must be called with governorMutex locked. Throttles the most expensive activities first.
+static void Throttle( std::vector< ActivityCost >& costs, double overheadNanos, double budgetNanos )
+{
+	std::sort( costs.begin(), costs.end(), []( const ActivityCost& a, const ActivityCost& b ) { return a.nanos > b.nanos; } );
+	for( ActivityCost& cost : costs )
+	{
+		if( overheadNanos <= budgetNanos || cost.nanos == 0.0 )
+			break;
+
+		//Throttle just enough to get within budget, unless the activity costs less than what we're over budget.
+		double excessNanos = overheadNanos - budgetNanos;
+		quUInt64 throttleInterval = ActivityFilter::DISABLED_INTERVAL;
+		if( cost.nanos > excessNanos )
+		{
+			quUInt64 factor = 2;
+			while( double( factor ) < cost.nanos / ( cost.nanos - excessNanos ) )
+				factor *= 2;
+			throttleInterval = std::max( cost.throttleInterval, 1u ) * factor;
+		}
+
+		if( throttleInterval > MAX_THROTTLE_INTERVAL )
+		{
+			ActivityFilter::SetThrottle( cost.activityID, ActivityFilter::DISABLED_INTERVAL );
+			AddDecisionMarker( "Disabled", cost.activityID );
+			overheadNanos -= cost.nanos;
+		}
+		else
+		{
+			ActivityFilter::SetThrottle( cost.activityID, quUInt32( throttleInterval ) );
+			AddDecisionMarker( "Throttled to 1/" + std::to_string( throttleInterval ), cost.activityID );
+			overheadNanos -= cost.nanos - cost.nanos * std::max( cost.throttleInterval, 1u ) / double( throttleInterval );
+		}
+	}
+}
+
+//Must be called with governorMutex locked. Restores the activities that would cost the least first, one step at a time.
+static void Relax( std::vector< ActivityCost >& costs, double overheadNanos, double budgetNanos, double startNanos )
+{
+	std::sort( costs.begin(), costs.end(), []( const ActivityCost& a, const ActivityCost& b ) { return a.starts < b.starts; } );
+	for( ActivityCost& cost : costs )
+	{
+		if( cost.throttleInterval <= 1 )
+			continue;
+
+		quUInt32 throttleInterval = cost.throttleInterval == ActivityFilter::DISABLED_INTERVAL ? MAX_THROTTLE_INTERVAL : cost.throttleInterval / 2;
+		double relaxedNanos = GetCost( cost.starts, throttleInterval, startNanos );
+		if( overheadNanos - cost.nanos + relaxedNanos > budgetNanos * RELAX_UP_TO )
+			break;
+
+		overheadNanos += relaxedNanos - cost.nanos;
+		ActivityFilter::SetThrottle( cost.activityID, throttleInterval > 1 ? throttleInterval : 0 );
+		if( throttleInterval > 1 )
+			AddDecisionMarker( "Throttled to 1/" + std::to_string( throttleInterval ), cost.activityID );
+		else
+			AddDecisionMarker( "Restored", cost.activityID );
+	}
+}
+
+//Must be called with governorMutex locked.
+static void Tick()
+{
+	std::vector< quUInt64 > startCounts;
+	ActivityFilter::CollectStartCounts( startCounts );
+	previousStartCounts.resize( startCounts.size(), 0 );
+	quUInt64 cpuNanos = GetProcessCpuNanos();
+	quUInt64 elapsedCpuNanos = cpuNanos - previousCpuNanos;
+	previousCpuNanos = cpuNanos;
+
+	double startNanos = ActivityFilter::GetAverageStartNanos();
+	double overheadNanos = 0.0;
+	std::vector< ActivityCost > costs;
+	for( quRecurringActivityID activityID = 0; activityID < startCounts.size(); ++activityID )
+	{
+		quUInt64 starts = startCounts[ activityID ] - previousStartCounts[ activityID ];
+		quUInt32 throttleInterval = ActivityFilter::GetThrottle( activityID );
+		if( starts == 0 && throttleInterval <= 1 )
+			continue;
+
+		double nanos = GetCost( starts, throttleInterval, startNanos );
+		costs.push_back( { activityID, starts, throttleInterval, nanos } );
+		overheadNanos += nanos;
+	}
+	previousStartCounts = std::move( startCounts );
+	if( !qu::IsRecording() || elapsedCpuNanos == 0 || startNanos == 0.0 )
+		return;
+
+	double budgetNanos = budget * double( elapsedCpuNanos );
+	if( overheadNanos > budgetNanos )
+		Throttle( costs, overheadNanos, budgetNanos );
+	else if( overheadNanos < budgetNanos * RELAX_BELOW )
+		Relax( costs, overheadNanos, budgetNanos, startNanos );
+
+	if( overheadCounterID == QU_INVALID_COUNTER_ID )
+		overheadCounterID = runtime.AddCounter( "Instrumentation overhead (% CPU)", 0 );
+	if( throttledCounterID == QU_INVALID_COUNTER_ID )
+		throttledCounterID = runtime.AddCounter( "Throttled activities", 0 );
+	quUInt32 throttledCount = 0;
+	for( const ActivityCost& cost : costs )
+		throttledCount += ActivityFilter::GetThrottle( cost.activityID ) > 1 ? 1 : 0;
+	runtime.SetCounterValue( overheadCounterID, float( overheadNanos * 100.0 / double( elapsedCpuNanos ) ) );
+	runtime.SetCounterValue( throttledCounterID, float( throttledCount ) );
+}
+
+static void Run()
+{
+	std::unique_lock lock( governorMutex );
+	previousStartCounts.clear();
+	ActivityFilter::CollectStartCounts( previousStartCounts );
+	previousCpuNanos = GetProcessCpuNanos();
+	while( !stopRequested.wait_for( lock, TICK_INTERVAL, [] { return stopping; } ) )
+		Tick();
+}
+
+static void Stop()
+{
+	{
+		std::lock_guard lock( governorMutex );
+		stopping = true;
+	}
+	stopRequested.notify_all();
+	if( governorThread.thread.joinable() )
+		governorThread.thread.join();
+
+	std::lock_guard lock( governorMutex );
+	for( quRecurringActivityID activityID = 0; activityID < previousStartCounts.size(); ++activityID )
+	{
+		if( ActivityFilter::GetThrottle( activityID ) != 0 )
+			ActivityFilter::SetThrottle( activityID, 0 );
+	}
+	ActivityFilter::SetCountingStarts( false );
+	previousStartCounts.clear();
+}
+
+void Governor::Attach( const quDispatchTable& runtimeTable )
+{
+	std::lock_guard lock( governorMutex );
+	runtime = runtimeTable;
+}
+void Governor::Detach()
+{
+	std::lock_guard controlLock( controlMutex );
+	Stop();
+
+	//Counters are only valid for the runtime that handed them out.
+	std::lock_guard lock( governorMutex );
+	runtime = {};
+	budget = 0.0f;
+	overheadCounterID = QU_INVALID_COUNTER_ID;
+	throttledCounterID = QU_INVALID_COUNTER_ID;
+}
+
+bool Governor::SetBudget( float cpuFraction )
+{
+	if( !( cpuFraction >= 0.0f ) )
+		return false;
+
+	std::lock_guard controlLock( controlMutex );
+	{
+		std::lock_guard lock( governorMutex );
+		if( runtime.AddMarker == nullptr )
+			return false;
+
+		budget = cpuFraction;
+		if( cpuFraction != 0.0f && governorThread.thread.joinable() )
+			return true;
+	}
+
+	if( cpuFraction == 0.0f )
+	{
+		Stop();
+		return true;
+	}
+
+	ActivityFilter::SetCountingStarts( true );
+	std::lock_guard lock( governorMutex );
+	stopping = false;
+	governorThread.thread = std::thread( &Run );
+	return true;
+}
+
+} //End namespace qul
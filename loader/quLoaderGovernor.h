@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+namespace qul
+{
+
+/**
+ * Keeps the overhead of recurring activities within a share of the CPU time the process uses. A background thread periodically
+ * estimates the overhead of every activity from how often it was started and what a start costs, both measured by the
+ * ActivityFilter. While the total exceeds the budget, the most expensive activities are throttled through the ActivityFilter, or
+ * disabled if throttling doesn't suffice. Once there is room again they're gradually restored.
+ * Every decision is recorded as a marker, the estimated overhead and the number of throttled activities as counters.
+ */
+class Governor
+{
+public:
+	static void Attach( const quDispatchTable& runtimeTable );
+	static void Detach();
+
+	//A budget of 0 stops the governor and restores every activity it throttled.
+	static bool SetBudget( float cpuFraction );
+};
+
+} //End namespace qul
@@ -19,8 +19,26 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include "quLoaderActivityFilter.h"
+#include "quLoaderActivityFormat.h"
+#include "quLoaderActivityInterning.h"
+#include "quLoaderActivityRegistry.h"
+#include "quLoaderActivityStacks.h"
+#include "quLoaderAnnotationKeys.h"
+#include "quLoaderClock.h"
+#include "quLoaderCounterAccumulators.h"
+#include "quLoaderCounterCoalescing.h"
+#include "quLoaderCounterFamilies.h"
+#include "quLoaderCounterPolling.h"
 #include "quLoaderDylib.h"
 #include "quLoaderEnvVar.h"
+#include "quLoaderEventStaging.h"
+#include "quLoaderFlightRecorder.h"
+#include "quLoaderGovernor.h"
+#include "quLoaderSharedState.h"
+#include "quLoaderThreadState.h"
 #if defined( __APPLE__ )
 #	if !defined( __OBJC__ )
 static_assert( false, "This file must be compiled as Objective-C++." );
@@ -32,40 +50,340 @@ static_assert( false, "This file must be compiled as Objective-C++." );
 namespace qu
 {
 
+//Hot path
+static quActivityID QU_CALL_CONV StubStartRecurringActivity( quActivityChannelID, quRecurringActivityID )
+{
+	return QU_INVALID_ACTIVITY_ID;
+}
+static bool QU_CALL_CONV StubStopActivity( quActivityID )
+{
+	return false;
+}
+static quActivityChannelID QU_CALL_CONV StubGetChannelIDForCurrentThread()
+{
+	return QU_INVALID_ACTIVITY_CHANNEL_ID;
+}
+static bool QU_CALL_CONV StubSetCounterValue( quCounterID, float )
+{
+	return false;
+}
+static quActivityID QU_CALL_CONV StubStartActivity( quActivityChannelID, const char*, quUInt32 )
+{
+	return QU_INVALID_ACTIVITY_ID;
+}
+static quFlowID QU_CALL_CONV StubStartFlow( quActivityChannelID )
+{
+	return QU_INVALID_FLOW_ID;
+}
+static bool QU_CALL_CONV StubStopFlow( quFlowID, quActivityChannelID )
+{
+	return false;
+}
+
 //QuApi core
-static quInitialize_Ptr Initialize = nullptr;
-static quRelease_Ptr Release = nullptr;
+static quUInt64 QU_CALL_CONV StubInitialize( quUInt32, quLogHook_Ptr )
+{
+	return 0;
+}
+static void QU_CALL_CONV StubRelease()
+{
+}
 
 //Outputs
-static quSetupGoogleTraceOutput_Ptr SetupGoogleTraceOutput = nullptr;
-static quSetupTCPOutput_Ptr SetupTCPOutput = nullptr;
-static quStartOutput_Ptr StartOutput = nullptr;
-static quStopOutput_Ptr StopOutput = nullptr;
-static quStartAllOutputs_Ptr StartAllOutputs = nullptr;
-static quStopAllOutputs_Ptr StopAllOutputs = nullptr;
-static quRemoveOutput_Ptr RemoveOutput = nullptr;
+static quOutputID QU_CALL_CONV StubSetupGoogleTraceOutput( const char*, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+static quOutputID QU_CALL_CONV StubSetupTCPOutput( const char*, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+static bool QU_CALL_CONV StubOutputOperation( quOutputID )
+{
+	return false;
+}
+static bool QU_CALL_CONV StubAllOutputsOperation()
+{
+	return false;
+}
 
 //Counters
-static quAddCounter_Ptr AddCounter = nullptr;
-static quSetCounterValue_Ptr SetCounterValue = nullptr;
-static quRemoveCounter_Ptr RemoveCounter = nullptr;
+static quCounterID QU_CALL_CONV StubAddCounter( const char*, quUInt32 )
+{
+	return QU_INVALID_COUNTER_ID;
+}
+static bool QU_CALL_CONV StubRemoveCounter( quCounterID )
+{
+	return false;
+}
 
 //Activity channels
-static quAddActivityChannel_Ptr AddActivityChannel = nullptr;
-static quAddActivityChannelForCurrentThread_Ptr AddActivityChannelForCurrentThread = nullptr;
-static quGetChannelIDForCurrentThread_Ptr GetChannelIDForCurrentThread = nullptr;
-static quAddRecurringActivity_Ptr AddRecurringActivity = nullptr;
-static quStartRecurringActivity_Ptr StartRecurringActivity = nullptr;
-static quStartActivity_Ptr StartActivity = nullptr;
-static quStopActivity_Ptr StopActivity = nullptr;
-static quRemoveActivityChannel_Ptr RemoveActivityChannel = nullptr;
-
-//Flow
-static quStartFlow_Ptr StartFlow = nullptr;
-static quStopFlow_Ptr StopFlow = nullptr;
+static quActivityChannelID QU_CALL_CONV StubAddActivityChannel( const char*, quUInt32 )
+{
+	return QU_INVALID_ACTIVITY_CHANNEL_ID;
+}
+static quRecurringActivityID QU_CALL_CONV StubAddRecurringActivity( const char*, quUInt32 )
+{
+	return QU_INVALID_RECURRING_ACTIVITY_ID;
+}
+static bool QU_CALL_CONV StubRemoveActivityChannel( quActivityChannelID )
+{
+	return false;
+}
 
 //Markers
-static quAddMarker_Ptr AddMarker = nullptr;
+static void QU_CALL_CONV StubAddMarker( const char* )
+{
+}
+
+//Events
+static bool QU_CALL_CONV StubSubmitEvents( const quEvent* events, quUInt32 count );
+
+//Event rings
+static quEventRing* QU_CALL_CONV StubGetEventRingForCurrentThread()
+{
+	return nullptr;
+}
+static void QU_CALL_CONV StubFlushEventRing()
+{
+}
+
+//Shared state
+static void QU_CALL_CONV StubSetSharedState( quSharedState* )
+{
+}
+
+//Activity descriptors
+static bool QU_CALL_CONV StubAddRecurringActivities( quActivityDescriptor* descriptors, quUInt32 count );
+
+//Activity addresses
+static void QU_CALL_CONV StubSetAddressResolver( quAddressResolver_Ptr )
+{
+}
+
+//Counter batches
+static bool QU_CALL_CONV StubSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count );
+
+//Typed counters
+static quCounterID QU_CALL_CONV StubAddTypedCounter( const char* counterName, quUInt32 color, quCounterType type );
+static bool QU_CALL_CONV StubSetCounterValueInt64( quCounterID counterID, quInt64 newCounterValue );
+static bool QU_CALL_CONV StubSetCounterValueDouble( quCounterID counterID, double newCounterValue );
+
+//Timestamps
+static quActivityID QU_CALL_CONV StubStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp );
+static bool QU_CALL_CONV StubStopActivityAt( quActivityID activityID, quUInt64 timestamp );
+static bool QU_CALL_CONV StubSetCounterValueAt( quCounterID counterID, float newCounterValue, quUInt64 timestamp );
+
+//Clocks
+static void QU_CALL_CONV StubSetClockCalibration( quClockSource, const quClockCalibration* )
+{
+}
+
+//Formatted activities
+static quActivityID QU_CALL_CONV StubStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount );
+
+//Activity annotations
+static void QU_CALL_CONV StubSetAnnotationKey( quAnnotationKeyID, const char* )
+{
+}
+static bool QU_CALL_CONV StubAnnotateActivity( quActivityID, const quAnnotation*, quUInt32 )
+{
+	return false;
+}
+static bool QU_CALL_CONV StubStopActivityWithArgs( quActivityID activityID, const quAnnotation* annotations, quUInt32 count );
+
+//Nested stops
+static bool QU_CALL_CONV StubStopCurrentActivity( quActivityChannelID )
+{
+	return false;
+}
+
+//Flight recorder
+static quOutputID QU_CALL_CONV StubSetupFlightRecorderOutput( quUInt64, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+static bool QU_CALL_CONV StubDumpFlightRecorder( quOutputID, const char* )
+{
+	return false;
+}
+
+//Mapped trace files
+static quOutputID QU_CALL_CONV StubSetupMappedTraceOutput( const char*, quUInt64, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+
+//Binary trace files
+static quOutputID QU_CALL_CONV StubSetupBinaryTraceOutput( const char*, quUInt32, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+
+//Perfetto trace files
+static quOutputID QU_CALL_CONV StubSetupPerfettoTraceOutput( const char*, bool )
+{
+	return QU_INVALID_OUTPUT_ID;
+}
+
+/**
+ * Every entry of the dispatch table starts out as a no-op so that the exported functions can call through it unconditionally,
+ * regardless of whether or not the runtime was loaded. The table is constant initialized, which makes it valid even for
+ * instrumentation that runs during static initialization before the runtime was loaded.
+ */
+static constexpr quDispatchTable STUB_DISPATCH_TABLE = {
+	.version = QU_DISPATCH_TABLE_VERSION,
+	.size = sizeof( quDispatchTable ),
+
+	//Hot path
+	.StartRecurringActivity = &StubStartRecurringActivity,
+	.StopActivity = &StubStopActivity,
+	.GetChannelIDForCurrentThread = &StubGetChannelIDForCurrentThread,
+	.SetCounterValue = &StubSetCounterValue,
+	.StartActivity = &StubStartActivity,
+	.StartFlow = &StubStartFlow,
+	.StopFlow = &StubStopFlow,
+
+	//QuApi core
+	.Initialize = &StubInitialize,
+	.Release = &StubRelease,
+
+	//Outputs
+	.SetupGoogleTraceOutput = &StubSetupGoogleTraceOutput,
+	.SetupTCPOutput = &StubSetupTCPOutput,
+	.StartOutput = &StubOutputOperation,
+	.StopOutput = &StubOutputOperation,
+	.StartAllOutputs = &StubAllOutputsOperation,
+	.StopAllOutputs = &StubAllOutputsOperation,
+	.RemoveOutput = &StubOutputOperation,
+
+	//Counters
+	.AddCounter = &StubAddCounter,
+	.RemoveCounter = &StubRemoveCounter,
+
+	//Activity channels
+	.AddActivityChannel = &StubAddActivityChannel,
+	.AddActivityChannelForCurrentThread = &StubAddActivityChannel,
+	.AddRecurringActivity = &StubAddRecurringActivity,
+	.RemoveActivityChannel = &StubRemoveActivityChannel,
+
+	//Markers
+	.AddMarker = &StubAddMarker,
+
+	//Events
+	.SubmitEvents = &StubSubmitEvents,
+
+	//Event rings
+	.GetEventRingForCurrentThread = &StubGetEventRingForCurrentThread,
+	.FlushEventRing = &StubFlushEventRing,
+
+	//Shared state
+	.SetSharedState = &StubSetSharedState,
+
+	//Activity descriptors
+	.AddRecurringActivities = &StubAddRecurringActivities,
+
+	//Activity addresses
+	.SetAddressResolver = &StubSetAddressResolver,
+
+	//Counter batches
+	.SetCounterValues = &StubSetCounterValues,
+
+	//Typed counters
+	.AddTypedCounter = &StubAddTypedCounter,
+	.SetCounterValueInt64 = &StubSetCounterValueInt64,
+	.SetCounterValueDouble = &StubSetCounterValueDouble,
+
+	//Timestamps
+	.StartRecurringActivityAt = &StubStartRecurringActivityAt,
+	.StopActivityAt = &StubStopActivityAt,
+	.SetCounterValueAt = &StubSetCounterValueAt,
+
+	//Clocks
+	.SetClockCalibration = &StubSetClockCalibration,
+
+	//Formatted activities
+	.StartFormattedActivity = &StubStartFormattedActivity,
+
+	//Activity annotations
+	.SetAnnotationKey = &StubSetAnnotationKey,
+	.AnnotateActivity = &StubAnnotateActivity,
+	.StopActivityWithArgs = &StubStopActivityWithArgs,
+
+	//Nested stops
+	.StopCurrentActivity = &StubStopCurrentActivity,
+
+	//Flight recorder
+	.SetupFlightRecorderOutput = &StubSetupFlightRecorderOutput,
+	.DumpFlightRecorder = &StubDumpFlightRecorder,
+
+	//Mapped trace files
+	.SetupMappedTraceOutput = &StubSetupMappedTraceOutput,
+
+	//Binary trace files
+	.SetupBinaryTraceOutput = &StubSetupBinaryTraceOutput,
+
+	//Perfetto trace files
+	.SetupPerfettoTraceOutput = &StubSetupPerfettoTraceOutput,
+};
+alignas( 64 ) static quDispatchTable dispatch = STUB_DISPATCH_TABLE;
+
+static bool QU_CALL_CONV StubSubmitEvents( const quEvent* events, quUInt32 count )
+{
+	//Older runtimes dont take batches, we can still hand them the events one by one.
+	return qul::EventStaging::ReplayEvents( events, count, dispatch );
+}
+static bool QU_CALL_CONV StubAddRecurringActivities( quActivityDescriptor* descriptors, quUInt32 count )
+{
+	//Older runtimes only take activities one at a time.
+	return qul::ActivityRegistry::RegisterOneByOne( descriptors, count, dispatch );
+}
+static bool QU_CALL_CONV StubSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count )
+{
+	//Older runtimes only take counter values one at a time.
+	bool setAll = true;
+	for( quUInt32 i = 0; i < count; ++i )
+		setAll &= dispatch.SetCounterValue( counterIDs[ i ], newCounterValues[ i ] );
+	return setAll;
+}
+static quCounterID QU_CALL_CONV StubAddTypedCounter( const char* counterName, quUInt32 color, quCounterType )
+{
+	//Older runtimes only know float counters, the values of typed counters are converted.
+	return dispatch.AddCounter( counterName, color );
+}
+static bool QU_CALL_CONV StubSetCounterValueInt64( quCounterID counterID, quInt64 newCounterValue )
+{
+	return dispatch.SetCounterValue( counterID, float( newCounterValue ) );
+}
+static bool QU_CALL_CONV StubSetCounterValueDouble( quCounterID counterID, double newCounterValue )
+{
+	return dispatch.SetCounterValue( counterID, float( newCounterValue ) );
+}
+static quActivityID QU_CALL_CONV StubStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 )
+{
+	//Runtimes that take neither timestamps nor batches of events can only record the activity now.
+	return dispatch.StartRecurringActivity( channelID, activityID );
+}
+static bool QU_CALL_CONV StubStopActivityAt( quActivityID activityID, quUInt64 )
+{
+	return dispatch.StopActivity( activityID );
+}
+static bool QU_CALL_CONV StubSetCounterValueAt( quCounterID counterID, float newCounterValue, quUInt64 )
+{
+	return dispatch.SetCounterValue( counterID, newCounterValue );
+}
+static quActivityID QU_CALL_CONV StubStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount )
+{
+	//Runtimes that can't take arguments are handed the formatted name instead.
+	static thread_local std::string name;
+	qul::ActivityFormat::Format( name, descriptor->name, args, argCount );
+	return dispatch.StartActivity( channelID, name.c_str(), descriptor->color );
+}
+static bool QU_CALL_CONV StubStopActivityWithArgs( quActivityID activityID, const quAnnotation*, quUInt32 )
+{
+	//Runtimes that don't support annotations still have to stop the activity.
+	return dispatch.StopActivity( activityID );
+}
 
 } //End namespace qu
 
@@ -74,6 +392,56 @@ namespace qul
 
 static Dylib library;
 
+static void FillDispatchTable( const quDispatchTable& runtimeTable )
+{
+	using Entry = void( QU_CALL_CONV* )();
+	constexpr size_t FIRST_ENTRY_OFFSET = offsetof( quDispatchTable, StartRecurringActivity );
+	static_assert( ( sizeof( quDispatchTable ) - FIRST_ENTRY_OFFSET ) % sizeof( Entry ) == 0, "The dispatch table may only contain function pointers." );
+
+	//The runtime may be older or newer than the header we were compiled with. We only take over the entries that both of us
+	//know about, anything the runtime doesn't provide keeps pointing to its no-op implementation.
+	size_t knownSize = std::min< size_t >( runtimeTable.size, sizeof( quDispatchTable ) );
+	quDispatchTable table = qu::STUB_DISPATCH_TABLE;
+	for( size_t offset = FIRST_ENTRY_OFFSET; offset + sizeof( Entry ) <= knownSize; offset += sizeof( Entry ) )
+	{
+		Entry entry;
+		memcpy( &entry, (const char*)&runtimeTable + offset, sizeof( Entry ) );
+		if( entry != nullptr )
+			memcpy( (char*)&table + offset, &entry, sizeof( Entry ) );
+	}
+
+	//Runtimes that take batches of events get their events staged per thread, see EventStaging.
+	quDispatchTable stagedTable = table;
+	bool annotates = table.AnnotateActivity != qu::STUB_DISPATCH_TABLE.AnnotateActivity;
+	bool takesTypedCounters = table.SetCounterValueInt64 != qu::STUB_DISPATCH_TABLE.SetCounterValueInt64;
+	bool takesFormatArguments = table.StartFormattedActivity != qu::STUB_DISPATCH_TABLE.StartFormattedActivity;
+	if( table.SubmitEvents != qu::STUB_DISPATCH_TABLE.SubmitEvents )
+		EventStaging::Install( stagedTable, table, annotates, takesTypedCounters, takesFormatArguments );
+	ActivityFilter::Install( stagedTable, table );
+	CounterCoalescing::Install( stagedTable );
+	CounterAccumulators::Install( stagedTable );
+	CounterPolling::Install( stagedTable );
+	if( table.DumpFlightRecorder != qu::STUB_DISPATCH_TABLE.DumpFlightRecorder )
+		FlightRecorder::Install( stagedTable );
+	//Goes last so that only activities that actually started end up on the stacks. Activities written to rings never pass
+	//through us, so they couldn't be stopped through the stacks.
+	if( table.StopCurrentActivity == qu::STUB_DISPATCH_TABLE.StopCurrentActivity )
+	{
+		ActivityStacks::Install( stagedTable );
+		stagedTable.GetEventRingForCurrentThread = qu::STUB_DISPATCH_TABLE.GetEventRingForCurrentThread;
+	}
+	Governor::Attach( table );
+	qu::dispatch = stagedTable;
+
+	bool maintainsSharedState = table.SetSharedState != qu::STUB_DISPATCH_TABLE.SetSharedState;
+	SharedState::Attach( maintainsSharedState ? table.SetSharedState : nullptr );
+	bool resolvesAddresses = table.SetAddressResolver != qu::STUB_DISPATCH_TABLE.SetAddressResolver;
+	ActivityRegistry::Attach( resolvesAddresses ? table.SetAddressResolver : nullptr );
+	bool takesClockCalibrations = table.SetClockCalibration != qu::STUB_DISPATCH_TABLE.SetClockCalibration;
+	Clock::Attach( takesClockCalibrations ? table.SetClockCalibration : nullptr );
+	AnnotationKeys::Attach( annotates ? table.SetAnnotationKey : nullptr );
+}
+
 static void UnloadQuApi();
 static bool LoadQuApi( quLogHook_Ptr logHook )
 {
@@ -169,42 +537,54 @@ static bool LoadQuApi( quLogHook_Ptr logHook )
 		return false;
 	}
 
+	//Current runtimes provide their entire api through a single dispatch table.
+	if( quGetDispatchTable_Ptr getDispatchTable = (quGetDispatchTable_Ptr)library.GetFunction( QU_DISPATCH_TABLE_SYMBOL ) )
+	{
+		if( const quDispatchTable* runtimeTable = getDispatchTable( QU_DISPATCH_TABLE_VERSION ) )
+		{
+			FillDispatchTable( *runtimeTable );
+			return true;
+		}
+	}
+
+	//Older runtimes only export every function individually.
+	quDispatchTable table = qu::STUB_DISPATCH_TABLE;
 	bool gotAllFunctions = true;
 
 	//QuApi core
-	gotAllFunctions &= ( qu::Initialize = (quInitialize_Ptr)library.GetFunction( "quInitialize" ) ) != nullptr;
-	gotAllFunctions &= ( qu::Release = (quRelease_Ptr)library.GetFunction( "quRelease" ) ) != nullptr;
+	gotAllFunctions &= ( table.Initialize = (quInitialize_Ptr)library.GetFunction( "quInitialize" ) ) != nullptr;
+	gotAllFunctions &= ( table.Release = (quRelease_Ptr)library.GetFunction( "quRelease" ) ) != nullptr;
 
 	//Outputs
-	gotAllFunctions &= ( qu::SetupGoogleTraceOutput = (quSetupGoogleTraceOutput_Ptr)library.GetFunction( "quSetupGoogleTraceOutput" ) ) != nullptr;
-	gotAllFunctions &= ( qu::SetupTCPOutput = (quSetupTCPOutput_Ptr)library.GetFunction( "quSetupTCPOutput" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StartOutput = (quStartOutput_Ptr)library.GetFunction( "quStartOutput" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StopOutput = (quStopOutput_Ptr)library.GetFunction( "quStopOutput" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StartAllOutputs = (quStartAllOutputs_Ptr)library.GetFunction( "quStartAllOutputs" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StopAllOutputs = (quStopAllOutputs_Ptr)library.GetFunction( "quStopAllOutputs" ) ) != nullptr;
-	gotAllFunctions &= ( qu::RemoveOutput = (quRemoveOutput_Ptr)library.GetFunction( "quRemoveOutput" ) ) != nullptr;
+	gotAllFunctions &= ( table.SetupGoogleTraceOutput = (quSetupGoogleTraceOutput_Ptr)library.GetFunction( "quSetupGoogleTraceOutput" ) ) != nullptr;
+	gotAllFunctions &= ( table.SetupTCPOutput = (quSetupTCPOutput_Ptr)library.GetFunction( "quSetupTCPOutput" ) ) != nullptr;
+	gotAllFunctions &= ( table.StartOutput = (quStartOutput_Ptr)library.GetFunction( "quStartOutput" ) ) != nullptr;
+	gotAllFunctions &= ( table.StopOutput = (quStopOutput_Ptr)library.GetFunction( "quStopOutput" ) ) != nullptr;
+	gotAllFunctions &= ( table.StartAllOutputs = (quStartAllOutputs_Ptr)library.GetFunction( "quStartAllOutputs" ) ) != nullptr;
+	gotAllFunctions &= ( table.StopAllOutputs = (quStopAllOutputs_Ptr)library.GetFunction( "quStopAllOutputs" ) ) != nullptr;
+	gotAllFunctions &= ( table.RemoveOutput = (quRemoveOutput_Ptr)library.GetFunction( "quRemoveOutput" ) ) != nullptr;
 
 	//Counters
-	gotAllFunctions &= ( qu::AddCounter = (quAddCounter_Ptr)library.GetFunction( "quAddCounter" ) ) != nullptr;
-	gotAllFunctions &= ( qu::SetCounterValue = (quSetCounterValue_Ptr)library.GetFunction( "quSetCounterValue" ) ) != nullptr;
-	gotAllFunctions &= ( qu::RemoveCounter = (quRemoveCounter_Ptr)library.GetFunction( "quRemoveCounter" ) ) != nullptr;
+	gotAllFunctions &= ( table.AddCounter = (quAddCounter_Ptr)library.GetFunction( "quAddCounter" ) ) != nullptr;
+	gotAllFunctions &= ( table.SetCounterValue = (quSetCounterValue_Ptr)library.GetFunction( "quSetCounterValue" ) ) != nullptr;
+	gotAllFunctions &= ( table.RemoveCounter = (quRemoveCounter_Ptr)library.GetFunction( "quRemoveCounter" ) ) != nullptr;
 
 	//Activity channels
-	gotAllFunctions &= ( qu::AddActivityChannel = (quAddActivityChannel_Ptr)library.GetFunction( "quAddActivityChannel" ) ) != nullptr;
-	gotAllFunctions &= ( qu::AddActivityChannelForCurrentThread = (quAddActivityChannelForCurrentThread_Ptr)library.GetFunction( "quAddActivityChannelForCurrentThread" ) ) != nullptr;
-	gotAllFunctions &= ( qu::GetChannelIDForCurrentThread = (quGetChannelIDForCurrentThread_Ptr)library.GetFunction( "quGetChannelIDForCurrentThread" ) ) != nullptr;
-	gotAllFunctions &= ( qu::AddRecurringActivity = (quAddRecurringActivity_Ptr)library.GetFunction( "quAddRecurringActivity" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StartRecurringActivity = (quStartRecurringActivity_Ptr)library.GetFunction( "quStartRecurringActivity" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StartActivity = (quStartActivity_Ptr)library.GetFunction( "quStartActivity" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StopActivity = (quStopActivity_Ptr)library.GetFunction( "quStopActivity" ) ) != nullptr;
-	gotAllFunctions &= ( qu::RemoveActivityChannel = (quRemoveActivityChannel_Ptr)library.GetFunction( "quRemoveActivityChannel" ) ) != nullptr;
+	gotAllFunctions &= ( table.AddActivityChannel = (quAddActivityChannel_Ptr)library.GetFunction( "quAddActivityChannel" ) ) != nullptr;
+	gotAllFunctions &= ( table.AddActivityChannelForCurrentThread = (quAddActivityChannelForCurrentThread_Ptr)library.GetFunction( "quAddActivityChannelForCurrentThread" ) ) != nullptr;
+	gotAllFunctions &= ( table.GetChannelIDForCurrentThread = (quGetChannelIDForCurrentThread_Ptr)library.GetFunction( "quGetChannelIDForCurrentThread" ) ) != nullptr;
+	gotAllFunctions &= ( table.AddRecurringActivity = (quAddRecurringActivity_Ptr)library.GetFunction( "quAddRecurringActivity" ) ) != nullptr;
+	gotAllFunctions &= ( table.StartRecurringActivity = (quStartRecurringActivity_Ptr)library.GetFunction( "quStartRecurringActivity" ) ) != nullptr;
+	gotAllFunctions &= ( table.StartActivity = (quStartActivity_Ptr)library.GetFunction( "quStartActivity" ) ) != nullptr;
+	gotAllFunctions &= ( table.StopActivity = (quStopActivity_Ptr)library.GetFunction( "quStopActivity" ) ) != nullptr;
+	gotAllFunctions &= ( table.RemoveActivityChannel = (quRemoveActivityChannel_Ptr)library.GetFunction( "quRemoveActivityChannel" ) ) != nullptr;
 
 	//Flow
-	gotAllFunctions &= ( qu::StartFlow = (quStartFlow_Ptr)library.GetFunction( "quStartFlow" ) ) != nullptr;
-	gotAllFunctions &= ( qu::StopFlow = (quStopFlow_Ptr)library.GetFunction( "quStopFlow" ) ) != nullptr;
+	gotAllFunctions &= ( table.StartFlow = (quStartFlow_Ptr)library.GetFunction( "quStartFlow" ) ) != nullptr;
+	gotAllFunctions &= ( table.StopFlow = (quStopFlow_Ptr)library.GetFunction( "quStopFlow" ) ) != nullptr;
 
 	//Markers
-	gotAllFunctions &= ( qu::AddMarker = (quAddMarker_Ptr)library.GetFunction( "quAddMarker" ) ) != nullptr;
+	gotAllFunctions &= ( table.AddMarker = (quAddMarker_Ptr)library.GetFunction( "quAddMarker" ) ) != nullptr;
 
 	if( !gotAllFunctions )
 	{
@@ -218,45 +598,38 @@ static bool LoadQuApi( quLogHook_Ptr logHook )
 		UnloadQuApi();
 		return false;
 	}
+
+	qu::dispatch = table;
+	ActivityFilter::Install( qu::dispatch, table );
+	CounterCoalescing::Install( qu::dispatch );
+	CounterAccumulators::Install( qu::dispatch );
+	CounterPolling::Install( qu::dispatch );
+	ActivityStacks::Install( qu::dispatch );
+	Governor::Attach( table );
+	SharedState::Attach( nullptr );
+	ActivityRegistry::Attach( nullptr );
+	Clock::Attach( nullptr );
+	AnnotationKeys::Attach( nullptr );
 	return true;
 }
 void UnloadQuApi()
 {
-	//QuApi core
-	qu::Initialize = nullptr;
-	qu::Release = nullptr;
-
-	//Outputs
-	qu::SetupGoogleTraceOutput = nullptr;
-	qu::SetupTCPOutput = nullptr;
-	qu::StartOutput = nullptr;
-	qu::StopOutput = nullptr;
-	qu::StartAllOutputs = nullptr;
-	qu::StopAllOutputs = nullptr;
-	qu::RemoveOutput = nullptr;
-
-	//Counters
-	qu::AddCounter = nullptr;
-	qu::SetCounterValue = nullptr;
-	qu::RemoveCounter = nullptr;
-
-	//Activity channels
-	qu::AddActivityChannel = nullptr;
-	qu::AddActivityChannelForCurrentThread = nullptr;
-	qu::GetChannelIDForCurrentThread = nullptr;
-	qu::AddRecurringActivity = nullptr;
-	qu::StartRecurringActivity = nullptr;
-	qu::StartActivity = nullptr;
-	qu::StopActivity = nullptr;
-	qu::RemoveActivityChannel = nullptr;
-
-	//Flow
-	qu::StartFlow = nullptr;
-	qu::StopFlow = nullptr;
-
-	//Markers
-	qu::AddMarker = nullptr;
-
+	Governor::Detach();
+	FlightRecorder::Detach();
+	Clock::Detach();
+	AnnotationKeys::Detach();
+	CounterPolling::Detach();
+	CounterFamilies::Detach();
+	ActivityInterning::Detach();
+	SharedState::Detach();
+	ActivityRegistry::Detach();
+	ActivityStacks::Detach();
+	ActivityFilter::Detach();
+	CounterCoalescing::Detach();
+	CounterAccumulators::Detach();
+	EventStaging::Uninstall();
+	qu::dispatch = qu::STUB_DISPATCH_TABLE;
+	ThreadState::DetachAll();
 	library.Unload();
 }
 
@@ -267,122 +640,268 @@ quUInt64 QU_CALL_CONV quInitialize( quUInt32 headerVersion, quLogHook_Ptr logHoo
 {
 	//It's possible for the application to just try to initialize before explicitly loading the dll. To support this case we
 	//automatically try to load the library here.
-	if( qu::Initialize == nullptr && !qul::LoadQuApi( logHook ) )
+	if( !qul::library.IsLoaded() && !qul::LoadQuApi( logHook ) )
 		return 0;
 
-	if( qu::Initialize != nullptr )
-		return qu::Initialize( headerVersion, logHook );
-	else
-		return 0;
+	//Register the activities declared throughout the binary in one go, instead of each of them the first time it's used.
+	quUInt64 result = qu::dispatch.Initialize( headerVersion, logHook );
+	if( result != 0 )
+		qul::ActivityRegistry::RegisterSection( qu::dispatch );
+	return result;
 }
 void QU_CALL_CONV quRelease()
 {
-	if( qu::Release != nullptr )
-		qu::Release();
+	qul::CounterCoalescing::Flush();
+	qul::EventStaging::FlushAllThreads();
+	qu::dispatch.Release();
 	qul::UnloadQuApi();
 }
 
 //Outputs
 quOutputID QU_CALL_CONV quSetupGoogleTraceOutput( const char* outputFile, bool startImmediately )
 {
-	if( qu::SetupGoogleTraceOutput == nullptr )
-		return QU_INVALID_OUTPUT_ID;
-	else
-		return qu::SetupGoogleTraceOutput( outputFile, startImmediately );
+	quOutputID outputID = qu::dispatch.SetupGoogleTraceOutput( outputFile, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
 }
 quOutputID QU_CALL_CONV quSetupTCPOutput( const char* appName, bool startImmediately )
 {
-	if( qu::SetupTCPOutput == nullptr )
-		return QU_INVALID_OUTPUT_ID;
-	else
-		return qu::SetupTCPOutput( appName, startImmediately );
+	quOutputID outputID = qu::dispatch.SetupTCPOutput( appName, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
 }
 bool QU_CALL_CONV quStartOutput( quOutputID outputID )
 {
-	if( qu::StartOutput == nullptr )
+	if( !qu::dispatch.StartOutput( outputID ) )
 		return false;
-	else
-		return qu::StartOutput( outputID );
+
+	qul::SharedState::OnOutputStarted( outputID );
+	return true;
 }
 bool QU_CALL_CONV quStopOutput( quOutputID outputID )
 {
-	if( qu::StopOutput == nullptr )
+	qul::ActivityFilter::ReportFilteredCounts();
+	qul::CounterCoalescing::Flush();
+	if( !qu::dispatch.StopOutput( outputID ) )
 		return false;
-	else
-		return qu::StopOutput( outputID );
+
+	qul::SharedState::OnOutputStopped( outputID );
+	return true;
 }
 bool QU_CALL_CONV quStartAllOutputs()
 {
-	if( qu::StartAllOutputs == nullptr )
+	if( !qu::dispatch.StartAllOutputs() )
 		return false;
-	else
-		return qu::StartAllOutputs();
+
+	qul::SharedState::OnAllOutputsStarted();
+	return true;
 }
 bool QU_CALL_CONV quStopAllOutputs()
 {
-	if( qu::StopAllOutputs == nullptr )
+	qul::ActivityFilter::ReportFilteredCounts();
+	qul::CounterCoalescing::Flush();
+	if( !qu::dispatch.StopAllOutputs() )
 		return false;
-	else
-		return qu::StopAllOutputs();
+
+	qul::SharedState::OnAllOutputsStopped();
+	return true;
 }
 bool QU_CALL_CONV quRemoveOutput( quOutputID outputID )
 {
-	if( qu::RemoveOutput == nullptr )
+	qul::ActivityFilter::ReportFilteredCounts();
+	qul::CounterCoalescing::Flush();
+	if( !qu::dispatch.RemoveOutput( outputID ) )
 		return false;
-	else
-		return qu::RemoveOutput( outputID );
+
+	qul::FlightRecorder::RemoveTriggers( outputID );
+	qul::SharedState::OnOutputRemoved( outputID );
+	return true;
+}
+quOutputID QU_CALL_CONV quSetupFlightRecorderOutput( quUInt64 bytesPerThread, bool startImmediately )
+{
+	quOutputID outputID = qu::dispatch.SetupFlightRecorderOutput( bytesPerThread, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
+}
+bool QU_CALL_CONV quDumpFlightRecorder( quOutputID outputID, const char* outputFile )
+{
+	return qul::FlightRecorder::Dump( outputID, outputFile );
+}
+bool QU_CALL_CONV quSetFlightRecorderTrigger( quOutputID outputID, const char* markerName, int signalNumber, const char* outputFile )
+{
+	return qul::FlightRecorder::AddTrigger( outputID, markerName, signalNumber, outputFile );
+}
+quOutputID QU_CALL_CONV quSetupMappedTraceOutput( const char* outputFile, quUInt64 bytesPerBuffer, bool startImmediately )
+{
+	quOutputID outputID = qu::dispatch.SetupMappedTraceOutput( outputFile, bytesPerBuffer, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
+}
+quOutputID QU_CALL_CONV quSetupBinaryTraceOutput( const char* outputFile, quUInt32 chunkBytes, bool startImmediately )
+{
+	quOutputID outputID = qu::dispatch.SetupBinaryTraceOutput( outputFile, chunkBytes, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
+}
+quOutputID QU_CALL_CONV quSetupPerfettoTraceOutput( const char* outputFile, bool startImmediately )
+{
+	quOutputID outputID = qu::dispatch.SetupPerfettoTraceOutput( outputFile, startImmediately );
+	qul::SharedState::OnOutputSetup( outputID, startImmediately );
+	return outputID;
 }
 
 //Counters
 quCounterID QU_CALL_CONV quAddCounter( const char* counterName, quUInt32 color )
 {
-	if( qu::AddCounter == nullptr )
-		return QU_INVALID_COUNTER_ID;
-	else
-		return qu::AddCounter( counterName, color );
+	return qu::dispatch.AddCounter( counterName, color );
 }
 bool QU_CALL_CONV quSetCounterValue( quCounterID counterID, float newCounterValue )
 {
-	if( qu::SetCounterValue == nullptr )
-		return false;
-	else
-		return qu::SetCounterValue( counterID, newCounterValue );
+	return qu::dispatch.SetCounterValue( counterID, newCounterValue );
 }
 bool QU_CALL_CONV quRemoveCounter( quCounterID counterID )
 {
-	if( qu::RemoveCounter == nullptr )
-		return false;
-	else
-		return qu::RemoveCounter( counterID );
+	qul::CounterPolling::RemovePolledCounter( counterID );
+	qul::CounterCoalescing::OnCounterRemoved( counterID );
+	qul::CounterAccumulators::RemoveAccumulator( counterID );
+	return qu::dispatch.RemoveCounter( counterID );
+}
+bool QU_CALL_CONV quSetCounterValues( const quCounterID* counterIDs, const float* newCounterValues, quUInt32 count )
+{
+	return qu::dispatch.SetCounterValues( counterIDs, newCounterValues, count );
+}
+
+//Counter coalescing
+bool QU_CALL_CONV quSetCounterCoalescing( quCounterID counterID, quCounterCoalescing coalescing )
+{
+	return qul::CounterCoalescing::SetCoalescing( counterID, coalescing );
+}
+void QU_CALL_CONV quSetCounterFlushInterval( quUInt64 intervalNanos )
+{
+	qul::CounterCoalescing::SetFlushInterval( intervalNanos );
+}
+void QU_CALL_CONV quFlushCounters()
+{
+	qul::CounterCoalescing::Flush();
+}
+
+//Typed counters
+quCounterID QU_CALL_CONV quAddTypedCounter( const char* counterName, quUInt32 color, quCounterType type )
+{
+	if( type > QU_COUNTER_TYPE_ACCUMULATOR )
+		return QU_INVALID_COUNTER_ID;
+	if( type != QU_COUNTER_TYPE_ACCUMULATOR )
+		return qu::dispatch.AddTypedCounter( counterName, color, type );
+
+	//The runtime only ever sees the sums of accumulators.
+	quCounterID counterID = qu::dispatch.AddTypedCounter( counterName, color, QU_COUNTER_TYPE_INT64 );
+	qul::CounterAccumulators::AddAccumulator( counterID );
+	if( counterID != QU_INVALID_COUNTER_ID )
+		qul::CounterCoalescing::StartFlushing();
+	return counterID;
+}
+bool QU_CALL_CONV quSetCounterValueInt64( quCounterID counterID, quInt64 newCounterValue )
+{
+	return qu::dispatch.SetCounterValueInt64( counterID, newCounterValue );
+}
+bool QU_CALL_CONV quSetCounterValueDouble( quCounterID counterID, double newCounterValue )
+{
+	return qu::dispatch.SetCounterValueDouble( counterID, newCounterValue );
+}
+bool QU_CALL_CONV quAddToCounter( quCounterID counterID, quInt64 delta )
+{
+	return qul::CounterAccumulators::AddTo( counterID, delta );
+}
+
+//Polled counters
+quCounterID QU_CALL_CONV quAddPolledCounter( const char* counterName, quUInt32 color, quPolledCounterCallback_Ptr callback, void* userData, quUInt32 periodMicros )
+{
+	if( callback == nullptr || periodMicros == 0 )
+		return QU_INVALID_COUNTER_ID;
+
+	quCounterID counterID = qu::dispatch.AddCounter( counterName, color );
+	if( counterID != QU_INVALID_COUNTER_ID && !qul::CounterPolling::AddPolledCounter( counterID, callback, userData, periodMicros ) )
+	{
+		qu::dispatch.RemoveCounter( counterID );
+		return QU_INVALID_COUNTER_ID;
+	}
+	return counterID;
+}
+
+//Timestamps
+quUInt64 QU_CALL_CONV quGetTimestamp()
+{
+	return qu::GetTimestamp();
+}
+quActivityID QU_CALL_CONV quStartRecurringActivityAt( quActivityChannelID channelID, quRecurringActivityID activityID, quUInt64 timestamp )
+{
+	return qu::dispatch.StartRecurringActivityAt( channelID, activityID, timestamp );
+}
+bool QU_CALL_CONV quStopActivityAt( quActivityID activityID, quUInt64 timestamp )
+{
+	return qu::dispatch.StopActivityAt( activityID, timestamp );
+}
+bool QU_CALL_CONV quSetCounterValueAt( quCounterID counterID, float newCounterValue, quUInt64 timestamp )
+{
+	return qu::dispatch.SetCounterValueAt( counterID, newCounterValue, timestamp );
+}
+
+//Clocks
+bool QU_CALL_CONV quSetClockSource( quClockSource clockSource )
+{
+	return qul::Clock::SetSource( clockSource );
+}
+
+//Counter families
+quCounterFamilyID QU_CALL_CONV quAddCounterFamily( const char* familyName, quUInt32 color, quCounterType type, const char* const* labelNames, quUInt32 labelCount, quUInt32 maxSeries )
+{
+	return qul::CounterFamilies::AddFamily( familyName, color, type, labelNames, labelCount, maxSeries );
+}
+bool QU_CALL_CONV quRemoveCounterFamily( quCounterFamilyID familyID )
+{
+	return qul::CounterFamilies::RemoveFamily( familyID );
+}
+bool QU_CALL_CONV quSetCounterSeriesValue( quCounterFamilyID familyID, const char* const* labelValues, double newCounterValue )
+{
+	return qul::CounterFamilies::SetValue( familyID, labelValues, newCounterValue );
+}
+bool QU_CALL_CONV quAddToCounterSeries( quCounterFamilyID familyID, const char* const* labelValues, quInt64 delta )
+{
+	return qul::CounterFamilies::AddTo( familyID, labelValues, delta );
 }
 
 //Activity channels
 quActivityChannelID QU_CALL_CONV quAddActivityChannel( const char* channelName, quUInt32 color )
 {
-	if( qu::AddActivityChannel == nullptr )
-		return QU_INVALID_ACTIVITY_CHANNEL_ID;
-	else
-		return qu::AddActivityChannel( channelName, color );
+	return qu::dispatch.AddActivityChannel( channelName, color );
 }
 quActivityChannelID QU_CALL_CONV quAddActivityChannelForCurrentThread( const char* channelName, quUInt32 color )
 {
-	if( qu::AddActivityChannelForCurrentThread == nullptr )
-		return QU_INVALID_ACTIVITY_CHANNEL_ID;
-	else
-		return qu::AddActivityChannelForCurrentThread( channelName, color );
+	quActivityChannelID channelID = qu::dispatch.AddActivityChannelForCurrentThread( channelName, color );
+	if( channelID == QU_INVALID_ACTIVITY_CHANNEL_ID )
+		return channelID;
+
+	qul::ThreadState::SetChannel( channelID );
+#if defined( QU_API_INLINE_EVENTS )
+	qul::ThreadState::AttachEventRing( qu::dispatch );
+#endif
+	return channelID;
 }
 quActivityChannelID QU_CALL_CONV quGetChannelIDForCurrentThread()
 {
-	if( qu::GetChannelIDForCurrentThread == nullptr )
-		return QU_INVALID_ACTIVITY_CHANNEL_ID;
-	else
-		return qu::GetChannelIDForCurrentThread();
+	if( !qul::ThreadState::IsCurrent() )
+		qul::ThreadState::Refresh( qu::dispatch );
+	//Channels for the current thread are normally added through us, in which case we dont have to ask the runtime.
+	if( qu::threadState.channelID != QU_INVALID_ACTIVITY_CHANNEL_ID )
+		return qu::threadState.channelID;
+
+	return qu::dispatch.GetChannelIDForCurrentThread();
 }
 quRecurringActivityID QU_CALL_CONV quAddRecurringActivity( const char* activityName, quUInt32 color )
 {
 	//This function is most likely called before QuApi is even loaded as the recurring activity id's are most likely stored in static memory.
 	//For this reason we try to load the library once here so that the recurring activity data may be stored right away.
-	if( qu::AddRecurringActivity == nullptr )
+	if( !qul::library.IsLoaded() )
 	{
 		static bool loadTriedAndFailed = false;
 		//If we've already failed to load the library we wont try again, probably the Qumulus application just isn't installed.
@@ -395,59 +914,155 @@ quRecurringActivityID QU_CALL_CONV quAddRecurringActivity( const char* activityN
 		}
 	}
 
-	if( qu::AddRecurringActivity != nullptr )
-		return qu::AddRecurringActivity( activityName, color );
-	else
-		return QU_INVALID_RECURRING_ACTIVITY_ID;
+	quRecurringActivityID activityID = qu::dispatch.AddRecurringActivity( activityName, color );
+	qul::ActivityRegistry::OnActivityAdded( activityID, activityName );
+	return activityID;
+}
+bool QU_CALL_CONV quAddRecurringActivities( quActivityDescriptor* descriptors, quUInt32 count )
+{
+	return qul::ActivityRegistry::Register( descriptors, count, qu::dispatch );
 }
 quActivityID QU_CALL_CONV quStartRecurringActivity( quActivityChannelID channelID, quRecurringActivityID activityID )
 {
-	if( qu::StartRecurringActivity == nullptr )
-		return QU_INVALID_ACTIVITY_ID;
-	else
-		return qu::StartRecurringActivity( channelID, activityID );
+	return qu::dispatch.StartRecurringActivity( channelID, activityID );
 }
 quActivityID QU_CALL_CONV quStartActivity( quActivityChannelID channelID, const char* activityName, quUInt32 color )
 {
-	if( qu::StartActivity == nullptr )
-		return QU_INVALID_ACTIVITY_ID;
-	else
-		return qu::StartActivity( channelID, activityName, color );
+	return qu::dispatch.StartActivity( channelID, activityName, color );
 }
 bool QU_CALL_CONV quStopActivity( quActivityID activityID )
 {
-	if( qu::StopActivity == nullptr )
-		return false;
-	else
-		return qu::StopActivity( activityID );
+	return qu::dispatch.StopActivity( activityID );
+}
+bool QU_CALL_CONV quStopCurrentActivity( quActivityChannelID channelID )
+{
+	return qu::dispatch.StopCurrentActivity( channelID );
 }
 bool QU_CALL_CONV quRemoveActivityChannel( quActivityChannelID channelID )
 {
-	if( qu::RemoveActivityChannel == nullptr )
-		return false;
-	else
-		return qu::RemoveActivityChannel( channelID );
+	qul::EventStaging::OnChannelRemoved( channelID );
+	bool removed = qu::dispatch.RemoveActivityChannel( channelID );
+	qul::ThreadState::RemoveChannel( channelID );
+	return removed;
 }
 
 //Flow
 quFlowID QU_CALL_CONV quStartFlow( quActivityChannelID sourceChannel )
 {
-	if( qu::StartFlow == nullptr )
-		return QU_INVALID_FLOW_ID;
-	else
-		return qu::StartFlow( sourceChannel );
+	return qu::dispatch.StartFlow( sourceChannel );
 }
 bool QU_CALL_CONV quStopFlow( quFlowID flowID, quActivityChannelID targetChannel )
 {
-	if( qu::StopFlow == nullptr )
-		return false;
-	else
-		return qu::StopFlow( flowID, targetChannel );
+	return qu::dispatch.StopFlow( flowID, targetChannel );
 }
 
 //Markers
 void QU_CALL_CONV quAddMarker( const char* markerName )
 {
-	if( qu::AddMarker != nullptr )
-		return qu::AddMarker( markerName );
+	qu::dispatch.AddMarker( markerName );
+}
+
+//Categories
+void QU_CALL_CONV quSetCategoryEnabled( quCategory category, bool enabled )
+{
+	qul::SharedState::SetCategoryEnabled( category, enabled );
+}
+void QU_CALL_CONV quSetCategoryMask( quUInt64 categoryMask )
+{
+	qul::SharedState::SetCategoryMask( categoryMask );
+}
+quUInt64 QU_CALL_CONV quGetCategoryMask()
+{
+	return qul::SharedState::GetCategoryMask();
+}
+
+//Activity filters
+quRecurringActivityID QU_CALL_CONV quAddFilteredRecurringActivity( const char* activityName, quUInt32 color, quUInt32 sampleInterval, quUInt64 minDurationNanos )
+{
+	quRecurringActivityID activityID = quAddRecurringActivity( activityName, color );
+	if( activityID != QU_INVALID_RECURRING_ACTIVITY_ID )
+		qul::ActivityFilter::SetFilter( activityID, sampleInterval, minDurationNanos );
+	return activityID;
+}
+bool QU_CALL_CONV quSetRecurringActivityFilter( quRecurringActivityID activityID, quUInt32 sampleInterval, quUInt64 minDurationNanos )
+{
+	return qul::ActivityFilter::SetFilter( activityID, sampleInterval, minDurationNanos );
+}
+
+//Formatted activities
+quActivityID QU_CALL_CONV quStartFormattedActivity( quActivityChannelID channelID, quActivityDescriptor* descriptor, const quActivityArg* args, quUInt32 argCount )
+{
+	if( descriptor == nullptr || descriptor->name == nullptr || ( args == nullptr && argCount != 0 ) || argCount > QU_MAX_ACTIVITY_ARGS )
+		return QU_INVALID_ACTIVITY_ID;
+
+	if( qu::GetRecurringActivityID( *descriptor ) == QU_INVALID_RECURRING_ACTIVITY_ID )
+		return QU_INVALID_ACTIVITY_ID;
+
+	return qu::dispatch.StartFormattedActivity( channelID, descriptor, args, argCount );
+}
+
+//Activity annotations
+quAnnotationKeyID QU_CALL_CONV quAddAnnotationKey( const char* keyName )
+{
+	return qul::AnnotationKeys::Add( keyName );
+}
+bool QU_CALL_CONV quAnnotateActivity( quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	if( activityID == QU_INVALID_ACTIVITY_ID || !qul::AnnotationKeys::AreValid( annotations, count ) )
+		return false;
+
+	return qu::dispatch.AnnotateActivity( activityID, annotations, count );
+}
+bool QU_CALL_CONV quStopActivityWithArgs( quActivityID activityID, const quAnnotation* annotations, quUInt32 count )
+{
+	//The activity is stopped regardless, leaving it running would break the nesting of its channel.
+	if( !qul::AnnotationKeys::AreValid( annotations, count ) )
+		count = 0;
+
+	return qu::dispatch.StopActivityWithArgs( activityID, annotations, count );
+}
+
+//Activity interning
+bool QU_CALL_CONV quSetActivityInterning( quUInt32 maxNames )
+{
+	return qul::ActivityInterning::SetMaxNames( maxNames );
+}
+quRecurringActivityID QU_CALL_CONV quInternActivity( const char* activityName, quUInt32 color )
+{
+	return qul::ActivityInterning::Intern( activityName, color );
+}
+void QU_CALL_CONV quGetActivityInterningStats( quActivityInterningStats* stats )
+{
+	if( stats != nullptr )
+		qul::ActivityInterning::GetStats( *stats );
+}
+
+//Governor
+bool QU_CALL_CONV quSetOverheadBudget( float cpuFraction )
+{
+	return qul::Governor::SetBudget( cpuFraction );
+}
+
+//Events
+bool QU_CALL_CONV quSubmitEvents( const quEvent* events, quUInt32 count )
+{
+	return qu::dispatch.SubmitEvents( events, count );
+}
+quActivityID QU_CALL_CONV quReserveActivityIDs( quUInt32 count )
+{
+	return qul::EventStaging::ReserveActivityIDs( count );
+}
+void QU_CALL_CONV quFlushEvents()
+{
+	qul::EventStaging::FlushCurrentThread();
+}
+
+//Event rings
+quEventRing* QU_CALL_CONV quGetEventRingForCurrentThread()
+{
+	return qu::dispatch.GetEventRingForCurrentThread();
+}
+void QU_CALL_CONV quFlushEventRing()
+{
+	qu::dispatch.FlushEventRing();
 }
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderSharedState.h"
+#include <mutex>
+#include <unordered_map>
+
+namespace qu
+{
+
+constinit quSharedState sharedState = {
+	.recording = 0,
+	.filtering = 0,
+	.categoryMask = ~0ull,
+	.clockSource = QU_CLOCK_SOURCE_MONOTONIC,
+	.clockSequence = 0,
+	.clockCalibration = { 0, 0, 0.0 },
+	.interning = 0,
+	.threadStateGeneration = 0,
+};
+
+} //End namespace qu
+
+namespace qul
+{
+
+static std::mutex outputsMutex;                           //!< Guards outputs and setSharedState.
+static std::unordered_map< quOutputID, bool > outputs;    //!< Every output that was setup, mapped to whether it's running.
+static quSetSharedState_Ptr setSharedState = nullptr;     //!< Set when the runtime maintains qu::sharedState itself.
+
+static void SetRecording( bool recording )
+{
+	std::atomic_ref< quUInt32 >( qu::sharedState.recording ).store( recording ? 1 : 0, std::memory_order_relaxed );
+}
+
+//Must be called with outputsMutex locked.
+static void UpdateRecording()
+{
+	bool anyRunning = false;
+	for( const auto& [outputID, running] : outputs )
+		anyRunning |= running;
+
+	SetRecording( anyRunning );
+}
+
+void SharedState::Attach( quSetSharedState_Ptr runtimeSetSharedState )
+{
+	std::lock_guard lock( outputsMutex );
+	outputs.clear();
+	SetRecording( false );
+	setSharedState = runtimeSetSharedState;
+	if( setSharedState != nullptr )
+		setSharedState( &qu::sharedState );
+}
+void SharedState::Detach()
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		setSharedState( nullptr );
+
+	outputs.clear();
+	setSharedState = nullptr;
+	SetRecording( false );
+}
+
+void SharedState::SetCategoryEnabled( quCategory category, bool enabled )
+{
+	if( category >= QU_MAX_CATEGORIES )
+		return;
+
+	std::atomic_ref< quUInt64 > categoryMask( qu::sharedState.categoryMask );
+	if( enabled )
+		categoryMask.fetch_or( 1ull << category, std::memory_order_relaxed );
+	else
+		categoryMask.fetch_and( ~( 1ull << category ), std::memory_order_relaxed );
+}
+void SharedState::SetCategoryMask( quUInt64 categoryMask )
+{
+	std::atomic_ref< quUInt64 >( qu::sharedState.categoryMask ).store( categoryMask, std::memory_order_relaxed );
+}
+quUInt64 SharedState::GetCategoryMask()
+{
+	return std::atomic_ref< quUInt64 >( qu::sharedState.categoryMask ).load( std::memory_order_relaxed );
+}
+
+void SharedState::SetFiltering( bool filtering )
+{
+	std::atomic_ref< quUInt32 >( qu::sharedState.filtering ).store( filtering ? 1 : 0, std::memory_order_relaxed );
+}
+void SharedState::SetInterning( bool interning )
+{
+	std::atomic_ref< quUInt32 >( qu::sharedState.interning ).store( interning ? 1 : 0, std::memory_order_relaxed );
+}
+
+void SharedState::OnOutputSetup( quOutputID outputID, bool startImmediately )
+{
+	if( outputID == QU_INVALID_OUTPUT_ID )
+		return;
+
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	outputs[outputID] = startImmediately;
+	UpdateRecording();
+}
+void SharedState::OnOutputStarted( quOutputID outputID )
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	outputs[outputID] = true;
+	UpdateRecording();
+}
+void SharedState::OnOutputStopped( quOutputID outputID )
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	outputs[outputID] = false;
+	UpdateRecording();
+}
+void SharedState::OnAllOutputsStarted()
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	for( auto& [outputID, running] : outputs )
+		running = true;
+	UpdateRecording();
+}
+void SharedState::OnAllOutputsStopped()
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	for( auto& [outputID, running] : outputs )
+		running = false;
+	UpdateRecording();
+}
+void SharedState::OnOutputRemoved( quOutputID outputID )
+{
+	std::lock_guard lock( outputsMutex );
+	if( setSharedState != nullptr )
+		return;
+
+	outputs.erase( outputID );
+	UpdateRecording();
+}
+
+} //End namespace qul
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.hpp>
+
+namespace qul
+{
+
+/**
+ * Maintains the qu::sharedState that the header utilities check before calling into the api. Runtimes that support it keep
+ * the state up to date themselves. For every other runtime the loader derives it from the output calls that pass through it.
+ */
+class SharedState
+{
+public:
+	//Pass nullptr for runtimes that dont maintain the shared state themselves.
+	static void Attach( quSetSharedState_Ptr runtimeSetSharedState );
+	static void Detach();
+
+	//Categories are maintained by the loader, regardless of the runtime.
+	static void SetCategoryEnabled( quCategory category, bool enabled );
+	static void SetCategoryMask( quUInt64 categoryMask );
+	static quUInt64 GetCategoryMask();
+
+	//Set by the ActivityFilter while any recurring activity is filtered.
+	static void SetFiltering( bool filtering );
+	//Set by ActivityInterning while interning is enabled.
+	static void SetInterning( bool interning );
+
+	//Only have an effect when the runtime doesn't maintain the shared state itself.
+	static void OnOutputSetup( quOutputID outputID, bool startImmediately );
+	static void OnOutputStarted( quOutputID outputID );
+	static void OnOutputStopped( quOutputID outputID );
+	static void OnAllOutputsStarted();
+	static void OnAllOutputsStopped();
+	static void OnOutputRemoved( quOutputID outputID );
+};
+
+} //End namespace qul
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderSymbolizer.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#if defined( _WIN64 )
+#	include <Windows.h>
+#	include <DbgHelp.h>
+#	pragma comment( lib, "dbghelp.lib" )
+#else
+#	include <cstdlib>
+#	include <cxxabi.h>
+#	include <dlfcn.h>
+#endif
+#if defined( __linux__ )
+#	include <algorithm>
+#	include <cstring>
+#	include <vector>
+#	include <elf.h>
+#	include <fcntl.h>
+#	include <link.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace qul
+{
+
+static std::mutex symbolizerMutex;                                 //!< Guards everything below, the platform symbol lookups aren't thread safe either.
+static std::unordered_map< const void*, std::string > resolvedNames; //!< Name for every address we were asked about, empty if it couldn't be resolved.
+
+#if defined( _WIN64 )
+static bool symbolHandlerInitialized = false; //!< Whether SymInitialize was called for the process.
+#else
+static std::string Demangle( const char* symbolName )
+{
+	int status = 0;
+	char* demangledName = abi::__cxa_demangle( symbolName, nullptr, nullptr, &status );
+	if( status != 0 )
+		return symbolName;
+
+	std::string result = demangledName;
+	free( demangledName );
+	return result;
+}
+#endif
+
+#if defined( __linux__ )
+struct ModuleSymbol
+{
+	uintptr_t begin;     //!< Address of the function in memory.
+	uintptr_t end;       //!< One past the last byte of the function, same as begin if the symbol has no size.
+	size_t nameOffset;   //!< Offset of the mangled name in ModuleSymbols::names.
+};
+struct ModuleSymbols
+{
+	std::vector< ModuleSymbol > symbols; //!< Sorted on begin.
+	std::string names;                   //!< Copy of the string table the symbols refer to.
+};
+static std::unordered_map< const void*, ModuleSymbols > moduleSymbols; //!< Symbols of every module we resolved an address in, keyed on their base address.
+
+//Reads the function symbols of an elf file, the full symbol table if it wasn't stripped and otherwise the dynamic one.
+static ModuleSymbols LoadModuleSymbols( const char* path, uintptr_t loadBias )
+{
+	ModuleSymbols module;
+	int file = open( path, O_RDONLY | O_CLOEXEC );
+	if( file < 0 )
+		return module;
+
+	struct stat fileStat;
+	void* mapping = MAP_FAILED;
+	if( fstat( file, &fileStat ) == 0 )
+		mapping = mmap( nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+	close( file );
+	if( mapping == MAP_FAILED )
+		return module;
+
+	const char* image = (const char*)mapping;
+	size_t imageSize = fileStat.st_size;
+	const ElfW( Ehdr )* header = (const ElfW( Ehdr )*)image;
+	bool validHeader = imageSize >= sizeof( ElfW( Ehdr ) ) && memcmp( header->e_ident, ELFMAG, SELFMAG ) == 0 &&
+	                   header->e_shoff + header->e_shnum * sizeof( ElfW( Shdr ) ) <= imageSize;
+	if( validHeader )
+	{
+		const ElfW( Shdr )* sections = (const ElfW( Shdr )*)( image + header->e_shoff );
+		const ElfW( Shdr )* symbolTable = nullptr;
+		for( size_t i = 0; i < header->e_shnum; ++i )
+		{
+			if( sections[ i ].sh_type == SHT_SYMTAB || ( sections[ i ].sh_type == SHT_DYNSYM && symbolTable == nullptr ) )
+				symbolTable = &sections[ i ];
+		}
+
+		if( symbolTable != nullptr && symbolTable->sh_link < header->e_shnum )
+		{
+			const ElfW( Shdr )& stringTable = sections[ symbolTable->sh_link ];
+			if( symbolTable->sh_offset + symbolTable->sh_size <= imageSize && stringTable.sh_offset + stringTable.sh_size <= imageSize )
+			{
+				const ElfW( Sym )* symbols = (const ElfW( Sym )*)( image + symbolTable->sh_offset );
+				size_t symbolCount = symbolTable->sh_size / sizeof( ElfW( Sym ) );
+				for( size_t i = 0; i < symbolCount; ++i )
+				{
+					const ElfW( Sym )& symbol = symbols[ i ];
+					if( ELF64_ST_TYPE( symbol.st_info ) != STT_FUNC || symbol.st_value == 0 || symbol.st_name >= stringTable.sh_size )
+						continue;
+
+					uintptr_t begin = loadBias + symbol.st_value;
+					module.symbols.push_back( { begin, begin + symbol.st_size, symbol.st_name } );
+				}
+				module.names.assign( image + stringTable.sh_offset, stringTable.sh_size );
+			}
+		}
+	}
+	munmap( mapping, imageSize );
+
+	std::sort( module.symbols.begin(), module.symbols.end(), []( const ModuleSymbol& lhs, const ModuleSymbol& rhs ) { return lhs.begin < rhs.begin; } );
+	return module;
+}
+#endif
+
+//Must be called with symbolizerMutex locked.
+static std::string ResolveUncached( const void* address )
+{
+#if defined( _WIN64 )
+	if( !symbolHandlerInitialized )
+	{
+		SymSetOptions( SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS );
+		symbolHandlerInitialized = SymInitialize( GetCurrentProcess(), nullptr, TRUE ) != FALSE;
+		if( !symbolHandlerInitialized )
+			return {};
+	}
+
+	alignas( SYMBOL_INFO ) char buffer[ sizeof( SYMBOL_INFO ) + MAX_SYM_NAME ];
+	SYMBOL_INFO* symbol = (SYMBOL_INFO*)buffer;
+	symbol->SizeOfStruct = sizeof( SYMBOL_INFO );
+	symbol->MaxNameLen = MAX_SYM_NAME;
+	if( !SymFromAddr( GetCurrentProcess(), (DWORD64)address, nullptr, symbol ) )
+		return {};
+
+	return std::string( symbol->Name, symbol->NameLen );
+#elif defined( __linux__ )
+	Dl_info info;
+	link_map* linkMap = nullptr;
+	if( dladdr1( address, &info, (void**)&linkMap, RTLD_DL_LINKMAP ) == 0 || linkMap == nullptr )
+		return {};
+
+	auto [moduleIt, inserted] = moduleSymbols.try_emplace( info.dli_fbase );
+	if( inserted )
+	{
+		//The executable itself has no name in the link map.
+		const char* path = linkMap->l_name[ 0 ] != '\0' ? linkMap->l_name : "/proc/self/exe";
+		moduleIt->second = LoadModuleSymbols( path, linkMap->l_addr );
+	}
+
+	const ModuleSymbols& module = moduleIt->second;
+	uintptr_t lookup = (uintptr_t)address;
+	auto symbolIt = std::upper_bound( module.symbols.begin(), module.symbols.end(), lookup, []( uintptr_t value, const ModuleSymbol& symbol ) { return value < symbol.begin; } );
+	if( symbolIt != module.symbols.begin() )
+	{
+		--symbolIt;
+		if( lookup < symbolIt->end || symbolIt->begin == symbolIt->end )
+			return Demangle( module.names.c_str() + symbolIt->nameOffset );
+	}
+
+	if( info.dli_sname != nullptr )
+		return Demangle( info.dli_sname );
+	return {};
+#else
+	Dl_info info;
+	if( dladdr( address, &info ) == 0 || info.dli_sname == nullptr )
+		return {};
+
+	return Demangle( info.dli_sname );
+#endif
+}
+
+const char* Symbolizer::Resolve( const void* address )
+{
+	//Addresses are usually return addresses, which may already belong to the next function if the call was the last instruction.
+	const void* lookup = (const char*)address - 1;
+
+	std::lock_guard lock( symbolizerMutex );
+	auto [nameIt, inserted] = resolvedNames.try_emplace( address );
+	if( inserted )
+		nameIt->second = ResolveUncached( lookup );
+
+	return nameIt->second.empty() ? nullptr : nameIt->second.c_str();
+}
+void Symbolizer::Clear()
+{
+	std::lock_guard lock( symbolizerMutex );
+	resolvedNames.clear();
+#if defined( _WIN64 )
+	if( symbolHandlerInitialized )
+		SymCleanup( GetCurrentProcess() );
+	symbolHandlerInitialized = false;
+#elif defined( __linux__ )
+	moduleSymbols.clear();
+#endif
+}
+
+} //End namespace qul
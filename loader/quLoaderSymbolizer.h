@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace qul
+{
+
+/**
+ * Resolves code addresses to the names of the functions they belong to. On linux the symbol table of the binary containing the
+ * address is read, so that functions which aren't exported can be resolved as well. Elsewhere the platform's own symbol lookup
+ * is used. Both the symbol tables and the resolved names are cached until Clear is called.
+ */
+class Symbolizer
+{
+public:
+	//Returns the demangled name of the function containing address, or nullptr if it can't be resolved. The name stays valid until Clear is called.
+	static const char* Resolve( const void* address );
+	static void Clear();
+};
+
+} //End namespace qul
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "quLoaderThreadState.h"
+#include "quLoaderEventStaging.h"
+#include <atomic>
+
+namespace qu
+{
+
+constinit thread_local quThreadState threadState = {
+	.eventRing = nullptr,
+	.channelID = QU_INVALID_ACTIVITY_CHANNEL_ID,
+	.generation = 0,
+};
+
+} //End namespace qu
+
+namespace qul
+{
+
+static std::atomic_ref< quUInt32 > Generation()
+{
+	return std::atomic_ref< quUInt32 >( qu::sharedState.threadStateGeneration );
+}
+//Makes every thread refresh its state the next time it reads it. Has to happen after the runtime forgot about the change, so a
+//thread that refreshes concurrently either sees the change or reads the generation before it was bumped.
+static void Invalidate()
+{
+	Generation().fetch_add( 1, std::memory_order_release );
+}
+
+void ThreadState::SetChannel( quActivityChannelID channelID )
+{
+	qu::threadState.generation = Generation().load( std::memory_order_acquire );
+	qu::threadState.eventRing = nullptr;
+	qu::threadState.channelID = channelID;
+}
+void ThreadState::RemoveChannel( quActivityChannelID channelID )
+{
+	if( qu::threadState.channelID == channelID )
+	{
+		qu::threadState.eventRing = nullptr;
+		qu::threadState.channelID = QU_INVALID_ACTIVITY_CHANNEL_ID;
+	}
+	//Channels are usually removed by the thread they belong to, but we cant rely on that.
+	Invalidate();
+}
+bool ThreadState::IsCurrent()
+{
+	return qu::threadState.generation == Generation().load( std::memory_order_acquire );
+}
+void ThreadState::Refresh( const quDispatchTable& dispatch )
+{
+	quUInt32 generation = Generation().load( std::memory_order_acquire );
+	qu::threadState.eventRing = nullptr;
+	qu::threadState.channelID = dispatch.GetChannelIDForCurrentThread();
+#if defined( QU_API_INLINE_EVENTS )
+	if( qu::threadState.channelID != QU_INVALID_ACTIVITY_CHANNEL_ID )
+		AttachEventRing( dispatch );
+#endif
+	qu::threadState.generation = generation;
+}
+void ThreadState::AttachEventRing( const quDispatchTable& dispatch )
+{
+	quEventRing* eventRing = dispatch.GetEventRingForCurrentThread();
+	if( eventRing == nullptr )
+		return;
+
+	//The ring replaces staging for this thread's channel. Keeping both would let the runtime receive the two out of order.
+	EventStaging::UnbindCurrentThreadChannel();
+	qu::threadState.eventRing = eventRing;
+}
+void ThreadState::DetachAll()
+{
+	qu::threadState.eventRing = nullptr;
+	qu::threadState.channelID = QU_INVALID_ACTIVITY_CHANNEL_ID;
+	Invalidate();
+}
+
+} //End namespace qul
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.hpp>
+
+namespace qul
+{
+
+/**
+ * Maintains the qu::threadState that the header utilities read instead of calling into the api. A thread only ever writes its
+ * own state. Changes that affect other threads, removing their channel or unloading the runtime, bump the shared generation
+ * instead, which has those threads refresh their state from the runtime the next time they read it.
+ */
+class ThreadState
+{
+public:
+	static void SetChannel( quActivityChannelID channelID );
+	//Called after the runtime removed the channel.
+	static void RemoveChannel( quActivityChannelID channelID );
+	static bool IsCurrent();
+	//Asks the runtime for the channel and ring of the current thread.
+	static void Refresh( const quDispatchTable& dispatch );
+	//Asks the runtime for the ring of the current thread, called after a channel was added for the current thread.
+	static void AttachEventRing( const quDispatchTable& dispatch );
+	//Called after the runtime was replaced by the stubs.
+	static void DetachAll();
+};
+
+} //End namespace qul
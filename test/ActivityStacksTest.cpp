@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivityStacksTest.h"
+#include "Test.h"
+#include <thread>
+
+//A producer starts activities that a consumer stops, after which the producer's own nested stops must only see what still runs.
+static void TestStopsOnOtherThreads()
+{
+	quActivityChannelID channelID = quAddActivityChannel( "Stops on other threads", 0 );
+	quRecurringActivityID recurringActivityID = quAddRecurringActivity( "Produced", 0 );
+	Test::TakeStartedActivities();
+	Test::TakeStoppedActivities();
+
+	for( int round = 0; round < 4; ++round )
+	{
+		std::vector< quActivityID > produced;
+		for( int i = 0; i < 16; ++i )
+			produced.push_back( quStartRecurringActivity( channelID, recurringActivityID ) );
+		std::thread consumer( [ & ] {
+			for( quActivityID activityID : produced )
+				quStopActivity( activityID );
+		} );
+		consumer.join();
+		QU_TEST_CHECK( Test::TakeStoppedActivities() == produced );
+
+		quActivityID current = quStartRecurringActivity( channelID, recurringActivityID );
+		QU_TEST_CHECK( quStopCurrentActivity( channelID ) );
+		QU_TEST_CHECK( Test::TakeStoppedActivities() == std::vector< quActivityID >{ current } );
+		QU_TEST_CHECK( !quStopCurrentActivity( channelID ) );
+		QU_TEST_CHECK( Test::TakeStoppedActivities().empty() );
+	}
+
+	quRemoveActivityChannel( channelID );
+}
+
+//The consumer's stops reach the producer while its outer activity still runs, which is the one to stop next.
+static void TestNestedStopsAroundOtherThreads()
+{
+	quActivityChannelID channelID = quAddActivityChannel( "Nested stops around other threads", 0 );
+	quRecurringActivityID recurringActivityID = quAddRecurringActivity( "Outer", 0 );
+	quActivityID outer = quStartRecurringActivity( channelID, recurringActivityID );
+	quActivityID inner = quStartRecurringActivity( channelID, recurringActivityID );
+	Test::TakeStoppedActivities();
+
+	std::thread( [ inner ] { quStopActivity( inner ); } ).join();
+	QU_TEST_CHECK( quStopCurrentActivity( channelID ) );
+	std::vector< quActivityID > stopped = Test::TakeStoppedActivities();
+	QU_TEST_CHECK( stopped == ( std::vector< quActivityID >{ inner, outer } ) );
+
+	quRemoveActivityChannel( channelID );
+}
+
+void RunActivityStacksTests()
+{
+	TestStopsOnOtherThreads();
+	TestNestedStopsAroundOtherThreads();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CounterPollingTest.h"
+#include "Test.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static constexpr quUInt32 PERIOD_MICROS = 1000;
+
+//Waits for condition to hold for at most a couple of seconds, the polling thread may take a while to be scheduled.
+template< typename Condition >
+static bool WaitFor( Condition condition )
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+	while( !condition() )
+	{
+		if( std::chrono::steady_clock::now() > deadline )
+			return false;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	return true;
+}
+
+struct ReplacedCounter
+{
+	std::atomic< quCounterID > counterID = QU_INVALID_COUNTER_ID; //!< Set once quAddPolledCounter returned, which may be after the first poll.
+	std::atomic< bool > replaced = false;
+	std::atomic< int > pollsAfterReplacing = 0;
+	std::atomic< quCounterID > replacementID = QU_INVALID_COUNTER_ID;
+	std::atomic< int > replacementPolls = 0;
+};
+
+static float QU_CALL_CONV PollReplacement( void* userData )
+{
+	++static_cast< ReplacedCounter* >( userData )->replacementPolls;
+	return 2.0f;
+}
+static float QU_CALL_CONV PollReplaced( void* userData )
+{
+	ReplacedCounter& counter = *static_cast< ReplacedCounter* >( userData );
+	quCounterID counterID = counter.counterID;
+	if( counter.replaced )
+		++counter.pollsAfterReplacing;
+	else if( counterID != QU_INVALID_COUNTER_ID )
+	{
+		quRemoveCounter( counterID );
+		counter.replaced = true;
+		counter.replacementID = quAddPolledCounter( "Replacement", 0, &PollReplacement, &counter, PERIOD_MICROS );
+	}
+	return 1.0f;
+}
+
+static void TestCallbacksReplacingTheirCounter()
+{
+	ReplacedCounter counter;
+	counter.counterID = quAddPolledCounter( "Replaced", 0, &PollReplaced, &counter, PERIOD_MICROS );
+	QU_TEST_CHECK( counter.counterID != QU_INVALID_COUNTER_ID );
+	QU_TEST_CHECK( WaitFor( [ & ] { return counter.replacementPolls >= 2; } ) );
+	QU_TEST_CHECK( counter.pollsAfterReplacing == 0 );
+
+	quRemoveCounter( counter.replacementID );
+	int replacementPolls = counter.replacementPolls;
+	std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+	QU_TEST_CHECK( counter.replacementPolls == replacementPolls );
+}
+
+struct SlowCounter
+{
+	std::atomic< bool > polling = false;
+	std::atomic< bool > returned = false;
+};
+
+static float QU_CALL_CONV PollSlowly( void* userData )
+{
+	SlowCounter& counter = *static_cast< SlowCounter* >( userData );
+	counter.returned = false;
+	counter.polling = true;
+	std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	counter.returned = true;
+	return 3.0f;
+}
+
+static void TestRemovalWaitingForCallback()
+{
+	SlowCounter counter;
+	quCounterID counterID = quAddPolledCounter( "Slow", 0, &PollSlowly, &counter, PERIOD_MICROS );
+	QU_TEST_CHECK( WaitFor( [ & ] { return counter.polling.load(); } ) );
+	quRemoveCounter( counterID );
+	QU_TEST_CHECK( counter.returned );
+}
+
+void RunCounterPollingTests()
+{
+	//Polled counters are only polled while recording.
+	quOutputID outputID = quSetupGoogleTraceOutput( "QuApiTests.json", true );
+	QU_TEST_CHECK( outputID != QU_INVALID_OUTPUT_ID );
+
+	TestCallbacksReplacingTheirCounter();
+	TestRemovalWaitingForCallback();
+
+	quRemoveOutput( outputID );
+}
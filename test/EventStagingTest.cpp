@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EventStagingTest.h"
+#include "Test.h"
+
+static quEvent MakeStart( quActivityID activityID, quActivityChannelID channelID, quRecurringActivityID recurringActivityID )
+{
+	quEvent event = {};
+	event.timestamp = quGetTimestamp();
+	event.activityID = activityID;
+	event.recurringActivityID = recurringActivityID;
+	event.channelID = channelID;
+	event.type = QU_EVENT_START_RECURRING_ACTIVITY;
+	return event;
+}
+static quEvent MakeStop( quActivityID activityID, quActivityChannelID channelID )
+{
+	quEvent event = {};
+	event.timestamp = quGetTimestamp();
+	event.activityID = activityID;
+	event.channelID = channelID;
+	event.type = QU_EVENT_STOP_ACTIVITY;
+	return event;
+}
+
+static void TestSubmittedCurrentStops()
+{
+	quActivityChannelID channelID = quAddActivityChannel( "Submitted current stops", 0 );
+	quRecurringActivityID recurringActivityID = quAddRecurringActivity( "Submitted", 0 );
+	quActivityID submittedID = quReserveActivityIDs( 2 );
+	Test::TakeStartedActivities();
+	Test::TakeStoppedActivities();
+
+	quEvent events[] = {
+		MakeStart( submittedID, channelID, recurringActivityID ),
+		MakeStart( submittedID + 1, channelID, recurringActivityID ),
+		MakeStop( QU_INVALID_ACTIVITY_ID, channelID ),
+		MakeStop( QU_INVALID_ACTIVITY_ID, channelID ),
+	};
+	QU_TEST_CHECK( quSubmitEvents( events, 4 ) );
+	std::vector< quActivityID > started = Test::TakeStartedActivities();
+	std::vector< quActivityID > stopped = Test::TakeStoppedActivities();
+	QU_TEST_CHECK( started.size() == 2 );
+	QU_TEST_CHECK( stopped.size() == 2 && started.size() == 2 && stopped[0] == started[1] && stopped[1] == started[0] );
+
+	//Nothing runs on the channel anymore, so there's nothing to stop either.
+	quEvent stop = MakeStop( QU_INVALID_ACTIVITY_ID, channelID );
+	QU_TEST_CHECK( !quSubmitEvents( &stop, 1 ) );
+	QU_TEST_CHECK( Test::TakeStoppedActivities().empty() );
+
+	quRemoveActivityChannel( channelID );
+}
+
+void RunEventStagingTests()
+{
+	TestSubmittedCurrentStops();
+}
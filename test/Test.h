@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TestRuntime.h"
+#include <iostream>
+#include <vector>
+
+/**
+ * Minimal checks shared by the tests. A check that fails reports where it is and fails the run, but the tests carry on so that
+ * every failure shows up at once.
+ */
+namespace Test
+{
+
+inline int failedChecks = 0;
+
+inline void Check( bool condition, const char* expression, const char* file, int line )
+{
+	if( condition )
+		return;
+
+	++failedChecks;
+	std::cout << file << "(" << line << "): check failed: " << expression << std::endl;
+}
+
+//Activities the test runtime started or stopped since these were last called, in the order it saw them.
+inline std::vector< quActivityID > TakeStartedActivities()
+{
+	std::vector< quActivityID > activityIDs( 64 );
+	activityIDs.resize( quTestTakeStartedActivities( activityIDs.data(), quUInt32( activityIDs.size() ) ) );
+	return activityIDs;
+}
+inline std::vector< quActivityID > TakeStoppedActivities()
+{
+	std::vector< quActivityID > activityIDs( 64 );
+	activityIDs.resize( quTestTakeStoppedActivities( activityIDs.data(), quUInt32( activityIDs.size() ) ) );
+	return activityIDs;
+}
+
+} //End namespace Test
+
+#define QU_TEST_CHECK( condition ) Test::Check( ( condition ), #condition, __FILE__, __LINE__ )
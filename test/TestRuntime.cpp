@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestRuntime.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+static std::atomic< quActivityID > nextActivityID = 1;
+static std::atomic< quActivityChannelID > nextChannelID = 1;
+static std::atomic< quRecurringActivityID > nextRecurringActivityID = 0;
+static std::atomic< quCounterID > nextCounterID = 0;
+static std::atomic< quOutputID > nextOutputID = 0;
+static std::mutex activitiesMutex; //!< Guards the activities below.
+static std::vector< quActivityID > startedActivities;
+static std::vector< quActivityID > stoppedActivities;
+
+static quUInt32 TakeActivities( std::vector< quActivityID >& activities, quActivityID* activityIDs, quUInt32 capacity )
+{
+	std::lock_guard lock( activitiesMutex );
+	quUInt32 count = quUInt32( activities.size() );
+	std::copy_n( activities.begin(), std::min( count, capacity ), activityIDs );
+	activities.clear();
+	return count;
+}
+
+static quUInt64 QU_CALL_CONV Initialize( quUInt32, quLogHook_Ptr )
+{
+	return 1;
+}
+static void QU_CALL_CONV Release()
+{
+}
+static quOutputID QU_CALL_CONV SetupGoogleTraceOutput( const char*, bool )
+{
+	return nextOutputID++;
+}
+static bool QU_CALL_CONV RemoveOutput( quOutputID )
+{
+	return true;
+}
+static quCounterID QU_CALL_CONV AddCounter( const char*, quUInt32 )
+{
+	return nextCounterID++;
+}
+static bool QU_CALL_CONV SetCounterValue( quCounterID, float )
+{
+	return true;
+}
+static bool QU_CALL_CONV RemoveCounter( quCounterID )
+{
+	return true;
+}
+static quActivityChannelID QU_CALL_CONV AddActivityChannel( const char*, quUInt32 )
+{
+	return nextChannelID++;
+}
+static bool QU_CALL_CONV RemoveActivityChannel( quActivityChannelID )
+{
+	return true;
+}
+static quRecurringActivityID QU_CALL_CONV AddRecurringActivity( const char*, quUInt32 )
+{
+	return nextRecurringActivityID++;
+}
+static quActivityID QU_CALL_CONV StartRecurringActivity( quActivityChannelID, quRecurringActivityID )
+{
+	quActivityID activityID = nextActivityID++;
+	std::lock_guard lock( activitiesMutex );
+	startedActivities.push_back( activityID );
+	return activityID;
+}
+static bool QU_CALL_CONV StopActivity( quActivityID activityID )
+{
+	std::lock_guard lock( activitiesMutex );
+	stoppedActivities.push_back( activityID );
+	return true;
+}
+
+static const quDispatchTable DISPATCH_TABLE = [] {
+	quDispatchTable table = {};
+	table.version = QU_DISPATCH_TABLE_VERSION;
+	table.size = sizeof( table );
+	table.Initialize = &Initialize;
+	table.Release = &Release;
+	table.SetupGoogleTraceOutput = &SetupGoogleTraceOutput;
+	table.RemoveOutput = &RemoveOutput;
+	table.AddCounter = &AddCounter;
+	table.SetCounterValue = &SetCounterValue;
+	table.RemoveCounter = &RemoveCounter;
+	table.AddActivityChannel = &AddActivityChannel;
+	table.RemoveActivityChannel = &RemoveActivityChannel;
+	table.AddRecurringActivity = &AddRecurringActivity;
+	table.StartRecurringActivity = &StartRecurringActivity;
+	table.StopActivity = &StopActivity;
+	return table;
+}();
+
+const quDispatchTable* quGetDispatchTable( quUInt32 )
+{
+	return &DISPATCH_TABLE;
+}
+
+quUInt32 quTestTakeStartedActivities( quActivityID* activityIDs, quUInt32 capacity )
+{
+	return TakeActivities( startedActivities, activityIDs, capacity );
+}
+quUInt32 quTestTakeStoppedActivities( quActivityID* activityIDs, quUInt32 capacity )
+{
+	return TakeActivities( stoppedActivities, activityIDs, capacity );
+}
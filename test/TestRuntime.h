@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quApi.h>
+
+#if defined( _WIN64 )
+#	if defined( QU_TEST_RUNTIME_EXPORTS )
+#		define QU_TEST_RUNTIME_API extern "C" __declspec( dllexport )
+#	else
+#		define QU_TEST_RUNTIME_API extern "C" __declspec( dllimport )
+#	endif
+#else
+#	define QU_TEST_RUNTIME_API extern "C" __attribute__( ( visibility( "default" ) ) )
+#endif
+
+/**
+ * Runtime the tests load in place of QuApi. It only provides what runtimes did before the dispatch table grew batches of events
+ * and nested stops, so everything the loader emulates for older runtimes is exercised. Activities are handed out ids counting up
+ * from 1 and every start and stop is remembered. The tests link to the runtime as well, which makes the loader load the very same
+ * library and lets the tests look at what reached it.
+ */
+QU_TEST_RUNTIME_API const quDispatchTable* quGetDispatchTable( quUInt32 headerVersion );
+
+//Copies the activities that were started or stopped since the last call into activityIDs, in the order the runtime saw them.
+//Returns the number of activities, which may be more than capacity.
+QU_TEST_RUNTIME_API quUInt32 quTestTakeStartedActivities( quActivityID* activityIDs, quUInt32 capacity );
+QU_TEST_RUNTIME_API quUInt32 quTestTakeStoppedActivities( quActivityID* activityIDs, quUInt32 capacity );
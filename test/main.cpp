@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ActivityStacksTest.h"
+#include "CounterPollingTest.h"
+#include "EventStagingTest.h"
+#include "Test.h"
+
+/**
+ * Checks what the loader does on behalf of runtimes, against the test runtime built along with the tests. The runtime is found
+ * through the QU_API_RELEASE_DLL and QU_API_DEBUG_DLL environment variables, which ctest sets. Returns non-zero if any check
+ * failed.
+ */
+int main()
+{
+	if( quInitialize( QU_VERSION, nullptr ) == 0 )
+	{
+		std::cout << "Failed to load the test runtime, is QU_API_RELEASE_DLL or QU_API_DEBUG_DLL set to it?" << std::endl;
+		return 1;
+	}
+
+	RunEventStagingTests();
+	RunActivityStacksTests();
+	RunCounterPollingTests();
+
+	quRelease();
+	std::cout << ( Test::failedChecks == 0 ? "All checks passed." : "Some checks failed." ) << std::endl;
+	return Test::failedChecks == 0 ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <BinaryTraceReader.h>
+#include <TraceAssembler.h>
+#include <TraceJsonWriter.h>
+#include <TracePerfettoWriter.h>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Passes on the activities and markers of the selected channels only, along with everything that isn't tied to a channel.
+class ChannelFilter : public qut::TraceEventSink
+{
+public:
+	ChannelFilter( qut::TraceEventSink& sink, const std::vector< quActivityChannelID >& channels ) :
+	    sink( sink ),
+	    channels( channels )
+	{
+	}
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override
+	{
+		if( IsSelected( channelID ) )
+			sink.NameChannel( channelID, name );
+	}
+	void NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name ) override
+	{
+		sink.NameRecurringActivity( recurringActivityID, name );
+	}
+	void NameActivity( quActivityID activityID, std::string_view name ) override
+	{
+		sink.NameActivity( activityID, name );
+	}
+	void NameCounter( quCounterID counterID, std::string_view name ) override
+	{
+		sink.NameCounter( counterID, name );
+	}
+	void NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name ) override
+	{
+		sink.NameAnnotationKey( annotationKeyID, name );
+	}
+
+	//Stops and annotations of activities that never started are ignored by every sink, so only starts have to be filtered.
+	void AddEvent( const quEvent& event ) override
+	{
+		bool channelEvent = event.type == QU_EVENT_START_RECURRING_ACTIVITY || ( event.type == QU_EVENT_STOP_ACTIVITY && event.activityID == QU_INVALID_ACTIVITY_ID );
+		if( !channelEvent || IsSelected( event.channelID ) )
+			sink.AddEvent( event );
+	}
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override
+	{
+		if( IsSelected( channelID ) )
+			sink.AddMarker( channelID, name, timestamp );
+	}
+
+private:
+	bool IsSelected( quActivityChannelID channelID ) const
+	{
+		return channels.empty() || std::find( channels.begin(), channels.end(), channelID ) != channels.end();
+	}
+
+	qut::TraceEventSink& sink;
+	const std::vector< quActivityChannelID >& channels;
+};
+
+//Returns false for anything but a whole unsigned number that fits.
+static bool ParseNumber( const char* text, quUInt64& value )
+{
+	if( *text < '0' || *text > '9' )
+		return false;
+
+	try
+	{
+		size_t length;
+		value = std::stoull( text, &length );
+		return text[ length ] == '\0';
+	}
+	catch( const std::logic_error& )
+	{
+		return false;
+	}
+}
+
+/**
+ * Turns a file written by quSetupBinaryTraceOutput into a Google trace, or into a Perfetto trace if the output file ends in
+ * .pftrace. Only the chunks the index lists for the selected time
+ * range and channels are read, so a slice of a long trace converts about as fast as a short trace would. Chunks are converted
+ * whole, the range selects chunks rather than cutting activities.
+ */
+int main( int argc, const char* argv[] )
+{
+	const char* inputFile = nullptr;
+	std::string outputFile;
+	quUInt64 fromMicros = 0;
+	quUInt64 toMicros = ~quUInt64( 0 );
+	std::vector< quActivityChannelID > channels;
+	bool validArguments = true;
+	for( int i = 1; i < argc && validArguments; ++i )
+	{
+		bool hasValue = i + 1 < argc;
+		if( strcmp( argv[ i ], "--from" ) == 0 && hasValue )
+			validArguments = ParseNumber( argv[ ++i ], fromMicros );
+		else if( strcmp( argv[ i ], "--to" ) == 0 && hasValue )
+			validArguments = ParseNumber( argv[ ++i ], toMicros );
+		else if( strcmp( argv[ i ], "--channel" ) == 0 && hasValue )
+		{
+			quUInt64 channelID = 0;
+			validArguments = ParseNumber( argv[ ++i ], channelID ) && channelID == quActivityChannelID( channelID );
+			channels.push_back( quActivityChannelID( channelID ) );
+		}
+		else if( argv[ i ][ 0 ] == '-' )
+			validArguments = false;
+		else if( inputFile == nullptr )
+			inputFile = argv[ i ];
+		else if( outputFile.empty() )
+			outputFile = argv[ i ];
+		else
+			validArguments = false;
+	}
+	if( !validArguments || inputFile == nullptr )
+	{
+		std::cerr << "Usage: QuTraceConvert <binary trace file> [output file, defaults to the binary trace file with .json appended, a .pftrace file gets the Perfetto format] [--from <microseconds>] [--to <microseconds>] [--channel <channel id>]..." << std::endl;
+		std::cerr << "Times are relative to the start of the trace, every --channel adds a channel to convert, all are converted without any." << std::endl;
+		return 1;
+	}
+	if( outputFile.empty() )
+		outputFile = std::string( inputFile ) + ".json";
+
+	qut::BinaryTraceReader reader;
+	if( !reader.Open( inputFile ) )
+	{
+		std::cerr << inputFile << " is not a binary trace of version " << QU_BINARY_TRACE_VERSION << "." << std::endl;
+		return 1;
+	}
+	if( !reader.HasIndex() )
+		std::cout << inputFile << " has no index, it was probably never closed. Its chunks are converted up to the first damaged one." << std::endl;
+
+	FILE* file = fopen( outputFile.c_str(), "wb" );
+	if( file == nullptr )
+	{
+		std::cerr << "Failed to create " << outputFile << "." << std::endl;
+		return 1;
+	}
+
+	quUInt64 startTimestamp = reader.GetChunkCount() != 0 ? reader.GetChunk( 0 ).firstTimestamp : 0;
+	quUInt64 from = startTimestamp + std::min( fromMicros, ~quUInt64( 0 ) / 1000 ) * 1000;
+	quUInt64 to = startTimestamp + std::min( toMicros, ( ~quUInt64( 0 ) - startTimestamp ) / 1000 ) * 1000;
+	std::unique_ptr< qut::TraceJsonWriter > writer;
+	std::unique_ptr< qut::TraceAssembler > assembler;
+	std::unique_ptr< qut::TracePerfettoWriter > perfettoWriter;
+	qut::TraceEventSink* sink;
+	if( outputFile.ends_with( ".pftrace" ) )
+	{
+		perfettoWriter = std::make_unique< qut::TracePerfettoWriter >( file );
+		sink = perfettoWriter.get();
+	}
+	else
+	{
+		writer = std::make_unique< qut::TraceJsonWriter >( file, startTimestamp );
+		assembler = std::make_unique< qut::TraceAssembler >( *writer );
+		sink = assembler.get();
+	}
+	ChannelFilter filter( *sink, channels );
+	size_t convertedCount = 0;
+	bool damaged = false;
+	for( size_t chunk = 0; chunk < reader.GetChunkCount() && !damaged; ++chunk )
+	{
+		const quBinaryTraceIndexEntry& entry = reader.GetChunk( chunk );
+		if( entry.lastTimestamp < from || entry.firstTimestamp > to )
+			continue;
+		bool selected = channels.empty() || std::any_of( channels.begin(), channels.end(), [ & ]( quActivityChannelID channelID ) { return reader.HasChannel( chunk, channelID ); } );
+		if( !selected )
+			continue;
+
+		damaged = !reader.DecodeChunk( chunk, filter );
+		++convertedCount;
+	}
+	quUInt64 unfinishedCount;
+	bool written;
+	if( assembler )
+	{
+		unfinishedCount = assembler->Finish();
+		written = writer->Finish();
+	}
+	else
+	{
+		written = perfettoWriter->Finish();
+		unfinishedCount = perfettoWriter->GetUnfinishedCount();
+	}
+	written &= fclose( file ) == 0;
+	if( !written )
+	{
+		std::cerr << "Failed to write " << outputFile << "." << std::endl;
+		return 1;
+	}
+
+	std::cout << "Converted " << convertedCount << " of " << reader.GetChunkCount() << " chunks." << std::endl;
+	if( damaged )
+		std::cout << "The last of them was damaged, it was converted up to the damage." << std::endl;
+	if( unfinishedCount != 0 )
+		std::cout << unfinishedCount << " activities didn't stop within the converted chunks, they end at their last event." << std::endl;
+	std::cout << "Wrote " << outputFile << "." << std::endl;
+	return 0;
+}
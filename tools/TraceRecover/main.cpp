@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <BinaryTraceEncoder.h>
+#include <BinaryTraceReader.h>
+#include <TraceAssembler.h>
+#include <TraceJsonWriter.h>
+#include <TracePerfettoWriter.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#if defined( _WIN64 )
+#	include <Windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+/**
+ * Maps a file read-only, so that traces much larger than memory can be recovered and their events are read where they are rather
+ * than copied. Pages the kernel kept of a process that died are as good as written ones, the file is never modified.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+	~MappedFile()
+	{
+		if( data == nullptr )
+			return;
+#if defined( _WIN64 )
+		UnmapViewOfFile( data );
+#else
+		munmap( (void*)data, size );
+#endif
+	}
+
+	//Empty files open fine but have no contents.
+	bool Open( const char* fileName )
+	{
+#if defined( _WIN64 )
+		HANDLE file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+
+		LARGE_INTEGER fileSize;
+		bool opened = GetFileSizeEx( file, &fileSize ) != 0;
+		if( opened && fileSize.QuadPart != 0 )
+		{
+			//The view keeps the mapping alive once its handle is closed.
+			HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			opened = mapping != nullptr;
+			if( opened )
+			{
+				data = (const char*)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+				CloseHandle( mapping );
+				opened = data != nullptr;
+				size = opened ? size_t( fileSize.QuadPart ) : 0;
+			}
+		}
+		CloseHandle( file );
+		return opened;
+#else
+		int file = open( fileName, O_RDONLY | O_CLOEXEC );
+		if( file < 0 )
+			return false;
+
+		struct stat fileStat;
+		bool opened = fstat( file, &fileStat ) == 0;
+		if( opened && fileStat.st_size != 0 )
+		{
+			void* mapping = mmap( nullptr, size_t( fileStat.st_size ), PROT_READ, MAP_PRIVATE, file, 0 );
+			opened = mapping != MAP_FAILED;
+			if( opened )
+			{
+				data = (const char*)mapping;
+				size = size_t( fileStat.st_size );
+			}
+		}
+		close( file );
+		return opened;
+#endif
+	}
+
+	std::string_view GetContents() const
+	{
+		return std::string_view( data, size );
+	}
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+//A buffer of the mapped trace along with where its events are in the file.
+struct MappedBuffer
+{
+	quMappedTraceBuffer header;
+	size_t eventsOffset;
+	size_t eventCount;
+};
+
+//An event of any thread, annotations are sorted along with the event that precedes them. Events are read from the mapped file.
+struct RecoveredEvent
+{
+	quUInt64 timestamp;
+	const quEvent* event;
+};
+
+//Markers are stored with the names, they're merged with the events once those are sorted.
+struct RecoveredMarker
+{
+	quUInt64 timestamp;
+	quActivityChannelID channelID;
+	std::string_view name;
+};
+
+/**
+ * Keeps what the binary trace format holds of every event and marker, so that the events a binary trace was encoded from can be
+ * compared with those decoded from it. Counter values are kept as the float the format gives back. Decoded chunks start by
+ * repeating the running activities along with their annotations, which are left out when told a chunk begins.
+ */
+class EventRecorder : public qut::TraceEventSink
+{
+public:
+	//Fields that identify an event: type, timestamp, channel or counter, activity, and recurring activity or value.
+	using Record = std::tuple< quUInt8, quUInt64, quUInt64, quUInt64, quUInt64, quUInt8 >;
+
+	void NameChannel( quActivityChannelID, std::string_view ) override
+	{
+	}
+	void NameRecurringActivity( quRecurringActivityID, std::string_view ) override
+	{
+	}
+	void NameActivity( quActivityID, std::string_view ) override
+	{
+	}
+	void NameCounter( quCounterID, std::string_view ) override
+	{
+	}
+	void NameAnnotationKey( quAnnotationKeyID, std::string_view ) override
+	{
+	}
+
+	void AddEvent( const quEvent& event ) override
+	{
+		bool start = event.type == QU_EVENT_START_RECURRING_ACTIVITY;
+		if( repeating && ( ( start && runningActivities.contains( event.activityID ) ) || ( event.type == QU_EVENT_ANNOTATE_ACTIVITY && event.activityID == repeatedActivityID ) ) )
+		{
+			repeatedActivityID = event.activityID;
+			return;
+		}
+		repeating = false;
+
+		switch( event.type )
+		{
+		case QU_EVENT_START_RECURRING_ACTIVITY:
+			runningActivities[ event.activityID ] = event.channelID;
+			channelStacks[ event.channelID ].push_back( event.activityID );
+			records.emplace_back( event.type, event.timestamp, event.channelID, event.activityID, event.recurringActivityID, 0 );
+			break;
+		case QU_EVENT_STOP_ACTIVITY:
+		{
+			bool current = event.activityID == QU_INVALID_ACTIVITY_ID;
+			quActivityID activityID = event.activityID;
+			if( current && !channelStacks[ event.channelID ].empty() )
+				activityID = channelStacks[ event.channelID ].back();
+			if( auto activity = runningActivities.find( activityID ); activity != runningActivities.end() )
+			{
+				std::erase( channelStacks[ activity->second ], activityID );
+				runningActivities.erase( activity );
+			}
+			records.emplace_back( event.type, event.timestamp, current ? event.channelID : 0, event.activityID, 0, 0 );
+			break;
+		}
+		case QU_EVENT_SET_COUNTER_VALUE:
+		case QU_EVENT_SET_TYPED_COUNTER_VALUE:
+		{
+			float value = float( qut::GetCounterValue( event ) );
+			quUInt32 bits;
+			memcpy( &bits, &value, sizeof( bits ) );
+			records.emplace_back( QU_EVENT_SET_COUNTER_VALUE, event.timestamp, event.counterID, 0, bits, 0 );
+			break;
+		}
+		case QU_EVENT_ANNOTATE_ACTIVITY:
+			records.emplace_back( event.type, 0, event.annotationKeyID, event.activityID, event.annotationValue, event.annotationType );
+			break;
+		default:
+			break;
+		}
+	}
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override
+	{
+		repeating = false;
+		markers.emplace_back( timestamp, channelID, std::string( name ) );
+	}
+
+	void BeginChunk()
+	{
+		repeating = true;
+		repeatedActivityID = QU_INVALID_ACTIVITY_ID;
+	}
+
+	std::vector< Record > records;
+	std::vector< std::tuple< quUInt64, quActivityChannelID, std::string > > markers;
+
+private:
+	bool repeating = false;
+	quActivityID repeatedActivityID = QU_INVALID_ACTIVITY_ID;
+	std::unordered_map< quActivityID, quActivityChannelID > runningActivities;
+	std::unordered_map< quActivityChannelID, std::vector< quActivityID > > channelStacks;
+};
+
+//Decodes the binary trace that was just written and compares it with the events it was encoded from.
+static bool VerifyBinaryTrace( const std::string& fileName, const EventRecorder& encoded )
+{
+	qut::BinaryTraceReader reader;
+	if( !reader.Open( fileName.c_str() ) || !reader.HasIndex() )
+	{
+		std::cerr << "Failed to read back " << fileName << "." << std::endl;
+		return false;
+	}
+
+	EventRecorder decoded;
+	for( size_t chunk = 0; chunk < reader.GetChunkCount(); ++chunk )
+	{
+		decoded.BeginChunk();
+		if( !reader.DecodeChunk( chunk, decoded ) )
+		{
+			std::cerr << "Chunk " << chunk << " of " << fileName << " is damaged." << std::endl;
+			return false;
+		}
+	}
+
+	auto mismatch = std::mismatch( encoded.records.begin(), encoded.records.end(), decoded.records.begin(), decoded.records.end() );
+	if( mismatch.first != encoded.records.end() || mismatch.second != decoded.records.end() )
+	{
+		std::cerr << fileName << " differs from the recovered events from event " << ( mismatch.first - encoded.records.begin() ) << " on." << std::endl;
+		return false;
+	}
+	if( encoded.markers != decoded.markers )
+	{
+		std::cerr << "The markers of " << fileName << " differ from the recovered ones." << std::endl;
+		return false;
+	}
+	std::cout << "Verified " << decoded.records.size() << " events and " << decoded.markers.size() << " markers of " << fileName << "." << std::endl;
+	return true;
+}
+
+//Only names whose record was complete when its cursor was stored are read, a record that doesn't fit ends the region.
+static void RecoverNames( std::string_view contents, size_t namesOffset, quUInt64 nameBytes, quUInt64 nameCursor, qut::TraceEventSink& sink, std::vector< RecoveredMarker >& markers )
+{
+	size_t end = namesOffset + size_t( std::min( { nameCursor, nameBytes, quUInt64( contents.size() - std::min( contents.size(), namesOffset ) ) } ) );
+	for( size_t offset = namesOffset; offset + sizeof( quMappedTraceName ) <= end; )
+	{
+		quMappedTraceName record;
+		memcpy( &record, &contents[ offset ], sizeof( record ) );
+		size_t nameOffset = offset + sizeof( record );
+		if( record.length > end - nameOffset )
+			break;
+
+		std::string_view name( &contents[ nameOffset ], record.length );
+		switch( record.kind )
+		{
+		case QU_MAPPED_TRACE_NAME_CHANNEL:
+			sink.NameChannel( quActivityChannelID( record.id ), name );
+			break;
+		case QU_MAPPED_TRACE_NAME_RECURRING_ACTIVITY:
+			sink.NameRecurringActivity( quRecurringActivityID( record.id ), name );
+			break;
+		case QU_MAPPED_TRACE_NAME_ACTIVITY:
+			sink.NameActivity( record.id, name );
+			break;
+		case QU_MAPPED_TRACE_NAME_COUNTER:
+			sink.NameCounter( quCounterID( record.id ), name );
+			break;
+		case QU_MAPPED_TRACE_NAME_ANNOTATION_KEY:
+			sink.NameAnnotationKey( quAnnotationKeyID( record.id ), name );
+			break;
+		case QU_MAPPED_TRACE_NAME_MARKER:
+			markers.push_back( { record.timestamp, quActivityChannelID( record.id ), name } );
+			break;
+		default:
+			break;
+		}
+		offset = nameOffset + ( ( size_t( record.length ) + 7 ) & ~size_t( 7 ) );
+	}
+}
+
+/**
+ * Turns a file written by quSetupMappedTraceOutput into a Google trace, whether or not the process that wrote it exited cleanly.
+ * Everything the cursors in the file cover is recovered, activities that never stopped end at the last event of the file. Output
+ * files ending in .qubt are written in the binary trace format instead, which QuTraceConvert turns into a Google trace, and
+ * those ending in .pftrace in the protobuf format of Perfetto. With --verify, binary traces are read back once written and
+ * compared with the events they were encoded from.
+ */
+int main( int argc, const char* argv[] )
+{
+	bool verify = argc > 1 && strcmp( argv[ argc - 1 ], "--verify" ) == 0;
+	if( verify )
+		--argc;
+	if( argc < 2 )
+	{
+		std::cerr << "Usage: QuTraceRecover <mapped trace file> [output file, defaults to the mapped trace file with .json appended, a .qubt file gets the binary trace format and a .pftrace file the Perfetto format] [--verify]" << std::endl;
+		return 1;
+	}
+
+	MappedFile mappedFile;
+	if( !mappedFile.Open( argv[1] ) )
+	{
+		std::cerr << "Failed to read " << argv[1] << "." << std::endl;
+		return 1;
+	}
+	std::string_view contents = mappedFile.GetContents();
+
+	quMappedTraceHeader header;
+	if( contents.size() < sizeof( header ) )
+	{
+		std::cerr << argv[1] << " is too small to be a mapped trace." << std::endl;
+		return 1;
+	}
+	memcpy( &header, contents.data(), sizeof( header ) );
+	//Events are read in place, which takes the name region to keep them aligned as the runtime does.
+	if( header.magic != QU_MAPPED_TRACE_MAGIC || header.version != QU_MAPPED_TRACE_VERSION || header.bufferBytes % sizeof( quEvent ) != 0 || header.nameBytes % alignof( quEvent ) != 0 )
+	{
+		std::cerr << argv[1] << " is not a mapped trace of version " << QU_MAPPED_TRACE_VERSION << "." << std::endl;
+		return 1;
+	}
+
+	//Files of processes that died may have been cut short anywhere, nothing beyond their end is read.
+	size_t buffersOffset = sizeof( header );
+	size_t namesOffset = buffersOffset + size_t( header.bufferCount ) * sizeof( quMappedTraceBuffer );
+	size_t eventsOffset = namesOffset + size_t( header.nameBytes );
+	std::vector< MappedBuffer > buffers;
+	for( quUInt32 i = 0; i < std::min( header.usedBuffers, header.bufferCount ); ++i )
+	{
+		size_t bufferOffset = buffersOffset + i * sizeof( quMappedTraceBuffer );
+		if( bufferOffset + sizeof( quMappedTraceBuffer ) > contents.size() )
+			break;
+
+		MappedBuffer buffer;
+		memcpy( &buffer.header, &contents[ bufferOffset ], sizeof( buffer.header ) );
+		buffer.eventsOffset = eventsOffset + i * size_t( header.bufferBytes );
+		quUInt64 available = buffer.eventsOffset < contents.size() ? contents.size() - buffer.eventsOffset : 0;
+		buffer.eventCount = size_t( std::min( { buffer.header.writeCursor, header.bufferBytes, available } ) / sizeof( quEvent ) );
+		buffers.push_back( buffer );
+	}
+	std::sort( buffers.begin(), buffers.end(), []( const MappedBuffer& a, const MappedBuffer& b ) { return a.header.threadID != b.header.threadID ? a.header.threadID < b.header.threadID : a.header.sequence < b.header.sequence; } );
+
+	//Threads are merged by timestamp, the buffers of a thread are already in order.
+	size_t eventCount = 0;
+	for( const MappedBuffer& buffer : buffers )
+		eventCount += buffer.eventCount;
+	std::vector< RecoveredEvent > order;
+	order.reserve( eventCount );
+	quUInt64 timestamp = 0;
+	for( size_t i = 0; i < buffers.size(); ++i )
+	{
+		if( i != 0 && buffers[ i ].header.threadID != buffers[ i - 1 ].header.threadID )
+			timestamp = 0;
+		const quEvent* events = reinterpret_cast< const quEvent* >( contents.data() + buffers[ i ].eventsOffset );
+		for( const quEvent* event = events; event != events + buffers[ i ].eventCount; ++event )
+		{
+			if( event->type != QU_EVENT_ANNOTATE_ACTIVITY )
+				timestamp = event->timestamp;
+			order.push_back( { timestamp, event } );
+		}
+	}
+	std::stable_sort( order.begin(), order.end(), []( const RecoveredEvent& a, const RecoveredEvent& b ) { return a.timestamp < b.timestamp; } );
+
+	std::string outputFile = argc > 2 ? argv[2] : std::string( argv[1] ) + ".json";
+	FILE* file = fopen( outputFile.c_str(), "wb" );
+	if( file == nullptr )
+	{
+		std::cerr << "Failed to create " << outputFile << "." << std::endl;
+		return 1;
+	}
+
+	std::vector< RecoveredMarker > markers;
+	std::unique_ptr< qut::TraceJsonWriter > writer;
+	std::unique_ptr< qut::TraceAssembler > assembler;
+	std::unique_ptr< qut::BinaryTraceEncoder > encoder;
+	std::unique_ptr< qut::TracePerfettoWriter > perfettoWriter;
+	qut::TraceEventSink* sink;
+	if( outputFile.ends_with( ".qubt" ) )
+	{
+		encoder = std::make_unique< qut::BinaryTraceEncoder >( file );
+		sink = encoder.get();
+	}
+	else if( outputFile.ends_with( ".pftrace" ) )
+	{
+		perfettoWriter = std::make_unique< qut::TracePerfettoWriter >( file );
+		sink = perfettoWriter.get();
+	}
+	else
+	{
+		writer = std::make_unique< qut::TraceJsonWriter >( file, header.startTimestamp );
+		assembler = std::make_unique< qut::TraceAssembler >( *writer );
+		sink = assembler.get();
+	}
+	RecoverNames( contents, namesOffset, header.nameBytes, header.nameCursor, *sink, markers );
+	std::stable_sort( markers.begin(), markers.end(), []( const RecoveredMarker& a, const RecoveredMarker& b ) { return a.timestamp < b.timestamp; } );
+	auto addEvents = [ & ]( qut::TraceEventSink& target )
+	{
+		auto marker = markers.begin();
+		for( const RecoveredEvent& recovered : order )
+		{
+			for( ; marker != markers.end() && marker->timestamp <= recovered.timestamp; ++marker )
+				target.AddMarker( marker->channelID, marker->name, marker->timestamp );
+			target.AddEvent( *recovered.event );
+		}
+		for( ; marker != markers.end(); ++marker )
+			target.AddMarker( marker->channelID, marker->name, marker->timestamp );
+	};
+	addEvents( *sink );
+
+	//The binary format keeps activities that never stopped as they are, they're only ended once it's converted.
+	quUInt64 unfinishedCount = 0;
+	bool written;
+	if( assembler )
+	{
+		unfinishedCount = assembler->Finish();
+		written = writer->Finish();
+	}
+	else if( perfettoWriter )
+	{
+		written = perfettoWriter->Finish();
+		unfinishedCount = perfettoWriter->GetUnfinishedCount();
+	}
+	else
+		written = encoder->Finish();
+	written &= fclose( file ) == 0;
+	if( !written )
+	{
+		std::cerr << "Failed to write " << outputFile << "." << std::endl;
+		return 1;
+	}
+
+	std::cout << "Recovered " << eventCount << " events from " << buffers.size() << " buffers of a trace that " << ( header.closed != 0 ? "was closed properly" : "was never closed" ) << "." << std::endl;
+	if( unfinishedCount != 0 )
+		std::cout << unfinishedCount << " activities never stopped, they end at the last event." << std::endl;
+	std::cout << "Wrote " << outputFile << "." << std::endl;
+
+	if( verify && encoder )
+	{
+		EventRecorder encoded;
+		addEvents( encoded );
+		if( !VerifyBinaryTrace( outputFile, encoded ) )
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BinaryTraceEncoder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace qut
+{
+
+static quUInt64 ZigZag( quInt64 value )
+{
+	return ( quUInt64( value ) << 1 ) ^ quUInt64( value >> 63 );
+}
+static void AppendVarint( std::string& bytes, quUInt64 value )
+{
+	while( value >= 0x80 )
+	{
+		bytes += char( value | 0x80 );
+		value >>= 7;
+	}
+	bytes += char( value );
+}
+
+BinaryTraceEncoder::BinaryTraceEncoder( FILE* file, quUInt32 chunkBytes ) :
+    file( file ),
+    chunkBytes( chunkBytes )
+{
+	records.reserve( chunkBytes + 4096 );
+	quBinaryTraceHeader header = { QU_BINARY_TRACE_MAGIC, QU_BINARY_TRACE_VERSION, 0 };
+	Write( &header, sizeof( header ) );
+}
+
+void BinaryTraceEncoder::NameChannel( quActivityChannelID channelID, std::string_view name )
+{
+	channelNames[ channelID ] = name;
+}
+void BinaryTraceEncoder::NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name )
+{
+	recurringActivityNames[ recurringActivityID ] = name;
+}
+void BinaryTraceEncoder::NameActivity( quActivityID activityID, std::string_view name )
+{
+	activityNames[ activityID ] = name;
+}
+void BinaryTraceEncoder::NameCounter( quCounterID counterID, std::string_view name )
+{
+	counterNames[ counterID ] = name;
+}
+void BinaryTraceEncoder::NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name )
+{
+	annotationKeyNames[ annotationKeyID ] = name;
+}
+
+void BinaryTraceEncoder::AddEvent( const quEvent& event )
+{
+	//Traces decoded from chunks repeat the running activities and their annotations, which are already part of this one.
+	if( event.type == QU_EVENT_ANNOTATE_ACTIVITY && event.activityID == repeatedActivityID )
+		return;
+	repeatedActivityID = QU_INVALID_ACTIVITY_ID;
+	if( event.type == QU_EVENT_START_RECURRING_ACTIVITY && runningActivities.contains( event.activityID ) )
+	{
+		repeatedActivityID = event.activityID;
+		return;
+	}
+
+	//Annotations carry their value where other events have their timestamp.
+	bool timed = event.type != QU_EVENT_ANNOTATE_ACTIVITY;
+	if( !chunkStarted )
+		BeginChunk( timed ? event.timestamp : lastTimestamp );
+	if( timed )
+	{
+		firstTimestamp = std::min( firstTimestamp, event.timestamp );
+		lastTimestamp = std::max( lastTimestamp, event.timestamp );
+	}
+
+	switch( event.type )
+	{
+	case QU_EVENT_START_RECURRING_ACTIVITY:
+	{
+		RunningActivity activity = { nextOrder++, event.channelID, event.recurringActivityID, event.timestamp, {}, {} };
+		if( activity.recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID )
+		{
+			if( auto name = activityNames.find( event.activityID ); name != activityNames.end() )
+			{
+				activity.name = std::move( name->second );
+				activityNames.erase( name );
+			}
+		}
+		WriteStart( event.activityID, activity );
+		channelStacks[ activity.channelID ].push_back( event.activityID );
+		runningActivities[ event.activityID ] = std::move( activity );
+		break;
+	}
+	case QU_EVENT_STOP_ACTIVITY:
+	{
+		quActivityID activityID = event.activityID;
+		if( activityID == QU_INVALID_ACTIVITY_ID )
+		{
+			UseChannel( event.channelID );
+			records += char( QU_BINARY_RECORD_STOP_CURRENT );
+			WriteTime( event.timestamp );
+			WriteVarint( event.channelID );
+			std::vector< quActivityID >& stack = channelStacks[ event.channelID ];
+			if( stack.empty() )
+				break;
+			activityID = stack.back();
+		}
+		else
+		{
+			records += char( QU_BINARY_RECORD_STOP );
+			WriteTime( event.timestamp );
+			WriteActivityID( activityID );
+		}
+
+		auto activity = runningActivities.find( activityID );
+		if( activity == runningActivities.end() )
+			break;
+		std::vector< quActivityID >& stack = channelStacks[ activity->second.channelID ];
+		stack.erase( std::find( stack.begin(), stack.end(), activityID ) );
+		runningActivities.erase( activity );
+		break;
+	}
+	case QU_EVENT_SET_COUNTER_VALUE:
+	case QU_EVENT_SET_TYPED_COUNTER_VALUE:
+	{
+		UseName( QU_BINARY_RECORD_COUNTER_NAME, counterNames, event.counterID );
+		records += char( QU_BINARY_RECORD_COUNTER_VALUE );
+		WriteTime( event.timestamp );
+		WriteVarint( event.counterID );
+		double value = GetCounterValue( event );
+		quUInt64 bits;
+		memcpy( &bits, &value, sizeof( bits ) );
+		WriteFixed( bits );
+		break;
+	}
+	case QU_EVENT_ANNOTATE_ACTIVITY:
+	{
+		StoredAnnotation annotation = { event.annotationKeyID, event.annotationType, event.annotationValue };
+		WriteAnnotation( event.activityID, annotation );
+		//Chunks that repeat the activity repeat its annotations as well.
+		if( auto activity = runningActivities.find( event.activityID ); activity != runningActivities.end() )
+			activity->second.annotations.push_back( annotation );
+		break;
+	}
+	default:
+		break;
+	}
+
+	if( records.size() >= chunkBytes )
+		EndChunk();
+}
+void BinaryTraceEncoder::AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp )
+{
+	if( !chunkStarted )
+		BeginChunk( timestamp );
+	firstTimestamp = std::min( firstTimestamp, timestamp );
+	lastTimestamp = std::max( lastTimestamp, timestamp );
+
+	UseChannel( channelID );
+	quUInt64 string = UseString( name );
+	records += char( QU_BINARY_RECORD_MARKER );
+	WriteTime( timestamp );
+	WriteVarint( channelID );
+	WriteVarint( string );
+	if( records.size() >= chunkBytes )
+		EndChunk();
+}
+bool BinaryTraceEncoder::Finish()
+{
+	EndChunk();
+
+	quBinaryTraceFooter footer = { fileOffset, quUInt32( index.size() ), quUInt32( indexChannels.size() ), QU_BINARY_TRACE_FOOTER_MAGIC };
+	Write( index.data(), index.size() * sizeof( quBinaryTraceIndexEntry ) );
+	Write( indexChannels.data(), indexChannels.size() * sizeof( quActivityChannelID ) );
+	Write( &footer, sizeof( footer ) );
+	failed |= fflush( file ) != 0;
+	return !failed;
+}
+
+void BinaryTraceEncoder::BeginChunk( quUInt64 timestamp )
+{
+	chunkStarted = true;
+	baseTimestamp = timestamp;
+	firstTimestamp = ~quUInt64( 0 );
+	lastTimestamp = timestamp;
+	hasTime = false;
+	previousTimestamp = timestamp;
+	previousActivityID = 0;
+	records.clear();
+	chunkStrings.clear();
+	for( std::unordered_set< quUInt64 >& names : chunkNames )
+		names.clear();
+	chunkChannels.clear();
+
+	//Activities that are still running are started again, in the order they started before.
+	std::vector< std::pair< quUInt64, quActivityID > > running;
+	running.reserve( runningActivities.size() );
+	for( const auto& [ activityID, activity ] : runningActivities )
+		running.emplace_back( activity.order, activityID );
+	std::sort( running.begin(), running.end() );
+	for( const auto& [ order, activityID ] : running )
+	{
+		const RunningActivity& activity = runningActivities[ activityID ];
+		WriteStart( activityID, activity );
+		for( const StoredAnnotation& annotation : activity.annotations )
+			WriteAnnotation( activityID, annotation );
+	}
+}
+void BinaryTraceEncoder::EndChunk()
+{
+	if( !chunkStarted )
+		return;
+
+	chunkStarted = false;
+	//Events may arrive slightly out of order, so the first one isn't necessarily the earliest. The time differences are rebased
+	//on the earliest timestamp by rewriting the first of them, every other one is relative to its predecessor.
+	if( firstTimestamp == ~quUInt64( 0 ) )
+		firstTimestamp = baseTimestamp;
+	if( hasTime && firstTimestamp != baseTimestamp )
+	{
+		std::string oldDifference, newDifference;
+		AppendVarint( oldDifference, ZigZag( quInt64( firstTime - baseTimestamp ) ) );
+		AppendVarint( newDifference, ZigZag( quInt64( firstTime - firstTimestamp ) ) );
+		records.replace( firstTimeOffset, oldDifference.size(), newDifference );
+	}
+	std::sort( chunkChannels.begin(), chunkChannels.end() );
+	quBinaryTraceIndexEntry entry = { fileOffset, firstTimestamp, lastTimestamp, quUInt32( indexChannels.size() ), quUInt32( chunkChannels.size() ) };
+	index.push_back( entry );
+	indexChannels.insert( indexChannels.end(), chunkChannels.begin(), chunkChannels.end() );
+
+	quBinaryTraceChunk chunk = { QU_BINARY_TRACE_CHUNK_MAGIC, quUInt32( records.size() ), firstTimestamp, lastTimestamp };
+	Write( &chunk, sizeof( chunk ) );
+	Write( records.data(), records.size() );
+}
+void BinaryTraceEncoder::WriteStart( quActivityID activityID, const RunningActivity& activity )
+{
+	UseChannel( activity.channelID );
+	bool named = activity.recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID;
+	quUInt64 string = 0;
+	if( named )
+		string = UseString( activity.name );
+	else
+		UseName( QU_BINARY_RECORD_RECURRING_ACTIVITY_NAME, recurringActivityNames, activity.recurringActivityID );
+
+	records += char( named ? QU_BINARY_RECORD_START_NAMED : QU_BINARY_RECORD_START_RECURRING );
+	WriteTime( activity.startTimestamp );
+	WriteVarint( activity.channelID );
+	WriteActivityID( activityID );
+	WriteVarint( named ? string : activity.recurringActivityID );
+}
+void BinaryTraceEncoder::WriteAnnotation( quActivityID activityID, const StoredAnnotation& annotation )
+{
+	UseName( QU_BINARY_RECORD_ANNOTATION_KEY_NAME, annotationKeyNames, annotation.annotationKeyID );
+	records += char( QU_BINARY_RECORD_ANNOTATION );
+	WriteActivityID( activityID );
+	WriteVarint( annotation.annotationKeyID );
+	records += char( annotation.annotationType );
+	WriteFixed( annotation.annotationValue );
+}
+void BinaryTraceEncoder::WriteTime( quUInt64 timestamp )
+{
+	if( !hasTime )
+	{
+		hasTime = true;
+		firstTimeOffset = records.size();
+		firstTime = timestamp;
+	}
+	WriteVarint( ZigZag( quInt64( timestamp - previousTimestamp ) ) );
+	previousTimestamp = timestamp;
+}
+void BinaryTraceEncoder::WriteActivityID( quActivityID activityID )
+{
+	WriteVarint( ZigZag( quInt64( activityID - previousActivityID ) ) );
+	previousActivityID = activityID;
+}
+void BinaryTraceEncoder::UseChannel( quActivityChannelID channelID )
+{
+	if( std::find( chunkChannels.begin(), chunkChannels.end(), channelID ) != chunkChannels.end() )
+		return;
+
+	chunkChannels.push_back( channelID );
+	UseName( QU_BINARY_RECORD_CHANNEL_NAME, channelNames, channelID );
+}
+void BinaryTraceEncoder::WriteVarint( quUInt64 value )
+{
+	AppendVarint( records, value );
+}
+void BinaryTraceEncoder::WriteFixed( quUInt64 bits )
+{
+	for( int i = 0; i < 8; ++i )
+		records += char( bits >> ( i * 8 ) );
+}
+quUInt64 BinaryTraceEncoder::UseString( std::string_view text )
+{
+	auto [ string, added ] = chunkStrings.try_emplace( std::string( text ), chunkStrings.size() );
+	if( added )
+	{
+		records += char( QU_BINARY_RECORD_STRING );
+		WriteVarint( text.size() );
+		records += text;
+	}
+	return string->second;
+}
+void BinaryTraceEncoder::UseName( quUInt8 tag, std::unordered_map< quUInt64, std::string >& names, quUInt64 id )
+{
+	std::unordered_set< quUInt64 >& written = chunkNames[ tag - QU_BINARY_RECORD_CHANNEL_NAME ];
+	if( written.contains( id ) )
+		return;
+
+	auto name = names.find( id );
+	if( name == names.end() )
+		return;
+
+	written.insert( id );
+	quUInt64 string = UseString( name->second );
+	records += char( tag );
+	WriteVarint( id );
+	WriteVarint( string );
+}
+void BinaryTraceEncoder::Write( const void* data, size_t size )
+{
+	if( !failed && size != 0 )
+		failed = fwrite( data, 1, size, file ) != size;
+	fileOffset += size;
+}
+
+} //End namespace qut
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TraceEventSink.h"
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace qut
+{
+
+/**
+ * Writes the chunked binary trace format described at quBinaryTraceHeader. Names are only remembered until they are first used
+ * in a chunk, at which point they're written into it. Once a chunk holds chunkBytes worth of records it's written to the file,
+ * the next one starts by repeating the activities that are still running, along with their annotations, so that it can be decoded
+ * without its predecessors.
+ */
+class BinaryTraceEncoder : public TraceEventSink
+{
+public:
+	static constexpr quUInt32 DEFAULT_CHUNK_BYTES = 1 << 20;
+
+	BinaryTraceEncoder( FILE* file, quUInt32 chunkBytes = DEFAULT_CHUNK_BYTES );
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override;
+	void NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name ) override;
+	void NameActivity( quActivityID activityID, std::string_view name ) override;
+	void NameCounter( quCounterID counterID, std::string_view name ) override;
+	void NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name ) override;
+
+	void AddEvent( const quEvent& event ) override;
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override;
+	//Writes the last chunk and the index, returns false if anything failed to be written.
+	bool Finish();
+
+private:
+	struct StoredAnnotation
+	{
+		quAnnotationKeyID annotationKeyID;
+		quActivityArgType annotationType;
+		quUInt64 annotationValue;
+	};
+	struct RunningActivity
+	{
+		quUInt64 order; //!< Position among the starts, running activities are repeated in the order they started.
+		quActivityChannelID channelID;
+		quRecurringActivityID recurringActivityID;
+		quUInt64 startTimestamp;
+		std::string name; //!< Name of activities that were started without a recurring activity.
+		std::vector< StoredAnnotation > annotations;
+	};
+
+	void BeginChunk( quUInt64 timestamp );
+	void EndChunk();
+	void WriteStart( quActivityID activityID, const RunningActivity& activity );
+	void WriteAnnotation( quActivityID activityID, const StoredAnnotation& annotation );
+	void WriteTime( quUInt64 timestamp );
+	void WriteActivityID( quActivityID activityID );
+	void WriteVarint( quUInt64 value );
+	void WriteFixed( quUInt64 bits );
+	//Names the channel the first time the chunk uses it and lists it among the chunk's channels in the index.
+	void UseChannel( quActivityChannelID channelID );
+	//Returns the number of the string in the current chunk, writing it if it wasn't used yet.
+	quUInt64 UseString( std::string_view text );
+	//Writes the name of the id the first time the chunk uses it.
+	void UseName( quUInt8 tag, std::unordered_map< quUInt64, std::string >& names, quUInt64 id );
+	void Write( const void* data, size_t size );
+
+	FILE* file;
+	quUInt32 chunkBytes;
+	quUInt64 fileOffset = 0;
+	bool failed = false;
+
+	std::unordered_map< quUInt64, std::string > channelNames;
+	std::unordered_map< quUInt64, std::string > recurringActivityNames;
+	std::unordered_map< quUInt64, std::string > counterNames;
+	std::unordered_map< quUInt64, std::string > annotationKeyNames;
+	std::unordered_map< quActivityID, std::string > activityNames; //!< Names of activities that haven't started yet.
+	std::unordered_map< quActivityID, RunningActivity > runningActivities;
+	std::unordered_map< quActivityChannelID, std::vector< quActivityID > > channelStacks; //!< Running activities of every channel in the order they started.
+	quActivityID repeatedActivityID = QU_INVALID_ACTIVITY_ID; //!< Activity whose start was just repeated, the annotations repeated along with it are ignored.
+	quUInt64 nextOrder = 0;
+
+	//State of the chunk being built
+	std::string records;
+	bool chunkStarted = false;
+	quUInt64 baseTimestamp = 0;  //!< Timestamp the time differences start from until the chunk ends, when it becomes firstTimestamp.
+	quUInt64 firstTimestamp = 0; //!< Earliest timestamp of the chunk's own events.
+	quUInt64 lastTimestamp = 0;  //!< Latest timestamp of the chunk's events.
+	size_t firstTimeOffset = 0;  //!< Position of the chunk's first time difference in records, the only one relative to baseTimestamp.
+	quUInt64 firstTime = 0;      //!< Timestamp the first time difference is for.
+	bool hasTime = false;        //!< Whether the chunk has any time difference yet.
+	quUInt64 previousTimestamp = 0;
+	quActivityID previousActivityID = 0;
+	std::unordered_map< std::string, quUInt64 > chunkStrings;
+	std::unordered_set< quUInt64 > chunkNames[ 4 ]; //!< Ids whose name was written to the chunk, per name record.
+	std::vector< quActivityChannelID > chunkChannels;
+
+	std::vector< quBinaryTraceIndexEntry > index;
+	std::vector< quActivityChannelID > indexChannels;
+};
+
+} //End namespace qut
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BinaryTraceReader.h"
+#include <algorithm>
+#include <cstring>
+
+namespace qut
+{
+
+//Decodes the records of a chunk, every read fails once the chunk ran out.
+class RecordDecoder
+{
+public:
+	RecordDecoder( const std::vector< char >& records, quUInt64 firstTimestamp ) :
+	    position( records.data() ),
+	    end( records.data() + records.size() ),
+	    previousTimestamp( firstTimestamp )
+	{
+	}
+
+	bool AtEnd() const
+	{
+		return position == end;
+	}
+	bool ReadByte( quUInt8& value )
+	{
+		if( position == end )
+			return false;
+
+		value = quUInt8( *position++ );
+		return true;
+	}
+	bool ReadVarint( quUInt64& value )
+	{
+		value = 0;
+		for( int shift = 0; shift < 64 && position != end; shift += 7 )
+		{
+			quUInt8 byte = quUInt8( *position++ );
+			value |= quUInt64( byte & 0x7F ) << shift;
+			if( ( byte & 0x80 ) == 0 )
+				return true;
+		}
+		return false;
+	}
+	bool ReadFixed( quUInt64& bits )
+	{
+		if( end - position < 8 )
+			return false;
+
+		bits = 0;
+		for( int i = 0; i < 8; ++i )
+			bits |= quUInt64( quUInt8( *position++ ) ) << ( i * 8 );
+		return true;
+	}
+	bool ReadBytes( quUInt64 size, std::string_view& bytes )
+	{
+		if( quUInt64( end - position ) < size )
+			return false;
+
+		bytes = std::string_view( position, size_t( size ) );
+		position += size;
+		return true;
+	}
+	bool ReadTime( quUInt64& timestamp )
+	{
+		quUInt64 zigZag;
+		if( !ReadVarint( zigZag ) )
+			return false;
+
+		previousTimestamp += UnZigZag( zigZag );
+		timestamp = previousTimestamp;
+		return true;
+	}
+	bool ReadActivityID( quActivityID& activityID )
+	{
+		quUInt64 zigZag;
+		if( !ReadVarint( zigZag ) )
+			return false;
+
+		previousActivityID += UnZigZag( zigZag );
+		activityID = previousActivityID;
+		return true;
+	}
+
+private:
+	static quUInt64 UnZigZag( quUInt64 value )
+	{
+		return ( value >> 1 ) ^ ( ~( value & 1 ) + 1 );
+	}
+
+	const char* position;
+	const char* end;
+	quUInt64 previousTimestamp;
+	quActivityID previousActivityID = 0;
+};
+
+bool BinaryTraceReader::Open( const char* fileName )
+{
+	file.open( fileName, std::ios::binary | std::ios::ate );
+	if( !file )
+		return false;
+
+	quUInt64 fileSize = quUInt64( file.tellg() );
+	quBinaryTraceHeader header;
+	file.seekg( 0 );
+	if( fileSize < sizeof( header ) || !file.read( (char*)&header, sizeof( header ) ) )
+		return false;
+	if( header.magic != QU_BINARY_TRACE_MAGIC || header.version != QU_BINARY_TRACE_VERSION )
+		return false;
+
+	indexed = ReadIndex( fileSize );
+	if( !indexed )
+		ScanChunks( fileSize );
+	return true;
+}
+
+bool BinaryTraceReader::HasIndex() const
+{
+	return indexed;
+}
+size_t BinaryTraceReader::GetChunkCount() const
+{
+	return chunks.size();
+}
+const quBinaryTraceIndexEntry& BinaryTraceReader::GetChunk( size_t chunk ) const
+{
+	return chunks[ chunk ];
+}
+bool BinaryTraceReader::HasChannel( size_t chunk, quActivityChannelID channelID ) const
+{
+	if( !indexed )
+		return true;
+
+	auto first = channels.begin() + chunks[ chunk ].firstChannel;
+	return std::binary_search( first, first + chunks[ chunk ].channelCount, channelID );
+}
+bool BinaryTraceReader::DecodeChunk( size_t chunk, TraceEventSink& sink )
+{
+	quBinaryTraceChunk header;
+	file.clear();
+	file.seekg( std::streamoff( chunks[ chunk ].offset ) );
+	if( !file.read( (char*)&header, sizeof( header ) ) || header.magic != QU_BINARY_TRACE_CHUNK_MAGIC )
+		return false;
+	records.resize( header.recordBytes );
+	if( !file.read( records.data(), std::streamsize( records.size() ) ) )
+		return false;
+
+	//Strings and names only apply to the chunk that defines them.
+	strings.clear();
+	RecordDecoder decoder( records, header.firstTimestamp );
+	auto readString = [ & ]( std::string_view& string )
+	{
+		quUInt64 index;
+		if( !decoder.ReadVarint( index ) || index >= strings.size() )
+			return false;
+
+		string = strings[ size_t( index ) ];
+		return true;
+	};
+
+	while( !decoder.AtEnd() )
+	{
+		quUInt8 tag;
+		quUInt64 id, value;
+		std::string_view string;
+		quEvent event = {};
+		decoder.ReadByte( tag );
+		switch( tag )
+		{
+		case QU_BINARY_RECORD_STRING:
+			if( !decoder.ReadVarint( value ) || !decoder.ReadBytes( value, string ) )
+				return false;
+			strings.push_back( string );
+			break;
+		case QU_BINARY_RECORD_CHANNEL_NAME:
+		case QU_BINARY_RECORD_RECURRING_ACTIVITY_NAME:
+		case QU_BINARY_RECORD_COUNTER_NAME:
+		case QU_BINARY_RECORD_ANNOTATION_KEY_NAME:
+			if( !decoder.ReadVarint( id ) || !readString( string ) )
+				return false;
+			if( tag == QU_BINARY_RECORD_CHANNEL_NAME )
+				sink.NameChannel( quActivityChannelID( id ), string );
+			else if( tag == QU_BINARY_RECORD_RECURRING_ACTIVITY_NAME )
+				sink.NameRecurringActivity( quRecurringActivityID( id ), string );
+			else if( tag == QU_BINARY_RECORD_COUNTER_NAME )
+				sink.NameCounter( quCounterID( id ), string );
+			else
+				sink.NameAnnotationKey( quAnnotationKeyID( id ), string );
+			break;
+		case QU_BINARY_RECORD_START_RECURRING:
+		case QU_BINARY_RECORD_START_NAMED:
+			event.type = QU_EVENT_START_RECURRING_ACTIVITY;
+			event.recurringActivityID = QU_INVALID_RECURRING_ACTIVITY_ID;
+			if( !decoder.ReadTime( event.timestamp ) || !decoder.ReadVarint( id ) || !decoder.ReadActivityID( event.activityID ) )
+				return false;
+			event.channelID = quActivityChannelID( id );
+			if( tag == QU_BINARY_RECORD_START_NAMED )
+			{
+				if( !readString( string ) )
+					return false;
+				sink.NameActivity( event.activityID, string );
+			}
+			else
+			{
+				if( !decoder.ReadVarint( id ) )
+					return false;
+				event.recurringActivityID = quRecurringActivityID( id );
+			}
+			sink.AddEvent( event );
+			break;
+		case QU_BINARY_RECORD_STOP:
+			event.type = QU_EVENT_STOP_ACTIVITY;
+			if( !decoder.ReadTime( event.timestamp ) || !decoder.ReadActivityID( event.activityID ) )
+				return false;
+			sink.AddEvent( event );
+			break;
+		case QU_BINARY_RECORD_STOP_CURRENT:
+			event.type = QU_EVENT_STOP_ACTIVITY;
+			event.activityID = QU_INVALID_ACTIVITY_ID;
+			if( !decoder.ReadTime( event.timestamp ) || !decoder.ReadVarint( id ) )
+				return false;
+			event.channelID = quActivityChannelID( id );
+			sink.AddEvent( event );
+			break;
+		case QU_BINARY_RECORD_COUNTER_VALUE:
+		{
+			event.type = QU_EVENT_SET_COUNTER_VALUE;
+			if( !decoder.ReadTime( event.timestamp ) || !decoder.ReadVarint( id ) || !decoder.ReadFixed( value ) )
+				return false;
+			double counterValue;
+			memcpy( &counterValue, &value, sizeof( counterValue ) );
+			event.counterID = quCounterID( id );
+			event.counterValue = float( counterValue );
+			sink.AddEvent( event );
+			break;
+		}
+		case QU_BINARY_RECORD_ANNOTATION:
+		{
+			quUInt8 annotationType;
+			event.type = QU_EVENT_ANNOTATE_ACTIVITY;
+			if( !decoder.ReadActivityID( event.activityID ) || !decoder.ReadVarint( id ) || !decoder.ReadByte( annotationType ) || !decoder.ReadFixed( event.annotationValue ) )
+				return false;
+			event.annotationKeyID = quAnnotationKeyID( id );
+			event.annotationType = quActivityArgType( annotationType );
+			sink.AddEvent( event );
+			break;
+		}
+		case QU_BINARY_RECORD_MARKER:
+			if( !decoder.ReadTime( value ) || !decoder.ReadVarint( id ) || !readString( string ) )
+				return false;
+			sink.AddMarker( quActivityChannelID( id ), string, value );
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+bool BinaryTraceReader::ReadIndex( quUInt64 fileSize )
+{
+	quBinaryTraceFooter footer;
+	if( fileSize < sizeof( quBinaryTraceHeader ) + sizeof( footer ) )
+		return false;
+
+	file.seekg( std::streamoff( fileSize - sizeof( footer ) ) );
+	if( !file.read( (char*)&footer, sizeof( footer ) ) || footer.magic != QU_BINARY_TRACE_FOOTER_MAGIC )
+		return false;
+
+	quUInt64 indexBytes = quUInt64( footer.chunkCount ) * sizeof( quBinaryTraceIndexEntry ) + quUInt64( footer.channelCount ) * sizeof( quActivityChannelID );
+	if( footer.indexOffset > fileSize - sizeof( footer ) || indexBytes != fileSize - sizeof( footer ) - footer.indexOffset )
+		return false;
+
+	chunks.resize( footer.chunkCount );
+	channels.resize( footer.channelCount );
+	file.seekg( std::streamoff( footer.indexOffset ) );
+	if( !file.read( (char*)chunks.data(), std::streamsize( chunks.size() * sizeof( quBinaryTraceIndexEntry ) ) ) || !file.read( (char*)channels.data(), std::streamsize( channels.size() * sizeof( quActivityChannelID ) ) ) )
+		return false;
+
+	for( const quBinaryTraceIndexEntry& chunk : chunks )
+	{
+		if( quUInt64( chunk.firstChannel ) + chunk.channelCount > channels.size() )
+			return false;
+	}
+	return true;
+}
+void BinaryTraceReader::ScanChunks( quUInt64 fileSize )
+{
+	chunks.clear();
+	channels.clear();
+	file.clear();
+	quUInt64 offset = sizeof( quBinaryTraceHeader );
+	quBinaryTraceChunk header;
+	while( offset + sizeof( header ) <= fileSize )
+	{
+		file.seekg( std::streamoff( offset ) );
+		if( !file.read( (char*)&header, sizeof( header ) ) || header.magic != QU_BINARY_TRACE_CHUNK_MAGIC )
+			break;
+		//The last chunk may have been cut short.
+		if( header.recordBytes > fileSize - offset - sizeof( header ) )
+			break;
+
+		chunks.push_back( { offset, header.firstTimestamp, header.lastTimestamp, 0, 0 } );
+		offset += sizeof( header ) + header.recordBytes;
+	}
+	file.clear();
+}
+
+} //End namespace qut
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TraceEventSink.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace qut
+{
+
+/**
+ * Reads files in the chunked binary trace format described at quBinaryTraceHeader. The index at the end of the file is all that's
+ * read up front, chunks are only read once they're decoded. Files without an index, such as those of processes that died, are
+ * indexed by walking the chunk headers instead, which leaves the channels of their chunks unknown.
+ */
+class BinaryTraceReader
+{
+public:
+	//Returns false if the file can't be read or isn't a binary trace.
+	bool Open( const char* fileName );
+
+	bool HasIndex() const;
+	size_t GetChunkCount() const;
+	const quBinaryTraceIndexEntry& GetChunk( size_t chunk ) const;
+	//Always true for chunks of files without an index.
+	bool HasChannel( size_t chunk, quActivityChannelID channelID ) const;
+	//Returns false if the chunk is damaged, whatever was decoded up to the damage has been passed on.
+	bool DecodeChunk( size_t chunk, TraceEventSink& sink );
+
+private:
+	bool ReadIndex( quUInt64 fileSize );
+	void ScanChunks( quUInt64 fileSize );
+
+	std::ifstream file;
+	bool indexed = false;
+	std::vector< quBinaryTraceIndexEntry > chunks;
+	std::vector< quActivityChannelID > channels;
+	std::vector< char > records;
+	std::vector< std::string_view > strings;
+};
+
+} //End namespace qut
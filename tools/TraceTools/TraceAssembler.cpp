@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceAssembler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace qut
+{
+
+TraceAssembler::TraceAssembler( TraceWriter& writer ) :
+    writer( writer )
+{
+}
+
+void TraceAssembler::NameChannel( quActivityChannelID channelID, std::string_view name )
+{
+	std::string& channelName = channelNames[ channelID ];
+	if( channelName == name )
+		return;
+
+	channelName = name;
+	writer.NameChannel( channelID, name );
+}
+void TraceAssembler::NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name )
+{
+	recurringActivityNames[ recurringActivityID ] = name;
+}
+void TraceAssembler::NameActivity( quActivityID activityID, std::string_view name )
+{
+	activityNames[ activityID ] = name;
+}
+void TraceAssembler::NameCounter( quCounterID counterID, std::string_view name )
+{
+	counterNames[ counterID ] = name;
+}
+void TraceAssembler::NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name )
+{
+	annotationKeyNames[ annotationKeyID ] = name;
+}
+
+void TraceAssembler::AddEvent( const quEvent& event )
+{
+	if( event.type == QU_EVENT_ANNOTATE_ACTIVITY && event.activityID == repeatedActivityID )
+		return;
+	repeatedActivityID = QU_INVALID_ACTIVITY_ID;
+
+	//Annotations carry their value where other events have their timestamp.
+	if( event.type != QU_EVENT_ANNOTATE_ACTIVITY )
+		lastTimestamp = std::max( lastTimestamp, event.timestamp );
+
+	switch( event.type )
+	{
+	case QU_EVENT_START_RECURRING_ACTIVITY:
+		if( runningActivities.try_emplace( event.activityID, RunningActivity { event.channelID, event.recurringActivityID, event.timestamp, {} } ).second )
+			channelStacks[ event.channelID ].push_back( event.activityID );
+		else
+			repeatedActivityID = event.activityID;
+		break;
+	case QU_EVENT_STOP_ACTIVITY:
+		if( event.activityID != QU_INVALID_ACTIVITY_ID )
+			Stop( event.activityID, event.timestamp, false );
+		else if( auto stack = channelStacks.find( event.channelID ); stack != channelStacks.end() && !stack->second.empty() )
+			Stop( stack->second.back(), event.timestamp, false );
+		break;
+	case QU_EVENT_SET_COUNTER_VALUE:
+	case QU_EVENT_SET_TYPED_COUNTER_VALUE:
+	{
+		auto name = counterNames.find( event.counterID );
+		if( name != counterNames.end() )
+			writer.AddCounterValue( name->second, event.timestamp, GetCounterValue( event ) );
+		else
+			writer.AddCounterValue( fallbackName = "Counter " + std::to_string( event.counterID ), event.timestamp, GetCounterValue( event ) );
+		break;
+	}
+	case QU_EVENT_ANNOTATE_ACTIVITY:
+	{
+		auto activity = runningActivities.find( event.activityID );
+		if( activity == runningActivities.end() )
+			break;
+
+		TraceArg arg;
+		auto key = annotationKeyNames.find( event.annotationKeyID );
+		if( key == annotationKeyNames.end() )
+			key = annotationKeyNames.emplace( event.annotationKeyID, "Key " + std::to_string( event.annotationKeyID ) ).first;
+		arg.key = key->second;
+		arg.type = event.annotationType;
+		memcpy( &arg.uint64Value, &event.annotationValue, sizeof( quUInt64 ) );
+		activity->second.args.push_back( arg );
+		break;
+	}
+	default:
+		break;
+	}
+}
+void TraceAssembler::AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp )
+{
+	lastTimestamp = std::max( lastTimestamp, timestamp );
+	writer.AddMarker( channelID, name, timestamp );
+}
+quUInt64 TraceAssembler::Finish()
+{
+	//Ends the innermost activities first, which is the order they would have stopped in.
+	quUInt64 unfinishedCount = 0;
+	for( auto& [ channelID, stack ] : channelStacks )
+	{
+		while( !stack.empty() )
+		{
+			Stop( stack.back(), lastTimestamp, true );
+			++unfinishedCount;
+		}
+	}
+	return unfinishedCount;
+}
+
+void TraceAssembler::Stop( quActivityID activityID, quUInt64 timestamp, bool unfinished )
+{
+	auto activity = runningActivities.find( activityID );
+	if( activity == runningActivities.end() )
+		return;
+
+	RunningActivity& running = activity->second;
+	quUInt64 duration = timestamp > running.startTimestamp ? timestamp - running.startTimestamp : 0;
+	writer.AddActivity( running.channelID, running.recurringActivityID, GetActivityName( activityID, running ), running.startTimestamp, duration, running.args.data(), quUInt32( running.args.size() ), unfinished );
+
+	std::vector< quActivityID >& stack = channelStacks[ running.channelID ];
+	auto it = std::find( stack.rbegin(), stack.rend(), activityID );
+	if( it != stack.rend() )
+		stack.erase( std::next( it ).base() );
+	activityNames.erase( activityID );
+	runningActivities.erase( activity );
+}
+std::string_view TraceAssembler::GetActivityName( quActivityID activityID, const RunningActivity& activity )
+{
+	if( activity.recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID )
+	{
+		auto name = activityNames.find( activityID );
+		return name != activityNames.end() ? std::string_view( name->second ) : std::string_view( "Unnamed activity" );
+	}
+	else
+	{
+		auto name = recurringActivityNames.find( activity.recurringActivityID );
+		if( name != recurringActivityNames.end() )
+			return name->second;
+	}
+	return fallbackName = "Activity " + std::to_string( activity.recurringActivityID );
+}
+
+} //End namespace qut
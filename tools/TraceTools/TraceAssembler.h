@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TraceEventSink.h"
+#include "TraceWriter.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qut
+{
+
+/**
+ * Turns the events the api submits into the complete activities, counter values and markers of a trace. Activities are passed on
+ * to the writer once they stop, those that never stopped are passed on by Finish, which ends them at the last timestamp that was
+ * seen. Starting an activity that is already running is ignored, along with the annotations right after it, so traces may repeat
+ * the starts of running activities and their annotations.
+ */
+class TraceAssembler : public TraceEventSink
+{
+public:
+	explicit TraceAssembler( TraceWriter& writer );
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override;
+	void NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name ) override;
+	void NameActivity( quActivityID activityID, std::string_view name ) override;
+	void NameCounter( quCounterID counterID, std::string_view name ) override;
+	void NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name ) override;
+
+	void AddEvent( const quEvent& event ) override;
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override;
+	//Returns the number of activities that never stopped.
+	quUInt64 Finish();
+
+private:
+	struct RunningActivity
+	{
+		quActivityChannelID channelID;
+		quRecurringActivityID recurringActivityID;
+		quUInt64 startTimestamp;
+		std::vector< TraceArg > args;
+	};
+
+	void Stop( quActivityID activityID, quUInt64 timestamp, bool unfinished );
+	std::string_view GetActivityName( quActivityID activityID, const RunningActivity& activity );
+
+	TraceWriter& writer;
+	quUInt64 lastTimestamp = 0;
+	std::unordered_map< quActivityChannelID, std::string > channelNames;
+	std::unordered_map< quRecurringActivityID, std::string > recurringActivityNames;
+	std::unordered_map< quActivityID, std::string > activityNames;
+	std::unordered_map< quCounterID, std::string > counterNames;
+	std::unordered_map< quAnnotationKeyID, std::string > annotationKeyNames;
+	std::unordered_map< quActivityID, RunningActivity > runningActivities;
+	std::unordered_map< quActivityChannelID, std::vector< quActivityID > > channelStacks; //!< Running activities of every channel in the order they started.
+	quActivityID repeatedActivityID = QU_INVALID_ACTIVITY_ID; //!< Activity whose start was just repeated, the annotations repeated along with it are ignored.
+	std::string fallbackName;
+};
+
+} //End namespace qut
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quConstants.h>
+#include <cstring>
+#include <string_view>
+
+namespace qut
+{
+
+//Value of a QU_EVENT_SET_COUNTER_VALUE or QU_EVENT_SET_TYPED_COUNTER_VALUE event.
+inline double GetCounterValue( const quEvent& event )
+{
+	if( event.type != QU_EVENT_SET_TYPED_COUNTER_VALUE )
+		return event.counterValue;
+	if( event.counterType == QU_COUNTER_TYPE_INT64 )
+		return double( quInt64( event.typedCounterBits ) );
+
+	double value;
+	memcpy( &value, &event.typedCounterBits, sizeof( value ) );
+	return value;
+}
+
+/**
+ * Receives a trace as the events the api submits along with the names they refer to. Events have to be added in the order they
+ * happened, names may be added at any point before the events that use them.
+ */
+class TraceEventSink
+{
+public:
+	virtual ~TraceEventSink() = default;
+
+	virtual void NameChannel( quActivityChannelID channelID, std::string_view name ) = 0;
+	virtual void NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name ) = 0;
+	//Activities started with a name rather than a recurring activity are named by their id.
+	virtual void NameActivity( quActivityID activityID, std::string_view name ) = 0;
+	virtual void NameCounter( quCounterID counterID, std::string_view name ) = 0;
+	virtual void NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name ) = 0;
+
+	virtual void AddEvent( const quEvent& event ) = 0;
+	virtual void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) = 0;
+};
+
+} //End namespace qut
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceJsonWriter.h"
+#include <bit>
+#include <charconv>
+#include <cstring>
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#	include <emmintrin.h>
+#	define QU_TRACE_JSON_SSE2
+#endif
+
+namespace qut
+{
+
+static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+static constexpr char DIGIT_PAIRS[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+template< size_t SIZE >
+static char* WriteLiteral( char* out, const char ( &text )[ SIZE ] )
+{
+	memcpy( out, text, SIZE - 1 );
+	return out + SIZE - 1;
+}
+
+//Returns the number of characters at the start of the text that can be copied without escaping them.
+static size_t FindEscape( const char* text, size_t size )
+{
+	size_t i = 0;
+#if defined( QU_TRACE_JSON_SSE2 )
+	const __m128i quote = _mm_set1_epi8( '"' );
+	const __m128i backslash = _mm_set1_epi8( '\\' );
+	const __m128i lastControl = _mm_set1_epi8( 0x1F );
+	for( ; i + 16 <= size; i += 16 )
+	{
+		__m128i block = _mm_loadu_si128( (const __m128i*)( text + i ) );
+		//There are no unsigned comparisons, control characters are the bytes that are their own minimum with 0x1F.
+		__m128i control = _mm_cmpeq_epi8( _mm_min_epu8( block, lastControl ), block );
+		__m128i escaped = _mm_or_si128( control, _mm_or_si128( _mm_cmpeq_epi8( block, quote ), _mm_cmpeq_epi8( block, backslash ) ) );
+		if( int mask = _mm_movemask_epi8( escaped ); mask != 0 )
+			return i + size_t( std::countr_zero( unsigned( mask ) ) );
+	}
+#else
+	//Eight bytes at a time, the high bit of a byte ends up set if it's a control character, a quote or a backslash. Borrows only
+	//carry into the bytes after one that is set, so the lowest set bit is always right.
+	if constexpr( std::endian::native == std::endian::little )
+	{
+		constexpr quUInt64 ONES = 0x0101010101010101ull;
+		constexpr quUInt64 HIGH_BITS = 0x8080808080808080ull;
+		for( ; i + 8 <= size; i += 8 )
+		{
+			quUInt64 block;
+			memcpy( &block, text + i, sizeof( block ) );
+			quUInt64 quotes = block ^ ( ONES * '"' );
+			quUInt64 backslashes = block ^ ( ONES * '\\' );
+			quUInt64 mask = ( ( block - ONES * 0x20 ) & ~block ) | ( ( quotes - ONES ) & ~quotes ) | ( ( backslashes - ONES ) & ~backslashes );
+			if( mask &= HIGH_BITS; mask != 0 )
+				return i + size_t( std::countr_zero( mask ) / 8 );
+		}
+	}
+#endif
+	for( ; i < size; ++i )
+	{
+		if( text[ i ] == '"' || text[ i ] == '\\' || (unsigned char)text[ i ] < 0x20 )
+			return i;
+	}
+	return size;
+}
+
+TraceJsonWriter::TraceJsonWriter( FILE* file, quUInt64 startTimestamp ) :
+    file( file ),
+    startTimestamp( startTimestamp ),
+    buffer( new char[ BUFFER_SIZE ] )
+{
+	char* out = Reserve( MAX_EVENT_BYTES );
+	out = WriteLiteral( out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+	used = size_t( out - buffer.get() );
+}
+
+void TraceJsonWriter::NameChannel( quActivityChannelID channelID, std::string_view name )
+{
+	char* out = Reserve( GetMaxStringBytes( name ) + MAX_EVENT_BYTES );
+	out = WriteSeparator( out );
+	out = BeginEvent( out, "thread_name", 'M' );
+	out = WriteLiteral( out, ",\"tid\":" );
+	out = WriteUnsigned( out, channelID );
+	out = WriteLiteral( out, ",\"args\":{\"name\":" );
+	out = WriteString( out, name );
+	out = WriteLiteral( out, "}}" );
+	used = size_t( out - buffer.get() );
+}
+void TraceJsonWriter::AddActivity( quActivityChannelID channelID, quRecurringActivityID recurringActivityID, std::string_view name, quUInt64 startTimestamp, quUInt64 duration, const TraceArg* args, quUInt32 argCount, bool unfinished )
+{
+	size_t maxBytes = GetMaxStringBytes( name ) + MAX_EVENT_BYTES;
+	for( quUInt32 i = 0; i < argCount; ++i )
+		maxBytes += GetMaxStringBytes( args[ i ].key ) + MAX_NUMBER_BYTES + 2;
+	char* out = Reserve( maxBytes );
+
+	if( recurringActivityID != QU_INVALID_RECURRING_ACTIVITY_ID )
+	{
+		ActivityPrefix& prefix = activityPrefixes[ recurringActivityID ];
+		if( prefix.json.empty() || prefix.name != name )
+		{
+			prefix.name = name;
+			prefix.json.resize( GetMaxStringBytes( name ) + MAX_EVENT_BYTES );
+			char* prefixEnd = BeginEvent( prefix.json.data(), name, 'X' );
+			prefixEnd = WriteLiteral( prefixEnd, ",\"tid\":" );
+			prefix.json.resize( size_t( prefixEnd - prefix.json.data() ) );
+		}
+		out = WriteSeparator( out );
+		memcpy( out, prefix.json.data(), prefix.json.size() );
+		out += prefix.json.size();
+	}
+	else
+	{
+		out = WriteSeparator( out );
+		out = BeginEvent( out, name, 'X' );
+		out = WriteLiteral( out, ",\"tid\":" );
+	}
+	out = WriteUnsigned( out, channelID );
+	out = WriteLiteral( out, ",\"ts\":" );
+	out = WriteMicros( out, quInt64( startTimestamp - this->startTimestamp ) );
+	out = WriteLiteral( out, ",\"dur\":" );
+	out = WriteMicros( out, quInt64( duration ) );
+	if( argCount != 0 || unfinished )
+	{
+		out = WriteLiteral( out, ",\"args\":{" );
+		for( quUInt32 i = 0; i < argCount; ++i )
+		{
+			if( i != 0 )
+				*out++ = ',';
+			out = WriteString( out, args[ i ].key );
+			*out++ = ':';
+			switch( args[ i ].type )
+			{
+			case QU_ACTIVITY_ARG_INT64:
+				out = WriteInteger( out, args[ i ].int64Value );
+				break;
+			case QU_ACTIVITY_ARG_UINT64:
+				out = WriteUnsigned( out, args[ i ].uint64Value );
+				break;
+			default:
+				out = WriteDouble( out, args[ i ].doubleValue );
+				break;
+			}
+		}
+		if( unfinished )
+			out = argCount != 0 ? WriteLiteral( out, ",\"unfinished\":true" ) : WriteLiteral( out, "\"unfinished\":true" );
+		*out++ = '}';
+	}
+	*out++ = '}';
+	used = size_t( out - buffer.get() );
+}
+void TraceJsonWriter::AddCounterValue( std::string_view counterName, quUInt64 timestamp, double value )
+{
+	char* out = Reserve( GetMaxStringBytes( counterName ) + MAX_EVENT_BYTES );
+	out = WriteSeparator( out );
+	out = BeginEvent( out, counterName, 'C' );
+	out = WriteLiteral( out, ",\"ts\":" );
+	out = WriteMicros( out, quInt64( timestamp - startTimestamp ) );
+	out = WriteLiteral( out, ",\"args\":{\"value\":" );
+	out = WriteDouble( out, value );
+	out = WriteLiteral( out, "}}" );
+	used = size_t( out - buffer.get() );
+}
+void TraceJsonWriter::AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp )
+{
+	char* out = Reserve( GetMaxStringBytes( name ) + MAX_EVENT_BYTES );
+	out = WriteSeparator( out );
+	out = BeginEvent( out, name, 'i' );
+	out = WriteLiteral( out, ",\"s\":\"t\",\"tid\":" );
+	out = WriteUnsigned( out, channelID );
+	out = WriteLiteral( out, ",\"ts\":" );
+	out = WriteMicros( out, quInt64( timestamp - startTimestamp ) );
+	*out++ = '}';
+	used = size_t( out - buffer.get() );
+}
+bool TraceJsonWriter::Finish()
+{
+	char* out = Reserve( MAX_EVENT_BYTES );
+	out = WriteLiteral( out, "]}\n" );
+	used = size_t( out - buffer.get() );
+	Flush();
+	failed |= fflush( file ) != 0;
+	return !failed;
+}
+
+char* TraceJsonWriter::Reserve( size_t bytes )
+{
+	if( bytes > bufferSize - used )
+	{
+		Flush();
+		//Events with huge names or lots of arguments may not even fit an empty buffer.
+		if( bytes > bufferSize )
+		{
+			bufferSize = bytes;
+			buffer.reset( new char[ bufferSize ] );
+		}
+	}
+	return buffer.get() + used;
+}
+char* TraceJsonWriter::WriteSeparator( char* out )
+{
+	out = firstEvent ? WriteLiteral( out, "\n" ) : WriteLiteral( out, ",\n" );
+	firstEvent = false;
+	return out;
+}
+char* TraceJsonWriter::BeginEvent( char* out, std::string_view name, char phase )
+{
+	out = WriteLiteral( out, "{\"name\":" );
+	out = WriteString( out, name );
+	out = WriteLiteral( out, ",\"ph\":\"" );
+	*out++ = phase;
+	return WriteLiteral( out, "\",\"pid\":1" );
+}
+size_t TraceJsonWriter::GetMaxStringBytes( std::string_view text )
+{
+	//Control characters take six bytes once escaped.
+	return text.size() * 6 + 2;
+}
+char* TraceJsonWriter::WriteString( char* out, std::string_view text )
+{
+	*out++ = '"';
+	for( ;; )
+	{
+		size_t plainSize = FindEscape( text.data(), text.size() );
+		memcpy( out, text.data(), plainSize );
+		out += plainSize;
+		if( plainSize == text.size() )
+			break;
+
+		char c = text[ plainSize ];
+		if( c == '"' || c == '\\' )
+		{
+			*out++ = '\\';
+			*out++ = c;
+		}
+		else
+		{
+			out = WriteLiteral( out, "\\u00" );
+			*out++ = HEX_DIGITS[ ( c >> 4 ) & 0xF ];
+			*out++ = HEX_DIGITS[ c & 0xF ];
+		}
+		text.remove_prefix( plainSize + 1 );
+	}
+	*out++ = '"';
+	return out;
+}
+char* TraceJsonWriter::WriteInteger( char* out, quInt64 value )
+{
+	if( value >= 0 )
+		return WriteUnsigned( out, quUInt64( value ) );
+
+	*out++ = '-';
+	return WriteUnsigned( out, 0 - quUInt64( value ) );
+}
+char* TraceJsonWriter::WriteUnsigned( char* out, quUInt64 value )
+{
+	//Digits are formatted from the back, two at a time.
+	char digits[ 20 ];
+	char* first = digits + sizeof( digits );
+	while( value >= 100 )
+	{
+		first -= 2;
+		memcpy( first, &DIGIT_PAIRS[ ( value % 100 ) * 2 ], 2 );
+		value /= 100;
+	}
+	if( value >= 10 )
+	{
+		first -= 2;
+		memcpy( first, &DIGIT_PAIRS[ value * 2 ], 2 );
+	}
+	else
+		*--first = char( '0' + value );
+
+	size_t size = size_t( digits + sizeof( digits ) - first );
+	memcpy( out, first, size );
+	return out + size;
+}
+char* TraceJsonWriter::WriteDouble( char* out, double value )
+{
+	//JSON has no representation for infinities and NaN.
+	if( value != value || value - value != 0.0 )
+		return WriteLiteral( out, "null" );
+
+	return std::to_chars( out, out + MAX_NUMBER_BYTES, value ).ptr;
+}
+char* TraceJsonWriter::WriteMicros( char* out, quInt64 nanos )
+{
+	quUInt64 magnitude = quUInt64( nanos );
+	if( nanos < 0 )
+	{
+		*out++ = '-';
+		magnitude = 0 - magnitude;
+	}
+	out = WriteUnsigned( out, magnitude / 1000 );
+	quUInt64 fraction = magnitude % 1000;
+	*out++ = '.';
+	*out++ = char( '0' + fraction / 100 );
+	memcpy( out, &DIGIT_PAIRS[ ( fraction % 100 ) * 2 ], 2 );
+	return out + 2;
+}
+void TraceJsonWriter::Flush()
+{
+	if( !failed && used != 0 )
+		failed = fwrite( buffer.get(), 1, used, file ) != used;
+	used = 0;
+}
+
+} //End namespace qut
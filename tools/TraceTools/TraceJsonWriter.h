@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TraceWriter.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace qut
+{
+
+/**
+ * Writes a Google trace, the JSON format chrome://tracing and Perfetto load. Events are encoded straight into a large buffer that
+ * is written to the file whenever the next event might not fit, timestamps are written relative to the one the trace started at.
+ * Encoding dominates the cost of writing big traces, so the start of the events of recurring activities is encoded once and
+ * copied from then on, strings are scanned for characters to escape a block at a time and numbers are formatted two digits at a
+ * time. Only the tools write traces through this class, quSetupGoogleTraceOutput is written by the runtime itself.
+ */
+class TraceJsonWriter : public TraceWriter
+{
+public:
+	TraceJsonWriter( FILE* file, quUInt64 startTimestamp );
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override;
+	void AddActivity( quActivityChannelID channelID, quRecurringActivityID recurringActivityID, std::string_view name, quUInt64 startTimestamp, quUInt64 duration, const TraceArg* args, quUInt32 argCount, bool unfinished ) override;
+	void AddCounterValue( std::string_view counterName, quUInt64 timestamp, double value ) override;
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override;
+	bool Finish() override;
+
+private:
+	static constexpr size_t BUFFER_SIZE = 4 << 20;
+	//Upper bounds of the bytes the parts of an event take once encoded.
+	static constexpr size_t MAX_NUMBER_BYTES = 32;
+	static constexpr size_t MAX_EVENT_BYTES = 256; //!< Everything but the strings and arguments.
+
+	//Encoded start of the events of a recurring activity, up to and including the key of the channel.
+	struct ActivityPrefix
+	{
+		std::string name;
+		std::string json;
+	};
+
+	//Returns where the next event can be encoded, which has room for at least the given number of bytes.
+	char* Reserve( size_t bytes );
+	//Writes what goes between two events, which differs for the first one.
+	char* WriteSeparator( char* out );
+	static char* BeginEvent( char* out, std::string_view name, char phase );
+	static size_t GetMaxStringBytes( std::string_view text );
+	static char* WriteString( char* out, std::string_view text );
+	static char* WriteInteger( char* out, quInt64 value );
+	static char* WriteUnsigned( char* out, quUInt64 value );
+	static char* WriteDouble( char* out, double value );
+	//Google traces take microseconds, which are written with the nanoseconds as three decimals.
+	static char* WriteMicros( char* out, quInt64 nanos );
+	void Flush();
+
+	FILE* file;
+	quUInt64 startTimestamp;
+	std::unique_ptr< char[] > buffer;
+	size_t bufferSize = BUFFER_SIZE;
+	size_t used = 0; //!< Bytes at the start of the buffer that are waiting to be written.
+	std::unordered_map< quRecurringActivityID, ActivityPrefix > activityPrefixes;
+	bool firstEvent = true;
+	bool failed = false;
+};
+
+} //End namespace qut
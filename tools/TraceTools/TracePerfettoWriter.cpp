@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TracePerfettoWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace qut
+{
+
+//Wire types of the protobuf encoding.
+static constexpr quUInt32 WIRE_VARINT = 0;
+static constexpr quUInt32 WIRE_FIXED64 = 1;
+static constexpr quUInt32 WIRE_BYTES = 2;
+
+//Field numbers of the messages in perfetto/protos/perfetto/trace, only the ones that are written.
+static constexpr quUInt32 TRACE_PACKET = 1;
+static constexpr quUInt32 PACKET_TIMESTAMP = 8;
+static constexpr quUInt32 PACKET_SEQUENCE_ID = 10;
+static constexpr quUInt32 PACKET_TRACK_EVENT = 11;
+static constexpr quUInt32 PACKET_INTERNED_DATA = 12;
+static constexpr quUInt32 PACKET_SEQUENCE_FLAGS = 13;
+static constexpr quUInt32 PACKET_TRACK_DESCRIPTOR = 60;
+static constexpr quUInt32 TRACK_UUID = 1;
+static constexpr quUInt32 TRACK_NAME = 2;
+static constexpr quUInt32 TRACK_PROCESS = 3;
+static constexpr quUInt32 TRACK_THREAD = 4;
+static constexpr quUInt32 TRACK_PARENT_UUID = 5;
+static constexpr quUInt32 TRACK_COUNTER = 8;
+static constexpr quUInt32 PROCESS_PID = 1;
+static constexpr quUInt32 THREAD_PID = 1;
+static constexpr quUInt32 THREAD_TID = 2;
+static constexpr quUInt32 THREAD_NAME = 5;
+static constexpr quUInt32 EVENT_DEBUG_ANNOTATIONS = 4;
+static constexpr quUInt32 EVENT_TYPE = 9;
+static constexpr quUInt32 EVENT_NAME_IID = 10;
+static constexpr quUInt32 EVENT_TRACK_UUID = 11;
+static constexpr quUInt32 EVENT_NAME = 23;
+static constexpr quUInt32 EVENT_DOUBLE_COUNTER_VALUE = 44;
+static constexpr quUInt32 ANNOTATION_NAME_IID = 1;
+static constexpr quUInt32 ANNOTATION_BOOL = 2;
+static constexpr quUInt32 ANNOTATION_UINT = 3;
+static constexpr quUInt32 ANNOTATION_INT = 4;
+static constexpr quUInt32 ANNOTATION_DOUBLE = 5;
+static constexpr quUInt32 ANNOTATION_NAME = 10;
+static constexpr quUInt32 INTERNED_EVENT_NAMES = 2;
+static constexpr quUInt32 INTERNED_ANNOTATION_NAMES = 3;
+static constexpr quUInt32 INTERNED_IID = 1;
+static constexpr quUInt32 INTERNED_NAME = 2;
+
+//Values of TracePacket::sequence_flags and TrackEvent::type.
+static constexpr quUInt64 SEQUENCE_INCREMENTAL_STATE_CLEARED = 1;
+static constexpr quUInt64 SEQUENCE_NEEDS_INCREMENTAL_STATE = 2;
+static constexpr quUInt64 TYPE_SLICE_BEGIN = 1;
+static constexpr quUInt64 TYPE_SLICE_END = 2;
+static constexpr quUInt64 TYPE_INSTANT = 3;
+static constexpr quUInt64 TYPE_COUNTER = 4;
+
+//Every packet is on the same sequence, which is what the interned names are scoped to.
+static constexpr quUInt64 SEQUENCE_ID = 1;
+static constexpr quUInt64 PROCESS_PID_VALUE = 1;
+static constexpr quUInt64 PROCESS_TRACK = 1;
+static constexpr quUInt64 CHANNEL_TRACKS = 1ull << 32;
+static constexpr quUInt64 COUNTER_TRACKS = 2ull << 32;
+
+static void WriteVarint( std::string& out, quUInt64 value )
+{
+	while( value >= 0x80 )
+	{
+		out += char( value | 0x80 );
+		value >>= 7;
+	}
+	out += char( value );
+}
+static void WriteVarintField( std::string& out, quUInt32 field, quUInt64 value )
+{
+	WriteVarint( out, field << 3 | WIRE_VARINT );
+	WriteVarint( out, value );
+}
+static void WriteFixed64Field( std::string& out, quUInt32 field, quUInt64 bits )
+{
+	WriteVarint( out, field << 3 | WIRE_FIXED64 );
+	for( int i = 0; i < 8; ++i )
+		out += char( bits >> ( i * 8 ) );
+}
+static void WriteDoubleField( std::string& out, quUInt32 field, double value )
+{
+	quUInt64 bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	WriteFixed64Field( out, field, bits );
+}
+//Strings and nested messages alike.
+static void WriteBytesField( std::string& out, quUInt32 field, std::string_view bytes )
+{
+	WriteVarint( out, field << 3 | WIRE_BYTES );
+	WriteVarint( out, bytes.size() );
+	out += bytes;
+}
+static void WriteInternedName( std::string& out, quUInt32 field, quUInt64 iid, std::string_view name )
+{
+	std::string entry;
+	WriteVarintField( entry, INTERNED_IID, iid );
+	WriteBytesField( entry, INTERNED_NAME, name );
+	WriteBytesField( out, field, entry );
+}
+
+TracePerfettoWriter::TracePerfettoWriter( FILE* file ) :
+    file( file )
+{
+	buffer.reserve( BUFFER_FLUSH_SIZE + 4096 );
+
+	//The first packet of the sequence clears its interned names and describes the process all channels belong to.
+	message.clear();
+	WriteVarintField( message, PROCESS_PID, PROCESS_PID_VALUE );
+	std::string track;
+	WriteVarintField( track, TRACK_UUID, PROCESS_TRACK );
+	WriteBytesField( track, TRACK_PROCESS, message );
+	packet.clear();
+	WriteVarintField( packet, PACKET_SEQUENCE_ID, SEQUENCE_ID );
+	WriteVarintField( packet, PACKET_SEQUENCE_FLAGS, SEQUENCE_INCREMENTAL_STATE_CLEARED );
+	WriteBytesField( packet, PACKET_TRACK_DESCRIPTOR, track );
+	WritePacket();
+}
+
+void TracePerfettoWriter::NameChannel( quActivityChannelID channelID, std::string_view name )
+{
+	std::string& channelName = channelNames[ channelID ];
+	if( channelName == name )
+		return;
+
+	channelName = name;
+	if( describedChannels.contains( channelID ) )
+		DescribeChannelTrack( channelID );
+}
+void TracePerfettoWriter::NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name )
+{
+	recurringActivityNames[ recurringActivityID ] = name;
+}
+void TracePerfettoWriter::NameActivity( quActivityID activityID, std::string_view name )
+{
+	activityNames[ activityID ] = name;
+}
+void TracePerfettoWriter::NameCounter( quCounterID counterID, std::string_view name )
+{
+	counterNames[ counterID ] = name;
+}
+void TracePerfettoWriter::NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name )
+{
+	annotationKeyNames[ annotationKeyID ] = name;
+}
+
+void TracePerfettoWriter::AddEvent( const quEvent& event )
+{
+	if( event.type == QU_EVENT_ANNOTATE_ACTIVITY && event.activityID == repeatedActivityID )
+		return;
+	repeatedActivityID = QU_INVALID_ACTIVITY_ID;
+
+	//Annotations carry their value where other events have their timestamp.
+	if( event.type != QU_EVENT_ANNOTATE_ACTIVITY )
+		lastTimestamp = std::max( lastTimestamp, event.timestamp );
+
+	switch( event.type )
+	{
+	case QU_EVENT_START_RECURRING_ACTIVITY:
+		Start( event );
+		break;
+	case QU_EVENT_STOP_ACTIVITY:
+		if( event.activityID != QU_INVALID_ACTIVITY_ID )
+			Stop( event.activityID, event.timestamp, false );
+		else if( auto stack = channelStacks.find( event.channelID ); stack != channelStacks.end() && !stack->second.empty() )
+			Stop( stack->second.back(), event.timestamp, false );
+		break;
+	case QU_EVENT_SET_COUNTER_VALUE:
+	case QU_EVENT_SET_TYPED_COUNTER_VALUE:
+		trackEvent.clear();
+		WriteVarintField( trackEvent, EVENT_TYPE, TYPE_COUNTER );
+		WriteVarintField( trackEvent, EVENT_TRACK_UUID, UseCounterTrack( event.counterID ) );
+		WriteDoubleField( trackEvent, EVENT_DOUBLE_COUNTER_VALUE, GetCounterValue( event ) );
+		WriteTrackEventPacket( event.timestamp );
+		break;
+	case QU_EVENT_ANNOTATE_ACTIVITY:
+		if( auto activity = runningActivities.find( event.activityID ); activity != runningActivities.end() )
+			activity->second.annotations.push_back( event );
+		break;
+	default:
+		break;
+	}
+}
+void TracePerfettoWriter::AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp )
+{
+	lastTimestamp = std::max( lastTimestamp, timestamp );
+	trackEvent.clear();
+	WriteVarintField( trackEvent, EVENT_TYPE, TYPE_INSTANT );
+	WriteVarintField( trackEvent, EVENT_TRACK_UUID, UseChannelTrack( channelID ) );
+	WriteBytesField( trackEvent, EVENT_NAME, name );
+	WriteTrackEventPacket( timestamp );
+}
+bool TracePerfettoWriter::Finish()
+{
+	//Ends the innermost activities first, which is the order they would have stopped in.
+	for( auto& [ channelID, stack ] : channelStacks )
+	{
+		while( !stack.empty() )
+		{
+			Stop( stack.back(), lastTimestamp, true );
+			++unfinishedCount;
+		}
+	}
+
+	if( !failed && !buffer.empty() )
+		failed = fwrite( buffer.data(), 1, buffer.size(), file ) != buffer.size();
+	buffer.clear();
+	failed |= fflush( file ) != 0;
+	return !failed;
+}
+quUInt64 TracePerfettoWriter::GetUnfinishedCount() const
+{
+	return unfinishedCount;
+}
+
+void TracePerfettoWriter::Start( const quEvent& event )
+{
+	//Traces may repeat the starts of activities that are still running.
+	if( !runningActivities.try_emplace( event.activityID, RunningActivity { event.channelID, {} } ).second )
+	{
+		repeatedActivityID = event.activityID;
+		return;
+	}
+	channelStacks[ event.channelID ].push_back( event.activityID );
+
+	quUInt64 track = UseChannelTrack( event.channelID );
+	trackEvent.clear();
+	WriteVarintField( trackEvent, EVENT_TYPE, TYPE_SLICE_BEGIN );
+	WriteVarintField( trackEvent, EVENT_TRACK_UUID, track );
+	if( event.recurringActivityID == QU_INVALID_RECURRING_ACTIVITY_ID )
+	{
+		auto name = activityNames.find( event.activityID );
+		WriteBytesField( trackEvent, EVENT_NAME, name != activityNames.end() ? std::string_view( name->second ) : std::string_view( "Unnamed activity" ) );
+		if( name != activityNames.end() )
+			activityNames.erase( name );
+	}
+	else if( auto name = recurringActivityNames.find( event.recurringActivityID ); name != recurringActivityNames.end() )
+	{
+		//Interned ids start at one, zero means there is none.
+		quUInt64 iid = quUInt64( event.recurringActivityID ) + 1;
+		if( internedRecurringActivities.insert( event.recurringActivityID ).second )
+			WriteInternedName( internedData, INTERNED_EVENT_NAMES, iid, name->second );
+		WriteVarintField( trackEvent, EVENT_NAME_IID, iid );
+	}
+	else
+		WriteBytesField( trackEvent, EVENT_NAME, "Activity " + std::to_string( event.recurringActivityID ) );
+	WriteTrackEventPacket( event.timestamp );
+}
+void TracePerfettoWriter::Stop( quActivityID activityID, quUInt64 timestamp, bool unfinished )
+{
+	auto activity = runningActivities.find( activityID );
+	if( activity == runningActivities.end() )
+		return;
+
+	RunningActivity& running = activity->second;
+	trackEvent.clear();
+	WriteVarintField( trackEvent, EVENT_TYPE, TYPE_SLICE_END );
+	WriteVarintField( trackEvent, EVENT_TRACK_UUID, CHANNEL_TRACKS | running.channelID );
+	for( const quEvent& annotation : running.annotations )
+		WriteAnnotation( annotation );
+	if( unfinished )
+	{
+		message.clear();
+		WriteBytesField( message, ANNOTATION_NAME, "unfinished" );
+		WriteVarintField( message, ANNOTATION_BOOL, 1 );
+		WriteBytesField( trackEvent, EVENT_DEBUG_ANNOTATIONS, message );
+	}
+	WriteTrackEventPacket( timestamp );
+
+	std::vector< quActivityID >& stack = channelStacks[ running.channelID ];
+	auto it = std::find( stack.rbegin(), stack.rend(), activityID );
+	if( it != stack.rend() )
+		stack.erase( std::next( it ).base() );
+	runningActivities.erase( activity );
+}
+quUInt64 TracePerfettoWriter::UseChannelTrack( quActivityChannelID channelID )
+{
+	if( describedChannels.insert( channelID ).second )
+		DescribeChannelTrack( channelID );
+	return CHANNEL_TRACKS | channelID;
+}
+quUInt64 TracePerfettoWriter::UseCounterTrack( quCounterID counterID )
+{
+	quUInt64 track = COUNTER_TRACKS | counterID;
+	if( !describedCounters.insert( counterID ).second )
+		return track;
+
+	auto name = counterNames.find( counterID );
+	std::string descriptor;
+	WriteVarintField( descriptor, TRACK_UUID, track );
+	WriteBytesField( descriptor, TRACK_NAME, name != counterNames.end() ? name->second : "Counter " + std::to_string( counterID ) );
+	WriteVarintField( descriptor, TRACK_PARENT_UUID, PROCESS_TRACK );
+	WriteBytesField( descriptor, TRACK_COUNTER, {} );
+	packet.clear();
+	WriteVarintField( packet, PACKET_SEQUENCE_ID, SEQUENCE_ID );
+	WriteBytesField( packet, PACKET_TRACK_DESCRIPTOR, descriptor );
+	WritePacket();
+	return track;
+}
+void TracePerfettoWriter::DescribeChannelTrack( quActivityChannelID channelID )
+{
+	message.clear();
+	WriteVarintField( message, THREAD_PID, PROCESS_PID_VALUE );
+	WriteVarintField( message, THREAD_TID, channelID );
+	if( auto name = channelNames.find( channelID ); name != channelNames.end() )
+		WriteBytesField( message, THREAD_NAME, name->second );
+	std::string descriptor;
+	WriteVarintField( descriptor, TRACK_UUID, CHANNEL_TRACKS | channelID );
+	WriteBytesField( descriptor, TRACK_THREAD, message );
+	packet.clear();
+	WriteVarintField( packet, PACKET_SEQUENCE_ID, SEQUENCE_ID );
+	WriteBytesField( packet, PACKET_TRACK_DESCRIPTOR, descriptor );
+	WritePacket();
+}
+void TracePerfettoWriter::WriteAnnotation( const quEvent& annotation )
+{
+	message.clear();
+	if( auto key = annotationKeyNames.find( annotation.annotationKeyID ); key != annotationKeyNames.end() )
+	{
+		quUInt64 iid = quUInt64( annotation.annotationKeyID ) + 1;
+		if( internedAnnotationKeys.insert( annotation.annotationKeyID ).second )
+			WriteInternedName( internedData, INTERNED_ANNOTATION_NAMES, iid, key->second );
+		WriteVarintField( message, ANNOTATION_NAME_IID, iid );
+	}
+	else
+		WriteBytesField( message, ANNOTATION_NAME, "Key " + std::to_string( annotation.annotationKeyID ) );
+
+	switch( annotation.annotationType )
+	{
+	case QU_ACTIVITY_ARG_INT64:
+		//Negative values take all ten bytes of a varint, as they do for any int64 field.
+		WriteVarintField( message, ANNOTATION_INT, annotation.annotationValue );
+		break;
+	case QU_ACTIVITY_ARG_UINT64:
+		WriteVarintField( message, ANNOTATION_UINT, annotation.annotationValue );
+		break;
+	default:
+		WriteFixed64Field( message, ANNOTATION_DOUBLE, annotation.annotationValue );
+		break;
+	}
+	WriteBytesField( trackEvent, EVENT_DEBUG_ANNOTATIONS, message );
+}
+void TracePerfettoWriter::WriteTrackEventPacket( quUInt64 timestamp )
+{
+	packet.clear();
+	WriteVarintField( packet, PACKET_TIMESTAMP, timestamp );
+	WriteVarintField( packet, PACKET_SEQUENCE_ID, SEQUENCE_ID );
+	WriteVarintField( packet, PACKET_SEQUENCE_FLAGS, SEQUENCE_NEEDS_INCREMENTAL_STATE );
+	if( !internedData.empty() )
+		WriteBytesField( packet, PACKET_INTERNED_DATA, internedData );
+	WriteBytesField( packet, PACKET_TRACK_EVENT, trackEvent );
+	internedData.clear();
+	WritePacket();
+}
+void TracePerfettoWriter::WritePacket()
+{
+	WriteBytesField( buffer, TRACE_PACKET, packet );
+	if( buffer.size() < BUFFER_FLUSH_SIZE )
+		return;
+
+	if( !failed )
+		failed = fwrite( buffer.data(), 1, buffer.size(), file ) != buffer.size();
+	buffer.clear();
+}
+
+} //End namespace qut
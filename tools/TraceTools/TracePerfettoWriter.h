@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "TraceEventSink.h"
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace qut
+{
+
+/**
+ * Streams a trace in the protobuf format of Perfetto, encoded by hand so that the tools don't depend on its libraries. Channels
+ * become the thread tracks of a single process and counters become counter tracks. Activities are written as the begin and end of
+ * a slice when they start and stop, the names of recurring activities and of annotation keys are interned so that each is only
+ * written once. Packets are appended to a buffer that is written to the file whenever it grows past BUFFER_FLUSH_SIZE.
+ */
+class TracePerfettoWriter : public TraceEventSink
+{
+public:
+	explicit TracePerfettoWriter( FILE* file );
+
+	void NameChannel( quActivityChannelID channelID, std::string_view name ) override;
+	void NameRecurringActivity( quRecurringActivityID recurringActivityID, std::string_view name ) override;
+	void NameActivity( quActivityID activityID, std::string_view name ) override;
+	void NameCounter( quCounterID counterID, std::string_view name ) override;
+	void NameAnnotationKey( quAnnotationKeyID annotationKeyID, std::string_view name ) override;
+
+	void AddEvent( const quEvent& event ) override;
+	void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) override;
+	//Ends the activities that never stopped at the last timestamp that was seen, returns false if anything failed to be written.
+	bool Finish();
+	//Number of activities Finish had to end.
+	quUInt64 GetUnfinishedCount() const;
+
+private:
+	static constexpr size_t BUFFER_FLUSH_SIZE = 1 << 20;
+
+	struct RunningActivity
+	{
+		quActivityChannelID channelID;
+		std::vector< quEvent > annotations; //!< Written along with the end of the slice, which is where Perfetto takes them from as well.
+	};
+
+	void Start( const quEvent& event );
+	void Stop( quActivityID activityID, quUInt64 timestamp, bool unfinished );
+	//Describes the track of the channel or counter the first time it's used.
+	quUInt64 UseChannelTrack( quActivityChannelID channelID );
+	quUInt64 UseCounterTrack( quCounterID counterID );
+	void DescribeChannelTrack( quActivityChannelID channelID );
+	void WriteAnnotation( const quEvent& annotation );
+	//Writes a packet holding trackEvent, along with the names that were interned for it.
+	void WriteTrackEventPacket( quUInt64 timestamp );
+	void WritePacket();
+
+	FILE* file;
+	std::string buffer;
+	std::string packet;
+	std::string trackEvent;
+	std::string internedData;
+	std::string message; //!< Scratch space for the messages nested in the others.
+	bool failed = false;
+	quUInt64 lastTimestamp = 0;
+	quUInt64 unfinishedCount = 0;
+	std::unordered_map< quActivityChannelID, std::string > channelNames;
+	std::unordered_map< quRecurringActivityID, std::string > recurringActivityNames;
+	std::unordered_map< quActivityID, std::string > activityNames;
+	std::unordered_map< quCounterID, std::string > counterNames;
+	std::unordered_map< quAnnotationKeyID, std::string > annotationKeyNames;
+	std::unordered_set< quActivityChannelID > describedChannels;
+	std::unordered_set< quCounterID > describedCounters;
+	std::unordered_set< quRecurringActivityID > internedRecurringActivities;
+	std::unordered_set< quAnnotationKeyID > internedAnnotationKeys;
+	std::unordered_map< quActivityID, RunningActivity > runningActivities;
+	std::unordered_map< quActivityChannelID, std::vector< quActivityID > > channelStacks; //!< Running activities of every channel in the order they started.
+	quActivityID repeatedActivityID = QU_INVALID_ACTIVITY_ID; //!< Activity whose start was just repeated, the annotations repeated along with it are ignored.
+};
+
+} //End namespace qut
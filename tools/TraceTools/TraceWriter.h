@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020-2023 mevicg (https://mevicg.com)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <quConstants.h>
+#include <string_view>
+
+namespace qut
+{
+
+//Key and value of an argument shown with an activity, such as the value of an annotation.
+struct TraceArg
+{
+	std::string_view key;
+	quActivityArgType type; //!< One of the QU_ACTIVITY_ARG_* values, except QU_ACTIVITY_ARG_STRING.
+	union
+	{
+		quInt64 int64Value;
+		quUInt64 uint64Value;
+		double doubleValue;
+	};
+};
+
+/**
+ * Receives the contents of a trace in whatever order they were recovered or decoded in and writes them in the format of the
+ * implementation. Timestamps are nanoseconds on the clock of quEvent::timestamp, channels show up as the threads of the trace.
+ */
+class TraceWriter
+{
+public:
+	virtual ~TraceWriter() = default;
+
+	virtual void NameChannel( quActivityChannelID channelID, std::string_view name ) = 0;
+	//Unfinished activities were still running when the trace ended, their duration reaches up to its last event. Activities that
+	//were started by name have QU_INVALID_RECURRING_ACTIVITY_ID, writers may reuse what they encoded for recurring activities.
+	virtual void AddActivity( quActivityChannelID channelID, quRecurringActivityID recurringActivityID, std::string_view name, quUInt64 startTimestamp, quUInt64 duration, const TraceArg* args, quUInt32 argCount, bool unfinished ) = 0;
+	virtual void AddCounterValue( std::string_view counterName, quUInt64 timestamp, double value ) = 0;
+	virtual void AddMarker( quActivityChannelID channelID, std::string_view name, quUInt64 timestamp ) = 0;
+	//Returns false if anything failed to be written.
+	virtual bool Finish() = 0;
+};
+
+} //End namespace qut